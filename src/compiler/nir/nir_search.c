@@ -30,6 +30,7 @@
 #include "nir_builder.h"
 #include "nir_worklist.h"
 #include "util/half_float.h"
+#include "util/u_worklist.h"
 
 /* This should be the same as nir_search_max_comm_ops in nir_algebraic.py. */
 #define NIR_SEARCH_MAX_COMM_OPS 8
@@ -662,24 +663,50 @@ add_uses_to_worklist(nir_instr *instr,
    }
 }
 
+/* Queues an ALU instruction for matching, unless the automaton already tells
+ * us that none of the transforms can apply to it.  The worklist is indexed by
+ * SSA def index, and is grown along with the automaton states as the pass
+ * creates new instructions.
+ */
+static void
+algebraic_worklist_push(u_worklist *worklist, nir_alu_instr *alu,
+                        const struct util_dynarray *states,
+                        const nir_algebraic_table *table)
+{
+   uint16_t state = *util_dynarray_element(states, uint16_t,
+                                           alu->dest.dest.ssa.index);
+   if (table->transforms[table->transform_offsets[state]].condition_offset == ~0)
+      return;
+
+   unsigned num_states = util_dynarray_num_elements(states, uint16_t);
+   if (worklist->size < num_states)
+      u_worklist_grow(worklist, MAX2(num_states, worklist->size * 2));
+
+   u_worklist_push_tail(worklist, &alu->dest.dest.ssa, index);
+}
+
 static void
 nir_algebraic_update_automaton(nir_instr *new_instr,
-                               nir_instr_worklist *algebraic_worklist,
+                               u_worklist *algebraic_worklist,
                                struct util_dynarray *states,
-                               const struct per_op_table *pass_op_table)
+                               const nir_algebraic_table *table)
 {
 
    nir_instr_worklist *automaton_worklist = nir_instr_worklist_create();
 
    /* Walk through the tree of uses of our new instruction's SSA value,
-    * recursively updating the automaton state until it stabilizes.
+    * recursively updating the automaton state until it stabilizes.  Only
+    * the instructions whose state changed need to be matched again.
     */
-   add_uses_to_worklist(new_instr, automaton_worklist, states, pass_op_table);
+   add_uses_to_worklist(new_instr, automaton_worklist, states,
+                        table->pass_op_table);
 
    nir_instr *instr;
    while ((instr = nir_instr_worklist_pop_head(automaton_worklist))) {
-      nir_instr_worklist_push_tail(algebraic_worklist, instr);
-      add_uses_to_worklist(instr, automaton_worklist, states, pass_op_table);
+      algebraic_worklist_push(algebraic_worklist, nir_instr_as_alu(instr),
+                              states, table);
+      add_uses_to_worklist(instr, automaton_worklist, states,
+                           table->pass_op_table);
    }
 
    nir_instr_worklist_destroy(automaton_worklist);
@@ -692,7 +719,7 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
                   const nir_algebraic_table *table,
                   const nir_search_expression *search,
                   const nir_search_value *replace,
-                  nir_instr_worklist *algebraic_worklist,
+                  u_worklist *algebraic_worklist,
                   struct exec_list *dead_instrs)
 {
    uint8_t swizzle[NIR_MAX_VEC_COMPONENTS] = { 0 };
@@ -798,7 +825,7 @@ nir_replace_instr(nir_builder *build, nir_alu_instr *instr,
     */
    nir_ssa_def_rewrite_uses(&instr->dest.dest.ssa, ssa_val);
    nir_algebraic_update_automaton(ssa_val->parent_instr, algebraic_worklist,
-                                  states, table->pass_op_table);
+                                  states, table);
 
    /* Nothing uses the instr any more, so drop it out of the program.  Note
     * that the instr may be in the worklist still, so we can't free it
@@ -869,7 +896,7 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
                     const bool *condition_flags,
                     const nir_algebraic_table *table,
                     struct util_dynarray *states,
-                    nir_instr_worklist *worklist,
+                    u_worklist *worklist,
                     struct exec_list *dead_instrs)
 {
 
@@ -928,9 +955,13 @@ nir_algebraic_impl(nir_function_impl *impl,
 
    struct hash_table *range_ht = _mesa_pointer_hash_table_create(NULL);
 
-   nir_instr_worklist *worklist = nir_instr_worklist_create();
+   u_worklist worklist;
+   u_worklist_init(&worklist, impl->ssa_alloc, NULL);
 
-   /* Walk top-to-bottom setting up the automaton state. */
+   /* Walk top-to-bottom setting up the automaton state.  Nothing is kept
+    * between calls, so this still visits the whole shader every time; only
+    * the matching below is limited to candidate instructions.
+    */
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block) {
          nir_algebraic_automaton(instr, &states, table->pass_op_table);
@@ -939,36 +970,42 @@ nir_algebraic_impl(nir_function_impl *impl,
 
    /* Put our instrs in the worklist such that we're popping the last instr
     * first.  This will encourage us to match the biggest source patterns when
-    * possible.
+    * possible.  Instructions for which the automaton found no candidate
+    * transform are left out; they only get queued if one of their sources
+    * changes.
     */
    nir_foreach_block_reverse(block, impl) {
       nir_foreach_instr_reverse(instr, block) {
          instr->pass_flags = 0;
-         if (instr->type == nir_instr_type_alu)
-            nir_instr_worklist_push_tail(worklist, instr);
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->dest.dest.is_ssa) {
+            algebraic_worklist_push(&worklist, nir_instr_as_alu(instr),
+                                    &states, table);
+         }
       }
    }
 
    struct exec_list dead_instrs;
    exec_list_make_empty(&dead_instrs);
 
-   nir_instr *instr;
-   while ((instr = nir_instr_worklist_pop_head(worklist))) {
-      /* The worklist can have an instr pushed to it multiple times if it was
-       * the src of multiple instrs that also got optimized, so make sure that
-       * we don't try to re-optimize an instr we already handled.
+   while (!u_worklist_is_empty(&worklist)) {
+      nir_ssa_def *def = u_worklist_pop_head(&worklist, nir_ssa_def, index);
+      nir_instr *instr = def->parent_instr;
+
+      /* An instr which got replaced may still be in the worklist, so make
+       * sure that we don't try to re-optimize it.
        */
       if (instr->pass_flags)
          continue;
 
       progress |= nir_algebraic_instr(&build, instr,
                                       range_ht, condition_flags,
-                                      table, &states, worklist, &dead_instrs);
+                                      table, &states, &worklist, &dead_instrs);
    }
 
    nir_instr_free_list(&dead_instrs);
 
-   nir_instr_worklist_destroy(worklist);
+   u_worklist_fini(&worklist);
    ralloc_free(range_ht);
    util_dynarray_fini(&states);
 
@@ -69,6 +69,9 @@ typedef struct {
 typedef struct {
    nir_shader *nir;
 
+   /* The function impl being read, NULL outside of function bodies. */
+   nir_function_impl *impl;
+
    struct blob_reader *blob;
 
    /* the next index to assign to a NIR in-memory object */
@@ -112,6 +115,17 @@ read_add_object(read_ctx *ctx, void *obj)
    ctx->idx_table[ctx->next_idx++] = obj;
 }
 
+/* Instructions are created with no block, hence their SSA defs don't get an
+ * index.  Hand them out here instead of having nir_instr_insert() look up the
+ * function impl for every single def.
+ */
+static void
+read_add_ssa_def(read_ctx *ctx, nir_ssa_def *def)
+{
+   def->index = ctx->impl->ssa_alloc++;
+   read_add_object(ctx, def);
+}
+
 static void *
 read_lookup_object(read_ctx *ctx, uint32_t idx)
 {
@@ -774,7 +788,7 @@ read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr,
          num_components = decode_num_components_in_3bits(dest.ssa.num_components);
       nir_ssa_dest_init(instr, dst, num_components, bit_size, NULL);
       dst->ssa.divergent = dest.ssa.divergent;
-      read_add_object(ctx, &dst->ssa);
+      read_add_ssa_def(ctx, &dst->ssa);
    } else {
       dst->reg.reg = read_object(ctx);
       dst->reg.base_offset = blob_read_uint32(ctx->blob);
@@ -1456,7 +1470,7 @@ read_load_const(read_ctx *ctx, union packed_instr header)
       break;
    }
 
-   read_add_object(ctx, &lc->def);
+   read_add_ssa_def(ctx, &lc->def);
    return lc;
 }
 
@@ -1485,7 +1499,7 @@ read_ssa_undef(read_ctx *ctx, union packed_instr header)
 
    undef->def.divergent = false;
 
-   read_add_object(ctx, &undef->def);
+   read_add_ssa_def(ctx, &undef->def);
    return undef;
 }
 
@@ -1772,6 +1786,46 @@ write_instr(write_ctx *ctx, const nir_instr *instr)
    }
 }
 
+static bool
+read_add_use_cb(nir_src *src, void *state)
+{
+   nir_instr *instr = state;
+
+   src->parent_instr = instr;
+   list_addtail(&src->use_link,
+                src->is_ssa ? &src->ssa->uses : &src->reg.reg->uses);
+
+   return true;
+}
+
+static bool
+read_add_reg_def_cb(nir_dest *dest, void *state)
+{
+   nir_instr *instr = state;
+
+   if (!dest->is_ssa) {
+      dest->reg.parent_instr = instr;
+      list_addtail(&dest->reg.def_link, &dest->reg.reg->defs);
+   }
+
+   return true;
+}
+
+/* Appends an instruction to the end of the block being read.  This is what
+ * nir_instr_insert_after_block() does for anything but jumps, minus the
+ * metadata invalidation, which read_function_impl() takes care of once.
+ */
+static void
+read_append_instr(read_ctx *ctx, nir_block *block, nir_instr *instr)
+{
+   assert(instr->type != nir_instr_type_jump);
+
+   instr->block = block;
+   nir_foreach_src(instr, read_add_use_cb, instr);
+   nir_foreach_dest(instr, read_add_reg_def_cb, instr);
+   exec_list_push_tail(&block->instr_list, &instr->node);
+}
+
 /* Return the number of instructions read. */
 static unsigned
 read_instr(read_ctx *ctx, nir_block *block)
@@ -1784,7 +1838,7 @@ read_instr(read_ctx *ctx, nir_block *block)
    switch (header.any.instr_type) {
    case nir_instr_type_alu:
       for (unsigned i = 0; i <= header.alu.num_followup_alu_sharing_header; i++)
-         nir_instr_insert_after_block(block, &read_alu(ctx, header)->instr);
+         read_append_instr(ctx, block, &read_alu(ctx, header)->instr);
       return header.alu.num_followup_alu_sharing_header + 1;
    case nir_instr_type_deref:
       instr = &read_deref(ctx, header)->instr;
@@ -1810,8 +1864,9 @@ read_instr(read_ctx *ctx, nir_block *block)
       read_phi(ctx, block, header);
       return 1;
    case nir_instr_type_jump:
-      instr = &read_jump(ctx, header)->instr;
-      break;
+      /* Jumps need to update the CFG. */
+      nir_instr_insert_after_block(block, &read_jump(ctx, header)->instr);
+      return 1;
    case nir_instr_type_call:
       instr = &read_call(ctx)->instr;
       break;
@@ -1821,7 +1876,7 @@ read_instr(read_ctx *ctx, nir_block *block)
       unreachable("bad instr type");
    }
 
-   nir_instr_insert_after_block(block, instr);
+   read_append_instr(ctx, block, instr);
    return 1;
 }
 
@@ -1986,6 +2041,7 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 {
    nir_function_impl *fi = nir_function_impl_create_bare(ctx->nir);
    fi->function = fxn;
+   ctx->impl = fi;
 
    fi->structured = blob_read_uint8(ctx->blob);
    bool preamble = blob_read_uint8(ctx->blob);
@@ -2001,6 +2057,7 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
    read_fixup_phis(ctx);
 
    fi->valid_metadata = 0;
+   ctx->impl = NULL;
 
    return fi;
 }
@@ -0,0 +1,302 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Micro-benchmarks for NIR infrastructure which is on the critical path of
+ * loading shaders from the disk cache.  Shaders are either read from files
+ * containing nir_serialize() output, e.g. a corpus dumped from a shader-db
+ * run, or generated.  Results are reported in ns per instruction, the best
+ * of all iterations is taken to filter out noise.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+
+struct bench_shader {
+   const char *name;
+   void *data;
+   size_t size;
+   unsigned num_instrs;
+};
+
+static const nir_shader_compiler_options bench_options = {
+   .lower_fdiv = true,
+   .lower_fsat = true,
+};
+
+static unsigned
+count_instrs(nir_shader *nir)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(func, nir) {
+      if (!func->impl)
+         continue;
+
+      nir_foreach_block(block, func->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+/* Something resembling a large fragment shader after linking: long ALU
+ * chains on vectors with some control flow in between.
+ */
+static nir_shader *
+generate_shader(unsigned size)
+{
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT,
+                                                  &bench_options, "bench");
+
+   nir_variable *in = nir_variable_create(b.shader, nir_var_shader_in,
+                                          glsl_vec4_type(), "in");
+   nir_variable *out = nir_variable_create(b.shader, nir_var_shader_out,
+                                           glsl_vec4_type(), "out");
+
+   nir_ssa_def *v = nir_load_var(&b, in);
+   nir_ssa_def *acc = v;
+
+   for (unsigned i = 0; i < size; i++) {
+      nir_ssa_def *x = nir_channel(&b, acc, i % 4);
+      nir_ssa_def *y = nir_fmul(&b, x, nir_imm_float(&b, 1.0f + i));
+      y = nir_fadd(&b, y, nir_channel(&b, v, (i + 1) % 4));
+      y = nir_ffma(&b, y, y, nir_fmax(&b, x, nir_imm_float(&b, 0.5f)));
+      y = nir_fadd(&b, y, nir_fneg(&b, nir_fmul_imm(&b, x, 0.0)));
+
+      if (i % 16 == 0) {
+         nir_push_if(&b, nir_flt(&b, y, x));
+         nir_ssa_def *then_def = nir_fsqrt(&b, y);
+         nir_push_else(&b, NULL);
+         nir_ssa_def *else_def = nir_fexp2(&b, nir_fdiv(&b, y, x));
+         nir_pop_if(&b, NULL);
+         y = nir_if_phi(&b, then_def, else_def);
+      }
+
+      acc = nir_vector_insert_imm(&b, acc, y, i % 4);
+   }
+
+   nir_store_var(&b, out, acc, 0xf);
+
+   return b.shader;
+}
+
+static void
+add_shader(struct bench_shader *shader, const char *name, nir_shader *nir)
+{
+   struct blob blob;
+
+   blob_init(&blob);
+   nir_serialize(&blob, nir, false);
+
+   shader->name = name;
+   shader->num_instrs = count_instrs(nir);
+   blob_finish_get_buffer(&blob, &shader->data, &shader->size);
+}
+
+static bool
+load_shader(struct bench_shader *shader, const char *filename)
+{
+   struct blob_reader reader;
+   size_t size;
+
+   char *data = os_read_file(filename, &size);
+   if (!data) {
+      fprintf(stderr, "nir_bench: failed to read %s\n", filename);
+      return false;
+   }
+
+   blob_reader_init(&reader, data, size);
+   nir_shader *nir = nir_deserialize(NULL, &bench_options, &reader);
+   if (reader.overrun) {
+      fprintf(stderr, "nir_bench: %s is not a serialized NIR shader\n",
+              filename);
+      ralloc_free(nir);
+      free(data);
+      return false;
+   }
+
+   shader->name = filename;
+   shader->data = data;
+   shader->size = size;
+   shader->num_instrs = count_instrs(nir);
+   ralloc_free(nir);
+
+   return true;
+}
+
+static void
+bench_deserialize(struct bench_shader *shaders, unsigned num_shaders,
+                  unsigned iterations)
+{
+   uint64_t total_time = 0, total_instrs = 0;
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      int64_t best = INT64_MAX;
+
+      for (unsigned iter = 0; iter < iterations; iter++) {
+         struct blob_reader reader;
+         blob_reader_init(&reader, shaders[i].data, shaders[i].size);
+
+         int64_t start = os_time_get_nano();
+         nir_shader *nir = nir_deserialize(NULL, &bench_options, &reader);
+         int64_t elapsed = os_time_get_nano() - start;
+
+         best = MIN2(best, elapsed);
+         ralloc_free(nir);
+      }
+
+      printf("deserialize %-40s %8u instrs %10zu bytes %8.1f ns/instr\n",
+             shaders[i].name, shaders[i].num_instrs, shaders[i].size,
+             (double) best / MAX2(shaders[i].num_instrs, 1));
+
+      total_time += best;
+      total_instrs += shaders[i].num_instrs;
+   }
+
+   printf("deserialize total %" PRIu64 " instrs %.1f ns/instr\n",
+          total_instrs, (double) total_time / MAX2(total_instrs, 1));
+}
+
+static void
+bench_algebraic(struct bench_shader *shaders, unsigned num_shaders,
+                unsigned iterations)
+{
+   uint64_t total_time = 0, total_instrs = 0;
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      int64_t best = INT64_MAX;
+      unsigned num_passes = 0;
+
+      for (unsigned iter = 0; iter < iterations; iter++) {
+         struct blob_reader reader;
+         blob_reader_init(&reader, shaders[i].data, shaders[i].size);
+         nir_shader *nir = nir_deserialize(NULL, &bench_options, &reader);
+
+         /* Run the pass until it stops making progress, the way the
+          * optimization loops in drivers do.  The last run is the common
+          * case of nothing left to do.
+          */
+         int64_t start = os_time_get_nano();
+         num_passes = 1;
+         while (nir_opt_algebraic(nir))
+            num_passes++;
+         int64_t elapsed = os_time_get_nano() - start;
+
+         best = MIN2(best, elapsed);
+         ralloc_free(nir);
+      }
+
+      printf("algebraic   %-40s %8u instrs %3u passes %8.1f ns/instr\n",
+             shaders[i].name, shaders[i].num_instrs, num_passes,
+             (double) best / MAX2(shaders[i].num_instrs, 1));
+
+      total_time += best;
+      total_instrs += shaders[i].num_instrs;
+   }
+
+   printf("algebraic total %" PRIu64 " instrs %.1f ns/instr\n",
+          total_instrs, (double) total_time / MAX2(total_instrs, 1));
+}
+
+static void
+print_usage(const char *exec_name, FILE *f)
+{
+   fprintf(f,
+"Usage: %s [options] <benchmark> [file...]\n"
+"Benchmarks:\n"
+"  deserialize             nir_deserialize() throughput.\n"
+"  algebraic               nir_opt_algebraic() run to a fixed point.\n"
+"Options:\n"
+"  -h, --help              Print this help.\n"
+"  -i, --iterations <n>    Number of runs per shader (default: 20).\n"
+"  -s, --size <n>          Size of the generated shader used when no files\n"
+"                          are given (default: 2000).\n"
+"Files must contain the output of nir_serialize().\n", exec_name);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned iterations = 20, size = 2000;
+   int ch;
+
+   static struct option long_options[] = {
+      {"help",       no_argument,       0, 'h'},
+      {"iterations", required_argument, 0, 'i'},
+      {"size",       required_argument, 0, 's'},
+      {0, 0, 0, 0}
+   };
+
+   while ((ch = getopt_long(argc, argv, "hi:s:", long_options, NULL)) != -1) {
+      switch (ch) {
+      case 'h':
+         print_usage(argv[0], stdout);
+         return 0;
+      case 'i':
+         iterations = MAX2(atoi(optarg), 1);
+         break;
+      case 's':
+         size = MAX2(atoi(optarg), 1);
+         break;
+      default:
+         print_usage(argv[0], stderr);
+         return 1;
+      }
+   }
+
+   if (optind >= argc) {
+      print_usage(argv[0], stderr);
+      return 1;
+   }
+
+   const char *benchmark = argv[optind++];
+
+   glsl_type_singleton_init_or_ref();
+
+   unsigned num_shaders = MAX2(argc - optind, 1);
+   struct bench_shader *shaders = calloc(num_shaders, sizeof(*shaders));
+
+   if (optind == argc) {
+      nir_shader *nir = generate_shader(size);
+      add_shader(&shaders[0], "generated", nir);
+      ralloc_free(nir);
+   } else {
+      for (unsigned i = 0; i < num_shaders; i++) {
+         if (!load_shader(&shaders[i], argv[optind + i]))
+            return 1;
+      }
+   }
+
+   int ret = 0;
+   if (strcmp(benchmark, "deserialize") == 0) {
+      bench_deserialize(shaders, num_shaders, iterations);
+   } else if (strcmp(benchmark, "algebraic") == 0) {
+      bench_algebraic(shaders, num_shaders, iterations);
+   } else {
+      print_usage(argv[0], stderr);
+      ret = 1;
+   }
+
+   for (unsigned i = 0; i < num_shaders; i++)
+      free(shaders[i].data);
+   free(shaders);
+
+   glsl_type_singleton_decref();
+
+   return ret;
+}
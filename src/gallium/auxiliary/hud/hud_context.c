@@ -1265,22 +1265,61 @@ hud_parse_env_var(struct hud_context *hud, struct pipe_screen *screen,
          hud_cpu_graph_install(pane, i);
       }
       else if (strcmp(name, "API-thread-busy") == 0) {
-         hud_thread_busy_install(pane, name, false);
+         hud_thread_busy_install(pane, name, HUD_THREAD_API);
       }
       else if (strcmp(name, "API-thread-offloaded-slots") == 0) {
-         hud_thread_counter_install(pane, name, HUD_COUNTER_OFFLOADED);
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_OFFLOADED);
       }
       else if (strcmp(name, "API-thread-direct-slots") == 0) {
-         hud_thread_counter_install(pane, name, HUD_COUNTER_DIRECT);
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_DIRECT);
       }
       else if (strcmp(name, "API-thread-num-syncs") == 0) {
-         hud_thread_counter_install(pane, name, HUD_COUNTER_SYNCS);
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_SYNCS);
       }
       else if (strcmp(name, "API-thread-num-batches") == 0) {
-         hud_thread_counter_install(pane, name, HUD_COUNTER_BATCHES);
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_BATCHES);
+      }
+      else if (strcmp(name, "API-thread-stalled") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_STALL_TIME);
+      }
+      else if (strcmp(name, "API-thread-batch-size") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_API,
+                                    HUD_COUNTER_BATCH_SIZE);
+      }
+      else if (strcmp(name, "driver-thread-busy") == 0) {
+         hud_thread_busy_install(pane, name, HUD_THREAD_DRIVER);
+      }
+      else if (strcmp(name, "driver-thread-offloaded-slots") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_OFFLOADED);
+      }
+      else if (strcmp(name, "driver-thread-direct-slots") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_DIRECT);
+      }
+      else if (strcmp(name, "driver-thread-num-syncs") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_SYNCS);
+      }
+      else if (strcmp(name, "driver-thread-num-batches") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_BATCHES);
+      }
+      else if (strcmp(name, "driver-thread-stalled") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_STALL_TIME);
+      }
+      else if (strcmp(name, "driver-thread-batch-size") == 0) {
+         hud_thread_counter_install(pane, name, HUD_THREAD_DRIVER,
+                                    HUD_COUNTER_BATCH_SIZE);
       }
       else if (strcmp(name, "main-thread-busy") == 0) {
-         hud_thread_busy_install(pane, name, true);
+         hud_thread_busy_install(pane, name, HUD_THREAD_MAIN);
       }
 #ifdef HAVE_GALLIUM_EXTRA_HUD
       else if (sscanf(name, "nic-rx-%s", arg_name) == 1) {
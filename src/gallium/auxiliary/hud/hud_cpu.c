@@ -33,6 +33,7 @@
 #include "os/os_thread.h"
 #include "util/u_memory.h"
 #include "util/u_queue.h"
+#include "util/u_threaded_context.h"
 #include <stdio.h>
 #include <inttypes.h>
 #ifdef PIPE_OS_WINDOWS
@@ -317,13 +318,23 @@ hud_get_num_cpus(void)
 }
 
 struct thread_info {
-   bool main_thread;
+   enum hud_thread thread;
    int64_t last_time;
    int64_t last_thread_time;
 };
 
+static struct util_queue_monitoring *
+get_monitored_queue(struct hud_graph *gr, struct pipe_context *pipe,
+                    enum hud_thread thread)
+{
+   if (thread == HUD_THREAD_DRIVER)
+      return threaded_context_get_monitoring(pipe);
+
+   return gr->pane->hud->monitored_queue;
+}
+
 static void
-query_api_thread_busy_status(struct hud_graph *gr, struct pipe_context *pipe)
+query_thread_busy_status(struct hud_graph *gr, struct pipe_context *pipe)
 {
    struct thread_info *info = gr->query_data;
    int64_t now = os_time_get_nano();
@@ -332,10 +343,11 @@ query_api_thread_busy_status(struct hud_graph *gr, struct pipe_context *pipe)
       if (info->last_time + gr->pane->period*1000 <= now) {
          int64_t thread_now;
 
-         if (info->main_thread) {
+         if (info->thread == HUD_THREAD_MAIN) {
             thread_now = util_current_thread_get_time_nano();
          } else {
-            struct util_queue_monitoring *mon = gr->pane->hud->monitored_queue;
+            struct util_queue_monitoring *mon =
+               get_monitored_queue(gr, pipe, info->thread);
 
             if (mon && mon->queue)
                thread_now = util_queue_get_thread_time_nano(mon->queue, 0);
@@ -365,7 +377,8 @@ query_api_thread_busy_status(struct hud_graph *gr, struct pipe_context *pipe)
 }
 
 void
-hud_thread_busy_install(struct hud_pane *pane, const char *name, bool main)
+hud_thread_busy_install(struct hud_pane *pane, const char *name,
+                        enum hud_thread thread)
 {
    struct hud_graph *gr;
 
@@ -381,8 +394,8 @@ hud_thread_busy_install(struct hud_pane *pane, const char *name, bool main)
       return;
    }
 
-   ((struct thread_info*)gr->query_data)->main_thread = main;
-   gr->query_new_value = query_api_thread_busy_status;
+   ((struct thread_info*)gr->query_data)->thread = thread;
+   gr->query_new_value = query_thread_busy_status;
 
    /* Don't use free() as our callback as that messes up Gallium's
     * memory debugger.  Use simple free_query_data() wrapper.
@@ -394,36 +407,29 @@ hud_thread_busy_install(struct hud_pane *pane, const char *name, bool main)
 }
 
 struct counter_info {
+   enum hud_thread thread;
    enum hud_counter counter;
    int64_t last_time;
+   int64_t last_query_time;
+   uint64_t last_value;
 };
 
-static unsigned get_counter(struct hud_graph *gr, enum hud_counter counter)
+static uint64_t get_counter(struct util_queue_monitoring *mon,
+                            enum hud_counter counter)
 {
-   struct util_queue_monitoring *mon = gr->pane->hud->monitored_queue;
-   unsigned value;
-
-   if (!mon || !mon->queue)
-      return 0;
-
-   /* Reset the counters to 0 to only display values for 1 frame. */
    switch (counter) {
    case HUD_COUNTER_OFFLOADED:
-      value = mon->num_offloaded_items;
-      mon->num_offloaded_items = 0;
-      return value;
+      return mon->num_offloaded_items;
    case HUD_COUNTER_DIRECT:
-      value = mon->num_direct_items;
-      mon->num_direct_items = 0;
-      return value;
+      return mon->num_direct_items;
    case HUD_COUNTER_SYNCS:
-      value = mon->num_syncs;
-      mon->num_syncs = 0;
-      return value;
+      return mon->num_syncs;
    case HUD_COUNTER_BATCHES:
-      value = mon->num_batches;
-      mon->num_batches = 0;
-      return value;
+      return mon->num_batches;
+   case HUD_COUNTER_STALL_TIME:
+      return mon->stall_time_ns;
+   case HUD_COUNTER_BATCH_SIZE:
+      return mon->batch_size_limit;
    default:
       assert(0);
       return 0;
@@ -434,8 +440,35 @@ static void
 query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
 {
    struct counter_info *info = gr->query_data;
+   struct util_queue_monitoring *mon =
+      get_monitored_queue(gr, pipe, info->thread);
    int64_t now = os_time_get_nano();
-   unsigned value = get_counter(gr, info->counter);
+   double value = 0;
+
+   /* The counters are cumulative, because drivers also read them for their
+    * own queries. Only display the difference since the last frame.
+    */
+   if (mon && mon->queue) {
+      uint64_t current = get_counter(mon, info->counter);
+
+      switch (info->counter) {
+      case HUD_COUNTER_BATCH_SIZE:
+         value = current;
+         break;
+      case HUD_COUNTER_STALL_TIME:
+         /* Display the percentage of the frame time. */
+         if (info->last_query_time) {
+            value = MIN2((current - info->last_value) * 100.0 /
+                         (now - info->last_query_time), 100.0);
+         }
+         break;
+      default:
+         value = (unsigned)(current - info->last_value);
+         break;
+      }
+      info->last_value = current;
+   }
+   info->last_query_time = now;
 
    if (info->last_time) {
       if (info->last_time + gr->pane->period*1000 <= now) {
@@ -449,6 +482,7 @@ query_thread_counter(struct hud_graph *gr, struct pipe_context *pipe)
 }
 
 void hud_thread_counter_install(struct hud_pane *pane, const char *name,
+                                enum hud_thread thread,
                                 enum hud_counter counter)
 {
    struct hud_graph *gr = CALLOC_STRUCT(hud_graph);
@@ -463,6 +497,7 @@ void hud_thread_counter_install(struct hud_pane *pane, const char *name,
       return;
    }
 
+   ((struct counter_info*)gr->query_data)->thread = thread;
    ((struct counter_info*)gr->query_data)->counter = counter;
    gr->query_new_value = query_thread_counter;
 
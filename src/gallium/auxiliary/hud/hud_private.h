@@ -39,6 +39,14 @@ enum hud_counter {
    HUD_COUNTER_DIRECT,
    HUD_COUNTER_SYNCS,
    HUD_COUNTER_BATCHES,
+   HUD_COUNTER_STALL_TIME,
+   HUD_COUNTER_BATCH_SIZE,
+};
+
+enum hud_thread {
+   HUD_THREAD_MAIN,
+   HUD_THREAD_API,      /* glthread */
+   HUD_THREAD_DRIVER,   /* u_threaded_context */
 };
 
 struct hud_context {
@@ -162,8 +170,10 @@ int hud_get_num_cpus(void);
 void hud_fps_graph_install(struct hud_pane *pane);
 void hud_frametime_graph_install(struct hud_pane *pane);
 void hud_cpu_graph_install(struct hud_pane *pane, unsigned cpu_index);
-void hud_thread_busy_install(struct hud_pane *pane, const char *name, bool main);
+void hud_thread_busy_install(struct hud_pane *pane, const char *name,
+                             enum hud_thread thread);
 void hud_thread_counter_install(struct hud_pane *pane, const char *name,
+                                enum hud_thread thread,
                                 enum hud_counter counter);
 void hud_pipe_query_install(struct hud_batch_query_context **pbq,
                             struct hud_pane *pane,
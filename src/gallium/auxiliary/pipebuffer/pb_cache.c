@@ -27,9 +27,44 @@
  **************************************************************************/
 
 #include "pb_cache.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
+#include "util/u_thread.h"
 
+/* One size class per power of two. */
+#define PB_CACHE_NUM_SIZE_CLASSES 64
+
+/* Per-CPU cache of buffers, oldest first. The buffers are not linked into
+ * the buckets.
+ *
+ * The lock is only contended when threads migrate between CPUs or when the
+ * cache is emptied, and it must never be held while taking the shared
+ * mutex.
+ */
+struct pb_cache_magazine
+{
+   simple_mtx_t mutex;
+   unsigned num_entries;
+   struct pb_cache_entry *entries[PB_CACHE_MAGAZINE_SIZE];
+};
+
+static struct pb_cache_magazine *
+get_magazine(struct pb_cache *mgr)
+{
+   unsigned cpu = (unsigned)util_get_current_cpu() % PB_CACHE_NUM_MAGAZINES;
+
+   return &mgr->magazines[cpu];
+}
+
+static struct list_head *
+get_size_class(struct pb_cache *mgr, unsigned bucket_index, pb_size size)
+{
+   unsigned size_class = util_logbase2_64(MAX2(size, 1));
+
+   return &mgr->size_classes[bucket_index * PB_CACHE_NUM_SIZE_CLASSES +
+                             size_class];
+}
 
 /**
  * Actually destroy the buffer.
@@ -43,6 +78,7 @@ destroy_buffer_locked(struct pb_cache_entry *entry)
    assert(!pipe_is_referenced(&buf->reference));
    if (list_is_linked(&entry->head)) {
       list_del(&entry->head);
+      list_del(&entry->size_head);
       assert(mgr->num_buffers);
       --mgr->num_buffers;
       mgr->cache_size -= buf->size;
@@ -75,6 +111,36 @@ release_expired_buffers_locked(struct list_head *cache,
    }
 }
 
+/**
+ * Add buffers to the buckets, whose caching interval has already been set.
+ */
+static void
+add_buffers_locked(struct pb_cache *mgr, struct pb_cache_entry **entries,
+                   unsigned num_entries, int64_t current_time)
+{
+   unsigned i;
+
+   for (i = 0; i < mgr->num_heaps; i++)
+      release_expired_buffers_locked(&mgr->buckets[i], current_time);
+
+   for (i = 0; i < num_entries; i++) {
+      struct pb_cache_entry *entry = entries[i];
+      struct pb_buffer *buf = entry->buffer;
+
+      /* Directly release any buffer that exceeds the limit. */
+      if (mgr->cache_size + buf->size > mgr->max_cache_size) {
+         mgr->destroy_buffer(mgr->winsys, buf);
+         continue;
+      }
+
+      list_addtail(&entry->head, &mgr->buckets[entry->bucket_index]);
+      list_addtail(&entry->size_head,
+                   get_size_class(mgr, entry->bucket_index, buf->size));
+      ++mgr->num_buffers;
+      mgr->cache_size += buf->size;
+   }
+}
+
 /**
  * Add a buffer to the cache. This is typically done when the buffer is
  * being released.
@@ -83,30 +149,51 @@ void
 pb_cache_add_buffer(struct pb_cache_entry *entry)
 {
    struct pb_cache *mgr = entry->mgr;
-   struct list_head *cache = &mgr->buckets[entry->bucket_index];
    struct pb_buffer *buf = entry->buffer;
-   unsigned i;
+   struct pb_cache_entry *batch[PB_CACHE_MAGAZINE_SIZE];
+   unsigned num_batch = 0;
 
-   simple_mtx_lock(&mgr->mutex);
    assert(!pipe_is_referenced(&buf->reference));
 
    int64_t current_time = os_time_get();
 
-   for (i = 0; i < mgr->num_heaps; i++)
-      release_expired_buffers_locked(&mgr->buckets[i], current_time);
+   entry->start = current_time;
+   entry->end = entry->start + mgr->usecs;
 
-   /* Directly release any buffer that exceeds the limit. */
-   if (mgr->cache_size + buf->size > mgr->max_cache_size) {
-      mgr->destroy_buffer(mgr->winsys, buf);
-      simple_mtx_unlock(&mgr->mutex);
-      return;
+   /* Only keep small buffers in the magazines, so that all of them together
+    * can't hold more than half of max_cache_size on top of the buckets.
+    */
+   if (buf->size <= mgr->max_cache_size /
+                    (2 * PB_CACHE_NUM_MAGAZINES * PB_CACHE_MAGAZINE_SIZE)) {
+      struct pb_cache_magazine *mag = get_magazine(mgr);
+
+      simple_mtx_lock(&mag->mutex);
+
+      /* Return the older half if the magazine is full or if its oldest
+       * buffer has expired, so that expiry isn't delayed for long.
+       */
+      if (mag->num_entries == PB_CACHE_MAGAZINE_SIZE ||
+          (mag->num_entries &&
+           os_time_timeout(mag->entries[0]->start, mag->entries[0]->end,
+                           current_time))) {
+         num_batch = DIV_ROUND_UP(mag->num_entries, 2);
+         memcpy(batch, mag->entries, num_batch * sizeof(*batch));
+         mag->num_entries -= num_batch;
+         memmove(mag->entries, &mag->entries[num_batch],
+                 mag->num_entries * sizeof(*mag->entries));
+      }
+      mag->entries[mag->num_entries++] = entry;
+
+      simple_mtx_unlock(&mag->mutex);
+
+      if (!num_batch)
+         return;
+   } else {
+      batch[num_batch++] = entry;
    }
 
-   entry->start = os_time_get();
-   entry->end = entry->start + mgr->usecs;
-   list_addtail(&entry->head, cache);
-   ++mgr->num_buffers;
-   mgr->cache_size += buf->size;
+   simple_mtx_lock(&mgr->mutex);
+   add_buffers_locked(mgr, batch, num_batch, current_time);
    simple_mtx_unlock(&mgr->mutex);
 }
 
@@ -140,33 +227,25 @@ pb_cache_is_buffer_compat(struct pb_cache_entry *entry,
 }
 
 /**
- * Find a compatible buffer in the cache, return it, and remove it
- * from the cache.
+ * Find a compatible buffer in one size class, freeing expired buffers
+ * in the process.
  */
-struct pb_buffer *
-pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
-                        unsigned alignment, unsigned usage,
-                        unsigned bucket_index)
+static struct pb_cache_entry *
+pb_cache_find_compat_locked(struct list_head *cache, pb_size size,
+                            unsigned alignment, unsigned usage, int64_t now)
 {
    struct pb_cache_entry *entry;
    struct pb_cache_entry *cur_entry;
    struct list_head *cur, *next;
-   int64_t now;
    int ret = 0;
 
-   assert(bucket_index < mgr->num_heaps);
-   struct list_head *cache = &mgr->buckets[bucket_index];
-
-   simple_mtx_lock(&mgr->mutex);
-
    entry = NULL;
    cur = cache->next;
    next = cur->next;
 
    /* search in the expired buffers, freeing them in the process */
-   now = os_time_get();
    while (cur != cache) {
-      cur_entry = list_entry(cur, struct pb_cache_entry, head);
+      cur_entry = list_entry(cur, struct pb_cache_entry, size_head);
 
       if (!entry && (ret = pb_cache_is_buffer_compat(cur_entry, size,
                                                      alignment, usage)) > 0)
@@ -188,7 +267,7 @@ pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
    /* keep searching in the hot buffers */
    if (!entry && ret != -1) {
       while (cur != cache) {
-         cur_entry = list_entry(cur, struct pb_cache_entry, head);
+         cur_entry = list_entry(cur, struct pb_cache_entry, size_head);
          ret = pb_cache_is_buffer_compat(cur_entry, size, alignment, usage);
 
          if (ret > 0) {
@@ -203,12 +282,70 @@ pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
       }
    }
 
+   return entry;
+}
+
+/**
+ * Find a compatible buffer in the cache, return it, and remove it
+ * from the cache.
+ */
+struct pb_buffer *
+pb_cache_reclaim_buffer(struct pb_cache *mgr, pb_size size,
+                        unsigned alignment, unsigned usage,
+                        unsigned bucket_index)
+{
+   struct pb_cache_entry *entry = NULL;
+   int64_t now;
+
+   assert(bucket_index < mgr->num_heaps);
+
+   /* Try the most-recently added buffers of the current CPU first. */
+   struct pb_cache_magazine *mag = get_magazine(mgr);
+
+   simple_mtx_lock(&mag->mutex);
+   for (int i = mag->num_entries - 1; i >= 0; i--) {
+      struct pb_cache_entry *cur_entry = mag->entries[i];
+
+      if (cur_entry->bucket_index == bucket_index &&
+          pb_cache_is_buffer_compat(cur_entry, size, alignment, usage) > 0) {
+         entry = cur_entry;
+         mag->num_entries--;
+         memmove(&mag->entries[i], &mag->entries[i + 1],
+                 (mag->num_entries - i) * sizeof(*mag->entries));
+         break;
+      }
+   }
+   simple_mtx_unlock(&mag->mutex);
+
+   if (entry) {
+      struct pb_buffer *buf = entry->buffer;
+
+      /* Increase refcount */
+      pipe_reference_init(&buf->reference, 1);
+      return buf;
+   }
+
+   /* Only the size classes between the requested size and the largest
+    * size accepted by pb_cache_is_buffer_compat can have a match.
+    */
+   struct list_head *first = get_size_class(mgr, bucket_index, size);
+   struct list_head *last =
+      get_size_class(mgr, bucket_index,
+                     MAX2((pb_size)(mgr->size_factor * size), size));
+
+   simple_mtx_lock(&mgr->mutex);
+
+   now = os_time_get();
+   for (struct list_head *cache = first; cache <= last && !entry; cache++)
+      entry = pb_cache_find_compat_locked(cache, size, alignment, usage, now);
+
    /* found a compatible buffer, return it */
    if (entry) {
       struct pb_buffer *buf = entry->buffer;
 
       mgr->cache_size -= buf->size;
       list_del(&entry->head);
+      list_del(&entry->size_head);
       --mgr->num_buffers;
       simple_mtx_unlock(&mgr->mutex);
       /* Increase refcount */
@@ -231,6 +368,21 @@ pb_cache_release_all_buffers(struct pb_cache *mgr)
    unsigned i;
 
    simple_mtx_lock(&mgr->mutex);
+   for (i = 0; i < PB_CACHE_NUM_MAGAZINES; i++) {
+      struct pb_cache_magazine *mag = &mgr->magazines[i];
+      struct pb_cache_entry *entries[PB_CACHE_MAGAZINE_SIZE];
+      unsigned num_entries;
+
+      simple_mtx_lock(&mag->mutex);
+      num_entries = mag->num_entries;
+      memcpy(entries, mag->entries, num_entries * sizeof(*entries));
+      mag->num_entries = 0;
+      simple_mtx_unlock(&mag->mutex);
+
+      for (unsigned j = 0; j < num_entries; j++)
+         destroy_buffer_locked(entries[j]);
+   }
+
    for (i = 0; i < mgr->num_heaps; i++) {
       struct list_head *cache = &mgr->buckets[i];
 
@@ -290,8 +442,30 @@ pb_cache_init(struct pb_cache *mgr, uint num_heaps,
    if (!mgr->buckets)
       return;
 
+   mgr->size_classes = CALLOC(num_heaps * PB_CACHE_NUM_SIZE_CLASSES,
+                              sizeof(struct list_head));
+   if (!mgr->size_classes) {
+      FREE(mgr->buckets);
+      mgr->buckets = NULL;
+      return;
+   }
+
+   mgr->magazines = CALLOC(PB_CACHE_NUM_MAGAZINES,
+                           sizeof(struct pb_cache_magazine));
+   if (!mgr->magazines) {
+      FREE(mgr->buckets);
+      FREE(mgr->size_classes);
+      mgr->buckets = NULL;
+      mgr->size_classes = NULL;
+      return;
+   }
+
    for (i = 0; i < num_heaps; i++)
       list_inithead(&mgr->buckets[i]);
+   for (i = 0; i < num_heaps * PB_CACHE_NUM_SIZE_CLASSES; i++)
+      list_inithead(&mgr->size_classes[i]);
+   for (i = 0; i < PB_CACHE_NUM_MAGAZINES; i++)
+      (void) simple_mtx_init(&mgr->magazines[i].mutex, mtx_plain);
 
    (void) simple_mtx_init(&mgr->mutex, mtx_plain);
    mgr->winsys = winsys;
@@ -313,7 +487,13 @@ void
 pb_cache_deinit(struct pb_cache *mgr)
 {
    pb_cache_release_all_buffers(mgr);
+   for (unsigned i = 0; i < PB_CACHE_NUM_MAGAZINES; i++)
+      simple_mtx_destroy(&mgr->magazines[i].mutex);
    simple_mtx_destroy(&mgr->mutex);
    FREE(mgr->buckets);
+   FREE(mgr->size_classes);
+   FREE(mgr->magazines);
    mgr->buckets = NULL;
+   mgr->size_classes = NULL;
+   mgr->magazines = NULL;
 }
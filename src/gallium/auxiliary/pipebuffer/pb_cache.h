@@ -34,12 +34,21 @@
 #include "util/list.h"
 #include "os/os_thread.h"
 
+struct pb_cache_magazine;
+
+/* Number of per-CPU magazines, and the maximum number of buffers each
+ * magazine can hold.
+ */
+#define PB_CACHE_NUM_MAGAZINES 8
+#define PB_CACHE_MAGAZINE_SIZE 8
+
 /**
  * Statically inserted into the driver-specific buffer structure.
  */
 struct pb_cache_entry
 {
-   struct list_head head;
+   struct list_head head; /**< In the bucket, ordered by release time */
+   struct list_head size_head; /**< In the size class of the bucket */
    struct pb_buffer *buffer; /**< Pointer to the structure this is part of. */
    struct pb_cache *mgr;
    int64_t start, end; /**< Caching time interval */
@@ -53,6 +62,19 @@ struct pb_cache
     */
    struct list_head *buckets;
 
+   /* Each bucket is further divided by log2 of the buffer size, so that
+    * reclaiming only walks buffers that can satisfy the requested size.
+    */
+   struct list_head *size_classes;
+
+   /* Per-CPU caches of the most-recently added small buffers, so that most
+    * adds and reclaims only take the magazine's lock instead of the shared
+    * mutex. A full magazine returns its older half to the buckets at once.
+    * Buffers in magazines aren't counted in num_buffers and cache_size, and
+    * are destroyed by pb_cache_release_all_buffers.
+    */
+   struct pb_cache_magazine *magazines;
+
    simple_mtx_t mutex;
    void *winsys;
    uint64_t cache_size;
@@ -27,8 +27,10 @@
 
 #include "pb_slab.h"
 
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_thread.h"
 
 /* All slab allocations from the same heap and with the same size belong
  * to the same group.
@@ -49,13 +51,34 @@ struct pb_slab_group
    struct list_head slabs;
 };
 
+/* Per-CPU cache of free entries of one group. The entries are not linked
+ * into any list and are not counted in pb_slab::num_free.
+ *
+ * The lock is only contended when threads migrate between CPUs or when the
+ * magazine is drained, and it must never be held while taking the shared
+ * mutex.
+ */
+struct pb_slab_magazine
+{
+   simple_mtx_t mutex;
+   unsigned num_entries;
+   struct pb_slab_entry *entries[PB_SLAB_MAGAZINE_SIZE];
+};
+
 
+static unsigned
+pb_slabs_num_groups(struct pb_slabs *slabs)
+{
+   return slabs->num_orders * slabs->num_heaps *
+          (1 + slabs->allow_three_fourths_allocations);
+}
+
+/* Put a free entry that isn't linked into any list back into its slab. */
 static void
-pb_slab_reclaim(struct pb_slabs *slabs, struct pb_slab_entry *entry)
+pb_slab_put_entry_locked(struct pb_slabs *slabs, struct pb_slab_entry *entry)
 {
    struct pb_slab *slab = entry->slab;
 
-   list_del(&entry->head); /* remove from reclaim list */
    list_add(&entry->head, &slab->free);
    slab->num_free++;
 
@@ -71,6 +94,127 @@ pb_slab_reclaim(struct pb_slabs *slabs, struct pb_slab_entry *entry)
    }
 }
 
+static void
+pb_slab_reclaim(struct pb_slabs *slabs, struct pb_slab_entry *entry)
+{
+   list_del(&entry->head); /* remove from reclaim list */
+   pb_slab_put_entry_locked(slabs, entry);
+}
+
+/* Return the magazine of the current CPU for the given group, allocating it
+ * if needed. Returns NULL if it can't be allocated.
+ */
+static struct pb_slab_magazine *
+pb_slabs_get_magazine(struct pb_slabs *slabs, unsigned group_index)
+{
+   unsigned cpu = (unsigned)util_get_current_cpu() % PB_SLAB_NUM_MAGAZINES;
+   struct pb_slab_magazine **slot =
+      &slabs->magazines[group_index * PB_SLAB_NUM_MAGAZINES + cpu];
+   struct pb_slab_magazine *mag = p_atomic_read(slot);
+
+   if (mag)
+      return mag;
+
+   mag = CALLOC_STRUCT(pb_slab_magazine);
+   if (!mag)
+      return NULL;
+
+   (void) simple_mtx_init(&mag->mutex, mtx_plain);
+
+   struct pb_slab_magazine *old = p_atomic_cmpxchg_ptr(slot, NULL, mag);
+   if (old) {
+      /* Another thread was faster. */
+      simple_mtx_destroy(&mag->mutex);
+      FREE(mag);
+      return old;
+   }
+   return mag;
+}
+
+/* Take the most-recently added entry out of the magazine. */
+static struct pb_slab_entry *
+pb_slab_magazine_pop(struct pb_slab_magazine *mag)
+{
+   struct pb_slab_entry *entry = NULL;
+
+   simple_mtx_lock(&mag->mutex);
+   if (mag->num_entries)
+      entry = mag->entries[--mag->num_entries];
+   simple_mtx_unlock(&mag->mutex);
+
+   return entry;
+}
+
+/* Add a batch of entries to the magazine. Returns the number of entries
+ * that didn't fit, which are left at the end of the batch.
+ */
+static unsigned
+pb_slab_magazine_push(struct pb_slab_magazine *mag,
+                      struct pb_slab_entry **entries, unsigned num_entries)
+{
+   simple_mtx_lock(&mag->mutex);
+   unsigned num = MIN2(num_entries, PB_SLAB_MAGAZINE_SIZE - mag->num_entries);
+   memcpy(&mag->entries[mag->num_entries], entries, num * sizeof(*entries));
+   mag->num_entries += num;
+   simple_mtx_unlock(&mag->mutex);
+
+   return num_entries - num;
+}
+
+/* Put all entries cached in the magazines back into their slabs. */
+static void
+pb_slabs_drain_magazines_locked(struct pb_slabs *slabs)
+{
+   unsigned num_magazines = pb_slabs_num_groups(slabs) * PB_SLAB_NUM_MAGAZINES;
+
+   for (unsigned i = 0; i < num_magazines; i++) {
+      struct pb_slab_magazine *mag = p_atomic_read(&slabs->magazines[i]);
+      struct pb_slab_entry *entries[PB_SLAB_MAGAZINE_SIZE];
+      unsigned num_entries;
+
+      if (!mag)
+         continue;
+
+      simple_mtx_lock(&mag->mutex);
+      num_entries = mag->num_entries;
+      memcpy(entries, mag->entries, num_entries * sizeof(*entries));
+      mag->num_entries = 0;
+      simple_mtx_unlock(&mag->mutex);
+
+      for (unsigned j = 0; j < num_entries; j++)
+         pb_slab_put_entry_locked(slabs, entries[j]);
+   }
+}
+
+/* Move the entries freed since the last call to the tail of the reclaim
+ * list, oldest first.
+ */
+static void
+pb_slabs_move_freed_locked(struct pb_slabs *slabs)
+{
+   struct list_head *freed = p_atomic_read(&slabs->freed);
+   struct list_head *old;
+   struct list_head list;
+
+   /* Take the whole stack. */
+   do {
+      old = freed;
+      freed = p_atomic_cmpxchg_ptr(&slabs->freed, old, NULL);
+   } while (freed != old);
+
+   list_inithead(&list);
+
+   /* The stack is in reverse order, so prepending restores the order. */
+   while (freed) {
+      struct list_head *next = freed->next;
+
+      list_add(freed, &list);
+      freed = next;
+   }
+
+   list_splicetail(&list, &slabs->reclaim);
+}
+
 #define MAX_FAILED_RECLAIMS 2
 
 static void
@@ -78,6 +222,9 @@ pb_slabs_reclaim_locked(struct pb_slabs *slabs)
 {
    struct pb_slab_entry *entry, *next;
    unsigned num_failed_reclaims = 0;
+
+   pb_slabs_move_freed_locked(slabs);
+
    LIST_FOR_EACH_ENTRY_SAFE(entry, next, &slabs->reclaim, head) {
       if (slabs->can_reclaim(slabs->priv, entry)) {
          pb_slab_reclaim(slabs, entry);
@@ -99,6 +246,9 @@ static void
 pb_slabs_reclaim_all_locked(struct pb_slabs *slabs)
 {
    struct pb_slab_entry *entry, *next;
+
+   pb_slabs_move_freed_locked(slabs);
+
    LIST_FOR_EACH_ENTRY_SAFE(entry, next, &slabs->reclaim, head) {
       if (slabs->can_reclaim(slabs->priv, entry)) {
          pb_slab_reclaim(slabs, entry);
@@ -113,6 +263,10 @@ pb_slabs_reclaim_all_locked(struct pb_slabs *slabs)
  * determined by the can_reclaim fallback function), a new slab will be
  * requested via the slab_alloc callback.
  *
+ * Unless reclaim_all is set, the entry is taken from the magazine of the
+ * current CPU if possible, and the magazine is refilled with a batch of
+ * entries from the same slab otherwise.
+ *
  * Note that slab_free can also be called by this function.
  */
 struct pb_slab_entry *
@@ -122,7 +276,10 @@ pb_slab_alloc_reclaimed(struct pb_slabs *slabs, unsigned size, unsigned heap, bo
    unsigned group_index;
    struct pb_slab_group *group;
    struct pb_slab *slab;
+   struct pb_slab_magazine *mag = NULL;
    struct pb_slab_entry *entry;
+   struct pb_slab_entry *batch[PB_SLAB_MAGAZINE_SIZE / 2];
+   unsigned num_batch = 0;
    unsigned entry_size = 1 << order;
    bool three_fourths = false;
 
@@ -141,6 +298,16 @@ pb_slab_alloc_reclaimed(struct pb_slabs *slabs, unsigned size, unsigned heap, bo
                  (1 + slabs->allow_three_fourths_allocations) + three_fourths;
    group = &slabs->groups[group_index];
 
+   /* Don't keep entries aside when memory is tight. */
+   if (!reclaim_all) {
+      mag = pb_slabs_get_magazine(slabs, group_index);
+      if (mag) {
+         entry = pb_slab_magazine_pop(mag);
+         if (entry)
+            return entry;
+      }
+   }
+
    simple_mtx_lock(&slabs->mutex);
 
    /* If there is no candidate slab at all, or the first slab has no free
@@ -184,8 +351,31 @@ pb_slab_alloc_reclaimed(struct pb_slabs *slabs, unsigned size, unsigned heap, bo
    list_del(&entry->head);
    slab->num_free--;
 
+   /* Refill the magazine while we hold the mutex anyway. */
+   if (mag) {
+      while (num_batch < ARRAY_SIZE(batch) && !list_is_empty(&slab->free)) {
+         batch[num_batch] = list_entry(slab->free.next, struct pb_slab_entry,
+                                       head);
+         list_del(&batch[num_batch]->head);
+         slab->num_free--;
+         num_batch++;
+      }
+   }
+
    simple_mtx_unlock(&slabs->mutex);
 
+   if (num_batch) {
+      unsigned num_left = pb_slab_magazine_push(mag, batch, num_batch);
+
+      /* Another thread on the same CPU refilled the magazine meanwhile. */
+      if (num_left) {
+         simple_mtx_lock(&slabs->mutex);
+         for (unsigned i = num_batch - num_left; i < num_batch; i++)
+            pb_slab_put_entry_locked(slabs, batch[i]);
+         simple_mtx_unlock(&slabs->mutex);
+      }
+   }
+
    return entry;
 }
 
@@ -200,25 +390,38 @@ pb_slab_alloc(struct pb_slabs *slabs, unsigned size, unsigned heap)
  * The entry may still be in use e.g. by in-flight command submissions. The
  * can_reclaim callback function will be called to determine whether the entry
  * can be handed out again by pb_slab_alloc.
+ *
+ * This doesn't take the mutex, so that threads that free many entries don't
+ * contend with allocations.
  */
 void
 pb_slab_free(struct pb_slabs* slabs, struct pb_slab_entry *entry)
 {
-   simple_mtx_lock(&slabs->mutex);
-   list_addtail(&entry->head, &slabs->reclaim);
-   simple_mtx_unlock(&slabs->mutex);
+   struct list_head *top = p_atomic_read(&slabs->freed);
+   struct list_head *old;
+
+   /* Push the entry to the stack. Entries are only ever popped all at once,
+    * so this isn't subject to the ABA problem.
+    */
+   do {
+      old = top;
+      entry->head.next = old;
+      top = p_atomic_cmpxchg_ptr(&slabs->freed, old, &entry->head);
+   } while (top != old);
 }
 
 /* Check if any of the entries handed to pb_slab_free are ready to be re-used.
  *
- * This may end up freeing some slabs and is therefore useful to try to reclaim
- * some no longer used memory. However, calling this function is not strictly
- * required since pb_slab_alloc will eventually do the same thing.
+ * This also drains the per-CPU magazines, so it may end up freeing some slabs
+ * and is therefore useful to try to reclaim some no longer used memory.
+ * However, calling this function is not strictly required since
+ * pb_slab_alloc will eventually do the same thing.
  */
 void
 pb_slabs_reclaim(struct pb_slabs *slabs)
 {
    simple_mtx_lock(&slabs->mutex);
+   pb_slabs_drain_magazines_locked(slabs);
    pb_slabs_reclaim_locked(slabs);
    simple_mtx_unlock(&slabs->mutex);
 }
@@ -256,13 +459,20 @@ pb_slabs_init(struct pb_slabs *slabs,
    slabs->slab_free = slab_free;
 
    list_inithead(&slabs->reclaim);
+   slabs->freed = NULL;
 
-   num_groups = slabs->num_orders * slabs->num_heaps *
-                (1 + allow_three_fourth_allocations);
+   num_groups = pb_slabs_num_groups(slabs);
    slabs->groups = CALLOC(num_groups, sizeof(*slabs->groups));
    if (!slabs->groups)
       return false;
 
+   slabs->magazines = CALLOC(num_groups * PB_SLAB_NUM_MAGAZINES,
+                             sizeof(*slabs->magazines));
+   if (!slabs->magazines) {
+      FREE(slabs->groups);
+      return false;
+   }
+
    for (i = 0; i < num_groups; ++i) {
       struct pb_slab_group *group = &slabs->groups[i];
       list_inithead(&group->slabs);
@@ -285,12 +495,24 @@ pb_slabs_deinit(struct pb_slabs *slabs)
    /* Reclaim all slab entries (even those that are still in flight). This
     * implicitly calls slab_free for everything.
     */
+   pb_slabs_drain_magazines_locked(slabs);
+   pb_slabs_move_freed_locked(slabs);
+
    while (!list_is_empty(&slabs->reclaim)) {
       struct pb_slab_entry *entry =
          list_entry(slabs->reclaim.next, struct pb_slab_entry, head);
       pb_slab_reclaim(slabs, entry);
    }
 
+   unsigned num_magazines = pb_slabs_num_groups(slabs) * PB_SLAB_NUM_MAGAZINES;
+   for (unsigned i = 0; i < num_magazines; i++) {
+      if (slabs->magazines[i]) {
+         simple_mtx_destroy(&slabs->magazines[i]->mutex);
+         FREE(slabs->magazines[i]);
+      }
+   }
+
+   FREE(slabs->magazines);
    FREE(slabs->groups);
    simple_mtx_destroy(&slabs->mutex);
 }
@@ -52,6 +52,13 @@
 struct pb_slab;
 struct pb_slabs;
 struct pb_slab_group;
+struct pb_slab_magazine;
+
+/* Number of per-CPU magazines per group, and the maximum number of free
+ * entries each magazine can hold.
+ */
+#define PB_SLAB_NUM_MAGAZINES 8
+#define PB_SLAB_MAGAZINE_SIZE 8
 
 /* Descriptor of a slab entry.
  *
@@ -122,12 +129,29 @@ struct pb_slabs
    /* One group per (heap, order, three_fourth_allocations). */
    struct pb_slab_group *groups;
 
+   /* PB_SLAB_NUM_MAGAZINES magazines per group, indexed by
+    * group_index * PB_SLAB_NUM_MAGAZINES + CPU. Each magazine is allocated
+    * on first use and caches a few free entries, so that most allocations
+    * only take the magazine's lock instead of the shared mutex. Magazines
+    * are refilled from the group's slabs in batches, and drained back into
+    * the slabs by pb_slabs_reclaim and pb_slabs_deinit.
+    */
+   struct pb_slab_magazine **magazines;
+
    /* List of entries waiting to be reclaimed, i.e. they have been passed to
     * pb_slab_free, but may not be safe for re-use yet. The tail points at
     * the most-recently freed entry.
     */
    struct list_head reclaim;
 
+   /* Entries passed to pb_slab_free that haven't been moved to the reclaim
+    * list yet. This is a lock-free stack linked through
+    * pb_slab_entry::head.next, with the most-recently freed entry on top.
+    * Freeing doesn't take the mutex, and the whole stack is moved to the
+    * reclaim list at once when the mutex is held anyway.
+    */
+   struct list_head *freed;
+
    void *priv;
    slab_can_reclaim_fn *can_reclaim;
    slab_alloc_fn *slab_alloc;
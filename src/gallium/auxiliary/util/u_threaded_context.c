@@ -222,31 +222,37 @@ tc_batch_execute(void *job, UNUSED void *gdata, int thread_index)
 
    /* Add the fence to the list of fences for the driver to signal at the next
     * flush, which we use for tracking which buffers are referenced by
-    * an unflushed command buffer.
+    * an unflushed command buffer. If the next batch shares the buffer list,
+    * it's not complete yet.
     */
    struct threaded_context *tc = batch->tc;
-   struct util_queue_fence *fence =
-      &tc->buffer_lists[batch->buffer_list_index].driver_flushed_fence;
 
-   if (tc->options.driver_calls_flush_notify) {
-      tc->signal_fences_next_flush[tc->num_signal_fences_next_flush++] = fence;
+   if (batch->closes_buffer_list) {
+      struct util_queue_fence *fence =
+         &tc->buffer_lists[batch->buffer_list_index].driver_flushed_fence;
 
-      /* Since our buffer lists are chained as a ring, we need to flush
-       * the context twice as we go around the ring to make the driver signal
-       * the buffer list fences, so that the producer thread can reuse the buffer
-       * list structures for the next batches without waiting.
-       */
-      unsigned half_ring = TC_MAX_BUFFER_LISTS / 2;
-      if (batch->buffer_list_index % half_ring == half_ring - 1)
-         pipe->flush(pipe, NULL, PIPE_FLUSH_ASYNC);
-   } else {
-      util_queue_fence_signal(fence);
+      if (tc->options.driver_calls_flush_notify) {
+         tc->signal_fences_next_flush[tc->num_signal_fences_next_flush++] = fence;
+
+         /* Since our buffer lists are chained as a ring, we need to flush
+          * the context twice as we go around the ring to make the driver signal
+          * the buffer list fences, so that the producer thread can reuse the buffer
+          * list structures for the next batches without waiting.
+          */
+         unsigned half_ring = TC_MAX_BUFFER_LISTS / 2;
+         if (batch->buffer_list_index % half_ring == half_ring - 1)
+            pipe->flush(pipe, NULL, PIPE_FLUSH_ASYNC);
+      } else {
+         util_queue_fence_signal(fence);
+      }
    }
 
    tc_clear_driver_thread(batch->tc);
    tc_batch_check(batch);
    batch->num_total_slots = 0;
    batch->last_mergeable_call = NULL;
+
+   p_atomic_inc(&tc->stats.num_batches);
 }
 
 static void
@@ -264,6 +270,7 @@ tc_begin_next_buffer_list(struct threaded_context *tc)
 
    tc->add_all_gfx_bindings_to_buffer_list = true;
    tc->add_all_compute_bindings_to_buffer_list = true;
+   tc->buffer_list_slots = 0;
 }
 
 static void
@@ -275,18 +282,63 @@ tc_batch_flush(struct threaded_context *tc)
    tc_batch_check(next);
    tc_debug_check(tc);
    tc->bytes_mapped_estimate = 0;
-   p_atomic_add(&tc->num_offloaded_slots, next->num_total_slots);
+   p_atomic_add(&tc->stats.num_offloaded_items, next->num_total_slots);
 
    if (next->token) {
       next->token->tc = NULL;
       tc_unflushed_batch_token_reference(&next->token, NULL);
    }
 
-   util_queue_add_job(&tc->queue, next, &next->fence, tc_batch_execute,
-                      NULL, 0);
+   /* The driver thread is idle if it has executed the last batch. The queue
+    * is full if the driver thread hasn't executed the batch that we are going
+    * to fill next, in which case util_queue_add_job waits.
+    */
+   bool idle = util_queue_fence_is_signalled(&tc->batch_slots[tc->last].fence);
+   bool stalled =
+      !util_queue_fence_is_signalled(&tc->batch_slots[(tc->next + 1) %
+                                                      TC_MAX_BATCHES].fence);
+
+   /* Flush smaller batches while the driver thread waits for work, so that
+    * it gets new calls sooner, and bigger batches while we wait for the
+    * driver thread, so that the queue overhead is lower.
+    */
+   if (idle)
+      tc->batch_slots_limit = MAX2(tc->batch_slots_limit / 2, TC_MIN_BATCH_SLOTS);
+   else if (stalled)
+      tc->batch_slots_limit = MIN2(tc->batch_slots_limit * 2, TC_SLOTS_PER_BATCH);
+   tc->stats.batch_size_limit = tc->batch_slots_limit;
+
+   /* Keep adding the next batches to the same buffer list until it holds
+    * about as many calls as a full batch. Buffer lists are thus counted in
+    * slots, and smaller batches don't make drivers with
+    * driver_calls_flush_notify flush their command buffer more often.
+    */
+   tc->buffer_list_slots += next->num_total_slots;
+   bool closes_buffer_list =
+      tc->buffer_list_slots + tc->batch_slots_limit > TC_SLOTS_PER_BATCH;
+   next->closes_buffer_list = closes_buffer_list;
+
+   if (unlikely(stalled)) {
+      int64_t start = os_time_get_nano();
+
+      MESA_TRACE_BEGIN("tc stall");
+      util_queue_add_job(&tc->queue, next, &next->fence, tc_batch_execute,
+                         NULL, 0);
+      MESA_TRACE_END();
+
+      p_atomic_add(&tc->stats.stall_time_ns, os_time_get_nano() - start);
+   } else {
+      util_queue_add_job(&tc->queue, next, &next->fence, tc_batch_execute,
+                         NULL, 0);
+   }
+
    tc->last = tc->next;
    tc->next = (tc->next + 1) % TC_MAX_BATCHES;
-   tc_begin_next_buffer_list(tc);
+
+   if (closes_buffer_list)
+      tc_begin_next_buffer_list(tc);
+   else
+      tc->batch_slots[tc->next].buffer_list_index = tc->next_buf_list;
 }
 
 /* This is the function that adds variable-sized calls into the current
@@ -302,7 +354,7 @@ tc_add_sized_call(struct threaded_context *tc, enum tc_call_id id,
    assert(num_slots <= TC_SLOTS_PER_BATCH);
    tc_debug_check(tc);
 
-   if (unlikely(next->num_total_slots + num_slots > TC_SLOTS_PER_BATCH)) {
+   if (unlikely(next->num_total_slots + num_slots > tc->batch_slots_limit)) {
       tc_batch_flush(tc);
       next = &tc->batch_slots[tc->next];
       tc_assert(next->num_total_slots == 0);
@@ -367,7 +419,7 @@ tc_enlarge_last_mergeable_call(struct threaded_context *tc, unsigned desired_num
 
    unsigned added_slots = desired_num_slots - call->num_slots;
 
-   if (unlikely(batch->num_total_slots + added_slots > TC_SLOTS_PER_BATCH))
+   if (unlikely(batch->num_total_slots + added_slots > tc->batch_slots_limit))
       return false;
 
    batch->num_total_slots += added_slots;
@@ -421,15 +473,16 @@ _tc_sync(struct threaded_context *tc, UNUSED const char *info, UNUSED const char
 
    /* .. and execute unflushed calls directly. */
    if (next->num_total_slots) {
-      p_atomic_add(&tc->num_direct_slots, next->num_total_slots);
+      p_atomic_add(&tc->stats.num_direct_items, next->num_total_slots);
       tc->bytes_mapped_estimate = 0;
+      next->closes_buffer_list = true;
       tc_batch_execute(next, NULL, 0);
       tc_begin_next_buffer_list(tc);
       synced = true;
    }
 
    if (synced) {
-      p_atomic_inc(&tc->num_syncs);
+      p_atomic_inc(&tc->stats.num_syncs);
 
       if (tc_strcmp(func, "tc_destroy") != 0) {
          tc_printf("sync %s %s", func, info);
@@ -3547,10 +3600,10 @@ tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
       while (num_draws) {
          struct tc_batch *next = &tc->batch_slots[tc->next];
 
-         int nb_slots_left = TC_SLOTS_PER_BATCH - next->num_total_slots;
+         int nb_slots_left = tc->batch_slots_limit - next->num_total_slots;
          /* If there isn't enough place for one draw, try to fill the next one */
          if (nb_slots_left < slots_for_one_draw)
-            nb_slots_left = TC_SLOTS_PER_BATCH;
+            nb_slots_left = tc->batch_slots_limit;
          const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
          /* How many draws can we fit in the current batch */
@@ -3600,10 +3653,10 @@ tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
       while (num_draws) {
          struct tc_batch *next = &tc->batch_slots[tc->next];
 
-         int nb_slots_left = TC_SLOTS_PER_BATCH - next->num_total_slots;
+         int nb_slots_left = tc->batch_slots_limit - next->num_total_slots;
          /* If there isn't enough place for one draw, try to fill the next one */
          if (nb_slots_left < slots_for_one_draw)
-            nb_slots_left = TC_SLOTS_PER_BATCH;
+            nb_slots_left = tc->batch_slots_limit;
          const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
          /* How many draws can we fit in the current batch */
@@ -3767,10 +3820,10 @@ tc_draw_vertex_state(struct pipe_context *_pipe,
    while (num_draws) {
       struct tc_batch *next = &tc->batch_slots[tc->next];
 
-      int nb_slots_left = TC_SLOTS_PER_BATCH - next->num_total_slots;
+      int nb_slots_left = tc->batch_slots_limit - next->num_total_slots;
       /* If there isn't enough place for one draw, try to fill the next one */
       if (nb_slots_left < slots_for_one_draw)
-         nb_slots_left = TC_SLOTS_PER_BATCH;
+         nb_slots_left = tc->batch_slots_limit;
       const int size_left_bytes = nb_slots_left * sizeof(struct tc_call_base);
 
       /* How many draws can we fit in the current batch */
@@ -4468,6 +4521,19 @@ tc_destroy(struct pipe_context *_pipe)
    FREE(tc);
 }
 
+/**
+ * Return the HUD counters of a threaded context, or NULL if the context
+ * isn't one.
+ */
+struct util_queue_monitoring *
+threaded_context_get_monitoring(struct pipe_context *pipe)
+{
+   if (!pipe || pipe->destroy != tc_destroy)
+      return NULL;
+
+   return &threaded_context(pipe)->stats;
+}
+
 static const tc_execute execute_func[TC_NUM_CALLS] = {
 #define CALL(name) tc_call_##name,
 #include "u_threaded_context_calls.h"
@@ -4560,6 +4626,10 @@ threaded_context_create(struct pipe_context *pipe,
    if (!util_queue_init(&tc->queue, "gdrv", TC_MAX_BATCHES - 2, 1, 0, NULL))
       goto fail;
 
+   tc->batch_slots_limit = TC_SLOTS_PER_BATCH;
+   tc->stats.queue = &tc->queue;
+   tc->stats.batch_size_limit = tc->batch_slots_limit;
+
    for (unsigned i = 0; i < TC_MAX_BATCHES; i++) {
 #if !defined(NDEBUG) && TC_DEBUG >= 1
       tc->batch_slots[i].sentinel = TC_SENTINEL;
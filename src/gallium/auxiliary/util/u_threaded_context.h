@@ -248,6 +248,15 @@ struct tc_unflushed_batch_token;
  */
 #define TC_SLOTS_PER_BATCH    1536
 
+/* The smallest number of slots at which batches are flushed.
+ *
+ * The flush size adapts between this and TC_SLOTS_PER_BATCH. It shrinks
+ * when the driver thread runs out of work and grows when the producer
+ * stalls on a full queue. Smaller batches share a buffer list, so they don't
+ * make drivers with driver_calls_flush_notify flush more often.
+ */
+#define TC_MIN_BATCH_SLOTS    (TC_SLOTS_PER_BATCH / 4)
+
 /* The buffer list queue is much deeper than the batch queue because buffer
  * lists need to stay around until the driver internally flushes its command
  * buffer.
@@ -432,6 +441,9 @@ struct tc_batch {
    uint16_t num_total_slots;
    uint16_t buffer_list_index;
 
+   /* Whether this is the last batch using its buffer list. */
+   bool closes_buffer_list;
+
    /* The last mergeable call that was added to this batch (i.e.
     * buffer subdata). This might be out-of-date or NULL.
     */
@@ -481,10 +493,11 @@ struct threaded_context {
 
    struct list_head unflushed_queries;
 
-   /* Counters for the HUD. */
-   unsigned num_offloaded_slots;
-   unsigned num_direct_slots;
-   unsigned num_syncs;
+   /* Counters for the HUD and driver queries. */
+   struct util_queue_monitoring stats;
+
+   /* Number of slots after which the current batch is flushed. */
+   unsigned batch_slots_limit;
 
    bool use_forced_staging_uploads;
    bool add_all_gfx_bindings_to_buffer_list;
@@ -525,6 +538,9 @@ struct threaded_context {
 
    unsigned last, next, next_buf_list;
 
+   /* Number of slots in the flushed batches using the current buffer list. */
+   unsigned buffer_list_slots;
+
    /* The list fences that the driver should signal after the next flush.
     * If this is empty, all driver command buffers have been flushed.
     */
@@ -567,6 +583,9 @@ threaded_context_flush(struct pipe_context *_pipe,
                        struct tc_unflushed_batch_token *token,
                        bool prefer_async);
 
+struct util_queue_monitoring *
+threaded_context_get_monitoring(struct pipe_context *pipe);
+
 void
 tc_draw_vbo(struct pipe_context *_pipe, const struct pipe_draw_info *info,
             unsigned drawid_offset,
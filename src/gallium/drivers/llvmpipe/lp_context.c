@@ -38,6 +38,7 @@
 #include "util/u_memory.h"
 #include "util/list.h"
 #include "util/u_upload_mgr.h"
+#include "util/u_threaded_context.h"
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -48,6 +49,7 @@
 #include "lp_setup.h"
 #include "lp_screen.h"
 #include "lp_fence.h"
+#include "lp_texture.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef EMBEDDED_DEVICE
@@ -319,7 +321,14 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    mtx_lock(&lp_screen->ctx_mutex);
    list_addtail(&llvmpipe->list, &lp_screen->ctx_list);
    mtx_unlock(&lp_screen->ctx_mutex);
-   return &llvmpipe->pipe;
+
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED))
+      return &llvmpipe->pipe;
+
+   /* Let the application thread run ahead of draw and binning. */
+   return threaded_context_create(&llvmpipe->pipe, &lp_screen->transfer_pool,
+                                  llvmpipe_replace_buffer_storage,
+                                  NULL, &llvmpipe->tc);
 
  fail:
    llvmpipe_destroy(&llvmpipe->pipe);
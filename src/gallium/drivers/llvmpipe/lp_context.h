@@ -183,6 +183,9 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    LLVMContextRef context;
 
+   /** The u_threaded_context wrapping this context, if any */
+   struct threaded_context *tc;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
@@ -206,5 +209,18 @@ llvmpipe_context( struct pipe_context *pipe )
    return (struct llvmpipe_context *)pipe;
 }
 
+/**
+ * Is "pipe", which created some object, this context or the
+ * u_threaded_context wrapping it?
+ */
+static inline bool
+llvmpipe_is_own_context(const struct llvmpipe_context *llvmpipe,
+                        const struct pipe_context *pipe)
+{
+   /* threaded_context starts with its pipe_context */
+   return pipe == &llvmpipe->pipe ||
+          (llvmpipe->tc && pipe == (const struct pipe_context *)llvmpipe->tc);
+}
+
 #endif /* LP_CONTEXT_H */
 
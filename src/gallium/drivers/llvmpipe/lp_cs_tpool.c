@@ -84,7 +84,7 @@ lp_cs_tpool_worker(void *data)
 }
 
 struct lp_cs_tpool *
-lp_cs_tpool_create(unsigned num_threads)
+lp_cs_tpool_create(unsigned num_threads, bool pin_threads)
 {
    struct lp_cs_tpool *pool = CALLOC_STRUCT(lp_cs_tpool);
 
@@ -103,6 +103,12 @@ lp_cs_tpool_create(unsigned num_threads)
       }
    }
    pool->num_threads = num_threads;
+
+   if (pin_threads) {
+      for (unsigned i = 0; i < num_threads; i++)
+         util_thread_pin_to_L3(pool->threads[i], i, num_threads);
+   }
+
    return pool;
 }
 
@@ -57,7 +57,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
                   const struct pipe_draw_start_count_bias *draws,
                   unsigned num_draws)
 {
-   if (!indirect && (!draws[0].count || !info->instance_count))
+   if (!indirect && (!info->instance_count ||
+                     (num_draws == 1 && !draws[0].count)))
       return;
 
    struct llvmpipe_context *lp = llvmpipe_context(pipe);
@@ -66,7 +66,12 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
+#define LP_MAX_THREADS 256
+
+/**
+ * Max number of scenes the rasterizer threads may work on at once.
+ */
+#define LP_MAX_INFLIGHT_SCENES 8
 
 
 /**
@@ -121,6 +121,21 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_fs_compile_stalls:         %u\n", lp_count.nr_fs_compile_stalls);
+      debug_printf("llvmpipe: total FS compile stall time:  %.2f sec\n", lp_count.fs_compile_stall_time / 1000000.0);
+
+      for (unsigned i = 0; i < LP_MAX_THREADS; i++) {
+         int64_t busy = lp_count.rast_busy_time[i];
+         int64_t idle = lp_count.rast_idle_time[i];
+
+         if (busy == 0 && idle == 0)
+            continue;
+
+         debug_printf("llvmpipe: rast thread %2u: busy %.3f sec, idle %.3f sec (%3.0f%%), %u bins stolen\n",
+                      i, busy / 1000000.0, idle / 1000000.0,
+                      100.0 * (float) idle / (float) (busy + idle),
+                      lp_count.nr_bins_stolen[i]);
+      }
 
    }
 }
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "lp_limits.h"
 
 /**
  * Various counters
@@ -64,10 +65,17 @@ struct lp_counters
    unsigned nr_non_empty_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_compile_stalls;
+   int64_t fs_compile_stall_time;  /**< waiting on the compile queue */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   /* Per rasterizer thread load balancing */
+   int64_t rast_busy_time[LP_MAX_THREADS];  /**< in microseconds */
+   int64_t rast_idle_time[LP_MAX_THREADS];  /**< waiting on other threads */
+   unsigned nr_bins_stolen[LP_MAX_THREADS];
 };
 
 
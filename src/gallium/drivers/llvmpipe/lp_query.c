@@ -340,13 +340,17 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
    }
 
    void *dst = (uint8_t *)lpr->data + offset;
+   const unsigned value_size = (result_type == PIPE_QUERY_TYPE_I64 ||
+                                result_type == PIPE_QUERY_TYPE_U64) ? 8 : 4;
+
+   util_range_add(resource, &lpr->base.valid_buffer_range,
+                  offset, offset + num_values * value_size);
 
    for (unsigned i = 0; i < num_values; i++) {
 
       if (i == 1) {
          value = value2;
-         dst = (char *)dst + ((result_type == PIPE_QUERY_TYPE_I64 ||
-                               result_type == PIPE_QUERY_TYPE_U64) ? 8 : 4);
+         dst = (char *)dst + value_size;
       }
       switch (result_type) {
       case PIPE_QUERY_TYPE_I32: {
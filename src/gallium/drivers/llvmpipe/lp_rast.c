@@ -26,6 +26,8 @@
  **************************************************************************/
 
 #include <limits.h>
+#include "util/u_atomic.h"
+#include "util/u_framebuffer.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -65,27 +67,107 @@ const float lp_sample_pos_4x[4][2] = { { 0.375, 0.125 },
                                        { 0.125, 0.625 },
                                        { 0.625, 0.875 } };
 
+/**
+ * Can the bins of the scene be rasterized while bins of the previous
+ * scenes are still in flight?  Bins of the same tile are always rasterized
+ * in order, so this is only about hazards spanning tiles: queries, shader
+ * writes to buffers/images, framebuffer changes and sampling from the
+ * previous render targets.
+ */
+static boolean
+lp_rast_scene_can_overlap(const struct lp_rasterizer *rast,
+                          const struct lp_scene *scene)
+{
+   if (rast->prev_exclusive ||
+       scene->had_queries ||
+       scene->writeable_resources)
+      return FALSE;
+
+   if (!util_framebuffer_state_equal(&rast->prev_fb, &scene->fb))
+      return FALSE;
+
+   for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] &&
+          lp_scene_is_resource_referenced(scene, scene->fb.cbufs[i]->texture))
+         return FALSE;
+   }
+
+   if (scene->fb.zsbuf &&
+       lp_scene_is_resource_referenced(scene, scene->fb.zsbuf->texture))
+      return FALSE;
+
+   return TRUE;
+}
+
+
 /**
  * Begin rasterizing a scene.
- * Called once per scene by one thread.
+ * Called once per scene by one thread, in scene order.
  */
 static void
 lp_rast_begin(struct lp_rasterizer *rast,
               struct lp_scene *scene)
 {
-   rast->curr_scene = scene;
-
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, MAX2(1, rast->num_threads));
+
+   if (rast->num_threads == 0)
+      return;
+
+   scene->wait_previous = !lp_rast_scene_can_overlap(rast, scene);
+   scene->wait_bins = rast->bins_issued;
+
+   for (unsigned q = 0; q < scene->num_queues; q++) {
+      for (unsigned i = scene->queues[q].head; i < scene->queues[q].tail; i++) {
+         unsigned idx = scene->bin_order[i];
+         scene->tiles[idx].ticket = rast->tile_issued[idx]++;
+         rast->bins_issued++;
+      }
+   }
+
+   memcpy(&rast->prev_fb, &scene->fb, sizeof scene->fb);
+   rast->prev_exclusive = scene->had_queries ||
+                          scene->writeable_resources != NULL;
+}
+
+
+/**
+ * Block until *counter has reached value, i.e. until enough bins have
+ * been retired by the other threads.
+ */
+static void
+lp_rast_wait_retired(struct lp_rasterizer *rast,
+                     const unsigned *counter, unsigned value)
+{
+   if ((int)(p_atomic_read(counter) - value) >= 0)
+      return;
+
+   mtx_lock(&rast->retire_mutex);
+   p_atomic_inc(&rast->retire_waiters);
+   while ((int)(p_atomic_read(counter) - value) < 0)
+      cnd_wait(&rast->retire_cond, &rast->retire_mutex);
+   p_atomic_dec(&rast->retire_waiters);
+   mtx_unlock(&rast->retire_mutex);
 }
 
 
+/**
+ * Mark a bin as rasterized, unblocking the bins of later scenes which
+ * cover the same tile.
+ */
 static void
-lp_rast_end(struct lp_rasterizer *rast)
+lp_rast_retire_bin(struct lp_rasterizer *rast, unsigned idx)
 {
-   rast->curr_scene = NULL;
+   p_atomic_inc(&rast->tile_retired[idx]);
+   p_atomic_inc(&rast->bins_retired);
+
+   if (p_atomic_read(&rast->retire_waiters)) {
+      mtx_lock(&rast->retire_mutex);
+      cnd_broadcast(&rast->retire_cond);
+      mtx_unlock(&rast->retire_mutex);
+   }
 }
 
 
@@ -990,7 +1072,8 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y)
 {
-   struct lp_bin_info info = lp_characterize_bin(bin);
+   /* Characterized by lp_scene_bin_iter_begin() */
+   const struct lp_bin_info info = bin->info;
 
    lp_rast_tile_begin(task, bin, x, y);
 
@@ -1037,6 +1120,17 @@ is_empty_bin(const struct cmd_bin *bin)
 }
 
 
+/**
+ * Timestamp for the per-thread busy/idle counters, only taken when
+ * counters are enabled.
+ */
+static inline int64_t
+rast_counter_time(void)
+{
+   return (LP_DEBUG & DEBUG_COUNTERS) ? os_time_get() : 0;
+}
+
+
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -1045,6 +1139,9 @@ static void
 rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
+   struct lp_rasterizer *rast = task->rast;
+   const boolean ordered = rast->num_threads > 0;
+
    task->scene = scene;
 
    /* Clear the cache tags. This should not always be necessary but
@@ -1058,18 +1155,38 @@ rasterize_scene(struct lp_rasterizer_task *task,
 #endif
 #endif
 
-   if (!task->rast->no_rast) {
-      /* loop over scene bins, rasterize each */
-      {
-         struct cmd_bin *bin;
-         int i, j;
+   if (ordered && scene->wait_previous) {
+      int64_t t0 = rast_counter_time();
+      lp_rast_wait_retired(rast, &rast->bins_retired, scene->wait_bins);
+      LP_COUNT_ADD(rast_idle_time[task->thread_index],
+                   rast_counter_time() - t0);
+   }
 
-         assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin(bin))
-               rasterize_bin(task, bin, i, j);
-         }
+   /* loop over scene bins, rasterize each.  Bins are still retired in
+    * no_rast mode, to keep the following scenes going.
+    */
+   {
+      int64_t t0 = rast_counter_time();
+      struct cmd_bin *bin;
+      int i, j;
+
+      assert(scene);
+      while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                           &i, &j))) {
+         const unsigned idx = j * scene->tiles_x + i;
+
+         if (ordered)
+            lp_rast_wait_retired(rast, &rast->tile_retired[idx], bin->ticket);
+
+         if (!rast->no_rast && !is_empty_bin(bin))
+            rasterize_bin(task, bin, i, j);
+
+         if (ordered)
+            lp_rast_retire_bin(rast, idx);
       }
+
+      LP_COUNT_ADD(rast_busy_time[task->thread_index],
+                   rast_counter_time() - t0);
    }
 
 
@@ -1121,11 +1238,7 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
 
       rasterize_scene(&rast->tasks[0], scene);
 
-      lp_rast_end(rast);
-
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    }
    else {
       /* threaded rendering! */
@@ -1160,6 +1273,69 @@ lp_rast_finish(struct lp_rasterizer *rast)
 }
 
 
+/**
+ * Get the next scene for the thread to rasterize.  The first thread to
+ * get to a scene dequeues it and prepares it for rasterization, the
+ * others pick it up from rast->inflight[].
+ */
+static struct lp_scene *
+lp_rast_get_scene(struct lp_rasterizer_task *task)
+{
+   struct lp_rasterizer *rast = task->rast;
+   const unsigned seq = task->scene_seq++;
+   unsigned slot = seq % rast->num_inflight;
+   struct lp_scene *scene;
+
+   mtx_lock(&rast->inflight_mutex);
+
+   if (seq == rast->scenes_started) {
+      rast->scenes_started++;
+
+      /* Wait for all threads to be done with the scene in this slot */
+      while (rast->inflight[slot].pending)
+         cnd_wait(&rast->inflight_cond, &rast->inflight_mutex);
+      mtx_unlock(&rast->inflight_mutex);
+
+      scene = lp_scene_dequeue(rast->full_scenes, TRUE);
+      lp_rast_begin(rast, scene);
+
+      mtx_lock(&rast->inflight_mutex);
+      rast->inflight[slot].scene = scene;
+      rast->inflight[slot].seq = seq;
+      rast->inflight[slot].pending = rast->num_threads;
+      cnd_broadcast(&rast->inflight_cond);
+   } else {
+      while (rast->inflight[slot].seq != seq ||
+             !rast->inflight[slot].scene)
+         cnd_wait(&rast->inflight_cond, &rast->inflight_mutex);
+      scene = rast->inflight[slot].scene;
+   }
+
+   mtx_unlock(&rast->inflight_mutex);
+
+   return scene;
+}
+
+
+/**
+ * Called by each thread when done with the scene from lp_rast_get_scene().
+ */
+static void
+lp_rast_put_scene(struct lp_rasterizer_task *task)
+{
+   struct lp_rasterizer *rast = task->rast;
+   unsigned slot = (task->scene_seq - 1) % rast->num_inflight;
+
+   mtx_lock(&rast->inflight_mutex);
+   assert(rast->inflight[slot].pending > 0);
+   if (--rast->inflight[slot].pending == 0) {
+      rast->inflight[slot].scene = NULL;
+      cnd_broadcast(&rast->inflight_cond);
+   }
+   mtx_unlock(&rast->inflight_mutex);
+}
+
+
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
@@ -1193,33 +1369,23 @@ thread_function(void *init_data)
       if (rast->exit_flag)
          break;
 
-      if (task->thread_index == 0) {
-         /* thread[0]:
-          *  - get next scene to rasterize
-          *  - map the framebuffer surfaces
-          */
-         lp_rast_begin(rast, lp_scene_dequeue(rast->full_scenes, TRUE));
-      }
-
-      /* Wait for all threads to get here so that threads[1+] don't
-       * get a null rast->curr_scene pointer.
+      /* Threads don't wait for each other at the end of a scene: once
+       * all the bins of a scene have been taken, threads go on with the
+       * next one.  Bins of the same tile are still rasterized in scene
+       * order, see lp_rast_begin().
        */
-      util_barrier_wait(&rast->barrier);
+      int64_t t0 = rast_counter_time();
+      struct lp_scene *scene = lp_rast_get_scene(task);
+      LP_COUNT_ADD(rast_idle_time[task->thread_index],
+                   rast_counter_time() - t0);
 
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task, rast->curr_scene);
+      rasterize_scene(task, scene);
 
-      /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
-
-      /* XXX: shouldn't be necessary:
-       */
-      if (task->thread_index == 0) {
-         lp_rast_end(rast);
-      }
+      lp_rast_put_scene(task);
 
       /* signal done with work */
       if (debug)
@@ -1240,7 +1406,7 @@ thread_function(void *init_data)
  * Initialize semaphores and spawn the threads.
  */
 static void
-create_rast_threads(struct lp_rasterizer *rast)
+create_rast_threads(struct lp_rasterizer *rast, boolean pin_threads)
 {
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (unsigned i = 0; i < rast->num_threads; i++) {
@@ -1252,6 +1418,17 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   /* Consecutive threads get adjacent runs of bins (see
+    * lp_scene_bin_iter_begin()), so keeping them on the same L3 cache /
+    * socket makes neighbouring tiles likely to be rasterized there.  This
+    * is only a preference: stealing tries the neighbours first, but any
+    * thread may still end up with any bin.
+    */
+   if (pin_threads) {
+      for (unsigned i = 0; i < rast->num_threads; i++)
+         util_thread_pin_to_L3(rast->threads[i], i, rast->num_threads);
+   }
 }
 
 
@@ -1259,9 +1436,10 @@ create_rast_threads(struct lp_rasterizer *rast)
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
  * \param num_threads  number of rasterizer threads to create
+ * \param pin_threads  spread the threads over the L3 caches
  */
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads)
+lp_rast_create(unsigned num_threads, boolean pin_threads)
 {
    struct lp_rasterizer *rast;
    unsigned i;
@@ -1287,21 +1465,35 @@ lp_rast_create(unsigned num_threads)
       }
    }
 
+   if (num_threads > 0) {
+      rast->tile_issued = CALLOC(TILES_X * TILES_Y, sizeof(unsigned));
+      rast->tile_retired = CALLOC(TILES_X * TILES_Y, sizeof(unsigned));
+      if (!rast->tile_issued || !rast->tile_retired) {
+         goto no_tile_tickets;
+      }
+   }
+
    rast->num_threads = num_threads;
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
-   create_rast_threads(rast);
+   rast->num_inflight = debug_get_num_option("LP_RAST_SCENES", 4);
+   rast->num_inflight = CLAMP(rast->num_inflight, 1, LP_MAX_INFLIGHT_SCENES);
 
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_init(&rast->barrier, rast->num_threads);
-   }
+   (void) mtx_init(&rast->inflight_mutex, mtx_plain);
+   cnd_init(&rast->inflight_cond);
+   (void) mtx_init(&rast->retire_mutex, mtx_plain);
+   cnd_init(&rast->retire_cond);
+
+   create_rast_threads(rast, pin_threads);
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
    return rast;
 
+no_tile_tickets:
+   FREE(rast->tile_issued);
+   FREE(rast->tile_retired);
 no_thread_data_cache:
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
@@ -1360,10 +1552,13 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 
    lp_fence_reference(&rast->last_fence, NULL);
 
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_destroy(&rast->barrier);
-   }
+   cnd_destroy(&rast->retire_cond);
+   mtx_destroy(&rast->retire_mutex);
+   cnd_destroy(&rast->inflight_cond);
+   mtx_destroy(&rast->inflight_mutex);
+
+   FREE(rast->tile_issued);
+   FREE(rast->tile_retired);
 
    lp_scene_queue_destroy(rast->full_scenes);
 
@@ -97,6 +97,9 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** Sequence number of the next scene this thread will rasterize */
+   unsigned scene_seq;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
@@ -118,17 +121,46 @@ struct lp_rasterizer
    /** The incoming queue of scenes ready to rasterize */
    struct lp_scene_queue *full_scenes;
 
-   /** The scene currently being rasterized by the threads */
-   struct lp_scene *curr_scene;
-
    /** A task object for each rasterization thread */
    struct lp_rasterizer_task tasks[LP_MAX_THREADS];
 
    unsigned num_threads;
    thrd_t threads[LP_MAX_THREADS];
 
-   /** For synchronizing the rasterization threads */
-   util_barrier barrier;
+   /**
+    * Scenes being rasterized, indexed by scene sequence number modulo
+    * num_inflight.  Threads which run out of bins in one scene move on to
+    * the next one, so up to num_inflight scenes may be rasterized at the
+    * same time.  Protected by inflight_mutex.
+    */
+   struct {
+      struct lp_scene *scene;
+      unsigned seq;
+      unsigned pending;  /**< threads not yet done with the scene */
+   } inflight[LP_MAX_INFLIGHT_SCENES];
+   unsigned num_inflight;
+   unsigned scenes_started;
+   mtx_t inflight_mutex;
+   cnd_t inflight_cond;
+
+   /**
+    * Bin ordering across in-flight scenes.  Each non-empty bin gets a
+    * ticket from tile_issued[] when its scene is started, and may only be
+    * rasterized once tile_retired[] for its tile reaches that ticket.
+    * Scenes which can't safely overlap with the previous ones wait for
+    * bins_retired to reach the number of bins issued before them.
+    */
+   unsigned *tile_issued;
+   unsigned *tile_retired;
+   unsigned bins_issued;
+   unsigned bins_retired;
+   unsigned retire_waiters;
+   mtx_t retire_mutex;
+   cnd_t retire_cond;
+
+   /** State of the last started scene, for hazard checks */
+   struct pipe_framebuffer_state prev_fb;  /**< unreferenced copy */
+   boolean prev_exclusive;  /**< had queries or writeable resources */
 
    struct lp_fence *last_fence;
 };
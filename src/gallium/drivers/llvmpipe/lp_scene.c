@@ -34,6 +34,7 @@
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 #include "lp_context.h"
 #include "lp_state_fs.h"
 
@@ -72,8 +73,10 @@ lp_scene_create(struct lp_setup_context *setup)
    scene->pipe = setup->pipe;
    scene->setup = setup;
    scene->data.head = &scene->data.first;
+   scene->max_size = LP_SCENE_MAX_SIZE;
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
+   for (unsigned i = 0; i < LP_MAX_THREADS; i++)
+      (void) mtx_init(&scene->queues[i].mutex, mtx_plain);
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -101,8 +104,10 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_scene_end_rasterization(scene);
-   mtx_destroy(&scene->mutex);
+   for (unsigned i = 0; i < LP_MAX_THREADS; i++)
+      mtx_destroy(&scene->queues[i].mutex);
    free(scene->tiles);
+   free(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -360,7 +365,7 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
 struct data_block *
 lp_scene_new_data_block( struct lp_scene *scene )
 {
-   if (scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
+   if (scene->scene_size + DATA_BLOCK_SIZE > scene->max_size) {
       if (0) debug_printf("%s: failed\n", __FUNCTION__);
       scene->alloc_failed = TRUE;
       return NULL;
@@ -541,61 +546,95 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Prepare the bin queues before rasterizing the scene.
+ *
+ * The non-empty bins are split, in raster order, into num_queues runs of
+ * roughly equal estimated cost (the command count reported by
+ * lp_characterize_bin()).  Keeping each run contiguous preserves some
+ * locality per thread; any remaining imbalance is handled by work stealing
+ * in lp_scene_bin_iter_next().
+ */
+void
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_queues)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned num_active = 0;
+   uint64_t total_cost = 0;
+
+   assert(num_queues >= 1 && num_queues <= LP_MAX_THREADS);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      struct cmd_bin *bin = &scene->tiles[i];
+
+      /* Empty bins just load and store the tile unchanged, skip them. */
+      if (bin->head == NULL)
+         continue;
+
+      bin->info = lp_characterize_bin(bin);
+      total_cost += bin->info.count;
+      scene->bin_order[num_active++] = i;
    }
-   return TRUE;
-}
 
+   uint64_t cost = 0;
+   unsigned pos = 0;
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
-{
-   scene->curr_x = scene->curr_y = -1;
+   for (unsigned q = 0; q < num_queues; q++) {
+      struct lp_bin_queue *queue = &scene->queues[q];
+      const uint64_t target = total_cost * (q + 1) / num_queues;
+
+      queue->head = pos;
+      while (pos < num_active &&
+             (cost < target || q == num_queues - 1)) {
+         cost += scene->tiles[scene->bin_order[pos]].info.count;
+         pos++;
+      }
+      queue->tail = pos;
+   }
+
+   scene->num_queues = num_queues;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Return pointer to next bin to be rendered by the given thread.
+ * Bins are taken from the head of the thread's own queue.  Once that is
+ * exhausted, bins are stolen from the tail of the other threads' queues.
+ * Returns NULL when there are no bins left at all.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned queue,
+                       int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   struct lp_bin_queue *own = &scene->queues[queue];
+   int idx = -1;
 
-   mtx_lock(&scene->mutex);
+   assert(queue < scene->num_queues);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+   mtx_lock(&own->mutex);
+   if (own->head < own->tail)
+      idx = scene->bin_order[own->head++];
+   mtx_unlock(&own->mutex);
+
+   for (unsigned i = 1; idx < 0 && i < scene->num_queues; i++) {
+      struct lp_bin_queue *victim =
+         &scene->queues[(queue + i) % scene->num_queues];
+
+      mtx_lock(&victim->mutex);
+      if (victim->head < victim->tail)
+         idx = scene->bin_order[--victim->tail];
+      mtx_unlock(&victim->mutex);
+
+      if (idx >= 0)
+         LP_COUNT(nr_bins_stolen[queue]);
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   if (idx < 0)
+      return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   *x = idx % scene->tiles_x;
+   *y = idx / scene->tiles_x;
+   return &scene->tiles[idx];
 }
 
 
@@ -619,6 +658,9 @@ void lp_scene_begin_binning(struct lp_scene *scene,
       scene->tiles = reallocarray(scene->tiles, num_required_tiles, sizeof(struct cmd_bin));
       if (!scene->tiles)
          return;
+      scene->bin_order = reallocarray(scene->bin_order, num_required_tiles, sizeof(unsigned));
+      if (!scene->bin_order)
+         return;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
    }
@@ -38,6 +38,7 @@
 #include "os/os_thread.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
+#include "lp_limits.h"
 
 struct lp_scene_queue;
 struct lp_rast_state;
@@ -59,9 +60,12 @@ struct lp_rast_state;
  */
 #define DATA_BLOCK_SIZE (64 * 1024)
 
-/* Scene temporary storage is clamped to this size:
+/* Scene temporary storage is initially clamped to this size.  The limit
+ * is raised, up to LP_SCENE_MAX_SIZE_LIMIT, while scenes keep running out
+ * of memory, see lp_setup_flush_and_restart().
  */
 #define LP_SCENE_MAX_SIZE (36*1024*1024)
+#define LP_SCENE_MAX_SIZE_LIMIT (16*LP_SCENE_MAX_SIZE)
 
 /* The maximum amount of texture storage referenced by a scene is
  * clamped to this size:
@@ -98,6 +102,19 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;  /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   struct lp_bin_info info;  /* computed by lp_scene_bin_iter_begin() */
+   unsigned ticket;          /* per-tile order across in-flight scenes */
+};
+
+
+/**
+ * Per-thread queue of bins to rasterize.  Each queue owns the range
+ * [head, tail) of lp_scene::bin_order.  The owning thread pops bins from
+ * the head, idle threads steal bins from the tail.
+ */
+struct lp_bin_queue {
+   mtx_t mutex;
+   unsigned head, tail;
 };
 
 
@@ -180,6 +197,9 @@ struct lp_scene {
     */
    unsigned scene_size;
 
+   /** Limit for scene_size, starting at LP_SCENE_MAX_SIZE */
+   unsigned max_size;
+
    /** Sum of sizes of all resources referenced by the scene.  Sums
     * all the textures read by the scene:
     */
@@ -194,11 +214,20 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /** Set by the rasterizer when the scene can't overlap with the
+    * previous scenes: rasterization waits until the wait_bins bins issued
+    * before this scene have all been retired.
+    */
+   boolean wait_previous;
+   unsigned wait_bins;
+
+   /** Per-thread bin queues, for iterating over bins */
+   struct lp_bin_queue queues[LP_MAX_THREADS];
+   unsigned num_queues;
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
+   unsigned *bin_order;  /**< indices of non-empty bins, num_alloced_tiles */
    struct data_block_list data;
 };
 
@@ -246,7 +275,7 @@ lp_scene_alloc(struct lp_scene *scene, unsigned size)
    if (LP_DEBUG & DEBUG_MEM)
       debug_printf("alloc %u block %u/%u tot %u/%u\n",
                    size, block->used, (unsigned)DATA_BLOCK_SIZE,
-                   scene->scene_size, LP_SCENE_MAX_SIZE);
+                   scene->scene_size, scene->max_size);
 
    if (block->used + size > DATA_BLOCK_SIZE) {
       block = lp_scene_new_data_block(scene);
@@ -280,7 +309,7 @@ lp_scene_alloc_aligned(struct lp_scene *scene, unsigned size,
       debug_printf("alloc %u block %u/%u tot %u/%u\n",
                    size + alignment - 1,
                    block->used, (unsigned)DATA_BLOCK_SIZE,
-                   scene->scene_size, LP_SCENE_MAX_SIZE);
+                   scene->scene_size, scene->max_size);
 
    if (block->used + size + alignment - 1 > DATA_BLOCK_SIZE) {
       block = lp_scene_new_data_block(scene);
@@ -395,10 +424,11 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_queues);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned queue,
+                       int *x, int *y);
 
 
 
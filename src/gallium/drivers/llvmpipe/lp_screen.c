@@ -840,6 +840,7 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    assert(texture->dt);
 
    if (texture->dt) {
+      _pipe = threaded_context_unwrap_sync(_pipe);
       if (_pipe)
          llvmpipe_flush_resource(_pipe, resource, 0, true, true, false, "frontbuffer");
       winsys->displaytarget_display(winsys, texture->dt, context_private, sub_box);
@@ -852,6 +853,9 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (util_queue_is_initialized(&screen->fs_compile_queue))
+      util_queue_destroy(&screen->fs_compile_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
@@ -869,6 +873,9 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    glsl_type_singleton_decref();
 
+   slab_destroy_parent(&screen->transfer_pool);
+   util_idalloc_mt_fini(&screen->buffer_ids);
+
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
    FREE(screen);
@@ -1002,13 +1009,14 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    if (screen->late_init_done)
       goto out;
 
-   screen->rast = lp_rast_create(screen->num_threads);
+   screen->rast = lp_rast_create(screen->num_threads, screen->pin_threads);
    if (!screen->rast) {
       ret = false;
       goto out;
    }
 
-   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads,
+                                         screen->pin_threads);
    if (!screen->cs_tpool) {
       lp_rast_destroy(screen->rast);
       ret = false;
@@ -1016,6 +1024,18 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    }
 
    lp_disk_cache_create(screen);
+
+   /* Compile fragment shader variants off the draw thread, which then only
+    * blocks when it starts binning with a variant that isn't ready yet.
+    */
+   unsigned num_compile_threads =
+      debug_get_num_option("LP_COMPILE_THREADS",
+                           MIN2(util_get_cpu_caps()->nr_cpus / 2, 4));
+   if (num_compile_threads)
+      util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                      num_compile_threads,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+
    screen->late_init_done = true;
 out:
    mtx_unlock(&screen->late_mutex);
@@ -1085,6 +1105,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 #endif
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+   screen->pin_threads = debug_get_bool_option("LP_PIN_THREADS", TRUE);
 
    lp_build_init(); /* get lp_native_vector_width initialised */
 
@@ -1097,5 +1118,9 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    (void) mtx_init(&screen->late_mutex, mtx_plain);
 
+   slab_create_parent(&screen->transfer_pool,
+                      sizeof(struct llvmpipe_transfer), 64);
+   util_idalloc_mt_init_tc(&screen->buffer_ids);
+
    return &screen->base;
 }
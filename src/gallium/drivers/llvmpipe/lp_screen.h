@@ -38,6 +38,9 @@
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
 #include "util/list.h"
+#include "util/slab.h"
+#include "util/u_idalloc.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
 
@@ -51,6 +54,7 @@ struct llvmpipe_screen
    struct sw_winsys *winsys;
 
    unsigned num_threads;
+   bool pin_threads;  /**< spread threads over the L3 caches / sockets */
 
    /* Increments whenever textures are modified.  Contexts can track this.
     */
@@ -62,6 +66,11 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Fragment shader variants are compiled here when initialized,
+    * see LP_COMPILE_THREADS.
+    */
+   struct util_queue fs_compile_queue;
+
    bool use_tgsi;
    bool allow_cl;
 
@@ -76,6 +85,10 @@ struct llvmpipe_screen
    struct disk_cache *disk_shader_cache;
    unsigned num_disk_shader_cache_hits;
    unsigned num_disk_shader_cache_misses;
+
+   /* For u_threaded_context */
+   struct slab_parent_pool transfer_pool;
+   struct util_idalloc_mt buffer_ids;
 };
 
 void lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
@@ -116,6 +116,7 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    setup->scene = setup->scenes[i];
    setup->scene->permit_linear_rasterizer = setup->permit_linear_rasterizer;
+   setup->scene->max_size = setup->scene_max_size;
    lp_scene_begin_binning(setup->scene, &setup->fb);
 }
 
@@ -212,6 +213,20 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
 
    lp_scene_end_binning(scene);
 
+   /* Lower the scene size limit again once a run of scenes has been using
+    * only a fraction of it.
+    */
+   if (setup->scene_max_size > LP_SCENE_MAX_SIZE) {
+      if (scene->scene_size < setup->scene_max_size / 4) {
+         if (++setup->num_small_scenes >= 16) {
+            setup->scene_max_size /= 2;
+            setup->num_small_scenes = 0;
+         }
+      } else {
+         setup->num_small_scenes = 0;
+      }
+   }
+
    mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
    mtx_unlock(&screen->rast_mutex);
@@ -1315,6 +1330,12 @@ try_update_scene_state(struct lp_setup_context *setup)
    }
 
    if (setup->dirty & LP_SETUP_NEW_FS) {
+      /* The variant may still be compiling on the screen's compile queue,
+       * binning needs all of it.
+       */
+      llvmpipe_fs_variant_wait(llvmpipe_context(setup->pipe),
+                               setup->fs.current.variant);
+
       if (!setup->fs.stored ||
           memcmp(setup->fs.stored,
                  &setup->fs.current,
@@ -1580,6 +1601,8 @@ lp_setup_create(struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
+   setup->scene_max_size = LP_SCENE_MAX_SIZE;
+
    slab_create(&setup->scene_slab,
                sizeof(struct lp_scene),
                INITIAL_SCENES);
@@ -1748,6 +1771,15 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 
    assert(setup->state == SETUP_ACTIVE);
 
+   /* If the scene ran out of memory, let the following scenes grow larger
+    * instead of flushing over and over in the middle of large draws.
+    */
+   if (lp_scene_is_oom(setup->scene) &&
+       setup->scene_max_size < LP_SCENE_MAX_SIZE_LIMIT) {
+      setup->scene_max_size *= 2;
+      setup->num_small_scenes = 0;
+   }
+
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
       return FALSE;
 
@@ -95,6 +95,8 @@ struct lp_setup_context
    int num_active_scenes;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
+   unsigned scene_max_size;              /**< adaptive lp_scene::max_size */
+   unsigned num_small_scenes;            /**< for shrinking scene_max_size */
 
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
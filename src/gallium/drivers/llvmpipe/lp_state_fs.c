@@ -1063,12 +1063,18 @@ generate_fs_loop(struct gallivm_state *gallivm,
    params.aniso_filter_table = lp_jit_context_aniso_filter_table(gallivm, context_type, context_ptr);
 
    /* Build the actual shader */
-   if (shader->base.type == PIPE_SHADER_IR_TGSI)
+   if (shader->base.type == PIPE_SHADER_IR_TGSI) {
       lp_build_tgsi_soa(gallivm, tokens, &params,
                         outputs);
-   else
-      lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
+   } else {
+      /* Variants may be compiled concurrently, and turning NIR into LLVM IR
+       * modifies the shader.
+       */
+      nir_shader *clone = nir_shader_clone(NULL, shader->base.ir.nir);
+      lp_build_nir_soa(gallivm, clone, &params,
                        outputs);
+      ralloc_free(clone);
+   }
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -3726,13 +3732,14 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 
 
 /**
- * Generate a new fragment shader variant from the shader code and
- * other state indicated by the key.
+ * Create a new fragment shader variant for the state indicated by the key.
+ * Only the cheap analysis of the key is done here, the code itself is
+ * generated by compile_variant().
  */
 static struct lp_fragment_shader_variant *
-generate_variant(struct llvmpipe_context *lp,
-                 struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+create_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key)
 {
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
@@ -3746,26 +3753,7 @@ generate_variant(struct llvmpipe_context *lp,
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_cached_code cached = { 0 };
-   unsigned char ir_sha1_cache_key[20];
-   bool needs_caching = false;
-   if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
-
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
-   }
-
-   char module_name[64];
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
+   util_queue_fence_init(&variant->ready);
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -3856,6 +3844,44 @@ generate_variant(struct llvmpipe_context *lp,
       }
    }
 
+   return variant;
+}
+
+
+/**
+ * Generate the code of a fragment shader variant.  This runs on the
+ * screen's compile queue when there is one, so it must only look at the
+ * variant and its shader, never at the context state.
+ *
+ * The gallivm state has already been created by compile_variant(); the
+ * disk cache lookup fills in the lp_cached_code it points to, which is
+ * only read once the module gets compiled.
+ */
+static void
+generate_variant_code(struct llvmpipe_context *lp,
+                      struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_cached_code *cached = variant->gallivm->cache;
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching = false;
+
+   /* Variants pre-warmed from the disk cache already come with code. */
+   if (shader->base.ir.nir && !cached->data_size) {
+      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+
+      lp_disk_cache_find_shader(screen, cached, ir_sha1_cache_key);
+      if (!cached->data_size)
+         needs_caching = true;
+   }
+
+   const boolean fullcolormask =
+         key->nr_cbufs == 1 &&
+         util_format_colormask_full(util_format_description(key->cbuf_format[0]),
+                                    key->blend.rt[0].colormask);
+
    /* Determine whether this shader + pipeline state is a candidate for
     * the linear path.
     */
@@ -3867,8 +3893,6 @@ generate_variant(struct llvmpipe_context *lp,
          (key->cbuf_format[0] == PIPE_FORMAT_B8G8R8A8_UNORM ||
           key->cbuf_format[0] == PIPE_FORMAT_B8G8R8X8_UNORM);
 
-   memcpy(&variant->key, key, sizeof *key);
-
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
@@ -3954,15 +3978,149 @@ generate_variant(struct llvmpipe_context *lp,
    }
 
    if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+      lp_disk_cache_insert_shader(screen, cached, ir_sha1_cache_key);
    }
 
    gallivm_free_ir(variant->gallivm);
+}
 
-   return variant;
+
+struct lp_fs_compile_job {
+   struct llvmpipe_context *lp;
+   struct lp_fragment_shader_variant *variant;
+   struct lp_cached_code cached;
+};
+
+
+static void
+fs_compile_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   int64_t t0 = os_time_get();
+   generate_variant_code(job->lp, variant);
+   variant->compile_time = os_time_get() - t0;
+}
+
+
+static void
+fs_compile_job_cleanup(void *data, void *gdata, int thread_index)
+{
+   FREE(data);
 }
 
 
+/**
+ * Generate the code of a new variant.  When the screen has a compile
+ * queue, this happens there in a private LLVM context and the caller must
+ * go through llvmpipe_fs_variant_wait() before the variant is binned.
+ * \p cached optionally holds code pre-warmed from the disk cache.
+ *
+ * The gallivm state is created right here so that a failure can be
+ * reported to the caller, which must then drop the variant.
+ */
+static bool
+compile_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader_variant *variant,
+                const struct lp_cached_code *cached)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_compile_job *job = NULL;
+
+   if (util_queue_is_initialized(&screen->fs_compile_queue)) {
+      job = CALLOC_STRUCT(lp_fs_compile_job);
+      if (job) {
+         variant->context = LLVMContextCreate();
+         if (!variant->context) {
+            FREE(job);
+            job = NULL;
+         }
+      }
+   }
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+            variant->shader->no, variant->no);
+
+   if (job) {
+#if LLVM_VERSION_MAJOR >= 15
+      LLVMContextSetOpaquePointers(variant->context, false);
+#endif
+      job->lp = lp;
+      job->variant = variant;
+      if (cached)
+         job->cached = *cached;
+
+      /* On failure, this already freed the pre-warmed code. */
+      variant->gallivm = gallivm_create(module_name, variant->context,
+                                        &job->cached);
+      if (!variant->gallivm) {
+         FREE(job);
+         return false;
+      }
+
+      util_queue_add_job(&screen->fs_compile_queue, job, &variant->ready,
+                         fs_compile_job_execute, fs_compile_job_cleanup, 0);
+      return true;
+   }
+
+   struct lp_cached_code sync_cached = { 0 };
+   if (cached)
+      sync_cached = *cached;
+
+   variant->gallivm = gallivm_create(module_name, lp->context, &sync_cached);
+   if (!variant->gallivm)
+      return false;
+
+   int64_t t0 = os_time_get();
+   generate_variant_code(lp, variant);
+   variant->compile_time = os_time_get() - t0;
+   return true;
+}
+
+
+/**
+ * Wait until the code of a variant has been generated.  Everything but the
+ * key analysis done by create_variant() may still be in flight before this.
+ */
+void
+llvmpipe_fs_variant_wait(struct llvmpipe_context *lp,
+                         struct lp_fragment_shader_variant *variant)
+{
+   if (!variant || variant->accounted)
+      return;
+
+   if (!util_queue_fence_is_signalled(&variant->ready)) {
+      int64_t t0 = os_time_get();
+      util_queue_fence_wait(&variant->ready);
+      LP_COUNT(nr_fs_compile_stalls);
+      LP_COUNT_ADD(fs_compile_stall_time, os_time_get() - t0);
+   }
+
+   lp->nr_fs_instrs += variant->nr_instrs;
+   LP_COUNT_ADD(llvm_compile_time, variant->compile_time);
+   variant->accounted = true;
+}
+
+
+static void
+add_variant(struct llvmpipe_context *lp,
+            struct lp_fragment_shader *shader,
+            struct lp_fragment_shader_variant *variant)
+{
+   list_add(&variant->list_item_local.list, &shader->variants.list);
+   list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
+   lp->nr_fs_variants++;
+   shader->variants_cached++;
+}
+
+
+static void
+prewarm_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader *shader);
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -4083,6 +4241,13 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 
    lp_fs_reference(llvmpipe, &llvmpipe->fs, lp_fs);
 
+   /* Prewarm when the shader is first bound rather than when it's created:
+    * under u_threaded_context creation runs in the application thread, which
+    * must not look at the bound state.
+    */
+   if (lp_fs && !lp_fs->variants_created)
+      prewarm_variant(llvmpipe, lp_fs);
+
    /* invalidate the setup link, NEW_FS will make it update */
    lp_setup_set_fs_variant(llvmpipe->setup, NULL);
    llvmpipe->dirty |= LP_NEW_FS;
@@ -4106,6 +4271,9 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
+   /* Make sure the instruction count below has been accounted for. */
+   llvmpipe_fs_variant_wait(lp, variant);
+
    /* remove from shader's list */
    list_del(&variant->list_item_local.list);
    variant->shader->variants_cached--;
@@ -4121,7 +4289,13 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   util_queue_fence_wait(&variant->ready);
+   util_queue_fence_destroy(&variant->ready);
+
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
+   if (variant->context)
+      LLVMContextDispose(variant->context);
    lp_fs_reference(lp, &variant->shader, NULL);
    FREE(variant);
 }
@@ -4593,6 +4767,51 @@ make_variant_key(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Start loading the variant for the current state from the disk cache, as
+ * chances are the new shader will be drawn with it.  Variants which aren't
+ * cached are not compiled speculatively.
+ */
+static void
+prewarm_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader *shader)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   if (!shader->base.ir.nir ||
+       !screen->disk_shader_cache ||
+       !util_queue_is_initialized(&screen->fs_compile_queue) ||
+       !lp->rasterizer || !lp->depth_stencil || !lp->blend ||
+       lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS)
+      return;
+
+   char store[LP_FS_MAX_VARIANT_KEY_SIZE];
+   const struct lp_fragment_shader_variant_key *key =
+      make_variant_key(lp, shader, store);
+
+   struct lp_fragment_shader_variant *variant =
+      create_variant(lp, shader, key);
+   if (!variant)
+      return;
+
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+   lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+   if (!cached.data_size) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return;
+   }
+
+   if (!compile_variant(lp, variant, &cached)) {
+      lp_fs_variant_reference(lp, &variant, NULL);
+      return;
+   }
+
+   add_variant(lp, shader, variant);
+}
+
+
 /**
  * Update fragment shader state.  This is called just prior to drawing
  * something when some fragment-related state has changed.
@@ -4673,22 +4892,17 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       }
 
       /*
-       * Generate the new variant.
+       * Generate the new variant.  It goes into the lists right away so
+       * that later lookups find it while it's still being compiled, the
+       * wait only happens once setup starts binning with it.
        */
-      int64_t t0 = os_time_get();
-      variant = generate_variant(lp, shader, key);
-      int64_t t1 = os_time_get();
-      int64_t dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+      variant = create_variant(lp, shader, key);
+      if (variant && !compile_variant(lp, variant, NULL))
+         lp_fs_variant_reference(lp, &variant, NULL);
 
-      /* Put the new variant into the list */
       if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
-         lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
+         add_variant(lp, shader, variant);
+         LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
       }
    }
 
@@ -38,6 +38,7 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct tgsi_token;
@@ -201,6 +202,20 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Signalled once the code above has been generated.  This may happen
+    * asynchronously on the screen's compile queue, so everything after
+    * the cheap key analysis must only be read after
+    * llvmpipe_fs_variant_wait().
+    */
+   struct util_queue_fence ready;
+
+   /* Private LLVM context of variants compiled on the compile queue */
+   LLVMContextRef context;
+
+   /* Compile time, folded into the context's counters once waited on */
+   int64_t compile_time;
+   bool accounted;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
@@ -286,6 +301,10 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_fs_variant_wait(struct llvmpipe_context *lp,
+                         struct lp_fragment_shader_variant *variant);
+
 static inline void
 lp_fs_variant_reference(struct llvmpipe_context *llvmpipe,
                         struct lp_fragment_shader_variant **ptr,
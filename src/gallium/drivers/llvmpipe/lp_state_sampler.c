@@ -144,7 +144,7 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
        * (which is why we need the hack above in the first place).
        * An assert would be better but st/mesa relies on it...
        */
-      if (view && view->context != pipe) {
+      if (view && !llvmpipe_is_own_context(llvmpipe, view->context)) {
          debug_printf("Illegal setting of sampler_view %d created in another "
                       "context\n", i);
       }
@@ -82,7 +82,8 @@ llvmpipe_set_so_targets(struct pipe_context *pipe,
        * XXX Not entirely sure if mesa/st may rely on this?
        * Otherwise should just assert.
        */
-      if (targets[i] && targets[i]->context != pipe) {
+      if (targets[i] &&
+          !llvmpipe_is_own_context(llvmpipe, targets[i]->context)) {
          debug_printf("Illegal setting of so target with target %d created in "
                        "another context\n", i);
       }
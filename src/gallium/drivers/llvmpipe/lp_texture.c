@@ -41,6 +41,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_transfer.h"
+#include "draw/draw_context.h"
 
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -65,6 +66,30 @@ static mtx_t resource_list_mutex = _MTX_INITIALIZER_NP;
 static unsigned id_counter = 0;
 
 
+/**
+ * Initialize the u_threaded_context part of a new resource.
+ * Resources whose storage we don't own can't be reallocated by tc.
+ */
+static void
+llvmpipe_resource_init_threaded(struct llvmpipe_screen *screen,
+                                struct llvmpipe_resource *lpr,
+                                bool shared)
+{
+   struct pipe_resource *pt = &lpr->base.b;
+
+   threaded_resource_init(pt, false);
+
+   if (pt->target != PIPE_BUFFER)
+      return;
+
+   lpr->base.buffer_id_unique = util_idalloc_mt_alloc(&screen->buffer_ids);
+   lpr->base.is_shared = shared;
+   lpr->base.is_user_ptr = lpr->user_ptr;
+   if (shared || lpr->user_ptr)
+      util_range_add(pt, &lpr->base.valid_buffer_range, 0, pt->width0);
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -74,7 +99,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                         struct llvmpipe_resource *lpr,
                         boolean allocate)
 {
-   struct pipe_resource *pt = &lpr->base;
+   struct pipe_resource *pt = &lpr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -98,7 +123,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
     * for the virgl driver when host uses llvmpipe, causing Qemu and crosvm to
     * bail out on the KVM error.
     */
-   if (lpr->base.flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
+   if (lpr->base.b.flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
       os_get_page_size(&mip_align);
 
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
@@ -122,7 +147,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
          align_x = align_y = 1;
       else {
          align_x = LP_RASTER_BLOCK_SIZE;
-         if (llvmpipe_resource_is_1d(&lpr->base))
+         if (llvmpipe_resource_is_1d(&lpr->base.b))
             align_y = 1;
          else
             align_y = LP_RASTER_BLOCK_SIZE;
@@ -142,16 +167,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       lpr->img_stride[level] = (uint64_t)lpr->row_stride[level] * nblocksy;
 
       /* Number of 3D image slices, cube faces or texture array layers */
-      if (lpr->base.target == PIPE_TEXTURE_CUBE) {
+      if (lpr->base.b.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
       }
 
-      if (lpr->base.target == PIPE_TEXTURE_3D)
+      if (lpr->base.b.target == PIPE_TEXTURE_3D)
          num_slices = depth;
-      else if (lpr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_CUBE ||
-               lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
+      else if (lpr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
       else
          num_slices = 1;
@@ -201,7 +226,7 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct llvmpipe_resource lpr;
    memset(&lpr, 0, sizeof(lpr));
-   lpr.base = *res;
+   lpr.base.b = *res;
    if (!llvmpipe_texture_layout(llvmpipe_screen(screen), &lpr, false))
       return false;
 
@@ -219,12 +244,12 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size to
     * avoid tile clipping.
     */
-   const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-   const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+   const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+   const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
    lpr->dt = winsys->displaytarget_create(winsys,
-                                          lpr->base.bind,
-                                          lpr->base.format,
+                                          lpr->base.b.bind,
+                                          lpr->base.b.format,
                                           width, height,
                                           64,
                                           map_front_private,
@@ -244,15 +269,15 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    if (!lpr)
       return NULL;
 
-   lpr->base = *templat;
+   lpr->base.b = *templat;
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
-   /* assert(lpr->base.bind); */
+   /* assert(lpr->base.b.bind); */
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
-      if (lpr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
+      if (lpr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
                             PIPE_BIND_SCANOUT |
                             PIPE_BIND_SHARED)) {
          /* displayable surface */
@@ -303,6 +328,7 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    }
 
    lpr->id = id_counter++;
+   llvmpipe_resource_init_threaded(screen, lpr, false);
 
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
@@ -310,7 +336,7 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
    mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
  fail:
    FREE(lpr);
@@ -344,6 +370,7 @@ llvmpipe_resource_create_unbacked(struct pipe_screen *_screen,
       return pt;
    lpr = llvmpipe_resource(pt);
    lpr->backable = true;
+   lpr->base.is_shared = true;
    *size_required = lpr->size_required;
    return pt;
 }
@@ -389,13 +416,13 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_memory_object *lpmo = llvmpipe_memory_object(memobj);
    struct llvmpipe_resource *lpr = CALLOC_STRUCT(llvmpipe_resource);
-   lpr->base = *templat;
+   lpr->base.b = *templat;
 
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       /* texture map */
       if (!llvmpipe_texture_layout(screen, lpr, false))
          goto fail;
@@ -432,6 +459,7 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    }
    lpr->id = id_counter++;
    lpr->imported_memory = true;
+   llvmpipe_resource_init_threaded(screen, lpr, true);
 
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
@@ -439,7 +467,7 @@ llvmpipe_resource_from_memobj(struct pipe_screen *pscreen,
    mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 fail:
    free(lpr);
@@ -453,7 +481,11 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    struct llvmpipe_screen *screen = llvmpipe_screen(pscreen);
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
 
-   if (!lpr->backable && !lpr->user_ptr) {
+   if (lpr->storage) {
+      /* the data belongs to another buffer */
+      pipe_resource_reference(&lpr->storage, NULL);
+   }
+   else if (!lpr->backable && !lpr->user_ptr) {
       if (lpr->dt) {
          /* display target */
          struct sw_winsys *winsys = screen->winsys;
@@ -479,6 +511,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
    mtx_unlock(&resource_list_mutex);
 #endif
 
+   if (pt->target == PIPE_BUFFER)
+      util_idalloc_mt_free(&screen->buffer_ids, lpr->base.buffer_id_unique);
+   threaded_resource_deinit(pt);
+
    FREE(lpr);
 }
 
@@ -588,18 +624,18 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
       goto no_lpr;
    }
 
-   lpr->base = *template;
+   lpr->base.b = *template;
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = _screen;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = _screen;
 
    /*
     * Looks like unaligned displaytargets work just fine,
     * at least sampler/render ones.
     */
 #if 0
-   assert(lpr->base.width0 == width);
-   assert(lpr->base.height0 == height);
+   assert(lpr->base.b.width0 == width);
+   assert(lpr->base.b.height0 == height);
 #endif
 
    lpr->dt = winsys->displaytarget_from_handle(winsys,
@@ -611,6 +647,7 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
    }
 
    lpr->id = id_counter++;
+   llvmpipe_resource_init_threaded(screen, lpr, true);
 
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
@@ -618,7 +655,7 @@ llvmpipe_resource_from_handle(struct pipe_screen *_screen,
    mtx_unlock(&resource_list_mutex);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 no_dt:
    FREE(lpr);
@@ -657,12 +694,12 @@ llvmpipe_resource_from_user_memory(struct pipe_screen *_screen,
       return NULL;
    }
 
-   lpr->base = *resource;
+   lpr->base.b = *resource;
    lpr->screen = screen;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = _screen;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = _screen;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       if (!llvmpipe_texture_layout(screen, lpr, false))
          goto fail;
 
@@ -670,17 +707,38 @@ llvmpipe_resource_from_user_memory(struct pipe_screen *_screen,
    } else
       lpr->data = user_memory;
    lpr->user_ptr = true;
+   llvmpipe_resource_init_threaded(screen, lpr, false);
 #ifdef DEBUG
    mtx_lock(&resource_list_mutex);
    list_addtail(&lpr->list, &resource_list.list);
    mtx_unlock(&resource_list_mutex);
 #endif
-   return &lpr->base;
+   return &lpr->base.b;
 fail:
    FREE(lpr);
    return NULL;
 }
 
+/**
+ * Note that a bound constant buffer may have been written through a
+ * transfer.
+ */
+static void
+llvmpipe_check_constant_buffer_write(struct llvmpipe_context *llvmpipe,
+                                     struct pipe_resource *resource)
+{
+   if (!(resource->bind & PIPE_BIND_CONSTANT_BUFFER))
+      return;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
+      if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
+         /* constants may have changed */
+         llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+         break;
+      }
+   }
+}
+
 void *
 llvmpipe_transfer_map_ms( struct pipe_context *pipe,
                           struct pipe_resource *resource,
@@ -724,23 +782,18 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
+   /* Check if we're mapping a current constant buffer.  Threaded
+    * unsynchronized maps come from the application thread, which must not
+    * touch the context state; those are checked at unmap time instead.
+    */
    if ((usage & PIPE_MAP_WRITE) &&
-       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
-      unsigned i;
-      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
-         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
-            /* constants may have changed */
-            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
-            break;
-         }
-      }
-   }
+       !(usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      llvmpipe_check_constant_buffer_write(llvmpipe, resource);
 
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -772,7 +825,7 @@ llvmpipe_transfer_map_ms( struct pipe_context *pipe,
       printf("transfer map tex %u  mode %s\n", lpr->id, mode);
    }
 
-   format = lpr->base.format;
+   format = lpr->base.b.format;
 
    map = llvmpipe_resource_map(resource,
                                level,
@@ -814,6 +867,17 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 {
    assert(transfer->resource);
 
+   /* PIPE_MAP_THREAD_SAFE unmaps bypass the threaded context and run in
+    * whichever thread made them, so they can't look at the context state
+    * either.  Those are only used for glthread's upload buffers, which
+    * get bound through set_constant_buffer after they're written.
+    */
+   if ((transfer->usage & PIPE_MAP_WRITE) &&
+       (transfer->usage & TC_TRANSFER_MAP_THREADED_UNSYNC) &&
+       !(transfer->usage & PIPE_MAP_THREAD_SAFE))
+      llvmpipe_check_constant_buffer_write(llvmpipe_context(pipe),
+                                           transfer->resource);
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -844,6 +908,126 @@ llvmpipe_is_resource_referenced( struct pipe_context *pipe,
 }
 
 
+/**
+ * Update the state which caches pointers into a buffer's data after the
+ * buffer's storage was replaced.  Vertex and index buffers, as well as the
+ * textures and images of the draw module, are mapped at draw time.
+ */
+static void
+llvmpipe_rebind_buffer(struct llvmpipe_context *llvmpipe,
+                       struct pipe_resource *buffer)
+{
+   ubyte *data = llvmpipe_resource_data(buffer);
+
+   draw_flush(llvmpipe->draw);
+
+   for (unsigned sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      const bool draw_stage = sh != PIPE_SHADER_FRAGMENT &&
+                              sh != PIPE_SHADER_COMPUTE;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         const struct pipe_constant_buffer *cb = &llvmpipe->constants[sh][i];
+         if (cb->buffer != buffer)
+            continue;
+
+         if (draw_stage)
+            draw_set_mapped_constant_buffer(llvmpipe->draw, sh, i,
+                                            data + cb->buffer_offset,
+                                            cb->buffer_size);
+         else if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_CONSTANTS;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+      }
+
+      for (unsigned i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[sh]); i++) {
+         const struct pipe_shader_buffer *sb = &llvmpipe->ssbos[sh][i];
+         if (sb->buffer != buffer)
+            continue;
+
+         if (draw_stage)
+            draw_set_mapped_shader_buffer(llvmpipe->draw, sh, i,
+                                          data + sb->buffer_offset,
+                                          sb->buffer_size);
+         else if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_SSBOS;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_SSBOS;
+      }
+
+      if (draw_stage)
+         continue;
+
+      for (unsigned i = 0; i < llvmpipe->num_images[sh]; i++) {
+         if (llvmpipe->images[sh][i].resource != buffer)
+            continue;
+
+         if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_IMAGES;
+         else
+            llvmpipe->dirty |= LP_NEW_FS_IMAGES;
+      }
+
+      for (unsigned i = 0; i < llvmpipe->num_sampler_views[sh]; i++) {
+         const struct pipe_sampler_view *view = llvmpipe->sampler_views[sh][i];
+         if (!view || view->texture != buffer)
+            continue;
+
+         if (sh == PIPE_SHADER_COMPUTE)
+            llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+         else
+            llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+      }
+   }
+
+   for (int i = 0; i < llvmpipe->num_so_targets; i++) {
+      struct draw_so_target *target = llvmpipe->so_targets[i];
+      if (target && target->target.buffer == buffer)
+         target->mapping = data;
+   }
+}
+
+
+/**
+ * u_threaded_context callback: make "dst" use the storage of "src", which
+ * tc allocated to invalidate "dst" without waiting for the driver thread.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src,
+                                unsigned num_rebinds,
+                                uint32_t rebind_mask,
+                                uint32_t delete_buffer_id)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lp_dst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lp_src = llvmpipe_resource(src);
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(lp_dst->size_required == lp_src->size_required);
+   assert(!lp_dst->user_ptr && !lp_dst->imported_memory && !lp_dst->backable);
+
+   /* Binned scenes access the data through pointers set up at binning
+    * time, so the old storage must stay around until they are done.
+    * Only textures, shader buffers and images are referenced by scenes,
+    * vertex, index and constant buffers are consumed while binning.
+    */
+   llvmpipe_flush_resource(pipe, dst, 0, FALSE, TRUE, FALSE, __FUNCTION__);
+
+   if (!lp_dst->storage)
+      align_free(lp_dst->data);
+   lp_dst->data = lp_src->data;
+   pipe_resource_reference(&lp_dst->storage,
+                           lp_src->storage ? lp_src->storage : src);
+
+   llvmpipe_rebind_buffer(llvmpipe, dst);
+
+   util_idalloc_mt_free(&screen->buffer_ids, delete_buffer_id);
+}
+
+
 /**
  * Returns the largest possible alignment for a format in llvmpipe
  */
@@ -890,20 +1074,21 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
       return NULL;
 
    buffer->screen = llvmpipe_screen(screen);
-   pipe_reference_init(&buffer->base.reference, 1);
-   buffer->base.screen = screen;
-   buffer->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   buffer->base.bind = bind_flags;
-   buffer->base.usage = PIPE_USAGE_IMMUTABLE;
-   buffer->base.flags = 0;
-   buffer->base.width0 = bytes;
-   buffer->base.height0 = 1;
-   buffer->base.depth0 = 1;
-   buffer->base.array_size = 1;
+   pipe_reference_init(&buffer->base.b.reference, 1);
+   buffer->base.b.screen = screen;
+   buffer->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   buffer->base.b.bind = bind_flags;
+   buffer->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   buffer->base.b.flags = 0;
+   buffer->base.b.width0 = bytes;
+   buffer->base.b.height0 = 1;
+   buffer->base.b.depth0 = 1;
+   buffer->base.b.array_size = 1;
    buffer->user_ptr = true;
    buffer->data = ptr;
+   llvmpipe_resource_init_threaded(buffer->screen, buffer, false);
 
-   return &buffer->base;
+   return &buffer->base.b;
 }
 
 
@@ -928,7 +1113,7 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 {
    unsigned offset;
 
-   assert(llvmpipe_resource_is_texture(&lpr->base));
+   assert(llvmpipe_resource_is_texture(&lpr->base.b));
 
    offset = lpr->mip_offsets[level];
 
@@ -1015,7 +1200,7 @@ static bool llvmpipe_resource_bind_backing(struct pipe_screen *screen,
    if (!lpr->backable)
       return FALSE;
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
       if (lpr->size_required > LP_MAX_TEXTURE_SIZE)
          return FALSE;
 
@@ -1048,11 +1233,11 @@ llvmpipe_print_resources(void)
    debug_printf("LLVMPIPE: current resources:\n");
    mtx_lock(&resource_list_mutex);
    LIST_FOR_EACH_ENTRY(lpr, &resource_list.list, list) {
-      unsigned size = llvmpipe_resource_size(&lpr->base);
+      unsigned size = llvmpipe_resource_size(&lpr->base.b);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
                    lpr->id, (void *) lpr,
-                   lpr->base.width0, lpr->base.height0, lpr->base.depth0,
-                   size, lpr->base.reference.count);
+                   lpr->base.b.width0, lpr->base.b.height0, lpr->base.b.depth0,
+                   size, lpr->base.b.reference.count);
       total += size;
       n++;
    }
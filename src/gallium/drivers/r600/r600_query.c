@@ -145,13 +145,13 @@ static bool r600_query_sw_begin(struct r600_common_context *rctx,
 		query->begin_result = rctx->num_resident_handles;
 		break;
 	case R600_QUERY_TC_OFFLOADED_SLOTS:
-		query->begin_result = rctx->tc ? rctx->tc->num_offloaded_slots : 0;
+		query->begin_result = rctx->tc ? rctx->tc->stats.num_offloaded_items : 0;
 		break;
 	case R600_QUERY_TC_DIRECT_SLOTS:
-		query->begin_result = rctx->tc ? rctx->tc->num_direct_slots : 0;
+		query->begin_result = rctx->tc ? rctx->tc->stats.num_direct_items : 0;
 		break;
 	case R600_QUERY_TC_NUM_SYNCS:
-		query->begin_result = rctx->tc ? rctx->tc->num_syncs : 0;
+		query->begin_result = rctx->tc ? rctx->tc->stats.num_syncs : 0;
 		break;
 	case R600_QUERY_REQUESTED_VRAM:
 	case R600_QUERY_REQUESTED_GTT:
@@ -297,13 +297,13 @@ static bool r600_query_sw_end(struct r600_common_context *rctx,
 		query->end_result = rctx->num_resident_handles;
 		break;
 	case R600_QUERY_TC_OFFLOADED_SLOTS:
-		query->end_result = rctx->tc ? rctx->tc->num_offloaded_slots : 0;
+		query->end_result = rctx->tc ? rctx->tc->stats.num_offloaded_items : 0;
 		break;
 	case R600_QUERY_TC_DIRECT_SLOTS:
-		query->end_result = rctx->tc ? rctx->tc->num_direct_slots : 0;
+		query->end_result = rctx->tc ? rctx->tc->stats.num_direct_items : 0;
 		break;
 	case R600_QUERY_TC_NUM_SYNCS:
-		query->end_result = rctx->tc ? rctx->tc->num_syncs : 0;
+		query->end_result = rctx->tc ? rctx->tc->stats.num_syncs : 0;
 		break;
 	case R600_QUERY_REQUESTED_VRAM:
 	case R600_QUERY_REQUESTED_GTT:
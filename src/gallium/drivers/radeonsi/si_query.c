@@ -165,13 +165,13 @@ static bool si_query_sw_begin(struct si_context *sctx, struct si_query *squery)
       query->begin_result = sctx->num_resident_handles;
       break;
    case SI_QUERY_TC_OFFLOADED_SLOTS:
-      query->begin_result = sctx->tc ? sctx->tc->num_offloaded_slots : 0;
+      query->begin_result = sctx->tc ? sctx->tc->stats.num_offloaded_items : 0;
       break;
    case SI_QUERY_TC_DIRECT_SLOTS:
-      query->begin_result = sctx->tc ? sctx->tc->num_direct_slots : 0;
+      query->begin_result = sctx->tc ? sctx->tc->stats.num_direct_items : 0;
       break;
    case SI_QUERY_TC_NUM_SYNCS:
-      query->begin_result = sctx->tc ? sctx->tc->num_syncs : 0;
+      query->begin_result = sctx->tc ? sctx->tc->stats.num_syncs : 0;
       break;
    case SI_QUERY_REQUESTED_VRAM:
    case SI_QUERY_REQUESTED_GTT:
@@ -324,13 +324,13 @@ static bool si_query_sw_end(struct si_context *sctx, struct si_query *squery)
       query->end_result = sctx->num_resident_handles;
       break;
    case SI_QUERY_TC_OFFLOADED_SLOTS:
-      query->end_result = sctx->tc ? sctx->tc->num_offloaded_slots : 0;
+      query->end_result = sctx->tc ? sctx->tc->stats.num_offloaded_items : 0;
       break;
    case SI_QUERY_TC_DIRECT_SLOTS:
-      query->end_result = sctx->tc ? sctx->tc->num_direct_slots : 0;
+      query->end_result = sctx->tc ? sctx->tc->stats.num_direct_items : 0;
       break;
    case SI_QUERY_TC_NUM_SYNCS:
-      query->end_result = sctx->tc ? sctx->tc->num_syncs : 0;
+      query->end_result = sctx->tc ? sctx->tc->stats.num_syncs : 0;
       break;
    case SI_QUERY_REQUESTED_VRAM:
    case SI_QUERY_REQUESTED_GTT:
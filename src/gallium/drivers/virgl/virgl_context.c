@@ -40,6 +40,8 @@
 #include "util/slab.h"
 #include "util/u_upload_mgr.h"
 #include "util/u_blitter.h"
+#include "util/u_thread.h"
+#include "util/u_threaded_context.h"
 #include "tgsi/tgsi_text.h"
 #include "indices/u_primconvert.h"
 
@@ -63,6 +65,68 @@ uint32_t virgl_object_assign_handle(void)
    return p_atomic_inc_return(&next_handle);
 }
 
+static inline bool
+virgl_context_in_app_thread(struct virgl_context *vctx)
+{
+   return vctx->tc && !u_thread_is_self(vctx->tc->queue.threads[0]);
+}
+
+/* Makes the driver thread idle, so that the application thread may use the
+ * command buffer.  Only for the rare paths that need the result right away.
+ */
+void
+virgl_context_sync_app_thread(struct virgl_context *vctx)
+{
+   if (virgl_context_in_app_thread(vctx))
+      threaded_context_unwrap_sync(&vctx->tc->base);
+}
+
+struct virgl_deferred_encode {
+   struct virgl_context *vctx;
+   virgl_deferred_encode_func func;
+   /* followed by a copy of the data */
+};
+
+static void
+virgl_run_deferred_encode(void *data)
+{
+   struct virgl_deferred_encode *job = data;
+
+   job->func(job->vctx, job + 1);
+   FREE(job);
+}
+
+/* With a threaded context, objects are created (and surfaces, sampler views
+ * and stream output targets destroyed) in the application thread, while the
+ * driver thread may be encoding into the same command buffer.  Their
+ * commands are passed to the driver thread as a tc callback instead, which
+ * keeps them in order with the calls using the objects.  The data is copied,
+ * anything it points to must stay alive until func has run.
+ */
+void
+virgl_context_encode_deferred(struct virgl_context *vctx,
+                              virgl_deferred_encode_func func,
+                              const void *data, size_t size)
+{
+   struct virgl_deferred_encode *job = NULL;
+
+   if (virgl_context_in_app_thread(vctx))
+      job = MALLOC(sizeof(*job) + size);
+
+   if (!job) {
+      virgl_context_sync_app_thread(vctx);
+      func(vctx, (void *)data);
+      return;
+   }
+
+   job->vctx = vctx;
+   job->func = func;
+   memcpy(job + 1, data, size);
+
+   vctx->tc->base.callback(&vctx->tc->base, virgl_run_deferred_encode, job,
+                           true);
+}
+
 bool
 virgl_can_rebind_resource(struct virgl_context *vctx,
                           struct pipe_resource *res)
@@ -347,13 +411,22 @@ static void virgl_reemit_compute_resources(struct virgl_context *vctx)
    virgl_attach_res_atomic_buffers(vctx);
 }
 
+static void virgl_encode_create_surface(struct virgl_context *vctx,
+                                        void *data)
+{
+   struct virgl_surface *surf = *(struct virgl_surface **)data;
+   struct virgl_resource *res = virgl_resource(surf->base.texture);
+
+   virgl_resource_dirty(res, 0);
+   virgl_encoder_create_surface(vctx, surf->handle, res, &surf->base);
+}
+
 static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
                                                 struct pipe_resource *resource,
                                                 const struct pipe_surface *templ)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_surface *surf;
-   struct virgl_resource *res = virgl_resource(resource);
    uint32_t handle;
 
    /* no support for buffer surfaces */
@@ -369,7 +442,6 @@ static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
           (util_format_is_srgb(templ->format) ==
            util_format_is_srgb(resource->format)));
 
-   virgl_resource_dirty(res, 0);
    handle = virgl_object_assign_handle();
    pipe_reference_init(&surf->base.reference, 1);
    pipe_resource_reference(&surf->base.texture, resource);
@@ -383,31 +455,56 @@ static struct pipe_surface *virgl_create_surface(struct pipe_context *ctx,
    surf->base.u.tex.last_layer = templ->u.tex.last_layer;
    surf->base.nr_samples = templ->nr_samples;
 
-   virgl_encoder_create_surface(vctx, handle, res, &surf->base);
    surf->handle = handle;
+
+   virgl_context_encode_deferred(vctx, virgl_encode_create_surface,
+                                 &surf, sizeof(surf));
    return &surf->base;
 }
 
+static void virgl_encode_destroy_surface(struct virgl_context *vctx,
+                                         void *data)
+{
+   struct virgl_surface *surf = *(struct virgl_surface **)data;
+
+   pipe_resource_reference(&surf->base.texture, NULL);
+   virgl_encode_delete_object(vctx, surf->handle, VIRGL_OBJECT_SURFACE);
+   FREE(surf);
+}
+
 static void virgl_surface_destroy(struct pipe_context *ctx,
                                  struct pipe_surface *psurf)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_surface *surf = virgl_surface(psurf);
 
-   pipe_resource_reference(&surf->base.texture, NULL);
-   virgl_encode_delete_object(vctx, surf->handle, VIRGL_OBJECT_SURFACE);
-   FREE(surf);
+   virgl_context_encode_deferred(vctx, virgl_encode_destroy_surface,
+                                 &surf, sizeof(surf));
+}
+
+struct virgl_blend_state_encode {
+   uint32_t handle;
+   struct pipe_blend_state state;
+};
+
+static void virgl_encode_create_blend_state(struct virgl_context *vctx,
+                                            void *data)
+{
+   struct virgl_blend_state_encode *enc = data;
+   virgl_encode_blend_state(vctx, enc->handle, &enc->state);
 }
 
 static void *virgl_create_blend_state(struct pipe_context *ctx,
                                               const struct pipe_blend_state *blend_state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
-   uint32_t handle;
-   handle = virgl_object_assign_handle();
+   struct virgl_blend_state_encode enc;
+   enc.handle = virgl_object_assign_handle();
+   enc.state = *blend_state;
 
-   virgl_encode_blend_state(vctx, handle, blend_state);
-   return (void *)(unsigned long)handle;
+   virgl_context_encode_deferred(vctx, virgl_encode_create_blend_state,
+                                 &enc, sizeof(enc));
+   return (void *)(unsigned long)enc.handle;
 
 }
 
@@ -427,15 +524,29 @@ static void virgl_delete_blend_state(struct pipe_context *ctx,
    virgl_encode_delete_object(vctx, handle, VIRGL_OBJECT_BLEND);
 }
 
+struct virgl_dsa_state_encode {
+   uint32_t handle;
+   struct pipe_depth_stencil_alpha_state state;
+};
+
+static void virgl_encode_create_dsa_state(struct virgl_context *vctx,
+                                          void *data)
+{
+   struct virgl_dsa_state_encode *enc = data;
+   virgl_encode_dsa_state(vctx, enc->handle, &enc->state);
+}
+
 static void *virgl_create_depth_stencil_alpha_state(struct pipe_context *ctx,
                                                    const struct pipe_depth_stencil_alpha_state *blend_state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
-   uint32_t handle;
-   handle = virgl_object_assign_handle();
+   struct virgl_dsa_state_encode enc;
+   enc.handle = virgl_object_assign_handle();
+   enc.state = *blend_state;
 
-   virgl_encode_dsa_state(vctx, handle, blend_state);
-   return (void *)(unsigned long)handle;
+   virgl_context_encode_deferred(vctx, virgl_encode_create_dsa_state,
+                                 &enc, sizeof(enc));
+   return (void *)(unsigned long)enc.handle;
 }
 
 static void virgl_bind_depth_stencil_alpha_state(struct pipe_context *ctx,
@@ -454,6 +565,14 @@ static void virgl_delete_depth_stencil_alpha_state(struct pipe_context *ctx,
    virgl_encode_delete_object(vctx, handle, VIRGL_OBJECT_DSA);
 }
 
+static void virgl_encode_create_rasterizer_state(struct virgl_context *vctx,
+                                                 void *data)
+{
+   struct virgl_rasterizer_state *vrs =
+      *(struct virgl_rasterizer_state **)data;
+   virgl_encode_rasterizer_state(vctx, vrs->handle, &vrs->rs);
+}
+
 static void *virgl_create_rasterizer_state(struct pipe_context *ctx,
                                                    const struct pipe_rasterizer_state *rs_state)
 {
@@ -468,7 +587,8 @@ static void *virgl_create_rasterizer_state(struct pipe_context *ctx,
    assert(rs_state->depth_clip_near ||
           virgl_screen(ctx->screen)->caps.caps.v1.bset.depth_clip_disable);
 
-   virgl_encode_rasterizer_state(vctx, vrs->handle, rs_state);
+   virgl_context_encode_deferred(vctx, virgl_encode_create_rasterizer_state,
+                                 &vrs, sizeof(vrs));
    return (void *)vrs;
 }
 
@@ -513,6 +633,20 @@ static void virgl_set_viewport_states(struct pipe_context *ctx,
    virgl_encoder_set_viewport_states(vctx, start_slot, num_viewports, state);
 }
 
+struct virgl_vertex_elements_encode {
+   uint32_t handle;
+   unsigned num_elements;
+   struct pipe_vertex_element elements[PIPE_MAX_ATTRIBS];
+};
+
+static void virgl_encode_create_vertex_elements(struct virgl_context *vctx,
+                                                void *data)
+{
+   struct virgl_vertex_elements_encode *enc = data;
+   virgl_encoder_create_vertex_elements(vctx, enc->handle,
+                                        enc->num_elements, enc->elements);
+}
+
 static void *virgl_create_vertex_elements_state(struct pipe_context *ctx,
                                                         unsigned num_elements,
                                                         const struct pipe_vertex_element *elements)
@@ -539,9 +673,12 @@ static void *virgl_create_vertex_elements_state(struct pipe_context *ctx,
       }
    }
 
-   state->handle = virgl_object_assign_handle();
-   virgl_encoder_create_vertex_elements(vctx, state->handle,
-                                       num_elements, elements);
+   struct virgl_vertex_elements_encode enc;
+   enc.handle = state->handle = virgl_object_assign_handle();
+   enc.num_elements = num_elements;
+   memcpy(enc.elements, elements, num_elements * sizeof(*elements));
+   virgl_context_encode_deferred(vctx, virgl_encode_create_vertex_elements,
+                                 &enc, sizeof(enc));
    return state;
 }
 
@@ -698,6 +835,57 @@ lower_gles_arrayshadow_offset_filter(const nir_instr *instr,
    return false;
 }
 
+struct virgl_shader_encode {
+   uint32_t handle;
+   enum pipe_shader_type type;
+   struct pipe_stream_output_info so_info;
+   uint32_t cs_req_local_mem;
+   struct tgsi_token *tokens;
+};
+
+static void virgl_encode_create_shader(struct virgl_context *vctx,
+                                       void *data)
+{
+   struct virgl_shader_encode *enc = data;
+
+   if (virgl_encode_shader_state(vctx, enc->handle, enc->type,
+                                 &enc->so_info, enc->cs_req_local_mem,
+                                 enc->tokens))
+      debug_printf("VIRGL: failed to encode shader %u\n", enc->handle);
+
+   FREE(enc->tokens);
+}
+
+/* Takes ownership of the tokens.  Shaders created in the application thread
+ * are encoded later, so they can't report failures, which only happen when
+ * running out of memory.
+ */
+static int virgl_create_shader(struct virgl_context *vctx,
+                               uint32_t handle,
+                               enum pipe_shader_type type,
+                               const struct pipe_stream_output_info *so_info,
+                               uint32_t cs_req_local_mem,
+                               struct tgsi_token *tokens)
+{
+   if (!virgl_context_in_app_thread(vctx)) {
+      int ret = virgl_encode_shader_state(vctx, handle, type, so_info,
+                                          cs_req_local_mem, tokens);
+      FREE(tokens);
+      return ret;
+   }
+
+   struct virgl_shader_encode enc = {
+      .handle = handle,
+      .type = type,
+      .so_info = *so_info,
+      .cs_req_local_mem = cs_req_local_mem,
+      .tokens = tokens,
+   };
+   virgl_context_encode_deferred(vctx, virgl_encode_create_shader,
+                                 &enc, sizeof(enc));
+   return 0;
+}
+
 static void *virgl_shader_encoder(struct pipe_context *ctx,
                                   const struct pipe_shader_state *shader,
                                   unsigned type)
@@ -740,18 +928,16 @@ static void *virgl_shader_encoder(struct pipe_context *ctx,
    if (!new_tokens)
       return NULL;
 
+   FREE((void *)ntt_tokens);
+
    handle = virgl_object_assign_handle();
    /* encode VS state */
-   ret = virgl_encode_shader_state(vctx, handle, type,
-                                   &shader->stream_output, 0,
-                                   new_tokens);
-   if (ret) {
-      FREE((void *)ntt_tokens);
+   ret = virgl_create_shader(vctx, handle, type,
+                             &shader->stream_output, 0,
+                             new_tokens);
+   if (ret)
       return NULL;
-   }
 
-   FREE((void *)ntt_tokens);
-   FREE(new_tokens);
    return (void *)(unsigned long)handle;
 
 }
@@ -1046,6 +1232,16 @@ static void virgl_flush_from_st(struct pipe_context *ctx,
    virgl_flush_eq(vctx, vctx, fence);
 }
 
+static void virgl_encode_create_sampler_view(struct virgl_context *vctx,
+                                             void *data)
+{
+   struct virgl_sampler_view *grview = *(struct virgl_sampler_view **)data;
+
+   virgl_encode_sampler_view(vctx, grview->handle,
+                             virgl_resource(grview->base.texture),
+                             &grview->base);
+}
+
 static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *ctx,
                                       struct pipe_resource *texture,
                                       const struct pipe_sampler_view *state)
@@ -1053,7 +1249,6 @@ static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_sampler_view *grview;
    uint32_t handle;
-   struct virgl_resource *res;
 
    if (!state)
       return NULL;
@@ -1062,9 +1257,7 @@ static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *
    if (!grview)
       return NULL;
 
-   res = virgl_resource(texture);
    handle = virgl_object_assign_handle();
-   virgl_encode_sampler_view(vctx, handle, res, state);
 
    grview->base = *state;
    grview->base.reference.count = 1;
@@ -1073,6 +1266,9 @@ static struct pipe_sampler_view *virgl_create_sampler_view(struct pipe_context *
    grview->base.context = ctx;
    pipe_resource_reference(&grview->base.texture, texture);
    grview->handle = handle;
+
+   virgl_context_encode_deferred(vctx, virgl_encode_create_sampler_view,
+                                 &grview, sizeof(grview));
    return &grview->base;
 }
 
@@ -1127,27 +1323,50 @@ virgl_texture_barrier(struct pipe_context *ctx, unsigned flags)
    virgl_encode_texture_barrier(vctx, flags);
 }
 
+static void virgl_encode_destroy_sampler_view(struct virgl_context *vctx,
+                                              void *data)
+{
+   struct virgl_sampler_view *grview = *(struct virgl_sampler_view **)data;
+
+   virgl_encode_delete_object(vctx, grview->handle, VIRGL_OBJECT_SAMPLER_VIEW);
+   pipe_resource_reference(&grview->base.texture, NULL);
+   FREE(grview);
+}
+
 static void virgl_destroy_sampler_view(struct pipe_context *ctx,
                                  struct pipe_sampler_view *view)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_sampler_view *grview = virgl_sampler_view(view);
 
-   virgl_encode_delete_object(vctx, grview->handle, VIRGL_OBJECT_SAMPLER_VIEW);
-   pipe_resource_reference(&view->texture, NULL);
-   FREE(view);
+   virgl_context_encode_deferred(vctx, virgl_encode_destroy_sampler_view,
+                                 &grview, sizeof(grview));
+}
+
+struct virgl_sampler_state_encode {
+   uint32_t handle;
+   struct pipe_sampler_state state;
+};
+
+static void virgl_encode_create_sampler_state(struct virgl_context *vctx,
+                                              void *data)
+{
+   struct virgl_sampler_state_encode *enc = data;
+   virgl_encode_sampler_state(vctx, enc->handle, &enc->state);
 }
 
 static void *virgl_create_sampler_state(struct pipe_context *ctx,
                                         const struct pipe_sampler_state *state)
 {
    struct virgl_context *vctx = virgl_context(ctx);
-   uint32_t handle;
+   struct virgl_sampler_state_encode enc;
 
-   handle = virgl_object_assign_handle();
+   enc.handle = virgl_object_assign_handle();
+   enc.state = *state;
 
-   virgl_encode_sampler_state(vctx, handle, state);
-   return (void *)(unsigned long)handle;
+   virgl_context_encode_deferred(vctx, virgl_encode_create_sampler_state,
+                                 &enc, sizeof(enc));
+   return (void *)(unsigned long)enc.handle;
 }
 
 static void virgl_delete_sampler_state(struct pipe_context *ctx,
@@ -1246,8 +1465,8 @@ static void virgl_resource_copy_region(struct pipe_context *ctx,
    struct virgl_resource *dres = virgl_resource(dst);
    struct virgl_resource *sres = virgl_resource(src);
 
-   if (dres->b.target == PIPE_BUFFER)
-      util_range_add(&dres->b, &dres->valid_buffer_range, dstx, dstx + src_box->width);
+   if (dres->b.b.target == PIPE_BUFFER)
+      util_range_add(&dres->b.b, &dres->b.valid_buffer_range, dstx, dstx + src_box->width);
    virgl_resource_dirty(dres, dst_level);
 
    virgl_encode_resource_copy_region(vctx, dres,
@@ -1437,18 +1656,15 @@ static void *virgl_create_compute_state(struct pipe_context *ctx,
    if (!new_tokens)
       return NULL;
 
+   FREE((void *)ntt_tokens);
+
    handle = virgl_object_assign_handle();
-   ret = virgl_encode_shader_state(vctx, handle, PIPE_SHADER_COMPUTE,
-                                   &so_info,
-                                   state->req_local_mem,
-                                   new_tokens);
-   if (ret) {
-      FREE((void *)ntt_tokens);
+   ret = virgl_create_shader(vctx, handle, PIPE_SHADER_COMPUTE,
+                             &so_info,
+                             state->req_local_mem,
+                             new_tokens);
+   if (ret)
       return NULL;
-   }
-
-   FREE((void *)ntt_tokens);
-   FREE(new_tokens);
 
    return (void *)(unsigned long)handle;
 }
@@ -1525,6 +1741,9 @@ virgl_context_destroy( struct pipe_context *ctx )
    struct virgl_screen *rs = virgl_screen(ctx->screen);
    enum pipe_shader_type shader_type;
 
+   /* The threaded context has already gone idle and stopped its thread. */
+   vctx->tc = NULL;
+
    vctx->framebuffer.zsbuf = NULL;
    vctx->framebuffer.nr_cbufs = 0;
    virgl_encoder_destroy_sub_ctx(vctx, vctx->hw_sub_ctx_id);
@@ -1547,6 +1766,7 @@ virgl_context_destroy( struct pipe_context *ctx )
    virgl_transfer_queue_fini(&vctx->queue);
 
    slab_destroy_child(&vctx->transfer_pool);
+   slab_destroy_child(&vctx->transfer_pool_unsync);
    FREE(vctx);
 }
 
@@ -1601,13 +1821,20 @@ static void virgl_send_tweaks(struct virgl_context *vctx, struct virgl_screen *r
                          rs->tweak_gles_tf3_value);
 }
 
+static void virgl_encode_link_shader_cb(struct virgl_context *vctx,
+                                        void *data)
+{
+   virgl_encode_link_shader(vctx, data);
+}
+
 static void virgl_link_shader(struct pipe_context *ctx, void **handles)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    uint32_t shader_handles[PIPE_SHADER_TYPES];
    for (uint32_t i = 0; i < PIPE_SHADER_TYPES; ++i)
       shader_handles[i] = (uintptr_t)handles[i];
-   virgl_encode_link_shader(vctx, shader_handles);
+   virgl_context_encode_deferred(vctx, virgl_encode_link_shader_cb,
+                                 shader_handles, sizeof(shader_handles));
 }
 
 struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
@@ -1720,6 +1947,7 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
    virgl_init_so_functions(vctx);
 
    slab_create_child(&vctx->transfer_pool, &rs->transfer_pool);
+   slab_create_child(&vctx->transfer_pool_unsync, &rs->transfer_pool);
    virgl_transfer_queue_init(&vctx->queue, vctx);
    vctx->encoded_transfers = (rs->vws->supports_encoded_transfers &&
                        (rs->caps.caps.v2.capability_bits & VIRGL_CAP_TRANSFER));
@@ -1757,7 +1985,20 @@ struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
    if (rs->caps.caps.v2.capability_bits & VIRGL_CAP_APP_TWEAK_SUPPORT)
       virgl_send_tweaks(vctx, rs);
 
-   return &vctx->base;
+   /* Video decoding encodes from the application thread and is not wrapped
+    * by the threaded context.
+    */
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       !rs->vws->supports_threads ||
+       (virgl_debug & VIRGL_DEBUG_VIDEO))
+      return &vctx->base;
+
+   return threaded_context_create(&vctx->base, &rs->transfer_pool,
+                                  virgl_replace_buffer_storage,
+                                  &(struct threaded_context_options){
+                                     .is_resource_busy = virgl_is_resource_busy,
+                                  },
+                                  &vctx->tc);
 fail:
    virgl_context_destroy(&vctx->base);
    return NULL;
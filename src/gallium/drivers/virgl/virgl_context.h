@@ -32,6 +32,7 @@
 #include "virgl_transfer_queue.h"
 
 struct pipe_screen;
+struct threaded_context;
 struct tgsi_token;
 struct u_upload_mgr;
 struct virgl_cmd_buf;
@@ -79,6 +80,8 @@ struct virgl_context {
    struct pipe_framebuffer_state framebuffer;
 
    struct slab_child_pool transfer_pool;
+   /* for TC_TRANSFER_MAP_THREADED_UNSYNC maps in the application thread */
+   struct slab_child_pool transfer_pool_unsync;
    struct virgl_transfer_queue queue;
    struct u_upload_mgr *uploader;
    struct virgl_staging_mgr staging;
@@ -101,6 +104,8 @@ struct virgl_context {
 
    /* The total size of staging resources used in queued copy transfers. */
    uint64_t queued_staging_res_size;
+
+   struct threaded_context *tc;
 };
 
 static inline struct virgl_sampler_view *
@@ -123,6 +128,15 @@ static inline struct virgl_context *virgl_context(struct pipe_context *ctx)
 struct pipe_context *virgl_context_create(struct pipe_screen *pscreen,
                                           void *priv, unsigned flags);
 
+void virgl_context_sync_app_thread(struct virgl_context *vctx);
+
+typedef void (*virgl_deferred_encode_func)(struct virgl_context *vctx,
+                                           void *data);
+
+void virgl_context_encode_deferred(struct virgl_context *vctx,
+                                   virgl_deferred_encode_func func,
+                                   const void *data, size_t size);
+
 void virgl_init_blit_functions(struct virgl_context *vctx);
 void virgl_init_query_functions(struct virgl_context *vctx);
 void virgl_init_so_functions(struct virgl_context *vctx);
@@ -681,7 +681,7 @@ int virgl_encode_clear_texture(struct virgl_context *ctx,
                                const struct pipe_box *box,
                                const void *data)
 {
-   const struct util_format_description *desc = util_format_description(res->b.format);
+   const struct util_format_description *desc = util_format_description(res->b.b.format);
    unsigned block_bits = desc->block.bits;
    uint32_t arr[4] = {0};
    /* The spec describe <data> as a pointer to an array of between one
@@ -906,7 +906,7 @@ static void virgl_encoder_transfer3d_common(struct virgl_screen *vs,
                                             enum virgl_transfer3d_encode_stride encode_stride)
 
 {
-   struct pipe_transfer *transfer = &xfer->base;
+   struct pipe_transfer *transfer = &xfer->base.b;
    unsigned stride;
    unsigned layer_stride;
 
@@ -949,11 +949,11 @@ int virgl_encoder_inline_write(struct virgl_context *ctx,
    struct virgl_transfer transfer;
    struct virgl_screen *vs = virgl_screen(ctx->base.screen);
 
-   transfer.base.resource = &res->b;
+   transfer.base.b.resource = &res->b.b;
    transfer.hw_res = res->hw_res;
-   transfer.base.level = level;
-   transfer.base.usage = usage;
-   transfer.base.box = *box;
+   transfer.base.b.level = level;
+   transfer.base.b.usage = usage;
+   transfer.base.b.box = *box;
 
    length = 11 + (size + 3) / 4;
    if ((ctx->cbuf->cdw + length + 1) > VIRGL_ENCODE_MAX_DWORDS) {
@@ -972,13 +972,13 @@ int virgl_encoder_inline_write(struct virgl_context *ctx,
 
       length = MIN2(thispass, left_bytes);
 
-      transfer.base.box.width = length;
+      transfer.base.b.box.width = length;
       virgl_encoder_write_cmd_dword(ctx, VIRGL_CMD0(VIRGL_CCMD_RESOURCE_INLINE_WRITE, 0, ((length + 3) / 4) + 11));
       virgl_encoder_transfer3d_common(vs, ctx->cbuf, &transfer,
                                       virgl_transfer3d_host_inferred_stride);
       virgl_encoder_write_block(ctx->cbuf, data, length);
       left_bytes -= length;
-      transfer.base.box.x += length;
+      transfer.base.b.box.x += length;
       data += length;
    }
    return 0;
@@ -1037,7 +1037,7 @@ int virgl_encode_sampler_view(struct virgl_context *ctx,
    if (rs->caps.caps.v2.capability_bits & VIRGL_CAP_TEXTURE_VIEW)
      dword_fmt_target |= (state->target << 24);
    virgl_encoder_write_dword(ctx->cbuf, dword_fmt_target);
-   if (res->b.target == PIPE_BUFFER) {
+   if (res->b.b.target == PIPE_BUFFER) {
       virgl_encoder_write_dword(ctx->cbuf, state->u.buf.offset / elem_size);
       virgl_encoder_write_dword(ctx->cbuf, (state->u.buf.offset + state->u.buf.size) / elem_size - 1);
    } else {
@@ -1393,7 +1393,7 @@ int virgl_encode_set_shader_buffers(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, buffers[i].buffer_size);
          virgl_encoder_write_res(ctx, res);
 
-         util_range_add(&res->b, &res->valid_buffer_range, buffers[i].buffer_offset,
+         util_range_add(&res->b.b, &res->b.valid_buffer_range, buffers[i].buffer_offset,
                buffers[i].buffer_offset + buffers[i].buffer_size);
          virgl_resource_dirty(res, 0);
       } else {
@@ -1420,7 +1420,7 @@ int virgl_encode_set_hw_atomic_buffers(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, buffers[i].buffer_size);
          virgl_encoder_write_res(ctx, res);
 
-         util_range_add(&res->b, &res->valid_buffer_range, buffers[i].buffer_offset,
+         util_range_add(&res->b.b, &res->b.valid_buffer_range, buffers[i].buffer_offset,
                buffers[i].buffer_offset + buffers[i].buffer_size);
          virgl_resource_dirty(res, 0);
       } else {
@@ -1451,8 +1451,8 @@ int virgl_encode_set_shader_images(struct virgl_context *ctx,
          virgl_encoder_write_dword(ctx->cbuf, images[i].u.buf.size);
          virgl_encoder_write_res(ctx, res);
 
-         if (res->b.target == PIPE_BUFFER) {
-            util_range_add(&res->b, &res->valid_buffer_range, images[i].u.buf.offset,
+         if (res->b.b.target == PIPE_BUFFER) {
+            util_range_add(&res->b.b, &res->b.valid_buffer_range, images[i].u.buf.offset,
                   images[i].u.buf.offset + images[i].u.buf.size);
          }
          virgl_resource_dirty(res, images[i].u.tex.level);
@@ -1555,12 +1555,12 @@ void virgl_encode_transfer(struct virgl_screen *vs, struct virgl_cmd_buf *buf,
                            struct virgl_transfer *trans, uint32_t direction)
 {
    uint32_t command;
-   struct virgl_resource *vres = virgl_resource(trans->base.resource);
+   struct virgl_resource *vres = virgl_resource(trans->base.b.resource);
    enum virgl_transfer3d_encode_stride stride_type =
         virgl_transfer3d_host_inferred_stride;
 
-   if (trans->base.box.depth == 1 && trans->base.level == 0 &&
-       trans->base.resource->target == PIPE_TEXTURE_2D &&
+   if (trans->base.b.box.depth == 1 && trans->base.b.level == 0 &&
+       trans->base.b.resource->target == PIPE_TEXTURE_2D &&
        vres->blob_mem == VIRGL_BLOB_MEM_HOST3D_GUEST)
       stride_type = virgl_transfer3d_explicit_stride;
 
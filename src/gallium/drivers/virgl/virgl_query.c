@@ -30,6 +30,7 @@
 #include "virgl_screen.h"
 
 struct virgl_query {
+   struct threaded_query b;
    struct virgl_resource *buf;
    uint32_t handle;
    uint32_t result_size;
@@ -92,6 +93,20 @@ static void virgl_render_condition(struct pipe_context *ctx,
    virgl_encoder_render_condition(vctx, handle, condition, mode);
 }
 
+struct virgl_query_encode {
+   struct virgl_query *query;
+   uint32_t query_type;
+   unsigned index;
+};
+
+static void virgl_encode_create_query(struct virgl_context *vctx, void *data)
+{
+   struct virgl_query_encode *enc = data;
+
+   virgl_encoder_create_query(vctx, enc->query->handle, enc->query_type,
+                              enc->index, enc->query->buf, 0);
+}
+
 static struct pipe_query *virgl_create_query(struct pipe_context *ctx,
                                             unsigned query_type, unsigned index)
 {
@@ -114,12 +129,17 @@ static struct pipe_query *virgl_create_query(struct pipe_context *ctx,
    query->result_size = (query_type == PIPE_QUERY_TIMESTAMP ||
                          query_type == PIPE_QUERY_TIME_ELAPSED) ? 8 : 4;
 
-   util_range_add(&query->buf->b, &query->buf->valid_buffer_range, 0,
+   util_range_add(&query->buf->b.b, &query->buf->b.valid_buffer_range, 0,
                   sizeof(struct virgl_host_query_state));
    virgl_resource_dirty(query->buf, 0);
 
-   virgl_encoder_create_query(vctx, query->handle,
-         pipe_to_virgl_query(query_type), index, query->buf, 0);
+   struct virgl_query_encode enc = {
+      .query = query,
+      .query_type = pipe_to_virgl_query(query_type),
+      .index = index,
+   };
+   virgl_context_encode_deferred(vctx, virgl_encode_create_query,
+                                 &enc, sizeof(enc));
 
    return (struct pipe_query *)query;
 }
@@ -184,6 +204,11 @@ static bool virgl_get_query_result(struct pipe_context *ctx,
       volatile struct virgl_host_query_state *host_state;
       struct pipe_transfer *transfer = NULL;
 
+      /* With a threaded context, this may be called from the application
+       * thread once the query has been flushed.  The command buffer is only
+       * safe to look at once the driver thread is idle.
+       */
+      virgl_context_sync_app_thread(vctx);
       if (vs->vws->res_is_referenced(vs->vws, vctx->cbuf, query->buf->hw_res))
          ctx->flush(ctx, NULL, 0);
 
@@ -209,7 +234,7 @@ static bool virgl_get_query_result(struct pipe_context *ctx,
                return false;
          }
 
-         host_state = pipe_buffer_map(ctx, &query->buf->b,
+         host_state = pipe_buffer_map(ctx, &query->buf->b.b,
                PIPE_MAP_READ, &transfer);
       }
 
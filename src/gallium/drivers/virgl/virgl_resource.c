@@ -66,9 +66,9 @@ enum virgl_transfer_map_type {
 static bool virgl_can_readback_from_rendertarget(struct virgl_screen *vs,
                                                  struct virgl_resource *res)
 {
-   return res->b.nr_samples < 2 &&
-         vs->base.is_format_supported(&vs->base, res->b.format, res->b.target,
-                                      res->b.nr_samples, res->b.nr_samples,
+   return res->b.b.nr_samples < 2 &&
+         vs->base.is_format_supported(&vs->base, res->b.b.format, res->b.b.target,
+                                      res->b.b.nr_samples, res->b.b.nr_samples,
                                       PIPE_BIND_RENDER_TARGET);
 }
 
@@ -78,20 +78,20 @@ static bool virgl_can_readback_from_scanout(struct virgl_screen *vs,
 {
    return (vs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_SCANOUT_USES_GBM) &&
          (bind & VIRGL_BIND_SCANOUT) &&
-         virgl_has_scanout_format(vs, res->b.format, true);
+         virgl_has_scanout_format(vs, res->b.b.format, true);
 }
 
 static bool virgl_can_use_staging(struct virgl_screen *vs,
                                   struct virgl_resource *res)
 {
    return (vs->caps.caps.v2.capability_bits_v2 & VIRGL_CAP_V2_COPY_TRANSFER_BOTH_DIRECTIONS) &&
-         (res->b.target != PIPE_BUFFER);
+         (res->b.b.target != PIPE_BUFFER);
 }
 
 static bool is_stencil_array(struct virgl_resource *res)
 {
-   const struct util_format_description *descr = util_format_description(res->b.format);
-   return (res->b.array_size > 1 || res->b.depth0 > 1) && util_format_has_stencil(descr);
+   const struct util_format_description *descr = util_format_description(res->b.b.format);
+   return (res->b.b.array_size > 1 || res->b.b.depth0 > 1) && util_format_has_stencil(descr);
 }
 
 static bool virgl_can_copy_transfer_from_host(struct virgl_screen *vs,
@@ -100,7 +100,7 @@ static bool virgl_can_copy_transfer_from_host(struct virgl_screen *vs,
 {
    return virgl_can_use_staging(vs, res) &&
          !is_stencil_array(res) &&
-         virgl_has_readback_format(&vs->base, pipe_to_virgl_format(res->b.format), false) &&
+         virgl_has_readback_format(&vs->base, pipe_to_virgl_format(res->b.b.format), false) &&
          ((!(vs->caps.caps.v2.capability_bits & VIRGL_CAP_HOST_IS_GLES)) ||
           virgl_can_readback_from_rendertarget(vs, res) ||
           virgl_can_readback_from_scanout(vs, res, bind));
@@ -116,9 +116,9 @@ static bool virgl_res_needs_flush(struct virgl_context *vctx,
                                   struct virgl_transfer *trans)
 {
    struct virgl_winsys *vws = virgl_screen(vctx->base.screen)->vws;
-   struct virgl_resource *res = virgl_resource(trans->base.resource);
+   struct virgl_resource *res = virgl_resource(trans->base.b.resource);
 
-   if (trans->base.usage & PIPE_MAP_UNSYNCHRONIZED)
+   if (trans->base.b.usage & PIPE_MAP_UNSYNCHRONIZED)
       return false;
 
    if (!vws->res_is_referenced(vws, vctx->cbuf, res->hw_res))
@@ -157,14 +157,14 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
 {
    struct virgl_screen *vs = virgl_screen(vctx->base.screen);
    struct virgl_winsys *vws = vs->vws;
-   struct virgl_resource *res = virgl_resource(xfer->base.resource);
+   struct virgl_resource *res = virgl_resource(xfer->base.b.resource);
    enum virgl_transfer_map_type map_type = VIRGL_TRANSFER_MAP_HW_RES;
    bool flush;
    bool readback;
    bool wait;
 
    /* there is no way to map the host storage currently */
-   if (xfer->base.usage & PIPE_MAP_DIRECTLY)
+   if (xfer->base.b.usage & PIPE_MAP_DIRECTLY)
       return VIRGL_TRANSFER_MAP_ERROR;
 
    /* We break the logic down into four steps
@@ -176,21 +176,22 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
     */
 
    flush = virgl_res_needs_flush(vctx, xfer);
-   readback = virgl_res_needs_readback(vctx, res, xfer->base.usage,
-                                       xfer->base.level);
+   readback = virgl_res_needs_readback(vctx, res, xfer->base.b.usage,
+                                       xfer->base.b.level);
    /* We need to wait for all cmdbufs, current or previous, that access the
     * resource to finish unless synchronization is disabled.
     */
-   wait = !(xfer->base.usage & PIPE_MAP_UNSYNCHRONIZED);
+   wait = !(xfer->base.b.usage & PIPE_MAP_UNSYNCHRONIZED);
 
    /* When the transfer range consists of only uninitialized data, we can
     * assume the GPU is not accessing the range and readback is unnecessary.
     * We can proceed as if PIPE_MAP_UNSYNCHRONIZED and
     * PIPE_MAP_DISCARD_RANGE are set.
     */
-   if (res->b.target == PIPE_BUFFER &&
-       !util_ranges_intersect(&res->valid_buffer_range, xfer->base.box.x,
-                              xfer->base.box.x + xfer->base.box.width) &&
+   if (res->b.b.target == PIPE_BUFFER &&
+       !(xfer->base.b.usage & TC_TRANSFER_MAP_NO_INFER_UNSYNCHRONIZED) &&
+       !util_ranges_intersect(&res->b.valid_buffer_range, xfer->base.b.box.x,
+                              xfer->base.b.box.x + xfer->base.b.box.width) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER))) {
       flush = false;
       readback = false;
@@ -201,7 +202,7 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
     * replace its HW resource or use a staging buffer to avoid waiting.
     */
    if (wait &&
-       (xfer->base.usage & (PIPE_MAP_DISCARD_RANGE |
+       (xfer->base.b.usage & (PIPE_MAP_DISCARD_RANGE |
                             PIPE_MAP_DISCARD_WHOLE_RESOURCE)) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER))) {
       bool can_realloc = false;
@@ -212,8 +213,8 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
        * otherwise those following unsynchronized transfers may overwrite
        * valid data.
        */
-      if (xfer->base.usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE) {
-         can_realloc = virgl_can_rebind_resource(vctx, &res->b);
+      if (xfer->base.b.usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE) {
+         can_realloc = virgl_can_rebind_resource(vctx, &res->b.b);
       }
 
       /* discard implies no readback */
@@ -248,16 +249,19 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
        * copy_transfer_from_host, then we can return here with proper map.
        */
       if (res->use_staging) {
-         if (xfer->base.usage & PIPE_MAP_READ)
+         if (xfer->base.b.usage & PIPE_MAP_READ)
             return VIRGL_TRANSFER_MAP_READ_FROM_STAGING;
          else
             return VIRGL_TRANSFER_MAP_WRITE_TO_STAGING_WITH_READBACK;
       }
 
       /* When the transfer queue has pending writes to this transfer's region,
-       * we have to flush before readback.
+       * we have to flush before readback.  The queue belongs to the driver
+       * thread and cannot be looked at from a threaded unsynchronized map.
        */
-      if (!flush && virgl_transfer_queue_is_queued(&vctx->queue, xfer))
+      if (!flush &&
+          !(xfer->base.b.usage & TC_TRANSFER_MAP_THREADED_UNSYNC) &&
+          virgl_transfer_queue_is_queued(&vctx->queue, xfer))
          flush = true;
    }
 
@@ -271,7 +275,7 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
     * during which another unsynchronized map could write to the resource
     * contents, leaving the contents in an undefined state.
     */
-   if ((xfer->base.usage & PIPE_MAP_DONTBLOCK) &&
+   if ((xfer->base.b.usage & PIPE_MAP_DONTBLOCK) &&
        (readback || (wait && vws->resource_is_busy(vws, res->hw_res))))
       return VIRGL_TRANSFER_MAP_ERROR;
 
@@ -281,8 +285,8 @@ virgl_resource_transfer_prepare(struct virgl_context *vctx,
        * PIPE_MAP_UNSYNCHRONIZED is set.
        */
       vws->resource_wait(vws, res->hw_res);
-      vws->transfer_get(vws, res->hw_res, &xfer->base.box, xfer->base.stride,
-                        xfer->l_stride, xfer->offset, xfer->base.level);
+      vws->transfer_get(vws, res->hw_res, &xfer->base.b.box, xfer->base.b.stride,
+                        xfer->l_stride, xfer->offset, xfer->base.b.level);
       /* transfer_get puts the resource into a maybe_busy state, so we will have
        * to wait another time if we want to use that resource. */
       wait = true;
@@ -307,8 +311,8 @@ virgl_transfer_map_size(struct virgl_transfer *vtransfer,
                         unsigned *out_stride,
                         unsigned *out_layer_stride)
 {
-   struct pipe_resource *pres = vtransfer->base.resource;
-   struct pipe_box *box = &vtransfer->base.box;
+   struct pipe_resource *pres = vtransfer->base.b.resource;
+   struct pipe_box *box = &vtransfer->base.b.box;
    unsigned stride;
    unsigned layer_stride;
    unsigned size;
@@ -341,7 +345,7 @@ static void *
 virgl_staging_map(struct virgl_context *vctx,
                   struct virgl_transfer *vtransfer)
 {
-   struct virgl_resource *vres = virgl_resource(vtransfer->base.resource);
+   struct virgl_resource *vres = virgl_resource(vtransfer->base.b.resource);
    unsigned size;
    unsigned align_offset;
    unsigned stride;
@@ -366,8 +370,8 @@ virgl_staging_map(struct virgl_context *vctx,
     *         |---|             ==> align_offset
     *         |------------|    ==> allocation of size + align_offset
     */
-   align_offset = vres->b.target == PIPE_BUFFER ?
-                  vtransfer->base.box.x % VIRGL_MAP_BUFFER_ALIGNMENT :
+   align_offset = vres->b.b.target == PIPE_BUFFER ?
+                  vtransfer->base.b.box.x % VIRGL_MAP_BUFFER_ALIGNMENT :
                   0;
 
    alloc_succeeded =
@@ -386,14 +390,14 @@ virgl_staging_map(struct virgl_context *vctx,
        * without going through the corresponding guest side resource, and
        * hence the two will diverge.
        */
-      virgl_resource_dirty(vres, vtransfer->base.level);
+      virgl_resource_dirty(vres, vtransfer->base.b.level);
 
       /* We are using the minimum required size to hold the contents,
        * possibly using a layout different from the layout of the resource,
        * so update the transfer strides accordingly.
        */
-      vtransfer->base.stride = stride;
-      vtransfer->base.layer_stride = layer_stride;
+      vtransfer->base.b.stride = stride;
+      vtransfer->base.b.layer_stride = layer_stride;
 
       /* Track the total size of active staging resources. */
       vctx->queued_staging_res_size += size + align_offset;
@@ -411,7 +415,7 @@ virgl_staging_read_map(struct virgl_context *vctx,
 {
    struct virgl_screen *vscreen = virgl_screen(vctx->base.screen);
    struct virgl_winsys *vws = vscreen->vws;
-   assert(vtransfer->base.resource->target != PIPE_BUFFER);
+   assert(vtransfer->base.b.resource->target != PIPE_BUFFER);
    void *map_addr;
 
    /* There are two possibilities to perform readback via:
@@ -436,7 +440,7 @@ static bool
 virgl_resource_realloc(struct virgl_context *vctx, struct virgl_resource *res)
 {
    struct virgl_screen *vs = virgl_screen(vctx->base.screen);
-   const struct pipe_resource *templ = &res->b;
+   const struct pipe_resource *templ = &res->b.b;
    unsigned vbind, vflags;
    struct virgl_hw_res *hw_res;
 
@@ -467,12 +471,12 @@ virgl_resource_realloc(struct virgl_context *vctx, struct virgl_resource *res)
    /* We can safely clear the range here, since it will be repopulated in the
     * following rebind operation, according to the active buffer binds.
     */
-   util_range_set_empty(&res->valid_buffer_range);
+   util_range_set_empty(&res->b.valid_buffer_range);
 
    /* count toward the staging resource size limit */
    vctx->queued_staging_res_size += res->metadata.total_size;
 
-   virgl_rebind_resource(vctx, &res->b);
+   virgl_rebind_resource(vctx, &res->b.b);
 
    return true;
 }
@@ -556,11 +560,11 @@ virgl_resource_transfer_map(struct pipe_context *ctx,
       return NULL;
    }
 
-   if (vres->b.target == PIPE_BUFFER) {
+   if (vres->b.b.target == PIPE_BUFFER) {
       /* For the checks below to be able to use 'usage', we assume that
        * transfer preparation doesn't affect the usage.
        */
-      assert(usage == trans->base.usage);
+      assert(usage == trans->base.b.usage);
 
       /* If we are doing a whole resource discard with a hw_res map, the buffer
        * storage can now be considered unused and we don't care about previous
@@ -575,14 +579,14 @@ virgl_resource_transfer_map(struct pipe_context *ctx,
       if (map_type == VIRGL_TRANSFER_MAP_HW_RES &&
           (usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE) &&
           (vres->clean_mask & 1)) {
-         util_range_set_empty(&vres->valid_buffer_range);
+         util_range_set_empty(&vres->b.valid_buffer_range);
       }
 
       if (usage & PIPE_MAP_WRITE)
-          util_range_add(&vres->b, &vres->valid_buffer_range, box->x, box->x + box->width);
+          util_range_add(&vres->b.b, &vres->b.valid_buffer_range, box->x, box->x + box->width);
    }
 
-   *transfer = &trans->base;
+   *transfer = &trans->base.b;
    return map_addr;
 }
 
@@ -640,12 +644,12 @@ static struct pipe_resource *virgl_resource_create_front(struct pipe_screen *scr
    struct virgl_resource *res = CALLOC_STRUCT(virgl_resource);
    uint32_t alloc_size;
 
-   res->b = *templ;
-   res->b.screen = &vs->base;
-   pipe_reference_init(&res->b.reference, 1);
+   res->b.b = *templ;
+   res->b.b.screen = &vs->base;
+   pipe_reference_init(&res->b.b.reference, 1);
    vbind = pipe_to_virgl_bind(vs, templ->bind);
    vflags = pipe_to_virgl_flags(vs, templ->flags);
-   virgl_resource_layout(&res->b, &res->metadata, 0, 0, 0, 0);
+   virgl_resource_layout(&res->b.b, &res->metadata, 0, 0, 0, 0);
 
    if ((vs->caps.caps.v2.capability_bits & VIRGL_CAP_APP_TWEAK_SUPPORT) &&
        vs->tweak_gles_emulate_bgra &&
@@ -684,14 +688,16 @@ static struct pipe_resource *virgl_resource_create_front(struct pipe_screen *scr
 
    res->clean_mask = (1 << VR_MAX_TEXTURE_2D_LEVELS) - 1;
 
+   threaded_resource_init(&res->b.b, false);
+
    if (templ->target == PIPE_BUFFER) {
-      util_range_init(&res->valid_buffer_range);
+      res->b.buffer_id_unique = util_idalloc_mt_alloc(&vs->buffer_ids);
       virgl_buffer_init(res);
    } else {
       virgl_texture_init(res);
    }
 
-   return &res->b;
+   return &res->b.b;
 
 }
 
@@ -715,9 +721,9 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
       return NULL;
 
    struct virgl_resource *res = CALLOC_STRUCT(virgl_resource);
-   res->b = *templ;
-   res->b.screen = &vs->base;
-   pipe_reference_init(&res->b.reference, 1);
+   res->b.b = *templ;
+   res->b.b.screen = &vs->base;
+   pipe_reference_init(&res->b.b.reference, 1);
 
    plane = winsys_stride = plane_offset = modifier = 0;
    res->hw_res = vs->vws->resource_create_from_handle(vs->vws, whandle,
@@ -734,7 +740,7 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
       modifier = 0;
    }
 
-   virgl_resource_layout(&res->b, &res->metadata, plane, winsys_stride,
+   virgl_resource_layout(&res->b.b, &res->metadata, plane, winsys_stride,
                          plane_offset, modifier);
    if (!res->hw_res) {
       FREE(res);
@@ -760,17 +766,17 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
       uint32_t plane_strides[VIRGL_MAX_PLANE_COUNT];
       uint32_t plane_offsets[VIRGL_MAX_PLANE_COUNT];
       uint32_t plane_count = 0;
-      struct pipe_resource *iter = &res->b;
+      struct pipe_resource *iter = &res->b.b;
 
       do {
          struct virgl_resource *plane = virgl_resource(iter);
 
          /* must be a plain 2D texture sharing the same hw_res */
-         if (plane->b.target != PIPE_TEXTURE_2D ||
-             plane->b.depth0 != 1 ||
-             plane->b.array_size != 1 ||
-             plane->b.last_level != 0 ||
-             plane->b.nr_samples > 1 ||
+         if (plane->b.b.target != PIPE_TEXTURE_2D ||
+             plane->b.b.depth0 != 1 ||
+             plane->b.b.array_size != 1 ||
+             plane->b.b.last_level != 0 ||
+             plane->b.b.nr_samples > 1 ||
              plane->hw_res != res->hw_res ||
              plane_count >= VIRGL_MAX_PLANE_COUNT) {
             vs->vws->resource_reference(vs->vws, &res->hw_res, NULL);
@@ -786,10 +792,10 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
 
       vs->vws->resource_set_type(vs->vws,
                                  res->hw_res,
-                                 pipe_to_virgl_format(res->b.format),
-                                 pipe_to_virgl_bind(vs, res->b.bind),
-                                 res->b.width0,
-                                 res->b.height0,
+                                 pipe_to_virgl_format(res->b.b.format),
+                                 pipe_to_virgl_bind(vs, res->b.b.bind),
+                                 res->b.b.width0,
+                                 res->b.b.height0,
                                  usage,
                                  res->metadata.modifier,
                                  plane_count,
@@ -797,9 +803,12 @@ static struct pipe_resource *virgl_resource_from_handle(struct pipe_screen *scre
                                  plane_offsets);
    }
 
+   threaded_resource_init(&res->b.b, false);
+   res->b.is_shared = true;
+
    virgl_texture_init(res);
 
-   return &res->b;
+   return &res->b.b;
 }
 
 void virgl_init_screen_resource_functions(struct pipe_screen *screen)
@@ -824,12 +833,12 @@ static void virgl_buffer_subdata(struct pipe_context *pipe,
     * the simplest way to make sure that is the case is to check the valid
     * buffer range.
     */
-   if (!util_ranges_intersect(&vbuf->valid_buffer_range,
+   if (!util_ranges_intersect(&vbuf->b.valid_buffer_range,
                               offset, offset + size) &&
        likely(!(virgl_debug & VIRGL_DEBUG_XFER)) &&
        virgl_transfer_queue_extend_buffer(&vctx->queue,
                                           vbuf->hw_res, offset, size, data)) {
-      util_range_add(&vbuf->b, &vbuf->valid_buffer_range, offset, offset + size);
+      util_range_add(&vbuf->b.b, &vbuf->b.valid_buffer_range, offset, offset + size);
       return;
    }
 
@@ -880,29 +889,32 @@ virgl_resource_create_transfer(struct virgl_context *vctx,
    offset += blocksy * metadata->stride[level];
    offset += blocksx * util_format_get_blocksize(format);
 
-   trans = slab_zalloc(&vctx->transfer_pool);
+   if (usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+      trans = slab_zalloc(&vctx->transfer_pool_unsync);
+   else
+      trans = slab_zalloc(&vctx->transfer_pool);
    if (!trans)
       return NULL;
 
-   pipe_resource_reference(&trans->base.resource, pres);
+   pipe_resource_reference(&trans->base.b.resource, pres);
    vws->resource_reference(vws, &trans->hw_res, virgl_resource(pres)->hw_res);
 
-   trans->base.level = level;
-   trans->base.usage = usage;
-   trans->base.box = *box;
-   trans->base.stride = metadata->stride[level];
-   trans->base.layer_stride = metadata->layer_stride[level];
+   trans->base.b.level = level;
+   trans->base.b.usage = usage;
+   trans->base.b.box = *box;
+   trans->base.b.stride = metadata->stride[level];
+   trans->base.b.layer_stride = metadata->layer_stride[level];
    trans->offset = offset;
    util_range_init(&trans->range);
 
-   if (trans->base.resource->target != PIPE_TEXTURE_3D &&
-       trans->base.resource->target != PIPE_TEXTURE_CUBE &&
-       trans->base.resource->target != PIPE_TEXTURE_1D_ARRAY &&
-       trans->base.resource->target != PIPE_TEXTURE_2D_ARRAY &&
-       trans->base.resource->target != PIPE_TEXTURE_CUBE_ARRAY)
+   if (trans->base.b.resource->target != PIPE_TEXTURE_3D &&
+       trans->base.b.resource->target != PIPE_TEXTURE_CUBE &&
+       trans->base.b.resource->target != PIPE_TEXTURE_1D_ARRAY &&
+       trans->base.b.resource->target != PIPE_TEXTURE_2D_ARRAY &&
+       trans->base.b.resource->target != PIPE_TEXTURE_CUBE_ARRAY)
       trans->l_stride = 0;
    else
-      trans->l_stride = trans->base.layer_stride;
+      trans->l_stride = trans->base.b.layer_stride;
 
    return trans;
 }
@@ -916,7 +928,7 @@ void virgl_resource_destroy_transfer(struct virgl_context *vctx,
 
    util_range_destroy(&trans->range);
    vws->resource_reference(vws, &trans->hw_res, NULL);
-   pipe_resource_reference(&trans->base.resource, NULL);
+   pipe_resource_reference(&trans->base.b.resource, NULL);
    slab_free(&vctx->transfer_pool, trans);
 }
 
@@ -926,13 +938,56 @@ void virgl_resource_destroy(struct pipe_screen *screen,
    struct virgl_screen *vs = virgl_screen(screen);
    struct virgl_resource *res = virgl_resource(resource);
 
-   if (res->b.target == PIPE_BUFFER)
-      util_range_destroy(&res->valid_buffer_range);
+   threaded_resource_deinit(resource);
+   util_idalloc_mt_free(&vs->buffer_ids, res->b.buffer_id_unique);
 
    vs->vws->resource_reference(vs->vws, &res->hw_res, NULL);
    FREE(res);
 }
 
+/* Called by the threaded context in the driver thread, after it has
+ * invalidated dst by allocating src in the application thread.
+ */
+void
+virgl_replace_buffer_storage(struct pipe_context *ctx,
+                             struct pipe_resource *dst,
+                             struct pipe_resource *src,
+                             unsigned num_rebinds,
+                             uint32_t rebind_mask,
+                             uint32_t delete_buffer_id)
+{
+   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_screen *vs = virgl_screen(ctx->screen);
+   struct virgl_winsys *vws = vs->vws;
+   struct virgl_resource *vdst = virgl_resource(dst);
+   struct virgl_resource *vsrc = virgl_resource(src);
+
+   /* Queued transfers hold their own references to the old hw_res. */
+   vws->resource_reference(vws, &vdst->hw_res, vsrc->hw_res);
+   vdst->clean_mask = vsrc->clean_mask;
+
+   virgl_rebind_resource(vctx, dst);
+
+   util_idalloc_mt_free(&vs->buffer_ids, delete_buffer_id);
+}
+
+bool
+virgl_is_resource_busy(struct pipe_screen *screen,
+                       struct pipe_resource *resource,
+                       unsigned usage)
+{
+   struct virgl_winsys *vws = virgl_screen(screen)->vws;
+   struct virgl_resource *res = virgl_resource(resource);
+
+   /* Keep the threaded context from inferring unsynchronized maps that
+    * would have to read back from the host.
+    */
+   if (virgl_res_needs_readback(NULL, res, usage, 0))
+      return true;
+
+   return vws->resource_is_busy(vws, res->hw_res);
+}
+
 bool virgl_resource_get_handle(struct pipe_screen *screen,
                                struct pipe_context *context,
                                struct pipe_resource *resource,
@@ -942,7 +997,7 @@ bool virgl_resource_get_handle(struct pipe_screen *screen,
    struct virgl_screen *vs = virgl_screen(screen);
    struct virgl_resource *res = virgl_resource(resource);
 
-   if (res->b.target == PIPE_BUFFER)
+   if (res->b.b.target == PIPE_BUFFER)
       return false;
 
    return vs->vws->resource_get_handle(vs->vws, res->hw_res,
@@ -953,7 +1008,7 @@ bool virgl_resource_get_handle(struct pipe_screen *screen,
 void virgl_resource_dirty(struct virgl_resource *res, uint32_t level)
 {
    if (res) {
-      if (res->b.target == PIPE_BUFFER)
+      if (res->b.b.target == PIPE_BUFFER)
          res->clean_mask &= ~1;
       else
          res->clean_mask &= ~(1 << level);
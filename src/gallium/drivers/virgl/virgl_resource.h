@@ -28,6 +28,7 @@
 #include "util/u_range.h"
 #include "util/list.h"
 #include "util/u_transfer.h"
+#include "util/u_threaded_context.h"
 
 #include "virtio-gpu/virgl_hw.h"
 #include "virgl_screen.h"
@@ -51,13 +52,13 @@ struct virgl_resource_metadata
 };
 
 struct virgl_resource {
-   struct pipe_resource b;
+   /* For PIPE_BUFFER, b.valid_buffer_range tracks the initialized data and is
+    * shared with the threaded context.
+    */
+   struct threaded_resource b;
    struct virgl_hw_res *hw_res;
    struct virgl_resource_metadata metadata;
 
-   /* For PIPE_BUFFER only.  Data outside of this range are uninitialized. */
-   struct util_range valid_buffer_range;
-
    /* This mask indicates where the resource has been bound to, excluding
     * pipe_surface binds.
     *
@@ -74,7 +75,7 @@ struct virgl_resource {
 };
 
 struct virgl_transfer {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
    uint32_t offset, l_stride;
    struct util_range range;
    struct list_head queue_link;
@@ -96,6 +97,17 @@ struct virgl_transfer {
 void virgl_resource_destroy(struct pipe_screen *screen,
                             struct pipe_resource *resource);
 
+void virgl_replace_buffer_storage(struct pipe_context *ctx,
+                                  struct pipe_resource *dst,
+                                  struct pipe_resource *src,
+                                  unsigned num_rebinds,
+                                  uint32_t rebind_mask,
+                                  uint32_t delete_buffer_id);
+
+bool virgl_is_resource_busy(struct pipe_screen *screen,
+                            struct pipe_resource *resource,
+                            unsigned usage);
+
 void virgl_init_screen_resource_functions(struct pipe_screen *screen);
 
 void virgl_init_context_resource_functions(struct pipe_context *ctx);
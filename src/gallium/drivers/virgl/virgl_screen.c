@@ -895,7 +895,8 @@ static void virgl_flush_frontbuffer(struct pipe_screen *screen,
    struct virgl_screen *vscreen = virgl_screen(screen);
    struct virgl_winsys *vws = vscreen->vws;
    struct virgl_resource *vres = virgl_resource(res);
-   struct virgl_context *vctx = virgl_context(ctx);
+   struct virgl_context *vctx =
+      virgl_context(threaded_context_unwrap_sync(ctx));
 
    if (vws->flush_frontbuffer) {
       virgl_flush_eq(vctx, vctx, NULL);
@@ -921,10 +922,9 @@ static bool virgl_fence_finish(struct pipe_screen *screen,
 {
    struct virgl_screen *vscreen = virgl_screen(screen);
    struct virgl_winsys *vws = vscreen->vws;
-   struct virgl_context *vctx = virgl_context(ctx);
 
-   if (vctx && timeout)
-      virgl_flush_eq(vctx, NULL, NULL);
+   if (ctx && timeout)
+      virgl_flush_eq(virgl_context(threaded_context_unwrap_sync(ctx)), NULL, NULL);
 
    return vws->fence_wait(vws, fence, timeout);
 }
@@ -951,6 +951,7 @@ virgl_destroy_screen(struct pipe_screen *screen)
    struct virgl_winsys *vws = vscreen->vws;
 
    slab_destroy_parent(&vscreen->transfer_pool);
+   util_idalloc_mt_fini(&vscreen->buffer_ids);
 
    if (vws)
       vws->destroy(vws);
@@ -1001,7 +1002,7 @@ static void virgl_query_memory_info(struct pipe_screen *screen, struct pipe_memo
    virgl_encode_get_memory_info(vctx, res);
    ctx->flush(ctx, NULL, 0);
    vscreen->vws->resource_wait(vscreen->vws, res->hw_res);
-   pipe_buffer_read(ctx, &res->b, 0, sizeof(struct virgl_memory_info), &virgl_info);
+   pipe_buffer_read(ctx, &res->b.b, 0, sizeof(struct virgl_memory_info), &virgl_info);
 
    info->avail_device_memory = virgl_info.avail_device_memory;
    info->avail_staging_memory = virgl_info.avail_staging_memory;
@@ -1010,7 +1011,7 @@ static void virgl_query_memory_info(struct pipe_screen *screen, struct pipe_memo
    info->total_device_memory = virgl_info.total_device_memory;
    info->total_staging_memory = virgl_info.total_staging_memory;
 
-   screen->resource_destroy(screen, &res->b);
+   screen->resource_destroy(screen, &res->b.b);
    ctx->destroy(ctx);
 }
 
@@ -1180,6 +1181,7 @@ virgl_create_screen(struct virgl_winsys *vws, const struct pipe_screen_config *c
    }
 
    slab_create_parent(&screen->transfer_pool, sizeof(struct virgl_transfer), 16);
+   util_idalloc_mt_init_tc(&screen->buffer_ids);
 
    virgl_disk_cache_create(screen);
    return &screen->base;
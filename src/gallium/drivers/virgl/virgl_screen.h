@@ -25,6 +25,7 @@
 
 #include "pipe/p_screen.h"
 #include "util/slab.h"
+#include "util/u_idalloc.h"
 #include "util/disk_cache.h"
 #include "virgl_winsys.h"
 #include "compiler/nir/nir.h"
@@ -58,6 +59,9 @@ struct virgl_screen {
 
    struct slab_parent_pool transfer_pool;
 
+   /* threaded_resource::buffer_id_unique */
+   struct util_idalloc_mt buffer_ids;
+
    uint32_t sub_ctx_id;
    bool tweak_gles_emulate_bgra;
    bool tweak_gles_apply_bgra_dest_swizzle;
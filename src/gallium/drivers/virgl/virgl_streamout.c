@@ -27,6 +27,19 @@
 #include "virtio-gpu/virgl_protocol.h"
 #include "virgl_resource.h"
 
+static void virgl_encode_create_so_target(struct virgl_context *vctx,
+                                          void *data)
+{
+   struct virgl_so_target *t = *(struct virgl_so_target **)data;
+   struct virgl_resource *res = virgl_resource(t->base.buffer);
+
+   res->bind_history |= PIPE_BIND_STREAM_OUTPUT;
+   virgl_resource_dirty(res, 0);
+
+   virgl_encoder_create_so_target(vctx, t->handle, res, t->base.buffer_offset,
+                                  t->base.buffer_size);
+}
+
 static struct pipe_stream_output_target *virgl_create_so_target(
    struct pipe_context *ctx,
    struct pipe_resource *buffer,
@@ -49,24 +62,32 @@ static struct pipe_stream_output_target *virgl_create_so_target(
    t->base.buffer_size = buffer_size;
    t->handle = handle;
 
-   res->bind_history |= PIPE_BIND_STREAM_OUTPUT;
-   util_range_add(&res->b, &res->valid_buffer_range, buffer_offset,
+   util_range_add(&res->b.b, &res->b.valid_buffer_range, buffer_offset,
                   buffer_offset + buffer_size);
-   virgl_resource_dirty(res, 0);
 
-   virgl_encoder_create_so_target(vctx, handle, res, buffer_offset, buffer_size);
+   virgl_context_encode_deferred(vctx, virgl_encode_create_so_target,
+                                 &t, sizeof(t));
    return &t->base;
 }
 
+static void virgl_encode_destroy_so_target(struct virgl_context *vctx,
+                                           void *data)
+{
+   struct virgl_so_target *t = *(struct virgl_so_target **)data;
+
+   pipe_resource_reference(&t->base.buffer, NULL);
+   virgl_encode_delete_object(vctx, t->handle, VIRGL_OBJECT_STREAMOUT_TARGET);
+   FREE(t);
+}
+
 static void virgl_destroy_so_target(struct pipe_context *ctx,
                                    struct pipe_stream_output_target *target)
 {
    struct virgl_context *vctx = virgl_context(ctx);
    struct virgl_so_target *t = virgl_so_target(target);
 
-   pipe_resource_reference(&t->base.buffer, NULL);
-   virgl_encode_delete_object(vctx, t->handle, VIRGL_OBJECT_STREAMOUT_TARGET);
-   FREE(t);
+   virgl_context_encode_deferred(vctx, virgl_encode_destroy_so_target,
+                                 &t, sizeof(t));
 }
 
 static void virgl_set_so_targets(struct pipe_context *ctx,
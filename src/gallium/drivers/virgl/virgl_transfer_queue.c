@@ -55,7 +55,7 @@ struct list_iteration_args
 static int
 transfer_dim(const struct virgl_transfer *xfer)
 {
-   switch (xfer->base.resource->target) {
+   switch (xfer->base.b.resource->target) {
    case PIPE_BUFFER:
    case PIPE_TEXTURE_1D:
       return 1;
@@ -110,7 +110,7 @@ transfer_overlap(const struct virgl_transfer *xfer,
 {
    const int dim_count = transfer_dim(xfer);
 
-   if (xfer->hw_res != hw_res || xfer->base.level != level)
+   if (xfer->hw_res != hw_res || xfer->base.b.level != level)
       return false;
 
    for (int dim = 0; dim < dim_count; dim++) {
@@ -119,7 +119,7 @@ transfer_overlap(const struct virgl_transfer *xfer,
       int box_min;
       int box_max;
 
-      box_min_max(&xfer->base.box, dim, &xfer_min, &xfer_max);
+      box_min_max(&xfer->base.b.box, dim, &xfer_min, &xfer_max);
       box_min_max(box, dim, &box_min, &box_max);
 
       if (include_touching) {
@@ -155,8 +155,8 @@ virgl_transfer_queue_find_overlap(const struct virgl_transfer_queue *queue,
 static bool transfers_intersect(struct virgl_transfer *queued,
                                 struct virgl_transfer *current)
 {
-   return transfer_overlap(queued, current->hw_res, current->base.level,
-         &current->base.box, true);
+   return transfer_overlap(queued, current->hw_res, current->base.b.level,
+         &current->base.b.box, true);
 }
 
 static void remove_transfer(struct virgl_transfer_queue *queue,
@@ -172,8 +172,8 @@ static void replace_unmapped_transfer(struct virgl_transfer_queue *queue,
    struct virgl_transfer *current = args->current;
    struct virgl_transfer *queued = args->queued;
 
-   u_box_union_2d(&current->base.box, &current->base.box, &queued->base.box);
-   current->offset = current->base.box.x;
+   u_box_union_2d(&current->base.b.box, &current->base.b.box, &queued->base.b.box);
+   current->offset = current->base.b.box.x;
 
    remove_transfer(queue, queued);
    queue->num_dwords -= (VIRGL_TRANSFER3D_SIZE + 1);
@@ -185,9 +185,9 @@ static void transfer_put(struct virgl_transfer_queue *queue,
    struct virgl_transfer *queued = args->queued;
 
    queue->vs->vws->transfer_put(queue->vs->vws, queued->hw_res,
-                                &queued->base.box,
-                                queued->base.stride, queued->l_stride,
-                                queued->offset, queued->base.level);
+                                &queued->base.b.box,
+                                queued->base.b.stride, queued->l_stride,
+                                queued->offset, queued->base.b.level);
 
    remove_transfer(queue, queued);
 }
@@ -307,7 +307,7 @@ int virgl_transfer_queue_unmap(struct virgl_transfer_queue *queue,
    assert(!transfer->copy_src_hw_res);
 
    /* Attempt to merge multiple intersecting transfers into a single one. */
-   if (transfer->base.resource->target == PIPE_BUFFER) {
+   if (transfer->base.b.resource->target == PIPE_BUFFER) {
       memset(&iter, 0, sizeof(iter));
       iter.current = transfer;
       iter.compare = transfers_intersect;
@@ -350,8 +350,8 @@ bool virgl_transfer_queue_is_queued(struct virgl_transfer_queue *queue,
 {
    return virgl_transfer_queue_find_overlap(queue,
                                             transfer->hw_res,
-                                            transfer->base.level,
-                                            &transfer->base.box,
+                                            transfer->base.b.level,
+                                            &transfer->base.b.box,
                                             false);
 }
 
@@ -369,12 +369,12 @@ virgl_transfer_queue_extend_buffer(struct virgl_transfer_queue *queue,
    if (!queued)
       return false;
 
-   assert(queued->base.resource->target == PIPE_BUFFER);
+   assert(queued->base.b.resource->target == PIPE_BUFFER);
    assert(queued->hw_res_map);
 
    memcpy(queued->hw_res_map + offset, data, size);
-   u_box_union_2d(&queued->base.box, &queued->base.box, &box);
-   queued->offset = queued->base.box.x;
+   u_box_union_2d(&queued->base.b.box, &queued->base.b.box, &box);
+   queued->offset = queued->base.b.box.x;
 
    return true;
 }
@@ -49,6 +49,7 @@ struct virgl_winsys {
    int supports_fences; /* In/Out fences are supported */
    int supports_encoded_transfers; /* Encoded transfers are supported */
    int supports_coherent;          /* Coherent memory is supported */
+   int supports_threads;           /* Calls from several threads are safe */
 
    void (*destroy)(struct virgl_winsys *vws);
 
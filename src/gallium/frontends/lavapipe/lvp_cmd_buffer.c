@@ -28,10 +28,15 @@
 #include "vk_common_entrypoints.h"
 
 static void
-lvp_cmd_buffer_destroy(struct vk_command_buffer *cmd_buffer)
+lvp_cmd_buffer_destroy(struct vk_command_buffer *vk_cmd_buffer)
 {
-   vk_command_buffer_finish(cmd_buffer);
-   vk_free(&cmd_buffer->pool->alloc, cmd_buffer);
+   struct lvp_cmd_buffer *cmd_buffer =
+      container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk);
+
+   lvp_cmd_buffer_free_bakes(cmd_buffer);
+   simple_mtx_destroy(&cmd_buffer->bake_lock);
+   vk_command_buffer_finish(&cmd_buffer->vk);
+   vk_free(&cmd_buffer->vk.pool->alloc, cmd_buffer);
 }
 
 static VkResult
@@ -55,6 +60,8 @@ lvp_create_cmd_buffer(struct vk_command_pool *pool,
    }
 
    cmd_buffer->device = device;
+   simple_mtx_init(&cmd_buffer->bake_lock, mtx_plain);
+   list_inithead(&cmd_buffer->bakes);
 
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
    *cmd_buffer_out = &cmd_buffer->vk;
@@ -64,12 +71,15 @@ lvp_create_cmd_buffer(struct vk_command_pool *pool,
 
 static void
 lvp_reset_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer,
-                     UNUSED VkCommandBufferResetFlags flags)
+                     VkCommandBufferResetFlags flags)
 {
    struct lvp_cmd_buffer *cmd_buffer =
       container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk);
 
    vk_command_buffer_reset(&cmd_buffer->vk);
+   lvp_cmd_buffer_free_bakes(cmd_buffer);
+   if (flags & VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT)
+      vk_cmd_queue_finish(&cmd_buffer->vk.cmd_queue);
 
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_INITIAL;
 }
@@ -88,6 +98,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
    if (cmd_buffer->status != LVP_CMD_BUFFER_STATUS_INITIAL)
       lvp_reset_cmd_buffer(&cmd_buffer->vk, 0);
    cmd_buffer->status = LVP_CMD_BUFFER_STATUS_RECORDING;
+   cmd_buffer->bake_binds =
+      !(pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
    return VK_SUCCESS;
 }
 
@@ -122,9 +134,8 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetWithTemplateKHR(
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
    LVP_FROM_HANDLE(lvp_descriptor_update_template, templ, descriptorUpdateTemplate);
    size_t info_size = 0;
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(cmd_buffer->vk.cmd_queue.alloc,
-                                              sizeof(*cmd), 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+   struct vk_cmd_queue_entry *cmd = vk_cmd_queue_zalloc(&cmd_buffer->vk.cmd_queue,
+                                                        sizeof(*cmd));
    if (!cmd)
       return;
 
@@ -164,7 +175,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_CmdPushDescriptorSetWithTemplateKHR(
       }
    }
 
-   cmd->u.push_descriptor_set_with_template_khr.data = vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, info_size, 8, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+   cmd->u.push_descriptor_set_with_template_khr.data = vk_cmd_queue_zalloc(&cmd_buffer->vk.cmd_queue, info_size);
 
    uint64_t offset = 0;
    for (unsigned i = 0; i < templ->entry_count; i++) {
@@ -25,6 +25,7 @@
 #include "vk_descriptors.h"
 #include "vk_util.h"
 #include "u_math.h"
+#include "util/set.h"
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorSetLayout(
     VkDevice                                    _device,
@@ -93,9 +94,10 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorSetLayout(
       set_layout->binding[b].descriptor_index = set_layout->size;
       set_layout->binding[b].type = binding->descriptorType;
       set_layout->binding[b].valid = true;
-      if (binding->descriptorType == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK)
+      if (binding->descriptorType == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK) {
          set_layout->size++;
-      else
+         set_layout->uniform_block_size += binding->descriptorCount;
+      } else
          set_layout->size += binding->descriptorCount;
 
       for (gl_shader_stage stage = MESA_SHADER_VERTEX; stage < MESA_SHADER_STAGES; stage++) {
@@ -304,30 +306,73 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineLayout(
    return VK_SUCCESS;
 }
 
+static VkResult
+lvp_descriptor_pool_ref_layout(struct lvp_descriptor_pool *pool,
+                               struct lvp_descriptor_set_layout *layout)
+{
+   if (layout == pool->last_layout)
+      return VK_SUCCESS;
+
+   bool found;
+   if (!_mesa_set_search_or_add(pool->layouts, layout, &found))
+      return VK_ERROR_OUT_OF_HOST_MEMORY;
+   if (!found)
+      vk_descriptor_set_layout_ref(&layout->vk);
+   pool->last_layout = layout;
+   return VK_SUCCESS;
+}
+
+static bool
+lvp_descriptor_set_in_host_mem(const struct lvp_descriptor_pool *pool,
+                               const struct lvp_descriptor_set *set)
+{
+   return (const uint8_t *)set >= pool->host_mem &&
+          (const uint8_t *)set < pool->host_mem + pool->host_mem_size;
+}
+
 VkResult
 lvp_descriptor_set_create(struct lvp_device *device,
+                          struct lvp_descriptor_pool *pool,
                           struct lvp_descriptor_set_layout *layout,
                           struct lvp_descriptor_set **out_set)
 {
    struct lvp_descriptor_set *set;
    size_t base_size = sizeof(*set) + layout->size * sizeof(set->descriptors[0]);
-   size_t size = base_size;
-   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
-      size += layout->stage[i].uniform_block_size;
-   set = vk_alloc(&device->vk.alloc /* XXX: Use the pool */, size, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!set)
-      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   size_t size = ALIGN_POT(base_size + layout->uniform_block_size, 8);
+
+   /* The pool holds the layout reference for all of its sets, so that
+    * resetting it doesn't have to visit every set.
+    */
+   VkResult result = lvp_descriptor_pool_ref_layout(pool, layout);
+   if (result != VK_SUCCESS)
+      return vk_error(device, result);
+
+   if (size <= pool->host_mem_size - pool->host_mem_offset) {
+      set = (struct lvp_descriptor_set *)(pool->host_mem + pool->host_mem_offset);
+      pool->host_mem_offset += size;
+   } else {
+      /* Either the application's pool sizes didn't account for our
+       * per-set overhead or freed sets left holes behind; fall back to a
+       * separate allocation rather than failing.
+       */
+      set = vk_alloc(&device->vk.alloc, size, 8,
+                     VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!set)
+         return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
 
    /* A descriptor set may not be 100% filled. Clear the set so we can can
     * later detect holes in it.
     */
    memset(set, 0, size);
+   if (!lvp_descriptor_set_in_host_mem(pool, set))
+      list_addtail(&set->link, &pool->sets);
 
    vk_object_base_init(&device->vk, &set->base,
                        VK_OBJECT_TYPE_DESCRIPTOR_SET);
    set->layout = layout;
-   vk_descriptor_set_layout_ref(&layout->vk);
+   set->size = size;
+   set->generation = p_atomic_inc_return(&device->descriptor_generation);
 
    /* Go through and fill out immutable samplers if we have any */
    struct lvp_descriptor *desc = set->descriptors;
@@ -353,11 +398,24 @@ lvp_descriptor_set_create(struct lvp_device *device,
 
 void
 lvp_descriptor_set_destroy(struct lvp_device *device,
+                           struct lvp_descriptor_pool *pool,
                            struct lvp_descriptor_set *set)
 {
-   vk_descriptor_set_layout_unref(&device->vk, &set->layout->vk);
    vk_object_base_finish(&set->base);
-   vk_free(&device->vk.alloc, set);
+
+   if (!lvp_descriptor_set_in_host_mem(pool, set)) {
+      list_del(&set->link);
+      vk_free(&device->vk.alloc, set);
+      return;
+   }
+
+   /* Freeing the most recent set gives its memory back, anything else
+    * leaves a hole until the pool is reset.
+    */
+   if ((uint8_t *)set + set->size == pool->host_mem + pool->host_mem_offset)
+      pool->host_mem_offset -= set->size;
+   else
+      set->layout = NULL;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateDescriptorSets(
@@ -375,17 +433,19 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_AllocateDescriptorSets(
       LVP_FROM_HANDLE(lvp_descriptor_set_layout, layout,
                       pAllocateInfo->pSetLayouts[i]);
 
-      result = lvp_descriptor_set_create(device, layout, &set);
+      result = lvp_descriptor_set_create(device, pool, layout, &set);
       if (result != VK_SUCCESS)
          break;
 
-      list_addtail(&set->link, &pool->sets);
       pDescriptorSets[i] = lvp_descriptor_set_to_handle(set);
    }
 
-   if (result != VK_SUCCESS)
+   if (result != VK_SUCCESS) {
       lvp_FreeDescriptorSets(_device, pAllocateInfo->descriptorPool,
                              i, pDescriptorSets);
+      for (i = 0; i < pAllocateInfo->descriptorSetCount; i++)
+         pDescriptorSets[i] = VK_NULL_HANDLE;
+   }
 
    return result;
 }
@@ -397,13 +457,17 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_FreeDescriptorSets(
     const VkDescriptorSet*                      pDescriptorSets)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   for (uint32_t i = 0; i < count; i++) {
+   LVP_FROM_HANDLE(lvp_descriptor_pool, pool, descriptorPool);
+
+   /* Free in reverse so that freeing a whole allocation batch returns its
+    * memory to the pool.
+    */
+   for (uint32_t i = count; i-- > 0;) {
       LVP_FROM_HANDLE(lvp_descriptor_set, set, pDescriptorSets[i]);
 
       if (!set)
          continue;
-      list_del(&set->link);
-      lvp_descriptor_set_destroy(device, set);
+      lvp_descriptor_set_destroy(device, pool, set);
    }
    return VK_SUCCESS;
 }
@@ -415,9 +479,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_UpdateDescriptorSets(
     uint32_t                                    descriptorCopyCount,
     const VkCopyDescriptorSet*                  pDescriptorCopies)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
+
    for (uint32_t i = 0; i < descriptorWriteCount; i++) {
       const VkWriteDescriptorSet *write = &pDescriptorWrites[i];
       LVP_FROM_HANDLE(lvp_descriptor_set, set, write->dstSet);
+      set->generation = p_atomic_inc_return(&device->descriptor_generation);
       const struct lvp_descriptor_set_binding_layout *bind_layout =
          &set->layout->binding[write->dstBinding];
       struct lvp_descriptor *desc =
@@ -554,6 +621,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_UpdateDescriptorSets(
       const VkCopyDescriptorSet *copy = &pDescriptorCopies[i];
       LVP_FROM_HANDLE(lvp_descriptor_set, src, copy->srcSet);
       LVP_FROM_HANDLE(lvp_descriptor_set, dst, copy->dstSet);
+      dst->generation = p_atomic_inc_return(&device->descriptor_generation);
 
       const struct lvp_descriptor_set_binding_layout *src_layout =
          &src->layout->binding[copy->srcBinding];
@@ -589,14 +657,48 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorPool(
    LVP_FROM_HANDLE(lvp_device, device, _device);
    struct lvp_descriptor_pool *pool;
    size_t size = sizeof(struct lvp_descriptor_pool);
+
+   const VkDescriptorPoolInlineUniformBlockCreateInfo *inline_info =
+      vk_find_struct_const(pCreateInfo->pNext,
+                           DESCRIPTOR_POOL_INLINE_UNIFORM_BLOCK_CREATE_INFO);
+
+   /* Inline uniform blocks take one descriptor per binding plus their data,
+    * which is what descriptorCount counts for them.
+    */
+   size_t host_mem_size = pCreateInfo->maxSets *
+                          (ALIGN_POT(sizeof(struct lvp_descriptor_set), 8) + 8);
+   if (inline_info)
+      host_mem_size += inline_info->maxInlineUniformBlockBindings *
+                       sizeof(struct lvp_descriptor);
+   for (unsigned i = 0; i < pCreateInfo->poolSizeCount; i++) {
+      const VkDescriptorPoolSize *pool_size = &pCreateInfo->pPoolSizes[i];
+      if (pool_size->type == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK)
+         host_mem_size += pool_size->descriptorCount;
+      else
+         host_mem_size += pool_size->descriptorCount * sizeof(struct lvp_descriptor);
+   }
+
    pool = vk_zalloc2(&device->vk.alloc, pAllocator, size, 8,
                      VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
    if (!pool)
       return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
 
+   /* Not zeroed, each set clears its own memory when allocated. */
+   pool->host_mem = vk_alloc2(&device->vk.alloc, pAllocator, host_mem_size, 8,
+                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   pool->layouts = _mesa_pointer_set_create(NULL);
+   if (!pool->host_mem || !pool->layouts) {
+      _mesa_set_destroy(pool->layouts, NULL);
+      vk_free2(&device->vk.alloc, pAllocator, pool->host_mem);
+      vk_free2(&device->vk.alloc, pAllocator, pool);
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    vk_object_base_init(&device->vk, &pool->base,
                        VK_OBJECT_TYPE_DESCRIPTOR_POOL);
    pool->flags = pCreateInfo->flags;
+   pool->max_sets = pCreateInfo->maxSets;
+   pool->host_mem_size = host_mem_size;
    list_inithead(&pool->sets);
    *pDescriptorPool = lvp_descriptor_pool_to_handle(pool);
    return VK_SUCCESS;
@@ -605,12 +707,31 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorPool(
 static void lvp_reset_descriptor_pool(struct lvp_device *device,
                                       struct lvp_descriptor_pool *pool)
 {
+   /* Nothing in host_mem is freed individually, the walk only drops the
+    * object names and private data which may have been attached to sets.
+    */
+   for (size_t offset = 0; offset < pool->host_mem_offset;) {
+      struct lvp_descriptor_set *set =
+         (struct lvp_descriptor_set *)(pool->host_mem + offset);
+      if (set->layout)
+         vk_object_base_finish(&set->base);
+      offset += set->size;
+   }
+   pool->host_mem_offset = 0;
+
    struct lvp_descriptor_set *set, *tmp;
    LIST_FOR_EACH_ENTRY_SAFE(set, tmp, &pool->sets, link) {
-      vk_descriptor_set_layout_unref(&device->vk, &set->layout->vk);
-      list_del(&set->link);
+      vk_object_base_finish(&set->base);
       vk_free(&device->vk.alloc, set);
    }
+   list_inithead(&pool->sets);
+
+   set_foreach(pool->layouts, entry) {
+      struct lvp_descriptor_set_layout *layout = (void *)entry->key;
+      vk_descriptor_set_layout_unref(&device->vk, &layout->vk);
+   }
+   _mesa_set_clear(pool->layouts, NULL);
+   pool->last_layout = NULL;
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyDescriptorPool(
@@ -625,7 +746,9 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDescriptorPool(
       return;
 
    lvp_reset_descriptor_pool(device, pool);
+   _mesa_set_destroy(pool->layouts, NULL);
    vk_object_base_finish(&pool->base);
+   vk_free2(&device->vk.alloc, pAllocator, pool->host_mem);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
 
@@ -711,10 +834,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_UpdateDescriptorSetWithTemplate(VkDevice _device,
                                          VkDescriptorUpdateTemplate descriptorUpdateTemplate,
                                          const void *pData)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
    LVP_FROM_HANDLE(lvp_descriptor_set, set, descriptorSet);
    LVP_FROM_HANDLE(lvp_descriptor_update_template, templ, descriptorUpdateTemplate);
    uint32_t i, j;
 
+   set->generation = p_atomic_inc_return(&device->descriptor_generation);
+
    for (i = 0; i < templ->entry_count; ++i) {
       VkDescriptorUpdateTemplateEntry *entry = &templ->entry[i];
       const uint8_t *pSrc = ((const uint8_t *) pData) + entry->offset;
@@ -240,6 +240,7 @@ lvp_physical_device_init(struct lvp_physical_device *device,
    device->pscreen = pipe_loader_create_screen_vk(device->pld, true);
    if (!device->pscreen)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+
    for (unsigned i = 0; i < ARRAY_SIZE(device->drv_options); i++)
       device->drv_options[i] = device->pscreen->get_compiler_options(device->pscreen, PIPE_SHADER_IR_NIR, i);
 
@@ -1393,7 +1394,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .queueFlags = VK_QUEUE_GRAPHICS_BIT |
          VK_QUEUE_COMPUTE_BIT |
          VK_QUEUE_TRANSFER_BIT,
-         .queueCount = 1,
+         .queueCount = MAX_QUEUES,
          .timestampValidBits = 64,
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
       };
@@ -1496,7 +1497,7 @@ destroy_pipelines(struct lvp_queue *queue)
 {
    simple_mtx_lock(&queue->pipeline_lock);
    while (util_dynarray_contains(&queue->pipeline_destroys, struct lvp_pipeline*)) {
-      lvp_pipeline_destroy(queue->device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*));
+      lvp_pipeline_destroy_queue(queue, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*));
    }
    simple_mtx_unlock(&queue->pipeline_lock);
 }
@@ -1589,14 +1590,20 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO);
 
-   size_t state_size = lvp_get_rendering_state_size();
+   assert(pCreateInfo->queueCreateInfoCount == 1);
+   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
+   assert(pCreateInfo->pQueueCreateInfos[0].queueCount <= MAX_QUEUES);
+   const unsigned num_queues = pCreateInfo->pQueueCreateInfos[0].queueCount;
+
+   size_t state_size = ALIGN_POT(lvp_get_rendering_state_size(), 8);
    device = vk_zalloc2(&physical_device->vk.instance->alloc, pAllocator,
-                       sizeof(*device) + state_size, 8,
+                       sizeof(*device) + state_size * num_queues, 8,
                        VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
    if (!device)
       return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
 
-   device->queue.state = device + 1;
+   for (unsigned i = 0; i < num_queues; i++)
+      device->queues[i].state = (uint8_t *)(device + 1) + state_size * i;
    device->poison_mem = debug_get_bool_option("LVP_POISON_MEMORY", false);
 
    struct vk_device_dispatch_table dispatch_table;
@@ -1622,19 +1629,40 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
-   if (result != VK_SUCCESS) {
-      vk_free(&device->vk.alloc, device);
-      return result;
+   for (unsigned i = 0; i < num_queues; i++) {
+      result = lvp_queue_init(device, &device->queues[i],
+                              pCreateInfo->pQueueCreateInfos, i);
+      if (result != VK_SUCCESS)
+         goto fail_queues;
+      device->num_queues++;
+   }
+
+   /* Pipeline cache objects which aren't in any VkPipelineCache are looked
+    * up in the llvmpipe disk cache, which also holds the JIT'ed code.
+    * llvmpipe only creates it along with the first context, so it can't be
+    * picked up when the physical device is created.
+    */
+   if (!physical_device->vk.disk_cache && device->pscreen->get_disk_shader_cache)
+      physical_device->vk.disk_cache =
+         device->pscreen->get_disk_shader_cache(device->pscreen);
+
+   struct vk_pipeline_cache_create_info cache_info = { 0 };
+   device->mem_cache = vk_pipeline_cache_create(&device->vk, &cache_info, NULL);
+   if (!device->mem_cache) {
+      result = vk_error(physical_device, VK_ERROR_OUT_OF_HOST_MEMORY);
+      goto fail_queues;
    }
 
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
 
+fail_queues:
+   for (unsigned i = 0; i < device->num_queues; i++)
+      lvp_queue_finish(&device->queues[i]);
+   vk_device_finish(&device->vk);
+   vk_free(&device->vk.alloc, device);
+   return result;
 }
 
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
@@ -1643,9 +1671,13 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
-   lvp_queue_finish(&device->queue);
+   vk_pipeline_cache_destroy(device->mem_cache, NULL);
+   for (unsigned i = 0; i < device->num_queues; i++) {
+      struct lvp_queue *queue = &device->queues[i];
+      if (queue->last_fence)
+         device->pscreen->fence_reference(device->pscreen, &queue->last_fence, NULL);
+      lvp_queue_finish(queue);
+   }
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
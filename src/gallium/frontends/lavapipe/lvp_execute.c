@@ -70,6 +70,7 @@ struct lvp_render_attachment {
 
 struct rendering_state {
    struct pipe_context *pctx;
+   unsigned queue_index;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -85,6 +86,8 @@ struct rendering_state {
    bool pcbuf_dirty[PIPE_SHADER_TYPES];
    bool has_pcbuf[PIPE_SHADER_TYPES];
    bool inlines_dirty[PIPE_SHADER_TYPES];
+   /* the stage was bound with uniform inlining, so no regular CSO is bound */
+   bool shader_inlined[PIPE_SHADER_TYPES];
    bool vp_dirty;
    bool scissor_dirty;
    bool ib_dirty;
@@ -187,6 +190,15 @@ struct rendering_state {
    uint32_t so_offsets[PIPE_MAX_SO_BUFFERS];
 
    struct lvp_pipeline *pipeline[2];
+   /* no command since the last graphics pipeline bind touched its state */
+   bool gfx_pipeline_clean;
+   /* last descriptor set bind per bind point, NULL once disturbed */
+   const struct vk_cmd_bind_descriptor_sets *last_bds[2];
+
+   /* the command buffer being executed, a secondary one inside
+    * vkCmdExecuteCommands
+    */
+   struct lvp_cmd_buffer *cmd_buffer;
 
    bool tess_ccw;
    void *tess_states[2];
@@ -269,21 +281,81 @@ update_pcbuf(struct rendering_state *state, enum pipe_shader_type pstage)
    state->pcbuf_dirty[pstage] = false;
 }
 
+static void
+bind_shader_state(struct rendering_state *state, enum pipe_shader_type sh, void *shader_state)
+{
+   switch (sh) {
+   case PIPE_SHADER_VERTEX:
+      state->pctx->bind_vs_state(state->pctx, shader_state);
+      break;
+   case PIPE_SHADER_TESS_CTRL:
+      state->pctx->bind_tcs_state(state->pctx, shader_state);
+      break;
+   case PIPE_SHADER_TESS_EVAL:
+      state->pctx->bind_tes_state(state->pctx, shader_state);
+      break;
+   case PIPE_SHADER_GEOMETRY:
+      state->pctx->bind_gs_state(state->pctx, shader_state);
+      break;
+   case PIPE_SHADER_FRAGMENT:
+      state->pctx->bind_fs_state(state->pctx, shader_state);
+      break;
+   case PIPE_SHADER_COMPUTE:
+      state->pctx->bind_compute_state(state->pctx, shader_state);
+      break;
+   default: break;
+   }
+}
+
+/* Returns this queue's regular CSO for a stage.  Stages that gave up on
+ * inlining uniforms only get it once a queue binds them, and it's compiled
+ * on that queue's own context.
+ */
+static void *
+get_shader_cso(struct rendering_state *state, struct lvp_pipeline *pipeline, enum pipe_shader_type sh)
+{
+   void **shader_cso = &pipeline->shader_cso[state->queue_index][sh];
+   void *cso = p_atomic_read(shader_cso);
+   if (cso)
+      return cso;
+
+   unsigned stage = tgsi_processor_to_shader_stage(sh);
+   simple_mtx_lock(&pipeline->inline_lock);
+   if (!*shader_cso) {
+      if (sh == PIPE_SHADER_TESS_EVAL && pipeline->tess_ccw)
+         pipeline->tess_ccw_cso[state->queue_index] = lvp_pipeline_compile(pipeline, state->pctx,
+                                                                           nir_shader_clone(NULL, pipeline->tess_ccw));
+      p_atomic_set(shader_cso, lvp_pipeline_compile(pipeline, state->pctx,
+                                                    nir_shader_clone(NULL, pipeline->pipeline_nir[stage])));
+   }
+   cso = *shader_cso;
+   simple_mtx_unlock(&pipeline->inline_lock);
+   return cso;
+}
+
 static void
 update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type sh, bool pcbuf_dirty, bool constbuf_dirty)
 {
    bool is_compute = sh == PIPE_SHADER_COMPUTE;
    uint32_t inline_uniforms[MAX_INLINABLE_UNIFORMS];
    unsigned stage = tgsi_processor_to_shader_stage(sh);
+   struct lvp_pipeline *pipeline = state->pipeline[is_compute];
    state->inlines_dirty[sh] = false;
-   if (!state->pipeline[is_compute]->inlines[stage].can_inline)
+   if (!pipeline->inlines[stage].can_inline) {
+      if (state->shader_inlined[sh]) {
+         /* another queue gave up on inlining since the pipeline was bound */
+         bind_shader_state(state, sh, get_shader_cso(state, pipeline, sh));
+         state->shader_inlined[sh] = false;
+      }
       return;
-   struct lvp_pipeline *pipeline = state->pipeline[is_compute];
+   }
    /* these buffers have already been flushed in llvmpipe, so they're safe to read */
    nir_shader *base_nir = pipeline->pipeline_nir[stage];
    if (stage == PIPE_SHADER_TESS_EVAL && state->tess_ccw)
       base_nir = pipeline->tess_ccw;
+   simple_mtx_lock(&pipeline->inline_lock);
    nir_shader *nir = nir_shader_clone(pipeline->pipeline_nir[stage], base_nir);
+   simple_mtx_unlock(&pipeline->inline_lock);
    nir_function_impl *impl = nir_shader_get_entrypoint(nir);
    unsigned ssa_alloc = impl->ssa_alloc;
    unsigned count = pipeline->inlines[stage].count[0];
@@ -331,34 +403,17 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
    if (ssa_alloc - impl->ssa_alloc < ssa_alloc / 2 &&
        !pipeline->inlines[stage].must_inline) {
       /* not enough change; don't inline further */
-      pipeline->inlines[stage].can_inline = 0;
       ralloc_free(nir);
-      pipeline->shader_cso[sh] = lvp_pipeline_compile(pipeline, nir_shader_clone(NULL, pipeline->pipeline_nir[stage]));
-      shader_state = pipeline->shader_cso[sh];
+      /* the other queues compile their regular CSO once they bind it */
+      simple_mtx_lock(&pipeline->inline_lock);
+      pipeline->inlines[stage].can_inline = 0;
+      simple_mtx_unlock(&pipeline->inline_lock);
+      shader_state = get_shader_cso(state, pipeline, sh);
+      state->shader_inlined[sh] = false;
    } else {
-      shader_state = lvp_pipeline_compile(pipeline, nir);
-   }
-   switch (sh) {
-   case PIPE_SHADER_VERTEX:
-      state->pctx->bind_vs_state(state->pctx, shader_state);
-      break;
-   case PIPE_SHADER_TESS_CTRL:
-      state->pctx->bind_tcs_state(state->pctx, shader_state);
-      break;
-   case PIPE_SHADER_TESS_EVAL:
-      state->pctx->bind_tes_state(state->pctx, shader_state);
-      break;
-   case PIPE_SHADER_GEOMETRY:
-      state->pctx->bind_gs_state(state->pctx, shader_state);
-      break;
-   case PIPE_SHADER_FRAGMENT:
-      state->pctx->bind_fs_state(state->pctx, shader_state);
-      break;
-   case PIPE_SHADER_COMPUTE:
-      state->pctx->bind_compute_state(state->pctx, shader_state);
-      break;
-   default: break;
+      shader_state = lvp_pipeline_compile(pipeline, state->pctx, nir);
    }
+   bind_shader_state(state, sh, shader_state);
 }
 
 static void emit_compute_state(struct rendering_state *state)
@@ -574,8 +629,9 @@ static void handle_compute_pipeline(struct vk_cmd_queue_entry *cmd,
    state->dispatch_info.block[1] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.workgroup_size[1];
    state->dispatch_info.block[2] = pipeline->pipeline_nir[MESA_SHADER_COMPUTE]->info.workgroup_size[2];
    state->inlines_dirty[PIPE_SHADER_COMPUTE] = pipeline->inlines[MESA_SHADER_COMPUTE].can_inline;
+   state->shader_inlined[PIPE_SHADER_COMPUTE] = state->inlines_dirty[PIPE_SHADER_COMPUTE];
    if (!pipeline->inlines[MESA_SHADER_COMPUTE].can_inline)
-      state->pctx->bind_compute_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
+      state->pctx->bind_compute_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_COMPUTE));
 }
 
 static void
@@ -673,44 +729,50 @@ static void handle_graphics_pipeline(struct vk_cmd_queue_entry *cmd,
    state->tess_states[0] = NULL;
    state->tess_states[1] = NULL;
    state->gs_output_lines = GS_OUTPUT_NONE;
+   memset(state->shader_inlined, 0, sizeof(state->shader_inlined[0]) * PIPE_SHADER_COMPUTE);
    {
       u_foreach_bit(b, pipeline->graphics_state.shader_stages) {
          VkShaderStageFlagBits vk_stage = (1 << b);
          switch (vk_stage) {
          case VK_SHADER_STAGE_FRAGMENT_BIT:
             state->inlines_dirty[PIPE_SHADER_FRAGMENT] = pipeline->inlines[MESA_SHADER_FRAGMENT].can_inline;
+            state->shader_inlined[PIPE_SHADER_FRAGMENT] = state->inlines_dirty[PIPE_SHADER_FRAGMENT];
             if (!pipeline->inlines[MESA_SHADER_FRAGMENT].can_inline)
-               state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+               state->pctx->bind_fs_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_FRAGMENT));
             has_stage[PIPE_SHADER_FRAGMENT] = true;
             break;
          case VK_SHADER_STAGE_VERTEX_BIT:
             state->inlines_dirty[PIPE_SHADER_VERTEX] = pipeline->inlines[MESA_SHADER_VERTEX].can_inline;
+            state->shader_inlined[PIPE_SHADER_VERTEX] = state->inlines_dirty[PIPE_SHADER_VERTEX];
             if (!pipeline->inlines[MESA_SHADER_VERTEX].can_inline)
-               state->pctx->bind_vs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
+               state->pctx->bind_vs_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_VERTEX));
             has_stage[PIPE_SHADER_VERTEX] = true;
             break;
          case VK_SHADER_STAGE_GEOMETRY_BIT:
             state->inlines_dirty[PIPE_SHADER_GEOMETRY] = pipeline->inlines[MESA_SHADER_GEOMETRY].can_inline;
+            state->shader_inlined[PIPE_SHADER_GEOMETRY] = state->inlines_dirty[PIPE_SHADER_GEOMETRY];
             if (!pipeline->inlines[MESA_SHADER_GEOMETRY].can_inline)
-               state->pctx->bind_gs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
+               state->pctx->bind_gs_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_GEOMETRY));
             state->gs_output_lines = pipeline->gs_output_lines ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
             has_stage[PIPE_SHADER_GEOMETRY] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
             state->inlines_dirty[PIPE_SHADER_TESS_CTRL] = pipeline->inlines[MESA_SHADER_TESS_CTRL].can_inline;
+            state->shader_inlined[PIPE_SHADER_TESS_CTRL] = state->inlines_dirty[PIPE_SHADER_TESS_CTRL];
             if (!pipeline->inlines[MESA_SHADER_TESS_CTRL].can_inline)
-               state->pctx->bind_tcs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
+               state->pctx->bind_tcs_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_TESS_CTRL));
             has_stage[PIPE_SHADER_TESS_CTRL] = true;
             break;
          case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
             state->inlines_dirty[PIPE_SHADER_TESS_EVAL] = pipeline->inlines[MESA_SHADER_TESS_EVAL].can_inline;
+            state->shader_inlined[PIPE_SHADER_TESS_EVAL] = state->inlines_dirty[PIPE_SHADER_TESS_EVAL];
             if (!pipeline->inlines[MESA_SHADER_TESS_EVAL].can_inline) {
                if (BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN)) {
-                  state->tess_states[0] = pipeline->shader_cso[PIPE_SHADER_TESS_EVAL];
-                  state->tess_states[1] = pipeline->tess_ccw_cso;
+                  state->tess_states[0] = get_shader_cso(state, pipeline, PIPE_SHADER_TESS_EVAL);
+                  state->tess_states[1] = pipeline->tess_ccw_cso[state->queue_index];
                   state->pctx->bind_tes_state(state->pctx, state->tess_states[state->tess_ccw]);
                } else {
-                  state->pctx->bind_tes_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
+                  state->pctx->bind_tes_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_TESS_EVAL));
                }
             }
             if (!BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN))
@@ -726,7 +788,7 @@ static void handle_graphics_pipeline(struct vk_cmd_queue_entry *cmd,
 
    /* there should always be a dummy fs. */
    if (!has_stage[PIPE_SHADER_FRAGMENT])
-      state->pctx->bind_fs_state(state->pctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
+      state->pctx->bind_fs_state(state->pctx, get_shader_cso(state, pipeline, PIPE_SHADER_FRAGMENT));
    if (state->pctx->bind_gs_state && !has_stage[PIPE_SHADER_GEOMETRY])
       state->pctx->bind_gs_state(state->pctx, NULL);
    if (state->pctx->bind_tcs_state && !has_stage[PIPE_SHADER_TESS_CTRL])
@@ -1047,6 +1109,15 @@ static void handle_pipeline(struct vk_cmd_queue_entry *cmd,
                             struct rendering_state *state)
 {
    LVP_FROM_HANDLE(lvp_pipeline, pipeline, cmd->u.bind_pipeline.pipeline);
+
+   /* Rebinding the bound pipeline is a no-op unless something in between
+    * overrode part of its state. Only the pipeline bind writes compute
+    * state, graphics is tracked by gfx_pipeline_clean.
+    */
+   if (state->pipeline[pipeline->is_compute_pipeline] == pipeline &&
+       (pipeline->is_compute_pipeline || state->gfx_pipeline_clean))
+      return;
+
    if (pipeline->is_compute_pipeline) {
       handle_compute_pipeline(cmd, state);
       handle_pipeline_access(state, MESA_SHADER_COMPUTE);
@@ -1057,6 +1128,8 @@ static void handle_pipeline(struct vk_cmd_queue_entry *cmd,
    }
    state->push_size[pipeline->is_compute_pipeline] = pipeline->layout->push_constant_size;
    state->pipeline[pipeline->is_compute_pipeline] = pipeline;
+   if (!pipeline->is_compute_pipeline)
+      state->gfx_pipeline_clean = true;
 }
 
 static void handle_vertex_buffers2(struct vk_cmd_queue_entry *cmd,
@@ -1082,6 +1155,41 @@ static void handle_vertex_buffers2(struct vk_cmd_queue_entry *cmd,
    state->vb_dirty = true;
 }
 
+/* A descriptor resolved to the rendering state slot it gets bound to. */
+enum bound_descriptor_kind {
+   BOUND_SAMPLER,
+   BOUND_SAMPLER_VIEW,
+   BOUND_IMAGE,
+   BOUND_CONST_BUFFER,
+   BOUND_SHADER_BUFFER,
+   BOUND_UNIFORM_BLOCK,
+};
+
+struct bound_descriptor {
+   uint8_t kind;
+   uint8_t p_stage;
+   uint16_t idx;
+   /* dynamic offset added to buffer descriptors */
+   uint32_t offset;
+   /* owned by the set or its layout, valid until the set is updated */
+   const void *data;
+};
+
+/* The resolved form of a vkCmdBindDescriptorSets, kept in the command's
+ * driver_data so later executions can skip walking the set layouts.  It
+ * stays valid as long as the generations of the bound sets match.
+ */
+struct descriptor_bake {
+   struct list_head link;
+   unsigned rebakes;
+   unsigned count;
+   struct bound_descriptor *descs;
+   uint64_t generations[];
+};
+
+/* Sets which keep changing between executions aren't worth baking. */
+#define MAX_DESCRIPTOR_REBAKES 4
+
 struct dyn_info {
    struct {
       uint16_t const_buffer_count;
@@ -1095,8 +1203,88 @@ struct dyn_info {
    uint32_t dyn_index;
    const uint32_t *dynamic_offsets;
    uint32_t dynamic_offset_count;
+
+   /* bound_descriptors are recorded here when baking */
+   struct util_dynarray *bake;
 };
 
+static void apply_bound_descriptor(struct rendering_state *state,
+                                   const struct bound_descriptor *desc)
+{
+   enum pipe_shader_type p_stage = desc->p_stage;
+   unsigned idx = desc->idx;
+
+   switch (desc->kind) {
+   case BOUND_SAMPLER:
+      state->ss[p_stage][idx] = *(const struct pipe_sampler_state *)desc->data;
+      if (state->num_sampler_states[p_stage] <= idx)
+         state->num_sampler_states[p_stage] = idx + 1;
+      state->ss_dirty[p_stage] = true;
+      break;
+   case BOUND_SAMPLER_VIEW:
+      assert(idx < ARRAY_SIZE(state->sv[p_stage]));
+      state->sv[p_stage][idx] = (struct pipe_sampler_view *)desc->data;
+      if (state->num_sampler_views[p_stage] <= idx)
+         state->num_sampler_views[p_stage] = idx + 1;
+      state->sv_dirty[p_stage] = true;
+      break;
+   case BOUND_IMAGE: {
+      /* the access flags come from the pipeline */
+      uint16_t access = state->iv[p_stage][idx].access;
+      uint16_t shader_access = state->iv[p_stage][idx].shader_access;
+      state->iv[p_stage][idx] = *(const struct pipe_image_view *)desc->data;
+      state->iv[p_stage][idx].access = access;
+      state->iv[p_stage][idx].shader_access = shader_access;
+      if (state->num_shader_images[p_stage] <= idx)
+         state->num_shader_images[p_stage] = idx + 1;
+      state->iv_dirty[p_stage] = true;
+      break;
+   }
+   case BOUND_CONST_BUFFER:
+      state->const_buffer[p_stage][idx] = *(const struct pipe_constant_buffer *)desc->data;
+      state->const_buffer[p_stage][idx].buffer_offset += desc->offset;
+      if (state->num_const_bufs[p_stage] <= idx)
+         state->num_const_bufs[p_stage] = idx + 1;
+      state->constbuf_dirty[p_stage] = true;
+      state->inlines_dirty[p_stage] = true;
+      break;
+   case BOUND_SHADER_BUFFER:
+      state->sb[p_stage][idx] = *(const struct pipe_shader_buffer *)desc->data;
+      state->sb[p_stage][idx].buffer_offset += desc->offset;
+      if (state->num_shader_buffers[p_stage] <= idx)
+         state->num_shader_buffers[p_stage] = idx + 1;
+      state->sb_dirty[p_stage] = true;
+      break;
+   case BOUND_UNIFORM_BLOCK:
+      state->uniform_blocks[p_stage].block[idx] = (void *)desc->data;
+      state->pcbuf_dirty[p_stage] = true;
+      state->inlines_dirty[p_stage] = true;
+      break;
+   default:
+      unreachable("unknown bound descriptor");
+   }
+}
+
+static void bind_descriptor(struct rendering_state *state,
+                            struct dyn_info *dyn_info,
+                            enum bound_descriptor_kind kind,
+                            enum pipe_shader_type p_stage,
+                            int idx, uint32_t offset,
+                            const void *data)
+{
+   struct bound_descriptor desc = {
+      .kind = kind,
+      .p_stage = p_stage,
+      .idx = idx,
+      .offset = offset,
+      .data = data,
+   };
+
+   apply_bound_descriptor(state, &desc);
+   if (dyn_info->bake)
+      util_dynarray_append(dyn_info->bake, struct bound_descriptor, desc);
+}
+
 static void fill_sampler_stage(struct rendering_state *state,
                                struct dyn_info *dyn_info,
                                gl_shader_stage stage,
@@ -1111,10 +1299,7 @@ static void fill_sampler_stage(struct rendering_state *state,
    ss_idx += array_idx;
    ss_idx += dyn_info->stage[stage].sampler_count;
    struct pipe_sampler_state *ss = binding->immutable_samplers ? binding->immutable_samplers[array_idx] : descriptor->sampler;
-   state->ss[p_stage][ss_idx] = *ss;
-   if (state->num_sampler_states[p_stage] <= ss_idx)
-      state->num_sampler_states[p_stage] = ss_idx + 1;
-   state->ss_dirty[p_stage] = true;
+   bind_descriptor(state, dyn_info, BOUND_SAMPLER, p_stage, ss_idx, 0, ss);
 }
 
 static void fill_sampler_view_stage(struct rendering_state *state,
@@ -1130,13 +1315,8 @@ static void fill_sampler_view_stage(struct rendering_state *state,
       return;
    sv_idx += array_idx;
    sv_idx += dyn_info->stage[stage].sampler_view_count;
-
-   assert(sv_idx < ARRAY_SIZE(state->sv[p_stage]));
-   state->sv[p_stage][sv_idx] = descriptor->sampler_view;
-
-   if (state->num_sampler_views[p_stage] <= sv_idx)
-      state->num_sampler_views[p_stage] = sv_idx + 1;
-   state->sv_dirty[p_stage] = true;
+   bind_descriptor(state, dyn_info, BOUND_SAMPLER_VIEW, p_stage, sv_idx, 0,
+                   descriptor->sampler_view);
 }
 
 static void fill_image_view_stage(struct rendering_state *state,
@@ -1152,16 +1332,8 @@ static void fill_image_view_stage(struct rendering_state *state,
       return;
    idx += array_idx;
    idx += dyn_info->stage[stage].image_count;
-   uint16_t access = state->iv[p_stage][idx].access;
-   uint16_t shader_access = state->iv[p_stage][idx].shader_access;
-   state->iv[p_stage][idx] = descriptor->image_view;
-   state->iv[p_stage][idx].access = access;
-   state->iv[p_stage][idx].shader_access = shader_access;
-
-   if (state->num_shader_images[p_stage] <= idx)
-      state->num_shader_images[p_stage] = idx + 1;
-
-   state->iv_dirty[p_stage] = true;
+   bind_descriptor(state, dyn_info, BOUND_IMAGE, p_stage, idx, 0,
+                   &descriptor->image_view);
 }
 
 static void handle_descriptor(struct rendering_state *state,
@@ -1183,9 +1355,8 @@ static void handle_descriptor(struct rendering_state *state,
          return;
       idx += dyn_info->stage[stage].uniform_block_count;
       assert(descriptor->uniform);
-      state->uniform_blocks[p_stage].block[idx] = descriptor->uniform;
-      state->pcbuf_dirty[p_stage] = true;
-      state->inlines_dirty[p_stage] = true;
+      bind_descriptor(state, dyn_info, BOUND_UNIFORM_BLOCK, p_stage, idx, 0,
+                      descriptor->uniform);
       break;
    }
    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
@@ -1201,15 +1372,10 @@ static void handle_descriptor(struct rendering_state *state,
          return;
       idx += array_idx;
       idx += dyn_info->stage[stage].const_buffer_count;
-      state->const_buffer[p_stage][idx] = descriptor->ubo;
-      if (is_dynamic) {
-         uint32_t offset = dyn_info->dynamic_offsets[dyn_info->dyn_index + binding->dynamic_index + array_idx];
-         state->const_buffer[p_stage][idx].buffer_offset += offset;
-      }
-      if (state->num_const_bufs[p_stage] <= idx)
-         state->num_const_bufs[p_stage] = idx + 1;
-      state->constbuf_dirty[p_stage] = true;
-      state->inlines_dirty[p_stage] = true;
+      uint32_t offset = is_dynamic ?
+         dyn_info->dynamic_offsets[dyn_info->dyn_index + binding->dynamic_index + array_idx] : 0;
+      bind_descriptor(state, dyn_info, BOUND_CONST_BUFFER, p_stage, idx, offset,
+                      &descriptor->ubo);
       break;
    }
    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
@@ -1219,14 +1385,10 @@ static void handle_descriptor(struct rendering_state *state,
          return;
       idx += array_idx;
       idx += dyn_info->stage[stage].shader_buffer_count;
-      state->sb[p_stage][idx] = descriptor->ssbo;
-      if (is_dynamic) {
-         uint32_t offset = dyn_info->dynamic_offsets[dyn_info->dyn_index + binding->dynamic_index + array_idx];
-         state->sb[p_stage][idx].buffer_offset += offset;
-      }
-      if (state->num_shader_buffers[p_stage] <= idx)
-         state->num_shader_buffers[p_stage] = idx + 1;
-      state->sb_dirty[p_stage] = true;
+      uint32_t offset = is_dynamic ?
+         dyn_info->dynamic_offsets[dyn_info->dyn_index + binding->dynamic_index + array_idx] : 0;
+      bind_descriptor(state, dyn_info, BOUND_SHADER_BUFFER, p_stage, idx, offset,
+                      &descriptor->ssbo);
       break;
    }
    case VK_DESCRIPTOR_TYPE_SAMPLER:
@@ -1310,6 +1472,94 @@ static void handle_compute_descriptor_sets(struct vk_cmd_queue_entry *cmd,
    }
 }
 
+static bool
+bind_descriptor_sets_equal(const struct vk_cmd_bind_descriptor_sets *a,
+                           const struct vk_cmd_bind_descriptor_sets *b)
+{
+   return a->layout == b->layout &&
+          a->first_set == b->first_set &&
+          a->descriptor_set_count == b->descriptor_set_count &&
+          a->dynamic_offset_count == b->dynamic_offset_count &&
+          !memcmp(a->descriptor_sets, b->descriptor_sets,
+                  a->descriptor_set_count * sizeof(a->descriptor_sets[0])) &&
+          (!a->dynamic_offset_count ||
+           !memcmp(a->dynamic_offsets, b->dynamic_offsets,
+                   a->dynamic_offset_count * sizeof(a->dynamic_offsets[0])));
+}
+
+static uint64_t
+descriptor_set_generation(VkDescriptorSet handle)
+{
+   const struct lvp_descriptor_set *set = lvp_descriptor_set_from_handle(handle);
+   return set ? set->generation : 0;
+}
+
+static bool
+replay_descriptor_bake(struct vk_cmd_queue_entry *cmd,
+                       struct rendering_state *state)
+{
+   const struct vk_cmd_bind_descriptor_sets *bds = &cmd->u.bind_descriptor_sets;
+   const struct descriptor_bake *bake = p_atomic_read(&cmd->driver_data);
+
+   if (!bake)
+      return false;
+
+   for (unsigned i = 0; i < bds->descriptor_set_count; i++) {
+      if (bake->generations[i] != descriptor_set_generation(bds->descriptor_sets[i]))
+         return false;
+   }
+
+   for (unsigned i = 0; i < bake->count; i++)
+      apply_bound_descriptor(state, &bake->descs[i]);
+   return true;
+}
+
+static void
+finish_descriptor_bake(struct vk_cmd_queue_entry *cmd,
+                       struct rendering_state *state,
+                       struct util_dynarray *descs)
+{
+   const struct vk_cmd_bind_descriptor_sets *bds = &cmd->u.bind_descriptor_sets;
+   struct descriptor_bake *old = p_atomic_read(&cmd->driver_data);
+   struct descriptor_bake *bake =
+      malloc(sizeof(*bake) + bds->descriptor_set_count * sizeof(bake->generations[0]) +
+             descs->size);
+   if (!bake)
+      goto out;
+
+   bake->rebakes = old ? old->rebakes + 1 : 0;
+   bake->count = util_dynarray_num_elements(descs, struct bound_descriptor);
+   bake->descs = (struct bound_descriptor *)&bake->generations[bds->descriptor_set_count];
+   for (unsigned i = 0; i < bds->descriptor_set_count; i++)
+      bake->generations[i] = descriptor_set_generation(bds->descriptor_sets[i]);
+   if (descs->size)
+      memcpy(bake->descs, descs->data, descs->size);
+
+   /* SIMULTANEOUS_USE command buffers can execute on several queues at once.
+    * Bakes which got replaced stay around until the command buffer is reset,
+    * another queue may still be replaying them.
+    */
+   if (p_atomic_cmpxchg(&cmd->driver_data, old, bake) != old) {
+      free(bake);
+      goto out;
+   }
+
+   simple_mtx_lock(&state->cmd_buffer->bake_lock);
+   list_addtail(&bake->link, &state->cmd_buffer->bakes);
+   simple_mtx_unlock(&state->cmd_buffer->bake_lock);
+
+out:
+   util_dynarray_fini(descs);
+}
+
+void
+lvp_cmd_buffer_free_bakes(struct lvp_cmd_buffer *cmd_buffer)
+{
+   list_for_each_entry_safe(struct descriptor_bake, bake, &cmd_buffer->bakes, link)
+      free(bake);
+   list_inithead(&cmd_buffer->bakes);
+}
+
 static void handle_descriptor_sets(struct vk_cmd_queue_entry *cmd,
                                    struct rendering_state *state)
 {
@@ -1318,13 +1568,35 @@ static void handle_descriptor_sets(struct vk_cmd_queue_entry *cmd,
    int i;
    struct dyn_info dyn_info;
 
+   /* Set contents can't change while the command buffer executes, so
+    * binding the same sets again would resolve to the same state.
+    */
+   bool is_compute = bds->pipeline_bind_point == VK_PIPELINE_BIND_POINT_COMPUTE;
+   if (state->last_bds[is_compute] &&
+       bind_descriptor_sets_equal(state->last_bds[is_compute], bds))
+      return;
+   state->last_bds[is_compute] = bds;
+
+   if (replay_descriptor_bake(cmd, state))
+      return;
+
+   const struct descriptor_bake *old_bake = p_atomic_read(&cmd->driver_data);
+   struct util_dynarray bake;
+   util_dynarray_init(&bake, NULL);
+
    dyn_info.dyn_index = 0;
    dyn_info.dynamic_offsets = bds->dynamic_offsets;
    dyn_info.dynamic_offset_count = bds->dynamic_offset_count;
+   dyn_info.bake = NULL;
+   if (state->cmd_buffer->bake_binds &&
+       (!old_bake || old_bake->rebakes < MAX_DESCRIPTOR_REBAKES))
+      dyn_info.bake = &bake;
 
    memset(dyn_info.stage, 0, sizeof(dyn_info.stage));
    if (bds->pipeline_bind_point == VK_PIPELINE_BIND_POINT_COMPUTE) {
       handle_compute_descriptor_sets(cmd, &dyn_info, state);
+      if (dyn_info.bake)
+         finish_descriptor_bake(cmd, state, &bake);
       return;
    }
 
@@ -1363,6 +1635,9 @@ static void handle_descriptor_sets(struct vk_cmd_queue_entry *cmd,
 
       increment_dyn_info(&dyn_info, layout->vk.set_layouts[bds->first_set + i], true);
    }
+
+   if (dyn_info.bake)
+      finish_descriptor_bake(cmd, state, &bake);
 }
 
 static struct pipe_surface *create_img_surface_bo(struct rendering_state *state,
@@ -2752,6 +3027,23 @@ static void handle_pipeline_barrier(struct vk_cmd_queue_entry *cmd,
    finish_fence(state);
 }
 
+/* Create the query on this queue's context if it doesn't exist yet. A query
+ * that was created by another queue is recreated, since it has been reset
+ * before it can be used again.
+ */
+static void
+get_query(struct rendering_state *state, struct lvp_query_pool *pool,
+          uint32_t query, enum pipe_query_type type, unsigned index)
+{
+   if (pool->queries[query] && pool->contexts[query] != state->pctx)
+      lvp_query_pool_destroy_query(pool, query);
+
+   if (!pool->queries[query]) {
+      pool->queries[query] = state->pctx->create_query(state->pctx, type, index);
+      pool->contexts[query] = state->pctx;
+   }
+}
+
 static void handle_begin_query(struct vk_cmd_queue_entry *cmd,
                                struct rendering_state *state)
 {
@@ -2764,11 +3056,7 @@ static void handle_begin_query(struct vk_cmd_queue_entry *cmd,
 
    emit_state(state);
 
-   if (!pool->queries[qcmd->query]) {
-      enum pipe_query_type qtype = pool->base_type;
-      pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
-                                                             qtype, 0);
-   }
+   get_query(state, pool, qcmd->query, pool->base_type, 0);
 
    state->pctx->begin_query(state->pctx, pool->queries[qcmd->query]);
 }
@@ -2796,11 +3084,7 @@ static void handle_begin_query_indexed_ext(struct vk_cmd_queue_entry *cmd,
 
    emit_state(state);
 
-   if (!pool->queries[qcmd->query]) {
-      enum pipe_query_type qtype = pool->base_type;
-      pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
-                                                             qtype, qcmd->index);
-   }
+   get_query(state, pool, qcmd->query, pool->base_type, qcmd->index);
 
    state->pctx->begin_query(state->pctx, pool->queries[qcmd->query]);
 }
@@ -2820,12 +3104,8 @@ static void handle_reset_query_pool(struct vk_cmd_queue_entry *cmd,
 {
    struct vk_cmd_reset_query_pool *qcmd = &cmd->u.reset_query_pool;
    LVP_FROM_HANDLE(lvp_query_pool, pool, qcmd->query_pool);
-   for (unsigned i = qcmd->first_query; i < qcmd->first_query + qcmd->query_count; i++) {
-      if (pool->queries[i]) {
-         state->pctx->destroy_query(state->pctx, pool->queries[i]);
-         pool->queries[i] = NULL;
-      }
-   }
+   for (unsigned i = qcmd->first_query; i < qcmd->first_query + qcmd->query_count; i++)
+      lvp_query_pool_destroy_query(pool, i);
 }
 
 static void handle_write_timestamp2(struct vk_cmd_queue_entry *cmd,
@@ -2833,10 +3113,7 @@ static void handle_write_timestamp2(struct vk_cmd_queue_entry *cmd,
 {
    struct vk_cmd_write_timestamp2 *qcmd = &cmd->u.write_timestamp2;
    LVP_FROM_HANDLE(lvp_query_pool, pool, qcmd->query_pool);
-   if (!pool->queries[qcmd->query]) {
-      pool->queries[qcmd->query] = state->pctx->create_query(state->pctx,
-                                                             PIPE_QUERY_TIMESTAMP, 0);
-   }
+   get_query(state, pool, qcmd->query, PIPE_QUERY_TIMESTAMP, 0);
 
    if (!(qcmd->stage == VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT))
       state->pctx->flush(state->pctx, NULL, 0);
@@ -3269,9 +3546,12 @@ static void handle_push_descriptor_set_generic(struct vk_cmd_push_descriptor_set
    const struct lvp_descriptor_set_layout *layout =
       vk_to_lvp_descriptor_set_layout(pds->layout->vk.set_layouts[pds->set]);
 
+   state->last_bds[pds->bind_point == VK_PIPELINE_BIND_POINT_COMPUTE] = NULL;
+
    struct dyn_info dyn_info;
    memset(&dyn_info.stage, 0, sizeof(dyn_info.stage));
    dyn_info.dyn_index = 0;
+   dyn_info.bake = NULL;
    if (pds->bind_point == VK_PIPELINE_BIND_POINT_COMPUTE) {
       handle_compute_push_descriptor_set(pds, &dyn_info, state);
    }
@@ -3986,13 +4266,54 @@ void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
 #undef ENQUEUE_CMD
 }
 
+/* Whether a command leaves all state set by a graphics pipeline bind alone,
+ * so that rebinding the same pipeline afterwards can be skipped.
+ */
+static bool
+cmd_preserves_gfx_pipeline(const struct vk_cmd_queue_entry *cmd)
+{
+   switch (cmd->type) {
+   case VK_CMD_BIND_PIPELINE:
+   case VK_CMD_BIND_DESCRIPTOR_SETS:
+   case VK_CMD_BIND_INDEX_BUFFER:
+   case VK_CMD_PUSH_CONSTANTS:
+   case VK_CMD_PUSH_DESCRIPTOR_SET_KHR:
+   case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE_KHR:
+   case VK_CMD_DRAW:
+   case VK_CMD_DRAW_MULTI_EXT:
+   case VK_CMD_DRAW_INDEXED:
+   case VK_CMD_DRAW_INDIRECT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+   case VK_CMD_DISPATCH:
+   case VK_CMD_DISPATCH_BASE:
+   case VK_CMD_DISPATCH_INDIRECT:
+   case VK_CMD_PIPELINE_BARRIER2:
+   case VK_CMD_BEGIN_QUERY:
+   case VK_CMD_END_QUERY:
+   case VK_CMD_WRITE_TIMESTAMP2:
+   /* the secondary's own commands are checked as they execute */
+   case VK_CMD_EXECUTE_COMMANDS:
+      return true;
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+      /* strides override the pipeline's vertex input state */
+      return !cmd->u.bind_vertex_buffers2.strides;
+   default:
+      return false;
+   }
+}
+
 static void lvp_execute_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer,
                                    struct rendering_state *state)
 {
    struct vk_cmd_queue_entry *cmd;
    bool first = true;
    bool did_flush = false;
+   struct lvp_cmd_buffer *parent = state->cmd_buffer;
 
+   state->cmd_buffer = cmd_buffer;
    LIST_FOR_EACH_ENTRY(cmd, &cmd_buffer->vk.cmd_queue.cmds, cmd_link) {
       switch (cmd->type) {
       case VK_CMD_BIND_PIPELINE:
@@ -4302,9 +4623,12 @@ static void lvp_execute_cmd_buffer(struct lvp_cmd_buffer *cmd_buffer,
          unreachable("Unsupported command");
          break;
       }
+      if (!cmd_preserves_gfx_pipeline(cmd))
+         state->gfx_pipeline_clean = false;
       first = false;
       did_flush = false;
    }
+   state->cmd_buffer = parent;
 }
 
 VkResult lvp_execute_cmds(struct lvp_device *device,
@@ -4314,6 +4638,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    struct rendering_state *state = queue->state;
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
+   state->queue_index = queue->vk.index_in_family;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
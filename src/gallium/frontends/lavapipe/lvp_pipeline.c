@@ -49,19 +49,6 @@
 void
 lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline)
 {
-   if (pipeline->shader_cso[PIPE_SHADER_VERTEX])
-      device->queue.ctx->delete_vs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_VERTEX]);
-   if (pipeline->shader_cso[PIPE_SHADER_FRAGMENT])
-      device->queue.ctx->delete_fs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_FRAGMENT]);
-   if (pipeline->shader_cso[PIPE_SHADER_GEOMETRY])
-      device->queue.ctx->delete_gs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_GEOMETRY]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_CTRL])
-      device->queue.ctx->delete_tcs_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_CTRL]);
-   if (pipeline->shader_cso[PIPE_SHADER_TESS_EVAL])
-      device->queue.ctx->delete_tes_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_TESS_EVAL]);
-   if (pipeline->shader_cso[PIPE_SHADER_COMPUTE])
-      device->queue.ctx->delete_compute_state(device->queue.ctx, pipeline->shader_cso[PIPE_SHADER_COMPUTE]);
-
    for (unsigned i = 0; i < MESA_SHADER_STAGES; i++)
       ralloc_free(pipeline->pipeline_nir[i]);
 
@@ -70,10 +57,39 @@ lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline)
 
    ralloc_free(pipeline->mem_ctx);
    vk_free(&device->vk.alloc, pipeline->state_data);
+   simple_mtx_destroy(&pipeline->inline_lock);
    vk_object_base_finish(&pipeline->base);
    vk_free(&device->vk.alloc, pipeline);
 }
 
+/* Called on each queue's thread once the pipeline has been destroyed, the
+ * last queue to get there frees the pipeline.
+ */
+void
+lvp_pipeline_destroy_queue(struct lvp_queue *queue, struct lvp_pipeline *pipeline)
+{
+   struct pipe_context *ctx = queue->ctx;
+   void **cso = pipeline->shader_cso[queue->vk.index_in_family];
+
+   if (cso[PIPE_SHADER_VERTEX])
+      ctx->delete_vs_state(ctx, cso[PIPE_SHADER_VERTEX]);
+   if (cso[PIPE_SHADER_FRAGMENT])
+      ctx->delete_fs_state(ctx, cso[PIPE_SHADER_FRAGMENT]);
+   if (cso[PIPE_SHADER_GEOMETRY])
+      ctx->delete_gs_state(ctx, cso[PIPE_SHADER_GEOMETRY]);
+   if (cso[PIPE_SHADER_TESS_CTRL])
+      ctx->delete_tcs_state(ctx, cso[PIPE_SHADER_TESS_CTRL]);
+   if (cso[PIPE_SHADER_TESS_EVAL])
+      ctx->delete_tes_state(ctx, cso[PIPE_SHADER_TESS_EVAL]);
+   if (pipeline->tess_ccw_cso[queue->vk.index_in_family])
+      ctx->delete_tes_state(ctx, pipeline->tess_ccw_cso[queue->vk.index_in_family]);
+   if (cso[PIPE_SHADER_COMPUTE])
+      ctx->delete_compute_state(ctx, cso[PIPE_SHADER_COMPUTE]);
+
+   if (p_atomic_dec_zero(&pipeline->queue_refs))
+      lvp_pipeline_destroy(queue->device, pipeline);
+}
+
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    VkDevice                                    _device,
    VkPipeline                                  _pipeline,
@@ -85,9 +101,14 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipeline(
    if (!_pipeline)
       return;
 
-   simple_mtx_lock(&device->queue.pipeline_lock);
-   util_dynarray_append(&device->queue.pipeline_destroys, struct lvp_pipeline*, pipeline);
-   simple_mtx_unlock(&device->queue.pipeline_lock);
+   /* Each queue drops its own CSOs the next time it's done with a submit */
+   pipeline->queue_refs = device->num_queues;
+   for (unsigned i = 0; i < device->num_queues; i++) {
+      struct lvp_queue *queue = &device->queues[i];
+      simple_mtx_lock(&queue->pipeline_lock);
+      util_dynarray_append(&queue->pipeline_destroys, struct lvp_pipeline*, pipeline);
+      simple_mtx_unlock(&queue->pipeline_lock);
+   }
 }
 
 static void
@@ -359,7 +380,9 @@ lvp_shader_optimize(nir_shader *nir)
 
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
-                         const VkPipelineShaderStageCreateInfo *sinfo)
+                         struct vk_pipeline_cache *cache,
+                         const VkPipelineShaderStageCreateInfo *sinfo,
+                         bool *cache_hit)
 {
    struct lvp_device *pdevice = pipeline->device;
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
@@ -418,11 +441,28 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
       .shared_addr_format = nir_address_format_32bit_offset,
    };
 
-   result = vk_pipeline_shader_stage_to_nir(&pdevice->vk, sinfo,
-                                            &spirv_options, pdevice->physical_device->drv_options[stage],
-                                            NULL, &nir);
-   if (result != VK_SUCCESS)
-      return result;
+   const nir_shader_compiler_options *nir_options =
+      pdevice->physical_device->drv_options[stage];
+
+   /* Only the SPIR-V -> NIR translation is cached here; everything below
+    * depends on pipeline state and is cheap compared to spirv_to_nir.  The
+    * LLVM code generated from the final NIR goes through llvmpipe's own
+    * disk cache.
+    */
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+   vk_pipeline_hash_shader_stage(sinfo, stage_sha1);
+
+   nir = vk_pipeline_cache_lookup_nir(cache, stage_sha1, sizeof(stage_sha1),
+                                      nir_options, cache_hit, NULL);
+   if (!nir) {
+      result = vk_pipeline_shader_stage_to_nir(&pdevice->vk, sinfo,
+                                               &spirv_options, nir_options,
+                                               NULL, &nir);
+      if (result != VK_SUCCESS)
+         return result;
+
+      vk_pipeline_cache_add_nir(cache, stage_sha1, sizeof(stage_sha1), nir);
+   }
 
    if (nir->info.stage != MESA_SHADER_TESS_CTRL)
       NIR_PASS_V(nir, remove_scoped_barriers, nir->info.stage == MESA_SHADER_COMPUTE);
@@ -594,15 +634,15 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 void *
-lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, nir_shader *nir)
+lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, struct pipe_context *ctx,
+                           nir_shader *nir)
 {
-   struct lvp_device *device = pipeline->device;
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.req_local_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -612,15 +652,15 @@ lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, nir_shader *nir)
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
          break;
@@ -630,11 +670,12 @@ lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, nir_shader *nir)
 }
 
 void *
-lvp_pipeline_compile(struct lvp_pipeline *pipeline, nir_shader *nir)
+lvp_pipeline_compile(struct lvp_pipeline *pipeline, struct pipe_context *ctx,
+                     nir_shader *nir)
 {
    struct lvp_device *device = pipeline->device;
    device->physical_device->pscreen->finalize_nir(device->physical_device->pscreen, nir);
-   return lvp_pipeline_compile_stage(pipeline, nir);
+   return lvp_pipeline_compile_stage(pipeline, ctx, nir);
 }
 
 #ifndef NDEBUG
@@ -722,8 +763,9 @@ merge_layouts(struct lvp_pipeline *dst, struct lvp_pipeline_layout *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
-                           const VkGraphicsPipelineCreateInfo *pCreateInfo)
+                           struct vk_pipeline_cache *cache,
+                           const VkGraphicsPipelineCreateInfo *pCreateInfo,
+                           bool *cache_hit)
 {
    VkResult result;
 
@@ -741,6 +783,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                          VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT |
                          VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
    pipeline->mem_ctx = ralloc_context(NULL);
+   simple_mtx_init(&pipeline->inline_lock, mtx_plain);
 
    if (pCreateInfo->flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR)
       pipeline->library = true;
@@ -800,6 +843,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->device = device;
 
+   unsigned stages_compiled = 0, stages_hit = 0;
    for (uint32_t i = 0; i < pCreateInfo->stageCount; i++) {
       const VkPipelineShaderStageCreateInfo *sinfo = &pCreateInfo->pStages[i];
       gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
@@ -810,9 +854,13 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
+      bool stage_hit = false;
+      result = lvp_shader_compile_to_ir(pipeline, cache, sinfo, &stage_hit);
       if (result != VK_SUCCESS)
          goto fail;
+      stages_compiled++;
+      if (stage_hit)
+         stages_hit++;
 
       switch (stage) {
       case MESA_SHADER_GEOMETRY:
@@ -826,6 +874,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
       default: break;
       }
    }
+   *cache_hit = stages_compiled && stages_hit == stages_compiled;
    if (pCreateInfo->stageCount && pipeline->pipeline_nir[MESA_SHADER_TESS_EVAL]) {
       nir_lower_patch_vertices(pipeline->pipeline_nir[MESA_SHADER_TESS_EVAL], pipeline->pipeline_nir[MESA_SHADER_TESS_CTRL]->info.tess.tcs_vertices_out, NULL);
       merge_tess_info(&pipeline->pipeline_nir[MESA_SHADER_TESS_EVAL]->info, &pipeline->pipeline_nir[MESA_SHADER_TESS_CTRL]->info);
@@ -876,11 +925,14 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          assert(stage == pipeline->pipeline_nir[i]->info.stage);
          enum pipe_shader_type pstage = pipe_shader_type_from_mesa(stage);
          if (!pipeline->inlines[stage].can_inline) {
-            pipeline->shader_cso[pstage] = lvp_pipeline_compile(pipeline,
-                                                                nir_shader_clone(NULL, pipeline->pipeline_nir[stage]));
-            if (pipeline->tess_ccw)
-               pipeline->tess_ccw_cso = lvp_pipeline_compile(pipeline,
-                                                             nir_shader_clone(NULL, pipeline->tess_ccw));
+            for (unsigned q = 0; q < device->num_queues; q++) {
+               struct pipe_context *ctx = device->queues[q].ctx;
+               pipeline->shader_cso[q][pstage] = lvp_pipeline_compile(pipeline, ctx,
+                                                                      nir_shader_clone(NULL, pipeline->pipeline_nir[stage]));
+               if (stage == MESA_SHADER_TESS_EVAL && pipeline->tess_ccw)
+                  pipeline->tess_ccw_cso[q] = lvp_pipeline_compile(pipeline, ctx,
+                                                                   nir_shader_clone(NULL, pipeline->tess_ccw));
+            }
          }
          if (stage == MESA_SHADER_FRAGMENT)
             has_fragment_shader = true;
@@ -892,10 +944,13 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                                                         "dummy_frag");
 
          pipeline->pipeline_nir[MESA_SHADER_FRAGMENT] = b.shader;
-         struct pipe_shader_state shstate = {0};
-         shstate.type = PIPE_SHADER_IR_NIR;
-         shstate.ir.nir = nir_shader_clone(NULL, pipeline->pipeline_nir[MESA_SHADER_FRAGMENT]);
-         pipeline->shader_cso[PIPE_SHADER_FRAGMENT] = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         for (unsigned q = 0; q < device->num_queues; q++) {
+            struct pipe_context *ctx = device->queues[q].ctx;
+            struct pipe_shader_state shstate = {0};
+            shstate.type = PIPE_SHADER_IR_NIR;
+            shstate.ir.nir = nir_shader_clone(NULL, pipeline->pipeline_nir[MESA_SHADER_FRAGMENT]);
+            pipeline->shader_cso[q][PIPE_SHADER_FRAGMENT] = ctx->create_fs_state(ctx, &shstate);
+         }
       }
    }
    return VK_SUCCESS;
@@ -910,6 +965,36 @@ fail:
    return result;
 }
 
+/* Whether the NIR of all given stages is in the cache or in the disk cache,
+ * in which case creating the pipeline doesn't translate any SPIR-V and
+ * VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT can be honored.
+ */
+static bool
+lvp_stages_are_cached(struct lvp_device *device, VkPipelineCache _cache,
+                      const VkPipelineShaderStageCreateInfo *stages,
+                      uint32_t stage_count)
+{
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
+
+   if (cache == NULL)
+      cache = device->mem_cache;
+
+   for (uint32_t i = 0; i < stage_count; i++) {
+      gl_shader_stage stage = vk_to_mesa_shader_stage(stages[i].stage);
+      unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+      vk_pipeline_hash_shader_stage(&stages[i], stage_sha1);
+
+      nir_shader *nir =
+         vk_pipeline_cache_lookup_nir(cache, stage_sha1, sizeof(stage_sha1),
+                                      device->physical_device->drv_options[stage],
+                                      NULL, NULL);
+      if (!nir)
+         return false;
+      ralloc_free(nir);
+   }
+   return true;
+}
+
 static VkResult
 lvp_graphics_pipeline_create(
    VkDevice _device,
@@ -918,7 +1003,7 @@ lvp_graphics_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -929,10 +1014,14 @@ lvp_graphics_pipeline_create(
    if (pipeline == NULL)
       return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
 
+   if (cache == NULL)
+      cache = device->mem_cache;
+
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
    uint64_t t0 = os_time_get_nano();
-   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo);
+   bool cache_hit = false;
+   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo, &cache_hit);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
@@ -942,6 +1031,8 @@ lvp_graphics_pipeline_create(
    if (feedback) {
       feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
       feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+      if (cache_hit && cache != device->mem_cache)
+         feedback->pPipelineCreationFeedback->flags |= VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
       memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
    }
 
@@ -958,12 +1049,15 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
    VkResult result = VK_SUCCESS;
    unsigned i = 0;
 
    for (; i < count; i++) {
       VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      if (!(pCreateInfos[i].flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT))
+      if (!(pCreateInfos[i].flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT) ||
+          lvp_stages_are_cached(device, pipelineCache, pCreateInfos[i].pStages,
+                                pCreateInfos[i].stageCount))
          r = lvp_graphics_pipeline_create(_device,
                                           pipelineCache,
                                           &pCreateInfos[i],
@@ -986,8 +1080,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
-                          const VkComputePipelineCreateInfo *pCreateInfo)
+                          struct vk_pipeline_cache *cache,
+                          const VkComputePipelineCreateInfo *pCreateInfo,
+                          bool *cache_hit)
 {
    pipeline->device = device;
    pipeline->layout = lvp_pipeline_layout_from_handle(pCreateInfo->layout);
@@ -995,14 +1090,18 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
    pipeline->force_min_sample = false;
 
    pipeline->mem_ctx = ralloc_context(NULL);
+   simple_mtx_init(&pipeline->inline_lock, mtx_plain);
    pipeline->is_compute_pipeline = true;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage, cache_hit);
    if (result != VK_SUCCESS)
       return result;
 
-   if (!pipeline->inlines[MESA_SHADER_COMPUTE].can_inline)
-      pipeline->shader_cso[PIPE_SHADER_COMPUTE] = lvp_pipeline_compile(pipeline, nir_shader_clone(NULL, pipeline->pipeline_nir[MESA_SHADER_COMPUTE]));
+   if (!pipeline->inlines[MESA_SHADER_COMPUTE].can_inline) {
+      for (unsigned q = 0; q < device->num_queues; q++)
+         pipeline->shader_cso[q][PIPE_SHADER_COMPUTE] = lvp_pipeline_compile(pipeline, device->queues[q].ctx,
+                                                                             nir_shader_clone(NULL, pipeline->pipeline_nir[MESA_SHADER_COMPUTE]));
+   }
    return VK_SUCCESS;
 }
 
@@ -1014,7 +1113,7 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1025,10 +1124,14 @@ lvp_compute_pipeline_create(
    if (pipeline == NULL)
       return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
 
+   if (cache == NULL)
+      cache = device->mem_cache;
+
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
    uint64_t t0 = os_time_get_nano();
-   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo);
+   bool cache_hit = false;
+   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo, &cache_hit);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
@@ -1038,6 +1141,8 @@ lvp_compute_pipeline_create(
    if (feedback) {
       feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
       feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+      if (cache_hit && cache != device->mem_cache)
+         feedback->pPipelineCreationFeedback->flags |= VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
       memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
    }
 
@@ -1054,12 +1159,14 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
+   LVP_FROM_HANDLE(lvp_device, device, _device);
    VkResult result = VK_SUCCESS;
    unsigned i = 0;
 
    for (; i < count; i++) {
       VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      if (!(pCreateInfos[i].flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT))
+      if (!(pCreateInfos[i].flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT) ||
+          lvp_stages_are_cached(device, pipelineCache, &pCreateInfos[i].stage, 1))
          r = lvp_compute_pipeline_create(_device,
                                          pipelineCache,
                                          &pCreateInfos[i],
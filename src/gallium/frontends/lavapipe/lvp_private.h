@@ -61,6 +61,7 @@ typedef uint32_t xcb_window_t;
 #include "vk_image.h"
 #include "vk_log.h"
 #include "vk_physical_device.h"
+#include "vk_pipeline_cache.h"
 #include "vk_shader_module.h"
 #include "vk_util.h"
 #include "vk_format.h"
@@ -86,6 +87,7 @@ extern "C" {
 #define MAX_PUSH_DESCRIPTORS 32
 #define MAX_DESCRIPTOR_UNIFORM_BLOCK_SIZE 4096
 #define MAX_PER_STAGE_DESCRIPTOR_UNIFORM_BLOCKS 8
+#define MAX_QUEUES       4
 
 #ifdef _WIN32
 #define lvp_printflike(a, b)
@@ -166,20 +168,25 @@ struct lvp_queue {
    simple_mtx_t pipeline_lock;
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
-};
-
 struct lvp_device {
    struct vk_device vk;
 
-   struct lvp_queue queue;
+   /* Every queue has its own pipe_context, the llvmpipe rasterizer and
+    * compute threads are shared through the screen.  queues[0] also owns
+    * the objects which aren't tied to a queue, like sampler views.
+    */
+   struct lvp_queue queues[MAX_QUEUES];
+   unsigned num_queues;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
    bool poison_mem;
+
+   /* Used for pipelines created without a VkPipelineCache. */
+   struct vk_pipeline_cache *mem_cache;
+
+   /* Source of lvp_descriptor_set::generation. */
+   uint64_t descriptor_generation;
 };
 
 void lvp_device_get_cache_uuid(void *uuid);
@@ -285,6 +292,9 @@ struct lvp_descriptor_set_layout {
    /* Total size of the descriptor set with room for all array entries */
    uint16_t size;
 
+   /* Total size in bytes of the inline uniform blocks in this set */
+   uint32_t uniform_block_size;
+
    /* Shader stages affected by this descriptor set */
    uint16_t shader_stages;
 
@@ -332,6 +342,11 @@ struct lvp_descriptor {
 struct lvp_descriptor_set {
    struct vk_object_base base;
    struct lvp_descriptor_set_layout *layout;
+   /* Size of the allocation, including the inline uniform data */
+   uint32_t size;
+   /* Unique across the device, changes whenever the descriptors do */
+   uint64_t generation;
+   /* Only used for sets which didn't fit in the pool's host memory */
    struct list_head link;
    struct lvp_descriptor descriptors[0];
 };
@@ -341,7 +356,19 @@ struct lvp_descriptor_pool {
    VkDescriptorPoolCreateFlags flags;
    uint32_t max_sets;
 
+   /* Sets are sub-allocated linearly from host_mem, which is sized from the
+    * pool create info.  Resetting the pool just rewinds host_mem_offset.
+    */
+   uint8_t *host_mem;
+   size_t host_mem_size;
+   size_t host_mem_offset;
+
+   /* Sets which didn't fit in host_mem, allocated individually */
    struct list_head sets;
+
+   /* Layouts referenced by sets in this pool, released on reset */
+   struct set *layouts;
+   struct lvp_descriptor_set_layout *last_layout;
 };
 
 struct lvp_descriptor_update_template {
@@ -378,11 +405,13 @@ lvp_descriptor_template_templ_unref(struct lvp_device *device,
 
 VkResult
 lvp_descriptor_set_create(struct lvp_device *device,
+                          struct lvp_descriptor_pool *pool,
                           struct lvp_descriptor_set_layout *layout,
                           struct lvp_descriptor_set **out_set);
 
 void
 lvp_descriptor_set_destroy(struct lvp_device *device,
+                           struct lvp_descriptor_pool *pool,
                            struct lvp_descriptor_set *set);
 
 struct lvp_pipeline_layout {
@@ -416,8 +445,15 @@ struct lvp_pipeline {
    bool force_min_sample;
    nir_shader *pipeline_nir[MESA_SHADER_STAGES];
    nir_shader *tess_ccw;
-   void *shader_cso[PIPE_SHADER_TYPES];
-   void *tess_ccw_cso;
+   /* llvmpipe shader CSOs are per-context, so there's a set per queue */
+   void *shader_cso[MAX_QUEUES][PIPE_SHADER_TYPES];
+   void *tess_ccw_cso[MAX_QUEUES];
+   /* Number of queues which still have to drop their CSOs on destruction */
+   uint32_t queue_refs;
+   /* Inlined shader variants are ralloc'ed off pipeline_nir[] and can be
+    * created by several queues at once.
+    */
+   simple_mtx_t inline_lock;
    struct {
       uint32_t uniform_offsets[PIPE_MAX_CONSTANT_BUFFERS][MAX_INLINABLE_UNIFORMS];
       uint8_t count[PIPE_MAX_CONSTANT_BUFFERS];
@@ -469,9 +505,16 @@ struct lvp_query_pool {
    uint32_t count;
    VkQueryPipelineStatisticFlags pipeline_stats;
    enum pipe_query_type base_type;
+   /* The context of the queue that created each query, which must be used
+    * for everything else done with the query.
+    */
+   struct pipe_context **contexts;
    struct pipe_query *queries[0];
 };
 
+void
+lvp_query_pool_destroy_query(struct lvp_query_pool *pool, uint32_t query);
+
 enum lvp_cmd_buffer_status {
    LVP_CMD_BUFFER_STATUS_INVALID,
    LVP_CMD_BUFFER_STATUS_INITIAL,
@@ -488,6 +531,13 @@ struct lvp_cmd_buffer {
    enum lvp_cmd_buffer_status status;
 
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
+
+   /* Descriptor set binds resolved on the first execution, replayed by the
+    * later ones.  Not used for one time submit command buffers.
+    */
+   bool bake_binds;
+   simple_mtx_t bake_lock;
+   struct list_head bakes;
 };
 
 extern const struct vk_command_buffer_ops lvp_cmd_buffer_ops;
@@ -535,8 +585,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_layout, vk.base, VkPipelineLayout,
@@ -567,6 +615,7 @@ void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp);
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
+void lvp_cmd_buffer_free_bakes(struct lvp_cmd_buffer *cmd_buffer);
 size_t
 lvp_get_rendering_state_size(void);
 struct lvp_image *lvp_swapchain_get_image(VkSwapchainKHR swapchain,
@@ -605,6 +654,8 @@ lvp_vk_format_to_pipe_format(VkFormat format)
 
 void
 lvp_pipeline_destroy(struct lvp_device *device, struct lvp_pipeline *pipeline);
+void
+lvp_pipeline_destroy_queue(struct lvp_queue *queue, struct lvp_pipeline *pipeline);
 
 void
 queue_thread_noop(void *data, void *gdata, int thread_index);
@@ -612,13 +663,15 @@ queue_thread_noop(void *data, void *gdata, int thread_index);
 void
 lvp_shader_optimize(nir_shader *nir);
 void *
-lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, nir_shader *nir);
+lvp_pipeline_compile_stage(struct lvp_pipeline *pipeline, struct pipe_context *ctx,
+                           nir_shader *nir);
 bool
 lvp_find_inlinable_uniforms(struct lvp_pipeline *pipeline, nir_shader *shader);
 void
 lvp_inline_uniforms(nir_shader *shader, const struct lvp_pipeline *pipeline, const uint32_t *uniform_values, uint32_t ubo);
 void *
-lvp_pipeline_compile(struct lvp_pipeline *pipeline, nir_shader *base_nir);
+lvp_pipeline_compile(struct lvp_pipeline *pipeline, struct pipe_context *ctx,
+                     nir_shader *base_nir);
 #ifdef __cplusplus
 }
 #endif
@@ -53,7 +53,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
       return VK_ERROR_FEATURE_NOT_PRESENT;
    }
    struct lvp_query_pool *pool;
-   uint32_t pool_size = sizeof(*pool) + pCreateInfo->queryCount * sizeof(struct pipe_query *);
+   uint32_t pool_size = sizeof(*pool) +
+                        pCreateInfo->queryCount * (sizeof(struct pipe_query *) +
+                                                   sizeof(struct pipe_context *));
 
    pool = vk_zalloc2(&device->vk.alloc, pAllocator,
                     pool_size, 8,
@@ -67,11 +69,25 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateQueryPool(
    pool->count = pCreateInfo->queryCount;
    pool->base_type = pipeq;
    pool->pipeline_stats = pCreateInfo->pipelineStatistics;
+   pool->contexts = (struct pipe_context **)&pool->queries[pool->count];
 
    *pQueryPool = lvp_query_pool_to_handle(pool);
    return VK_SUCCESS;
 }
 
+void
+lvp_query_pool_destroy_query(struct lvp_query_pool *pool, uint32_t query)
+{
+   struct pipe_context *ctx = pool->contexts[query];
+
+   if (!pool->queries[query])
+      return;
+
+   ctx->destroy_query(ctx, pool->queries[query]);
+   pool->queries[query] = NULL;
+   pool->contexts[query] = NULL;
+}
+
 VKAPI_ATTR void VKAPI_CALL lvp_DestroyQueryPool(
     VkDevice                                    _device,
     VkQueryPool                                 _pool,
@@ -84,8 +100,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyQueryPool(
       return;
 
    for (unsigned i = 0; i < pool->count; i++)
-      if (pool->queries[i])
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[i]);
+      lvp_query_pool_destroy_query(pool, i);
    vk_object_base_finish(&pool->base);
    vk_free2(&device->vk.alloc, pAllocator, pool);
 }
@@ -111,10 +126,10 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_GetQueryPoolResults(
       union pipe_query_result result;
       bool ready = false;
       if (pool->queries[i]) {
-        ready = device->queue.ctx->get_query_result(device->queue.ctx,
-                                                    pool->queries[i],
-                                                    (flags & VK_QUERY_RESULT_WAIT_BIT),
-                                                    &result);
+        struct pipe_context *ctx = pool->contexts[i];
+        ready = ctx->get_query_result(ctx, pool->queries[i],
+                                      (flags & VK_QUERY_RESULT_WAIT_BIT),
+                                      &result);
       } else {
         result.u64 = 0;
       }
@@ -203,15 +218,8 @@ VKAPI_ATTR void VKAPI_CALL lvp_ResetQueryPool(
    uint32_t                                    firstQuery,
    uint32_t                                    queryCount)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
    LVP_FROM_HANDLE(lvp_query_pool, pool, queryPool);
 
-   for (uint32_t i = 0; i < queryCount; i++) {
-      uint32_t idx = i + firstQuery;
-
-      if (pool->queries[idx]) {
-         device->queue.ctx->destroy_query(device->queue.ctx, pool->queries[idx]);
-         pool->queries[idx] = NULL;
-      }
-   }
+   for (uint32_t i = 0; i < queryCount; i++)
+      lvp_query_pool_destroy_query(pool, i + firstQuery);
 }
@@ -0,0 +1,264 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Checks that SPIR-V translated by one process is found in the disk cache by
+ * the next one.  Every pipeline is created in a forked child, so nothing is
+ * shared between them but the cache directory.
+ * VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT only succeeds
+ * when lavapipe finds the NIR of all stages in a cache.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <ftw.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <vulkan/vulkan_core.h>
+
+extern "C" VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL
+vk_icdGetInstanceProcAddr(VkInstance instance, const char *pName);
+
+/* OpCapability Shader
+ * OpMemoryModel Logical GLSL450
+ * OpEntryPoint GLCompute %3 "main"
+ * OpExecutionMode %3 LocalSize 1 1 1
+ * %1 = OpTypeVoid
+ * %2 = OpTypeFunction %1
+ * %3 = OpFunction %1 None %2
+ * %4 = OpLabel
+ * OpReturn
+ * OpFunctionEnd
+ */
+static const uint32_t empty_cs[] = {
+   0x07230203, 0x00010000, 0x00000000, 0x00000005, 0x00000000,
+   0x00020011, 0x00000001,
+   0x0003000e, 0x00000000, 0x00000001,
+   0x0005000f, 0x00000005, 0x00000003, 0x6e69616d, 0x00000000,
+   0x00060010, 0x00000003, 0x00000011, 0x00000001, 0x00000001, 0x00000001,
+   0x00020013, 0x00000001,
+   0x00030021, 0x00000002, 0x00000001,
+   0x00050036, 0x00000001, 0x00000003, 0x00000000, 0x00000002,
+   0x000200f8, 0x00000004,
+   0x000100fd,
+   0x00010038,
+};
+
+#define GET_PROC(get, obj, name) \
+   PFN_##name name = (PFN_##name)get(obj, #name); \
+   if (!name) \
+      return VK_ERROR_INITIALIZATION_FAILED;
+
+static VkResult
+create_pipeline(VkPipelineCreateFlags flags)
+{
+   GET_PROC(vk_icdGetInstanceProcAddr, VK_NULL_HANDLE, vkCreateInstance);
+
+   VkApplicationInfo app_info = {};
+   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+   app_info.apiVersion = VK_API_VERSION_1_3;
+
+   VkInstanceCreateInfo instance_info = {};
+   instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+   instance_info.pApplicationInfo = &app_info;
+
+   VkInstance instance;
+   VkResult result = vkCreateInstance(&instance_info, NULL, &instance);
+   if (result != VK_SUCCESS)
+      return result;
+
+   GET_PROC(vk_icdGetInstanceProcAddr, instance, vkEnumeratePhysicalDevices);
+   GET_PROC(vk_icdGetInstanceProcAddr, instance, vkCreateDevice);
+   GET_PROC(vk_icdGetInstanceProcAddr, instance, vkGetDeviceProcAddr);
+   GET_PROC(vk_icdGetInstanceProcAddr, instance, vkDestroyInstance);
+
+   uint32_t count = 1;
+   VkPhysicalDevice pdev;
+   result = vkEnumeratePhysicalDevices(instance, &count, &pdev);
+   if (result < 0 || count == 0) {
+      vkDestroyInstance(instance, NULL);
+      return VK_ERROR_INITIALIZATION_FAILED;
+   }
+
+   VkPhysicalDeviceVulkan13Features features13 = {};
+   features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+   features13.pipelineCreationCacheControl = VK_TRUE;
+
+   const float priority = 1.0f;
+   VkDeviceQueueCreateInfo queue_info = {};
+   queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+   queue_info.queueFamilyIndex = 0;
+   queue_info.queueCount = 1;
+   queue_info.pQueuePriorities = &priority;
+
+   VkDeviceCreateInfo device_info = {};
+   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+   device_info.pNext = &features13;
+   device_info.queueCreateInfoCount = 1;
+   device_info.pQueueCreateInfos = &queue_info;
+
+   VkDevice device;
+   result = vkCreateDevice(pdev, &device_info, NULL, &device);
+   if (result != VK_SUCCESS) {
+      vkDestroyInstance(instance, NULL);
+      return result;
+   }
+
+   GET_PROC(vkGetDeviceProcAddr, device, vkCreateShaderModule);
+   GET_PROC(vkGetDeviceProcAddr, device, vkDestroyShaderModule);
+   GET_PROC(vkGetDeviceProcAddr, device, vkCreatePipelineLayout);
+   GET_PROC(vkGetDeviceProcAddr, device, vkDestroyPipelineLayout);
+   GET_PROC(vkGetDeviceProcAddr, device, vkCreateComputePipelines);
+   GET_PROC(vkGetDeviceProcAddr, device, vkDestroyPipeline);
+   GET_PROC(vkGetDeviceProcAddr, device, vkDestroyDevice);
+
+   VkShaderModuleCreateInfo module_info = {};
+   module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+   module_info.codeSize = sizeof(empty_cs);
+   module_info.pCode = empty_cs;
+
+   VkShaderModule module;
+   vkCreateShaderModule(device, &module_info, NULL, &module);
+
+   VkPipelineLayoutCreateInfo layout_info = {};
+   layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+   VkPipelineLayout layout;
+   vkCreatePipelineLayout(device, &layout_info, NULL, &layout);
+
+   VkComputePipelineCreateInfo pipeline_info = {};
+   pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+   pipeline_info.flags = flags;
+   pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+   pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+   pipeline_info.stage.module = module;
+   pipeline_info.stage.pName = "main";
+   pipeline_info.layout = layout;
+
+   VkPipeline pipeline = VK_NULL_HANDLE;
+   result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                     NULL, &pipeline);
+
+   vkDestroyPipeline(device, pipeline, NULL);
+   vkDestroyPipelineLayout(device, layout, NULL);
+   vkDestroyShaderModule(device, module, NULL);
+   vkDestroyDevice(device, NULL);
+   /* The disk cache writes are only flushed when the screen goes away. */
+   vkDestroyInstance(instance, NULL);
+
+   return result;
+}
+
+/* Exit statuses of the child, VkResult doesn't fit in one. */
+enum child_status {
+   CHILD_SUCCESS,
+   CHILD_COMPILE_REQUIRED,
+   CHILD_ERROR,
+};
+
+static VkResult
+create_pipeline_in_child(const std::string &cache_dir, VkPipelineCreateFlags flags)
+{
+   pid_t pid = fork();
+   if (pid == 0) {
+      setenv("MESA_SHADER_CACHE_DIR", cache_dir.c_str(), 1);
+      setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+
+      switch (create_pipeline(flags)) {
+      case VK_SUCCESS:
+         _exit(CHILD_SUCCESS);
+      case VK_PIPELINE_COMPILE_REQUIRED:
+         _exit(CHILD_COMPILE_REQUIRED);
+      default:
+         _exit(CHILD_ERROR);
+      }
+   }
+
+   int status;
+   if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+      return VK_ERROR_UNKNOWN;
+
+   switch (WEXITSTATUS(status)) {
+   case CHILD_SUCCESS:
+      return VK_SUCCESS;
+   case CHILD_COMPILE_REQUIRED:
+      return VK_PIPELINE_COMPILE_REQUIRED;
+   default:
+      return VK_ERROR_UNKNOWN;
+   }
+}
+
+static int
+count_file(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+   return type == FTW_F;
+}
+
+static int
+remove_file(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+   return remove(path);
+}
+
+class DiskCacheTest : public ::testing::Test {
+protected:
+   void SetUp() override
+   {
+      char tmpl[] = "/tmp/lvp-disk-cache-XXXXXX";
+      ASSERT_NE(mkdtemp(tmpl), nullptr);
+      dir = tmpl;
+   }
+
+   void TearDown() override
+   {
+      nftw(dir.c_str(), remove_file, 8, FTW_DEPTH | FTW_PHYS);
+   }
+
+   bool cache_is_empty()
+   {
+      /* nftw stops at the first callback returning nonzero. */
+      return nftw(dir.c_str(), count_file, 8, FTW_PHYS) == 0;
+   }
+
+   std::string dir;
+};
+
+TEST_F(DiskCacheTest, ColdMiss)
+{
+   EXPECT_EQ(create_pipeline_in_child(dir, VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT),
+             VK_PIPELINE_COMPILE_REQUIRED);
+}
+
+TEST_F(DiskCacheTest, SecondProcessHit)
+{
+   ASSERT_EQ(create_pipeline_in_child(dir, 0), VK_SUCCESS);
+   if (cache_is_empty())
+      GTEST_SKIP() << "built without the shader disk cache";
+
+   EXPECT_EQ(create_pipeline_in_child(dir, VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT),
+             VK_SUCCESS);
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Stress test for pb_cache and pb_slabs.
+ *
+ * Several threads allocate and free buffers of random sizes concurrently,
+ * like contexts of a multi-context application sharing one winsys. The test
+ * succeeds if the entries have the requested sizes and every slab and cached
+ * buffer is destroyed at the end. The time taken is printed, so the test
+ * doubles as a benchmark.
+ *
+ * Usage: pb_stress_test [-v] [iterations per thread]
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipebuffer/pb_cache.h"
+#include "pipebuffer/pb_slab.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+
+
+#define NUM_THREADS 8
+#define NUM_HEAPS 2
+
+/* Buffers held by each thread at any time. */
+#define NUM_LIVE 64
+
+#define SLAB_MIN_ORDER 8
+#define SLAB_MAX_ORDER 16
+#define SLAB_NUM_ENTRIES 32
+
+#define CACHE_MIN_SIZE (4 * 1024)
+#define CACHE_MAX_SIZE (1024 * 1024)
+
+static int verbosity = 0;
+static unsigned num_iterations = 20000;
+
+static struct pb_slabs slabs;
+static struct pb_cache cache;
+
+static thrd_t threads[NUM_THREADS];
+static unsigned thread_ids[NUM_THREADS];
+
+/* Number of existing slabs and cache buffers. */
+static int num_slabs;
+static int num_buffers;
+
+
+#define LOG(fmt, ...) \
+   if (verbosity > 0) { \
+      fprintf(stdout, fmt, ##__VA_ARGS__); \
+   }
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      _exit(EXIT_FAILURE); \
+   }
+
+
+struct test_slab {
+   struct pb_slab base;
+   struct pb_slab_entry entries[SLAB_NUM_ENTRIES];
+};
+
+struct test_buffer {
+   struct pb_buffer base;
+   struct pb_cache_entry cache_entry;
+};
+
+
+static struct pb_slab *
+test_slab_alloc(void *priv, unsigned heap, unsigned entry_size,
+                unsigned group_index)
+{
+   struct test_slab *slab = CALLOC_STRUCT(test_slab);
+   if (!slab)
+      return NULL;
+
+   list_inithead(&slab->base.free);
+   slab->base.num_entries = SLAB_NUM_ENTRIES;
+   slab->base.num_free = SLAB_NUM_ENTRIES;
+
+   for (unsigned i = 0; i < SLAB_NUM_ENTRIES; i++) {
+      struct pb_slab_entry *entry = &slab->entries[i];
+
+      entry->slab = &slab->base;
+      entry->group_index = group_index;
+      entry->entry_size = entry_size;
+      list_addtail(&entry->head, &slab->base.free);
+   }
+
+   p_atomic_inc(&num_slabs);
+   return &slab->base;
+}
+
+static void
+test_slab_free(void *priv, struct pb_slab *slab)
+{
+   FREE(slab);
+   p_atomic_dec(&num_slabs);
+}
+
+static bool
+test_slab_can_reclaim(void *priv, struct pb_slab_entry *entry)
+{
+   return true;
+}
+
+static void
+test_buffer_destroy(void *winsys, struct pb_buffer *buf)
+{
+   FREE(buf);
+   p_atomic_dec(&num_buffers);
+}
+
+static bool
+test_buffer_can_reclaim(void *winsys, struct pb_buffer *buf)
+{
+   return true;
+}
+
+
+static struct pb_buffer *
+test_buffer_create(pb_size size, unsigned heap)
+{
+   struct pb_buffer *buf =
+      pb_cache_reclaim_buffer(&cache, size, 4096, 0, heap);
+   if (buf)
+      return buf;
+
+   struct test_buffer *tbuf = CALLOC_STRUCT(test_buffer);
+   CHECK(tbuf);
+
+   pipe_reference_init(&tbuf->base.reference, 1);
+   tbuf->base.alignment_log2 = 12;
+   tbuf->base.size = size;
+   pb_cache_init_entry(&cache, &tbuf->cache_entry, &tbuf->base, heap);
+
+   p_atomic_inc(&num_buffers);
+   return &tbuf->base;
+}
+
+static void
+test_buffer_release(struct pb_buffer *buf)
+{
+   struct test_buffer *tbuf = (struct test_buffer *)buf;
+
+   if (pipe_reference(&buf->reference, NULL))
+      pb_cache_add_buffer(&tbuf->cache_entry);
+}
+
+
+static uint32_t
+next_random(uint32_t *state)
+{
+   /* xorshift32 */
+   *state ^= *state << 13;
+   *state ^= *state >> 17;
+   *state ^= *state << 5;
+   return *state;
+}
+
+static int
+thread_function(void *thread_data)
+{
+   unsigned thread_id = *((unsigned *) thread_data);
+   struct pb_slab_entry *entries[NUM_LIVE] = {0};
+   struct pb_buffer *buffers[NUM_LIVE] = {0};
+   uint32_t state = thread_id + 1;
+
+   LOG("thread %u starting\n", thread_id);
+
+   for (unsigned i = 0; i < num_iterations; i++) {
+      unsigned slot = next_random(&state) % NUM_LIVE;
+      unsigned heap = next_random(&state) % NUM_HEAPS;
+
+      /* Slab entries */
+      if (entries[slot])
+         pb_slab_free(&slabs, entries[slot]);
+
+      unsigned size = 1 + next_random(&state) % (1 << SLAB_MAX_ORDER);
+      entries[slot] = pb_slab_alloc(&slabs, size, heap);
+      CHECK(entries[slot]);
+      CHECK(entries[slot]->entry_size >= size);
+
+      /* Cached buffers */
+      if (buffers[slot])
+         test_buffer_release(buffers[slot]);
+
+      pb_size buf_size = CACHE_MIN_SIZE +
+         next_random(&state) % (CACHE_MAX_SIZE - CACHE_MIN_SIZE);
+      buf_size = align64(buf_size, 4096);
+      buffers[slot] = test_buffer_create(buf_size, heap);
+      CHECK(buffers[slot]->size >= buf_size);
+   }
+
+   for (unsigned i = 0; i < NUM_LIVE; i++) {
+      pb_slab_free(&slabs, entries[i]);
+      test_buffer_release(buffers[i]);
+   }
+
+   LOG("thread %u exiting\n", thread_id);
+
+   return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+   int i;
+
+   for (i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      if (strcmp(arg, "-v") == 0) {
+         ++verbosity;
+      } else if (atoi(arg) > 0) {
+         num_iterations = atoi(arg);
+      } else {
+         fprintf(stderr, "error: unrecognized option `%s`\n", arg);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   // Disable buffering
+   setbuf(stdout, NULL);
+
+   CHECK(pb_slabs_init(&slabs, SLAB_MIN_ORDER, SLAB_MAX_ORDER, NUM_HEAPS,
+                       true, NULL, test_slab_can_reclaim, test_slab_alloc,
+                       test_slab_free));
+   pb_cache_init(&cache, NUM_HEAPS, 500000, 2.0f, 0, 64 * 1024 * 1024,
+                 NULL, test_buffer_destroy, test_buffer_can_reclaim);
+   CHECK(cache.buckets);
+
+   int64_t start = os_time_get_nano();
+
+   for (i = 0; i < NUM_THREADS; i++) {
+      thread_ids[i] = i;
+      u_thread_create(threads + i, thread_function, (void *) &thread_ids[i]);
+   }
+
+   for (i = 0; i < NUM_THREADS; i++)
+      thrd_join(threads[i], NULL);
+
+   int64_t end = os_time_get_nano();
+
+   printf("%u threads x %u iterations: %.1f ms\n", NUM_THREADS,
+          num_iterations, (end - start) / 1000000.0);
+
+   pb_cache_deinit(&cache);
+   pb_slabs_deinit(&slabs);
+
+   CHECK(p_atomic_read(&num_buffers) == 0);
+   CHECK(p_atomic_read(&num_slabs) == 0);
+
+   return 0;
+}
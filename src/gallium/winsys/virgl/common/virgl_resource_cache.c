@@ -21,8 +21,14 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <inttypes.h>
+
 #include "virgl_resource_cache.h"
+#include "util/log.h"
 #include "util/os_time.h"
+#include "util/timespec.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
 
 /* Checks whether the resource represented by a cache entry is able to hold
  * data of the specified size, bind and format.
@@ -46,11 +52,18 @@ virgl_resource_cache_entry_is_compatible(struct virgl_resource_cache_entry *entr
    }
 }
 
+static unsigned
+virgl_resource_cache_bucket_index(uint32_t size)
+{
+   return util_logbase2(MAX2(size, 1));
+}
+
 static void
 virgl_resource_cache_entry_release(struct virgl_resource_cache *cache,
                                    struct virgl_resource_cache_entry *entry)
 {
       list_del(&entry->head);
+      list_del(&entry->bucket_head);
       cache->entry_release_func(entry, cache->user_data);
 }
 
@@ -65,6 +78,7 @@ virgl_resource_cache_destroy_expired(struct virgl_resource_cache *cache, int64_t
       if (!os_time_timeout(entry->timeout_start, entry->timeout_end, now))
          break;
       virgl_resource_cache_entry_release(cache, entry);
+      cache->stats.expired++;
    }
 }
 
@@ -76,10 +90,20 @@ virgl_resource_cache_init(struct virgl_resource_cache *cache,
                           void *user_data)
 {
    list_inithead(&cache->resources);
+   for (unsigned i = 0; i < VIRGL_RESOURCE_CACHE_BUCKET_COUNT; i++)
+      list_inithead(&cache->buckets[i]);
    cache->timeout_usecs = timeout_usecs;
    cache->entry_is_busy_func = is_busy_func;
    cache->entry_release_func = destroy_func;
    cache->user_data = user_data;
+
+   memset(&cache->stats, 0, sizeof(cache->stats));
+   cache->print_stats =
+      debug_get_bool_option("VIRGL_RESOURCE_CACHE_STATS", false);
+
+   cache->reaper.mutex = NULL;
+   cache->reaper.running = false;
+   cache->reaper.stop = false;
 }
 
 void
@@ -87,6 +111,8 @@ virgl_resource_cache_add(struct virgl_resource_cache *cache,
                          struct virgl_resource_cache_entry *entry)
 {
    const int64_t now = os_time_get();
+   const unsigned bucket =
+      virgl_resource_cache_bucket_index(entry->params.size);
 
    /* Entry should not already be in the cache. */
    assert(entry->head.next == NULL);
@@ -94,53 +120,73 @@ virgl_resource_cache_add(struct virgl_resource_cache *cache,
 
    virgl_resource_cache_destroy_expired(cache, now);
 
+   /* Wake up the reaper, which sleeps while the cache is empty. */
+   if (cache->reaper.running && list_is_empty(&cache->resources))
+      cnd_signal(&cache->reaper.cond);
+
    entry->timeout_start = now;
    entry->timeout_end = entry->timeout_start + cache->timeout_usecs;
    list_addtail(&entry->head, &cache->resources);
+   list_addtail(&entry->bucket_head, &cache->buckets[bucket]);
+}
+
+/* Finds the oldest compatible entry in a bucket.  Sets *busy and returns
+ * NULL when that entry is busy, since the entries added after it are likely
+ * busy as well.
+ */
+static struct virgl_resource_cache_entry *
+virgl_resource_cache_find_in_bucket(struct virgl_resource_cache *cache,
+                                    unsigned bucket,
+                                    struct virgl_resource_params params,
+                                    bool *busy)
+{
+   list_for_each_entry(struct virgl_resource_cache_entry,
+                       entry, &cache->buckets[bucket], bucket_head) {
+      if (!virgl_resource_cache_entry_is_compatible(entry, params))
+         continue;
+
+      if (cache->entry_is_busy_func(entry, cache->user_data)) {
+         *busy = true;
+         return NULL;
+      }
+
+      return entry;
+   }
+
+   return NULL;
 }
 
 struct virgl_resource_cache_entry *
 virgl_resource_cache_remove_compatible(struct virgl_resource_cache *cache,
                                        struct virgl_resource_params params)
 {
-   const int64_t now = os_time_get();
-   struct virgl_resource_cache_entry *compat_entry = NULL;
-   bool check_expired = true;
+   const unsigned bucket = virgl_resource_cache_bucket_index(params.size);
+   struct virgl_resource_cache_entry *compat_entry;
+   bool busy = false;
 
-   /* Iterate through the cache to find a compatible resource, while also
-    * destroying any expired resources we come across.
+   virgl_resource_cache_destroy_expired(cache, os_time_get());
+
+   /* Buffers are compatible with buffers up to twice their size, which are
+    * in the same or in the next bucket.
     */
-   list_for_each_entry_safe(struct virgl_resource_cache_entry,
-                            entry, &cache->resources, head) {
-      const bool compatible =
-         virgl_resource_cache_entry_is_compatible(entry, params);
-
-      if (compatible) {
-         if (!cache->entry_is_busy_func(entry, cache->user_data))
-            compat_entry = entry;
-
-         /* We either have found a compatible resource, in which case we are
-          * done, or the resource is busy, which means resources later in
-          * the cache list will also be busy, so there is no point in
-          * searching further.
-          */
-         break;
-      }
+   compat_entry =
+      virgl_resource_cache_find_in_bucket(cache, bucket, params, &busy);
+   if (!compat_entry && params.target == PIPE_BUFFER &&
+       bucket + 1 < VIRGL_RESOURCE_CACHE_BUCKET_COUNT) {
+      compat_entry = virgl_resource_cache_find_in_bucket(cache, bucket + 1,
+                                                         params, &busy);
+   }
 
-      /* If we aren't using this resource, check to see if it has expired.
-       * Once we have found the first non-expired resource, we can stop checking
-       * since the cache holds resources in non-decreasing timeout order.
-       */
-      if (check_expired) {
-         if (os_time_timeout(entry->timeout_start, entry->timeout_end, now))
-            virgl_resource_cache_entry_release(cache, entry);
-         else
-            check_expired = false;
-      }
+   if (!compat_entry) {
+      cache->stats.misses++;
+      if (busy)
+         cache->stats.busy++;
+      return NULL;
    }
 
-   if (compat_entry)
-      list_del(&compat_entry->head);
+   cache->stats.hits++;
+   list_del(&compat_entry->head);
+   list_del(&compat_entry->bucket_head);
 
    return compat_entry;
 }
@@ -153,3 +199,80 @@ virgl_resource_cache_flush(struct virgl_resource_cache *cache)
       virgl_resource_cache_entry_release(cache, entry);
    }
 }
+
+static int
+virgl_resource_cache_reaper_thread(void *data)
+{
+   struct virgl_resource_cache *cache = data;
+
+   mtx_lock(cache->reaper.mutex);
+   while (!cache->reaper.stop) {
+      if (list_is_empty(&cache->resources)) {
+         /* Sleep until virgl_resource_cache_add adds an entry. */
+         cnd_wait(&cache->reaper.cond, cache->reaper.mutex);
+      } else {
+         /* Sleep until the oldest entry expires. */
+         struct virgl_resource_cache_entry *oldest =
+            list_first_entry(&cache->resources,
+                             struct virgl_resource_cache_entry, head);
+         int64_t wait_usecs = oldest->timeout_end - os_time_get();
+
+         if (wait_usecs > 0) {
+            struct timespec abstime;
+            timespec_get(&abstime, TIME_UTC);
+            timespec_add_nsec(&abstime, &abstime, (uint64_t)wait_usecs * 1000);
+            cnd_timedwait(&cache->reaper.cond, cache->reaper.mutex, &abstime);
+         }
+      }
+
+      if (!cache->reaper.stop)
+         virgl_resource_cache_destroy_expired(cache, os_time_get());
+   }
+   mtx_unlock(cache->reaper.mutex);
+
+   return 0;
+}
+
+void
+virgl_resource_cache_start_reaper(struct virgl_resource_cache *cache,
+                                  mtx_t *mutex)
+{
+   assert(!cache->reaper.running);
+
+   if (cnd_init(&cache->reaper.cond) != thrd_success)
+      return;
+
+   cache->reaper.mutex = mutex;
+   cache->reaper.stop = false;
+   if (thrd_create(&cache->reaper.thread, virgl_resource_cache_reaper_thread,
+                   cache) != thrd_success) {
+      cnd_destroy(&cache->reaper.cond);
+      return;
+   }
+
+   cache->reaper.running = true;
+}
+
+void
+virgl_resource_cache_fini(struct virgl_resource_cache *cache)
+{
+   if (cache->reaper.running) {
+      mtx_lock(cache->reaper.mutex);
+      cache->reaper.stop = true;
+      cnd_signal(&cache->reaper.cond);
+      mtx_unlock(cache->reaper.mutex);
+
+      thrd_join(cache->reaper.thread, NULL);
+      cnd_destroy(&cache->reaper.cond);
+      cache->reaper.running = false;
+   }
+
+   if (cache->print_stats) {
+      mesa_logi("virgl resource cache: %" PRIu64 " hits, %" PRIu64
+                " misses (%" PRIu64 " busy), %" PRIu64 " expired",
+                cache->stats.hits, cache->stats.misses, cache->stats.busy,
+                cache->stats.expired);
+   }
+
+   virgl_resource_cache_flush(cache);
+}
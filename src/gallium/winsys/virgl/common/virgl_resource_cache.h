@@ -26,6 +26,7 @@
 
 #include <stdint.h>
 
+#include "c11/threads.h"
 #include "util/list.h"
 #include "gallium/include/pipe/p_defines.h"
 
@@ -43,8 +44,14 @@ struct virgl_resource_params {
    enum pipe_texture_target target;
 };
 
+/* Entries are bucketed by the log2 of their size. */
+#define VIRGL_RESOURCE_CACHE_BUCKET_COUNT 32
+
 struct virgl_resource_cache_entry {
+   /* in the list of all entries, in non-decreasing timeout order */
    struct list_head head;
+   /* in the list of the size bucket, in the same order */
+   struct list_head bucket_head;
    int64_t timeout_start;
    int64_t timeout_end;
    struct virgl_resource_params params;
@@ -62,12 +69,32 @@ typedef bool (*virgl_resource_cache_entry_is_busy_func) (
 typedef void (*virgl_resource_cache_entry_release_func) (
    struct virgl_resource_cache_entry *entry, void *user_data);
 
+struct virgl_resource_cache_stats {
+   uint64_t hits;
+   uint64_t misses;
+   /* misses where a compatible resource was found busy */
+   uint64_t busy;
+   uint64_t expired;
+};
+
 struct virgl_resource_cache {
    struct list_head resources;
+   struct list_head buckets[VIRGL_RESOURCE_CACHE_BUCKET_COUNT];
    unsigned timeout_usecs;
    virgl_resource_cache_entry_is_busy_func entry_is_busy_func;
    virgl_resource_cache_entry_release_func entry_release_func;
    void *user_data;
+
+   struct virgl_resource_cache_stats stats;
+   bool print_stats;
+
+   struct {
+      mtx_t *mutex;
+      cnd_t cond;
+      thrd_t thread;
+      bool running;
+      bool stop;
+   } reaper;
 };
 
 void
@@ -99,6 +126,20 @@ virgl_resource_cache_remove_compatible(struct virgl_resource_cache *cache,
 void
 virgl_resource_cache_flush(struct virgl_resource_cache *cache);
 
+/** Starts a thread that releases expired resources in the background.
+ *
+ *  The thread holds mutex while it touches the cache, which must be the
+ *  mutex the caller holds around all other cache calls.  The release
+ *  callback is then also called from that thread.
+ */
+void
+virgl_resource_cache_start_reaper(struct virgl_resource_cache *cache,
+                                  mtx_t *mutex);
+
+/** Stops the reaper thread, if any, and empties the resource cache. */
+void
+virgl_resource_cache_fini(struct virgl_resource_cache *cache);
+
 static inline void
 virgl_resource_cache_entry_init(struct virgl_resource_cache_entry *entry,
                                 struct virgl_resource_params params)
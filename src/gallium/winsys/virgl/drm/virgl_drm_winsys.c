@@ -130,7 +130,7 @@ virgl_drm_winsys_destroy(struct virgl_winsys *qws)
 {
    struct virgl_drm_winsys *qdws = virgl_drm_winsys(qws);
 
-   virgl_resource_cache_flush(&qdws->cache);
+   virgl_resource_cache_fini(&qdws->cache);
 
    _mesa_hash_table_destroy(qdws->bo_handles, NULL);
    _mesa_hash_table_destroy(qdws->bo_names, NULL);
@@ -689,7 +689,13 @@ static void *virgl_drm_resource_map(struct virgl_winsys *qws,
    if (ptr == MAP_FAILED)
       return NULL;
 
-   res->ptr = ptr;
+   /* Threaded contexts may map the same resource from two threads. */
+   void *old = p_atomic_cmpxchg_ptr(&res->ptr, NULL, ptr);
+   if (old) {
+      os_munmap(ptr, res->size);
+      return old;
+   }
+
    return ptr;
 
 }
@@ -1248,6 +1254,10 @@ virgl_drm_winsys_create(int drmFD)
 
    qdws->bo_handles = util_hash_table_create_ptr_keys();
    qdws->bo_names = util_hash_table_create_ptr_keys();
+
+   /* releasing resources only needs bo_handles_mutex and the fd */
+   virgl_resource_cache_start_reaper(&qdws->cache, &qdws->mutex);
+
    qdws->base.destroy = virgl_drm_winsys_destroy;
 
    qdws->base.transfer_put = virgl_bo_transfer_put;
@@ -1275,6 +1285,7 @@ virgl_drm_winsys_create(int drmFD)
    qdws->base.get_caps = virgl_drm_get_caps;
    qdws->base.supports_fences =  drm_version >= VIRGL_DRM_VERSION_FENCE_FD;
    qdws->base.supports_encoded_transfers = 1;
+   qdws->base.supports_threads = 1;
 
    qdws->base.supports_coherent = params[param_resource_blob].value &&
                                   params[param_host_visible].value;
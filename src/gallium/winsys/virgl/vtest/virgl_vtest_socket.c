@@ -28,29 +28,18 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <os/os_mman.h>
 #include <os/os_process.h>
+#include <util/anon_file.h>
+#include <util/compress.h>
 #include <util/format/u_format.h>
+#include <util/u_atomic.h>
+#include <util/u_debug.h>
 
 #include "virgl_vtest_winsys.h"
 #include "virgl_vtest_public.h"
 
-/* block read/write routines */
-static int virgl_block_write(int fd, void *buf, int size)
-{
-   void *ptr = buf;
-   int left;
-   int ret;
-   left = size;
-   do {
-      ret = write(fd, ptr, left);
-      if (ret < 0)
-         return -errno;
-      left -= ret;
-      ptr += ret;
-   } while (left);
-   return size;
-}
-
+/* block read routine */
 static int virgl_block_read(int fd, void *buf, int size)
 {
    void *ptr = buf;
@@ -72,6 +61,31 @@ static int virgl_block_read(int fd, void *buf, int size)
    return size;
 }
 
+/* Commands are batched and sent with a single writev when a reply is about
+ * to be read, or when the server is expected to act on them, see
+ * vtest_batch.h.  Large buffers are referenced until the batch is flushed.
+ */
+static int virgl_vtest_write(struct virgl_vtest_winsys *vws,
+                             const void *buf, int size)
+{
+   int ret = vtest_batch_write(&vws->batch, vws->sock_fd, buf, size);
+   return ret ? ret : size;
+}
+
+int virgl_vtest_flush(struct virgl_vtest_winsys *vws)
+{
+   return vtest_batch_flush(&vws->batch, vws->sock_fd);
+}
+
+static int virgl_vtest_read(struct virgl_vtest_winsys *vws,
+                            void *buf, int size)
+{
+   int ret = virgl_vtest_flush(vws);
+   if (ret)
+      return ret;
+   return virgl_block_read(vws->sock_fd, buf, size);
+}
+
 static int virgl_vtest_receive_fd(int socket_fd)
 {
     struct cmsghdr *cmsgh;
@@ -115,6 +129,35 @@ static int virgl_vtest_receive_fd(int socket_fd)
     return *((int *) CMSG_DATA(cmsgh));
 }
 
+static int virgl_vtest_send_fd(int socket_fd, int fd)
+{
+   char buf[CMSG_SPACE(sizeof(int))];
+   char c = 0;
+   struct iovec iovec = {
+      .iov_base = &c,
+      .iov_len = sizeof(c),
+   };
+   struct msghdr msgh = {
+      .msg_iov = &iovec,
+      .msg_iovlen = 1,
+      .msg_control = buf,
+      .msg_controllen = sizeof(buf),
+   };
+   struct cmsghdr *cmsgh = CMSG_FIRSTHDR(&msgh);
+   ssize_t ret;
+
+   cmsgh->cmsg_level = SOL_SOCKET;
+   cmsgh->cmsg_type = SCM_RIGHTS;
+   cmsgh->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsgh), &fd, sizeof(int));
+
+   do {
+      ret = sendmsg(socket_fd, &msgh, 0);
+   } while (ret < 0 && errno == EINTR);
+
+   return ret < 0 ? -errno : 0;
+}
+
 static int virgl_vtest_send_init(struct virgl_vtest_winsys *vws)
 {
    uint32_t buf[VTEST_HDR_SIZE];
@@ -137,12 +180,13 @@ static int virgl_vtest_send_init(struct virgl_vtest_winsys *vws)
    buf[VTEST_CMD_LEN] = strlen(cmdline) + 1;
    buf[VTEST_CMD_ID] = VCMD_CREATE_RENDERER;
 
-   virgl_block_write(vws->sock_fd, &buf, sizeof(buf));
-   virgl_block_write(vws->sock_fd, (void *)cmdline, strlen(cmdline) + 1);
+   virgl_vtest_write(vws, &buf, sizeof(buf));
+   virgl_vtest_write(vws, (void *)cmdline, strlen(cmdline) + 1);
    return 0;
 }
 
-static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
+static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws,
+                                         uint32_t version)
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
    uint32_t version_buf[VCMD_PROTOCOL_VERSION_SIZE];
@@ -152,49 +196,163 @@ static int virgl_vtest_negotiate_version(struct virgl_vtest_winsys *vws)
 
    vtest_hdr[VTEST_CMD_LEN] = VCMD_PING_PROTOCOL_VERSION_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_PING_PROTOCOL_VERSION;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
 
    vtest_hdr[VTEST_CMD_LEN] = VCMD_BUSY_WAIT_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_BUSY_WAIT;
    busy_wait_buf[VCMD_BUSY_WAIT_HANDLE] = 0;
    busy_wait_buf[VCMD_BUSY_WAIT_FLAGS] = 0;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &busy_wait_buf, sizeof(busy_wait_buf));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &busy_wait_buf, sizeof(busy_wait_buf));
 
-   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   ret = virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
    assert(ret);
 
    if (vtest_hdr[VTEST_CMD_ID] == VCMD_PING_PROTOCOL_VERSION) {
      /* Read dummy busy_wait response */
-     ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+     ret = virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
      assert(ret);
-     ret = virgl_block_read(vws->sock_fd, busy_wait_result, sizeof(busy_wait_result));
+     ret = virgl_vtest_read(vws, busy_wait_result, sizeof(busy_wait_result));
      assert(ret);
 
      vtest_hdr[VTEST_CMD_LEN] = VCMD_PROTOCOL_VERSION_SIZE;
      vtest_hdr[VTEST_CMD_ID] = VCMD_PROTOCOL_VERSION;
-     version_buf[VCMD_PROTOCOL_VERSION_VERSION] = VTEST_PROTOCOL_VERSION;
-     virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-     virgl_block_write(vws->sock_fd, &version_buf, sizeof(version_buf));
+     version_buf[VCMD_PROTOCOL_VERSION_VERSION] = version;
+     virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+     virgl_vtest_write(vws, &version_buf, sizeof(version_buf));
 
-     ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+     ret = virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
      assert(ret);
-     ret = virgl_block_read(vws->sock_fd, version_buf, sizeof(version_buf));
+     ret = virgl_vtest_read(vws, version_buf, sizeof(version_buf));
      assert(ret);
      return version_buf[VCMD_PROTOCOL_VERSION_VERSION];
    }
 
    /* Read dummy busy_wait response */
    assert(vtest_hdr[VTEST_CMD_ID] == VCMD_RESOURCE_BUSY_WAIT);
-   ret = virgl_block_read(vws->sock_fd, busy_wait_result, sizeof(busy_wait_result));
+   ret = virgl_vtest_read(vws, busy_wait_result, sizeof(busy_wait_result));
    assert(ret);
 
    /* Old server, return version 0 */
    return 0;
 }
 
+static uint32_t virgl_vtest_get_param(struct virgl_vtest_winsys *vws,
+                                      enum vcmd_param param)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_GET_PARAM_SIZE];
+   uint32_t resp[2];
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_GET_PARAM_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_GET_PARAM;
+   cmd[VCMD_GET_PARAM_PARAM] = param;
+
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
+
+   virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
+   assert(vtest_hdr[VTEST_CMD_LEN] == 2);
+   assert(vtest_hdr[VTEST_CMD_ID] == VCMD_GET_PARAM);
+   virgl_vtest_read(vws, resp, sizeof(resp));
+
+   return resp[0] ? resp[1] : 0;
+}
+
+static void virgl_vtest_ring_init(struct virgl_vtest_winsys *vws)
+{
+   const uint32_t buffer_size = VIRGL_VTEST_RING_SIZE;
+   const size_t shm_size = VCMD_RING_BUFFER_OFFSET + buffer_size;
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_RING_CREATE_SIZE];
+   void *ptr;
+   int fd, ret;
+
+   /* the head starts out zeroed */
+   fd = os_create_anonymous_file(shm_size, "virgl-vtest-ring");
+   if (fd < 0)
+      return;
+
+   ptr = os_mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (ptr == MAP_FAILED) {
+      close(fd);
+      return;
+   }
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_RING_CREATE_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_RING_CREATE;
+   cmd[VCMD_RING_CREATE_BUFFER_SIZE] = buffer_size;
+
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
+   ret = virgl_vtest_flush(vws);
+   if (!ret)
+      ret = virgl_vtest_send_fd(vws->sock_fd, fd);
+   close(fd);
+
+   if (ret) {
+      os_munmap(ptr, shm_size);
+      return;
+   }
+
+   vws->ring.ptr = ptr;
+   vws->ring.size = buffer_size;
+   vws->ring.cur = 0;
+}
+
+void virgl_vtest_ring_fini(struct virgl_vtest_winsys *vws)
+{
+   if (!vws->ring.ptr)
+      return;
+
+   os_munmap(vws->ring.ptr, VCMD_RING_BUFFER_OFFSET + vws->ring.size);
+   vws->ring.ptr = NULL;
+}
+
+/* Returns false when the command stream does not fit in the ring without
+ * waiting for the server, in which case it is sent through the socket.
+ */
+static bool virgl_vtest_ring_submit(struct virgl_vtest_winsys *vws,
+                                    const uint32_t *data, uint32_t cdw)
+{
+   const uint32_t *head_ptr =
+      (const uint32_t *)((uint8_t *)vws->ring.ptr + VCMD_RING_HEAD_OFFSET);
+   uint8_t *buffer = (uint8_t *)vws->ring.ptr + VCMD_RING_BUFFER_OFFSET;
+   const uint32_t mask = vws->ring.size - 1;
+   const uint32_t size = cdw * 4;
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_SUBMIT_CMD_RING_SIZE];
+   uint32_t pos = vws->ring.cur;
+   uint32_t head;
+
+   if (size > vws->ring.size)
+      return false;
+
+   /* command streams never wrap around the end of the buffer */
+   if ((pos & mask) + size > vws->ring.size)
+      pos = (pos + vws->ring.size) & ~mask;
+
+   /* the server stores the head once it is done reading the ring */
+   head = p_atomic_read(head_ptr);
+   if (pos + size - head > vws->ring.size)
+      return false;
+
+   memcpy(buffer + (pos & mask), data, size);
+   vws->ring.cur = pos + size;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_SUBMIT_CMD_RING_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD_RING;
+   cmd[VCMD_SUBMIT_CMD_RING_POS] = pos;
+   cmd[VCMD_SUBMIT_CMD_RING_CMD_SIZE] = cdw;
+
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
+   return true;
+}
+
 int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
 {
+   bool use_ring;
    struct sockaddr_un un;
    int sock, ret;
 
@@ -215,12 +373,31 @@ int virgl_vtest_connect(struct virgl_vtest_winsys *vws)
 
    vws->sock_fd = sock;
    virgl_vtest_send_init(vws);
-   vws->protocol_version = virgl_vtest_negotiate_version(vws);
+
+   vws->encode_transfers = debug_get_bool_option("VTEST_ENCODE_TRANSFERS", false);
+   use_ring = debug_get_bool_option("VTEST_SHM_RING", false);
+   vws->protocol_version =
+      virgl_vtest_negotiate_version(vws,
+                                    vws->encode_transfers || use_ring ?
+                                    VTEST_PROTOCOL_VERSION :
+                                    VTEST_PROTOCOL_VERSION_DEFAULT);
 
    /* Version 1 is deprecated. */
    if (vws->protocol_version == 1)
       vws->protocol_version = 0;
 
+   if (vws->protocol_version < 4)
+      vws->encode_transfers = false;
+   if (vws->encode_transfers) {
+      vws->transfer_encodings =
+         virgl_vtest_get_param(vws, VCMD_PARAM_TRANSFER3_ENCODINGS) |
+         (1 << VCMD_TRANSFER3_ENCODING_RAW);
+   }
+
+   if (use_ring && vws->protocol_version >= 5 &&
+       virgl_vtest_get_param(vws, VCMD_PARAM_RING))
+      virgl_vtest_ring_init(vws);
+
    return 0;
 }
 
@@ -236,9 +413,9 @@ int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
    get_caps_buf[VTEST_CMD_LEN + 2] = 0;
    get_caps_buf[VTEST_CMD_ID + 2] = VCMD_GET_CAPS;
 
-   virgl_block_write(vws->sock_fd, &get_caps_buf, sizeof(get_caps_buf));
+   virgl_vtest_write(vws, &get_caps_buf, sizeof(get_caps_buf));
 
-   ret = virgl_block_read(vws->sock_fd, resp_buf, sizeof(resp_buf));
+   ret = virgl_vtest_read(vws, resp_buf, sizeof(resp_buf));
    if (ret <= 0)
       return 0;
 
@@ -251,10 +428,10 @@ int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
 	   resp_size = caps_size;
        }
 
-       ret = virgl_block_read(vws->sock_fd, &caps->caps, resp_size);
+       ret = virgl_vtest_read(vws, &caps->caps, resp_size);
 
        while (dummy_size) {
-           ret = virgl_block_read(vws->sock_fd, &dummy,
+           ret = virgl_vtest_read(vws, &dummy,
                     dummy_size < sizeof(dummy) ? dummy_size : sizeof(dummy));
            if (ret <= 0)
                break;
@@ -262,18 +439,17 @@ int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
        }
 
        /* now read back the pointless caps v1 we requested */
-       ret = virgl_block_read(vws->sock_fd, resp_buf, sizeof(resp_buf));
+       ret = virgl_vtest_read(vws, resp_buf, sizeof(resp_buf));
        if (ret <= 0)
 	   return 0;
-       ret = virgl_block_read(vws->sock_fd, &dummy, sizeof(struct virgl_caps_v1));
+       ret = virgl_vtest_read(vws, &dummy, sizeof(struct virgl_caps_v1));
    } else
-       ret = virgl_block_read(vws->sock_fd, &caps->caps, sizeof(struct virgl_caps_v1));
+       ret = virgl_vtest_read(vws, &caps->caps, sizeof(struct virgl_caps_v1));
 
    return 0;
 }
 
 static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
-                                             uint32_t handle,
                                              enum pipe_texture_target target,
                                              uint32_t format,
                                              uint32_t bind,
@@ -284,6 +460,7 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
                                              uint32_t last_level,
                                              uint32_t nr_samples,
                                              uint32_t size,
+                                             uint32_t *handle,
                                              int *out_fd)
 {
    uint32_t res_create_buf[VCMD_RES_CREATE2_SIZE], vtest_hdr[VTEST_HDR_SIZE];
@@ -291,7 +468,9 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
    vtest_hdr[VTEST_CMD_LEN] = VCMD_RES_CREATE2_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_CREATE2;
 
-   res_create_buf[VCMD_RES_CREATE2_RES_HANDLE] = handle;
+   /* Since protocol version 3 the server picks the handle. */
+   res_create_buf[VCMD_RES_CREATE2_RES_HANDLE] =
+      vws->protocol_version >= 3 ? 0 : *handle;
    res_create_buf[VCMD_RES_CREATE2_TARGET] = target;
    res_create_buf[VCMD_RES_CREATE2_FORMAT] = format;
    res_create_buf[VCMD_RES_CREATE2_BIND] = bind;
@@ -303,13 +482,21 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
    res_create_buf[VCMD_RES_CREATE2_NR_SAMPLES] = nr_samples;
    res_create_buf[VCMD_RES_CREATE2_DATA_SIZE] = size;
 
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &res_create_buf, sizeof(res_create_buf));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &res_create_buf, sizeof(res_create_buf));
+
+   if (vws->protocol_version >= 3) {
+      virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
+      assert(vtest_hdr[VTEST_CMD_LEN] == 1);
+      assert(vtest_hdr[VTEST_CMD_ID] == VCMD_RESOURCE_CREATE2);
+      virgl_vtest_read(vws, handle, sizeof(*handle));
+   }
 
    /* Multi-sampled textures have no backing store attached. */
    if (size == 0)
       return 0;
 
+   virgl_vtest_flush(vws);
    *out_fd = virgl_vtest_receive_fd(vws->sock_fd);
    if (*out_fd < 0) {
       fprintf(stderr, "failed to get fd\n");
@@ -320,7 +507,6 @@ static int virgl_vtest_send_resource_create2(struct virgl_vtest_winsys *vws,
 }
 
 int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
-                                     uint32_t handle,
                                      enum pipe_texture_target target,
                                      uint32_t format,
                                      uint32_t bind,
@@ -331,20 +517,22 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
                                      uint32_t last_level,
                                      uint32_t nr_samples,
                                      uint32_t size,
+                                     uint32_t *handle,
                                      int *out_fd)
 {
    uint32_t res_create_buf[VCMD_RES_CREATE_SIZE], vtest_hdr[VTEST_HDR_SIZE];
 
    if (vws->protocol_version >= 2)
-      return virgl_vtest_send_resource_create2(vws, handle, target, format,
+      return virgl_vtest_send_resource_create2(vws, target, format,
                                                bind, width, height, depth,
                                                array_size, last_level,
-                                               nr_samples, size, out_fd);
+                                               nr_samples, size, handle,
+                                               out_fd);
 
    vtest_hdr[VTEST_CMD_LEN] = VCMD_RES_CREATE_SIZE;
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_CREATE;
 
-   res_create_buf[VCMD_RES_CREATE_RES_HANDLE] = handle;
+   res_create_buf[VCMD_RES_CREATE_RES_HANDLE] = *handle;
    res_create_buf[VCMD_RES_CREATE_TARGET] = target;
    res_create_buf[VCMD_RES_CREATE_FORMAT] = format;
    res_create_buf[VCMD_RES_CREATE_BIND] = bind;
@@ -355,8 +543,8 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
    res_create_buf[VCMD_RES_CREATE_LAST_LEVEL] = last_level;
    res_create_buf[VCMD_RES_CREATE_NR_SAMPLES] = nr_samples;
 
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &res_create_buf, sizeof(res_create_buf));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &res_create_buf, sizeof(res_create_buf));
 
    return 0;
 }
@@ -366,12 +554,16 @@ int virgl_vtest_submit_cmd(struct virgl_vtest_winsys *vws,
 {
    uint32_t vtest_hdr[VTEST_HDR_SIZE];
 
+   if (vws->ring.ptr &&
+       virgl_vtest_ring_submit(vws, cbuf->buf, cbuf->base.cdw))
+      return virgl_vtest_flush(vws);
+
    vtest_hdr[VTEST_CMD_LEN] = cbuf->base.cdw;
    vtest_hdr[VTEST_CMD_ID] = VCMD_SUBMIT_CMD;
 
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, cbuf->buf, cbuf->base.cdw * 4);
-   return 0;
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, cbuf->buf, cbuf->base.cdw * 4);
+   return virgl_vtest_flush(vws);
 }
 
 int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
@@ -383,8 +575,8 @@ int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
    vtest_hdr[VTEST_CMD_ID] = VCMD_RESOURCE_UNREF;
 
    cmd[0] = handle;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
    return 0;
 }
 
@@ -417,8 +609,8 @@ static int virgl_vtest_send_transfer_cmd(struct virgl_vtest_winsys *vws,
    cmd[8] = box->height;
    cmd[9] = box->depth;
    cmd[10] = data_size;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
 
    return 0;
 }
@@ -451,8 +643,8 @@ static int virgl_vtest_send_transfer_cmd2(struct virgl_vtest_winsys *vws,
    cmd[VCMD_TRANSFER2_DEPTH] = box->depth;
    cmd[VCMD_TRANSFER2_DATA_SIZE] = data_size;
    cmd[VCMD_TRANSFER2_OFFSET] = offset;
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
 
    return 0;
 }
@@ -495,7 +687,324 @@ int virgl_vtest_send_transfer_put_data(struct virgl_vtest_winsys *vws,
                                        void *data,
                                        uint32_t data_size)
 {
-   return virgl_block_write(vws->sock_fd, data, data_size);
+   int ret = virgl_vtest_write(vws, data, data_size);
+   if (ret < 0)
+      return ret;
+   ret = virgl_vtest_flush(vws);
+   return ret ? ret : (int)data_size;
+}
+
+static void *
+virgl_vtest_transfer_scratch(struct virgl_vtest_winsys *vws, unsigned idx,
+                             size_t size)
+{
+   if (vws->transfer_scratch_size[idx] < size) {
+      free(vws->transfer_scratch[idx]);
+      vws->transfer_scratch[idx] = malloc(size);
+      vws->transfer_scratch_size[idx] = vws->transfer_scratch[idx] ? size : 0;
+   }
+   return vws->transfer_scratch[idx];
+}
+
+static uint32_t
+virgl_vtest_local_transfer_encoding(void)
+{
+#if defined(HAVE_COMPRESSION) && defined(HAVE_ZSTD)
+   return VCMD_TRANSFER3_ENCODING_ZSTD;
+#elif defined(HAVE_COMPRESSION)
+   return VCMD_TRANSFER3_ENCODING_ZLIB;
+#else
+   return VCMD_TRANSFER3_ENCODING_RAW;
+#endif
+}
+
+static bool
+virgl_vtest_transfer_shadow_matches(const struct virgl_vtest_transfer_shadow *shadow,
+                                    uint32_t level, const struct pipe_box *box,
+                                    uint32_t data_size, uint32_t offset)
+{
+   return shadow->size && shadow->size == data_size &&
+          shadow->level == level && shadow->offset == offset &&
+          !memcmp(&shadow->box, box, sizeof(*box));
+}
+
+/* Remember the data of a transfer as the base for the next one.  Small
+ * transfers aren't worth a delta, but the shadow must still be dropped so
+ * that it stays in sync with the other end.
+ */
+static void
+virgl_vtest_transfer_shadow_update(struct virgl_vtest_transfer_shadow *shadow,
+                                   uint32_t level, const struct pipe_box *box,
+                                   const void *data, uint32_t data_size,
+                                   uint32_t offset)
+{
+   if (data_size < 2 * VCMD_TRANSFER3_DELTA_BLOCK_SIZE) {
+      shadow->size = 0;
+      return;
+   }
+
+   if (!virgl_vtest_transfer_shadow_matches(shadow, level, box, data_size, offset)) {
+      free(shadow->data);
+      shadow->data = malloc(data_size);
+      if (!shadow->data) {
+         shadow->size = 0;
+         return;
+      }
+      shadow->level = level;
+      shadow->offset = offset;
+      shadow->size = data_size;
+      shadow->box = *box;
+   }
+   memcpy(shadow->data, data, data_size);
+}
+
+void
+virgl_vtest_transfer_shadow_fini(struct virgl_vtest_transfer_shadow *shadow)
+{
+   free(shadow->data);
+   shadow->data = NULL;
+   shadow->size = 0;
+}
+
+/* Only the blocks that differ from the shadow, preceded by a mask of them. */
+static uint32_t
+virgl_vtest_encode_delta(const struct virgl_vtest_transfer_shadow *shadow,
+                         const uint8_t *data, uint32_t data_size,
+                         uint8_t *out)
+{
+   const uint32_t num_blocks = DIV_ROUND_UP(data_size, VCMD_TRANSFER3_DELTA_BLOCK_SIZE);
+   const uint32_t mask_size = DIV_ROUND_UP(num_blocks, 32) * 4;
+   uint32_t *mask = (uint32_t *)out;
+   uint8_t *ptr = out + mask_size;
+
+   memset(mask, 0, mask_size);
+   for (uint32_t i = 0; i < num_blocks; i++) {
+      const uint32_t offset = i * VCMD_TRANSFER3_DELTA_BLOCK_SIZE;
+      const uint32_t size = MIN2(data_size - offset, VCMD_TRANSFER3_DELTA_BLOCK_SIZE);
+
+      if (!memcmp(data + offset, shadow->data + offset, size))
+         continue;
+
+      mask[i / 32] |= 1u << (i % 32);
+      memcpy(ptr, data + offset, size);
+      ptr += size;
+   }
+
+   return ptr - out;
+}
+
+static bool
+virgl_vtest_decode_delta(const struct virgl_vtest_transfer_shadow *shadow,
+                         const uint8_t *delta, uint32_t delta_size,
+                         uint8_t *data, uint32_t data_size)
+{
+   const uint32_t num_blocks = DIV_ROUND_UP(data_size, VCMD_TRANSFER3_DELTA_BLOCK_SIZE);
+   const uint32_t mask_size = DIV_ROUND_UP(num_blocks, 32) * 4;
+   const uint32_t *mask = (const uint32_t *)delta;
+   const uint8_t *ptr = delta + mask_size;
+
+   if (delta_size < mask_size)
+      return false;
+
+   for (uint32_t i = 0; i < num_blocks; i++) {
+      const uint32_t offset = i * VCMD_TRANSFER3_DELTA_BLOCK_SIZE;
+      const uint32_t size = MIN2(data_size - offset, VCMD_TRANSFER3_DELTA_BLOCK_SIZE);
+
+      if (mask[i / 32] & (1u << (i % 32))) {
+         if (ptr + size > delta + delta_size)
+            return false;
+         memcpy(data + offset, ptr, size);
+         ptr += size;
+      } else {
+         memcpy(data + offset, shadow->data + offset, size);
+      }
+   }
+
+   return true;
+}
+
+static void
+virgl_vtest_fill_transfer3_cmd(uint32_t *cmd, uint32_t handle, uint32_t level,
+                               const struct pipe_box *box, uint32_t data_size,
+                               uint32_t offset)
+{
+   memset(cmd, 0, VCMD_TRANSFER3_HDR_SIZE * 4);
+   cmd[VCMD_TRANSFER3_RES_HANDLE] = handle;
+   cmd[VCMD_TRANSFER3_LEVEL] = level;
+   cmd[VCMD_TRANSFER3_X] = box->x;
+   cmd[VCMD_TRANSFER3_Y] = box->y;
+   cmd[VCMD_TRANSFER3_Z] = box->z;
+   cmd[VCMD_TRANSFER3_WIDTH] = box->width;
+   cmd[VCMD_TRANSFER3_HEIGHT] = box->height;
+   cmd[VCMD_TRANSFER3_DEPTH] = box->depth;
+   cmd[VCMD_TRANSFER3_DATA_SIZE] = data_size;
+   cmd[VCMD_TRANSFER3_OFFSET] = offset;
+}
+
+int virgl_vtest_send_transfer_put3(struct virgl_vtest_winsys *vws,
+                                   struct virgl_hw_res *res,
+                                   uint32_t level,
+                                   const struct pipe_box *box,
+                                   const void *data,
+                                   uint32_t data_size,
+                                   uint32_t offset)
+{
+   static const uint8_t zero[4];
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_TRANSFER3_HDR_SIZE];
+   const uint8_t *payload = data;
+   uint32_t payload_size = data_size;
+   uint32_t encoding = VCMD_TRANSFER3_ENCODING_RAW;
+   uint32_t flags = 0;
+
+   virgl_vtest_fill_transfer3_cmd(cmd, res->res_handle, level, box,
+                                  data_size, offset);
+
+   if (virgl_vtest_transfer_shadow_matches(&res->put_shadow, level, box,
+                                           data_size, offset)) {
+      const uint32_t max_size =
+         DIV_ROUND_UP(DIV_ROUND_UP(data_size, VCMD_TRANSFER3_DELTA_BLOCK_SIZE), 32) * 4 +
+         data_size;
+      uint8_t *delta = virgl_vtest_transfer_scratch(vws, 0, max_size);
+      if (delta) {
+         uint32_t delta_size = virgl_vtest_encode_delta(&res->put_shadow, data,
+                                                        data_size, delta);
+         if (delta_size < data_size) {
+            payload = delta;
+            payload_size = delta_size;
+            flags |= VCMD_TRANSFER3_FLAG_DELTA;
+         }
+      }
+   }
+   cmd[VCMD_TRANSFER3_DECODED_SIZE] = payload_size;
+
+#ifdef HAVE_COMPRESSION
+   const uint32_t local_encoding = virgl_vtest_local_transfer_encoding();
+   if ((vws->transfer_encodings & (1 << local_encoding)) && payload_size) {
+      const size_t max_size = util_compress_max_compressed_len(payload_size);
+      uint8_t *compressed = virgl_vtest_transfer_scratch(vws, 1, max_size);
+      size_t compressed_size = compressed ?
+         util_compress_deflate(payload, payload_size, compressed, max_size) : 0;
+      if (compressed_size && compressed_size < payload_size) {
+         payload = compressed;
+         payload_size = compressed_size;
+         encoding = local_encoding;
+      }
+   }
+#endif
+
+   cmd[VCMD_TRANSFER3_ENCODING] = encoding;
+   cmd[VCMD_TRANSFER3_FLAGS] = flags;
+   cmd[VCMD_TRANSFER3_PAYLOAD_SIZE] = payload_size;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_TRANSFER3_HDR_SIZE + DIV_ROUND_UP(payload_size, 4);
+   vtest_hdr[VTEST_CMD_ID] = VCMD_TRANSFER_PUT3;
+
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
+   if (payload_size)
+      virgl_vtest_write(vws, (void *)payload, payload_size);
+   if (payload_size % 4)
+      virgl_vtest_write(vws, (void *)zero, 4 - payload_size % 4);
+   /* the payload is in a scratch buffer */
+   virgl_vtest_flush(vws);
+
+   virgl_vtest_transfer_shadow_update(&res->put_shadow, level, box, data,
+                                      data_size, offset);
+
+   vws->transfer_stats.data_bytes += data_size;
+   vws->transfer_stats.wire_bytes += vtest_hdr[VTEST_CMD_LEN] * 4 + sizeof(vtest_hdr);
+   return 0;
+}
+
+int virgl_vtest_transfer_get3(struct virgl_vtest_winsys *vws,
+                              struct virgl_hw_res *res,
+                              uint32_t level,
+                              const struct pipe_box *box,
+                              void *data,
+                              uint32_t data_size,
+                              uint32_t offset)
+{
+   uint32_t vtest_hdr[VTEST_HDR_SIZE];
+   uint32_t cmd[VCMD_TRANSFER3_HDR_SIZE];
+   const bool has_base =
+      virgl_vtest_transfer_shadow_matches(&res->get_shadow, level, box,
+                                          data_size, offset);
+
+   virgl_vtest_fill_transfer3_cmd(cmd, res->res_handle, level, box,
+                                  data_size, offset);
+   cmd[VCMD_TRANSFER3_ENCODING] = (1 << VCMD_TRANSFER3_ENCODING_RAW) |
+                                  (1 << virgl_vtest_local_transfer_encoding());
+   cmd[VCMD_TRANSFER3_FLAGS] = has_base ? VCMD_TRANSFER3_FLAG_DELTA : 0;
+
+   vtest_hdr[VTEST_CMD_LEN] = VCMD_TRANSFER3_HDR_SIZE;
+   vtest_hdr[VTEST_CMD_ID] = VCMD_TRANSFER_GET3;
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
+
+   virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
+   assert(vtest_hdr[VTEST_CMD_ID] == VCMD_TRANSFER_GET3);
+   virgl_vtest_read(vws, cmd, sizeof(cmd));
+
+   const uint32_t encoding = cmd[VCMD_TRANSFER3_ENCODING];
+   const uint32_t flags = cmd[VCMD_TRANSFER3_FLAGS];
+   const uint32_t decoded_size = cmd[VCMD_TRANSFER3_DECODED_SIZE];
+   const uint32_t payload_size = cmd[VCMD_TRANSFER3_PAYLOAD_SIZE];
+   const uint32_t padded_size = ALIGN_POT(payload_size, 4);
+
+   vws->transfer_stats.data_bytes += data_size;
+   vws->transfer_stats.wire_bytes += vtest_hdr[VTEST_CMD_LEN] * 4 + sizeof(vtest_hdr);
+
+   uint8_t *payload = virgl_vtest_transfer_scratch(vws, 0, MAX2(padded_size, 4));
+   if (!payload) {
+      /* Keep the socket in sync with the server. */
+      for (uint32_t left = padded_size; left;) {
+         uint8_t discard[256];
+         uint32_t chunk = MIN2(left, sizeof(discard));
+         virgl_vtest_read(vws, discard, chunk);
+         left -= chunk;
+      }
+      goto fail;
+   }
+   if (padded_size)
+      virgl_vtest_read(vws, payload, padded_size);
+
+   const uint8_t *decoded = payload;
+   if (encoding != VCMD_TRANSFER3_ENCODING_RAW) {
+#ifdef HAVE_COMPRESSION
+      uint8_t *inflated = encoding == virgl_vtest_local_transfer_encoding() ?
+         virgl_vtest_transfer_scratch(vws, 1, decoded_size) : NULL;
+      if (!inflated ||
+          !util_compress_inflate(payload, payload_size, inflated, decoded_size))
+         goto fail;
+      decoded = inflated;
+#else
+      goto fail;
+#endif
+   } else if (decoded_size != payload_size) {
+      goto fail;
+   }
+
+   if (flags & VCMD_TRANSFER3_FLAG_DELTA) {
+      if (!has_base ||
+          !virgl_vtest_decode_delta(&res->get_shadow, decoded, decoded_size,
+                                    data, data_size))
+         goto fail;
+   } else {
+      if (decoded_size != data_size)
+         goto fail;
+      memcpy(data, decoded, data_size);
+   }
+
+   virgl_vtest_transfer_shadow_update(&res->get_shadow, level, box, data,
+                                      data_size, offset);
+   return 0;
+
+fail:
+   fprintf(stderr, "failed to decode transfer for resource %u\n",
+           res->res_handle);
+   res->get_shadow.size = 0;
+   return -1;
 }
 
 int virgl_vtest_recv_transfer_get_data(struct virgl_vtest_winsys *vws,
@@ -511,7 +1020,7 @@ int virgl_vtest_recv_transfer_get_data(struct virgl_vtest_winsys *vws,
 
    line = malloc(stride);
    while (hblocks) {
-      virgl_block_read(vws->sock_fd, line, stride);
+      virgl_vtest_read(vws, line, stride);
       memcpy(ptr, line, util_format_get_stride(format, box->width));
       ptr += stride;
       hblocks--;
@@ -532,12 +1041,12 @@ int virgl_vtest_busy_wait(struct virgl_vtest_winsys *vws, int handle,
    cmd[VCMD_BUSY_WAIT_HANDLE] = handle;
    cmd[VCMD_BUSY_WAIT_FLAGS] = flags;
 
-   virgl_block_write(vws->sock_fd, &vtest_hdr, sizeof(vtest_hdr));
-   virgl_block_write(vws->sock_fd, &cmd, sizeof(cmd));
+   virgl_vtest_write(vws, &vtest_hdr, sizeof(vtest_hdr));
+   virgl_vtest_write(vws, &cmd, sizeof(cmd));
 
-   ret = virgl_block_read(vws->sock_fd, vtest_hdr, sizeof(vtest_hdr));
+   ret = virgl_vtest_read(vws, vtest_hdr, sizeof(vtest_hdr));
    assert(ret);
-   ret = virgl_block_read(vws->sock_fd, result, sizeof(result));
+   ret = virgl_vtest_read(vws, result, sizeof(result));
    assert(ret);
    return result[0];
 }
@@ -20,12 +20,14 @@
  * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
  * USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <inttypes.h>
 #include <stdio.h>
 #include "util/u_surface.h"
 #include "util/u_memory.h"
 #include "util/format/u_format.h"
 #include "util/u_inlines.h"
 #include "util/os_time.h"
+#include "util/u_debug.h"
 #include "frontend/sw_winsys.h"
 #include "os/os_mman.h"
 
@@ -75,11 +77,11 @@ static uint32_t vtest_get_transfer_size(struct virgl_hw_res *res,
 }
 
 static int
-virgl_vtest_transfer_put(struct virgl_winsys *vws,
-                         struct virgl_hw_res *res,
-                         const struct pipe_box *box,
-                         uint32_t stride, uint32_t layer_stride,
-                         uint32_t buf_offset, uint32_t level)
+virgl_vtest_transfer_put_locked(struct virgl_winsys *vws,
+                                struct virgl_hw_res *res,
+                                const struct pipe_box *box,
+                                uint32_t stride, uint32_t layer_stride,
+                                uint32_t buf_offset, uint32_t level)
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
    uint32_t size;
@@ -89,6 +91,14 @@ virgl_vtest_transfer_put(struct virgl_winsys *vws,
    size = vtest_get_transfer_size(res, box, stride, layer_stride, level,
                                   &valid_stride);
 
+   if (vtws->encode_transfers) {
+      ptr = virgl_vtest_resource_map(vws, res);
+      virgl_vtest_send_transfer_put3(vtws, res, level, box, ptr + buf_offset,
+                                     size, buf_offset);
+      virgl_vtest_resource_unmap(vws, res);
+      return 0;
+   }
+
    virgl_vtest_send_transfer_put(vtws, res->res_handle,
                                  level, stride, layer_stride,
                                  box, size, buf_offset);
@@ -102,6 +112,23 @@ virgl_vtest_transfer_put(struct virgl_winsys *vws,
    return 0;
 }
 
+static int
+virgl_vtest_transfer_put(struct virgl_winsys *vws,
+                         struct virgl_hw_res *res,
+                         const struct pipe_box *box,
+                         uint32_t stride, uint32_t layer_stride,
+                         uint32_t buf_offset, uint32_t level)
+{
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
+
+   mtx_lock(&vtws->io_mutex);
+   int ret = virgl_vtest_transfer_put_locked(vws, res, box, stride,
+                                             layer_stride, buf_offset, level);
+   mtx_unlock(&vtws->io_mutex);
+   return ret;
+}
+
+/* Called with io_mutex held. */
 static int
 virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
                                   struct virgl_hw_res *res,
@@ -117,12 +144,23 @@ virgl_vtest_transfer_get_internal(struct virgl_winsys *vws,
 
    size = vtest_get_transfer_size(res, box, stride, layer_stride, level,
                                   &valid_stride);
-   virgl_vtest_send_transfer_get(vtws, res->res_handle,
-                                 level, stride, layer_stride,
-                                 box, size, buf_offset);
 
-   if (flush_front_buffer || vtws->protocol_version >= 2)
-      virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
+   if (vtws->encode_transfers) {
+      /* The reply is only sent once the data has been read back. */
+      ptr = virgl_vtest_resource_map(vws, res);
+      int ret = virgl_vtest_transfer_get3(vtws, res, level, box,
+                                          ptr + buf_offset, size, buf_offset);
+      virgl_vtest_resource_unmap(vws, res);
+      if (ret)
+         return ret;
+   } else {
+      virgl_vtest_send_transfer_get(vtws, res->res_handle,
+                                    level, stride, layer_stride,
+                                    box, size, buf_offset);
+
+      if (flush_front_buffer || vtws->protocol_version >= 2)
+         virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
+   }
 
    if (vtws->protocol_version >= 2) {
       if (flush_front_buffer) {
@@ -166,17 +204,27 @@ virgl_vtest_transfer_get(struct virgl_winsys *vws,
                          uint32_t stride, uint32_t layer_stride,
                          uint32_t buf_offset, uint32_t level)
 {
-   return virgl_vtest_transfer_get_internal(vws, res, box, stride,
-                                            layer_stride, buf_offset,
-                                            level, false);
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
+
+   mtx_lock(&vtws->io_mutex);
+   int ret = virgl_vtest_transfer_get_internal(vws, res, box, stride,
+                                               layer_stride, buf_offset,
+                                               level, false);
+   mtx_unlock(&vtws->io_mutex);
+   return ret;
 }
 
 static void virgl_hw_res_destroy(struct virgl_vtest_winsys *vtws,
                                  struct virgl_hw_res *res)
 {
+   mtx_lock(&vtws->io_mutex);
    virgl_vtest_send_resource_unref(vtws, res->res_handle);
    if (res->dt)
       vtws->sws->displaytarget_destroy(vtws->sws, res->dt);
+   mtx_unlock(&vtws->io_mutex);
+
+   virgl_vtest_transfer_shadow_fini(&res->put_shadow);
+   virgl_vtest_transfer_shadow_fini(&res->get_shadow);
    if (vtws->protocol_version >= 2) {
       if (res->ptr)
          os_munmap(res->ptr, res->size);
@@ -194,7 +242,9 @@ static boolean virgl_vtest_resource_is_busy(struct virgl_winsys *vws,
 
    /* implement busy check */
    int ret;
+   mtx_lock(&vtws->io_mutex);
    ret = virgl_vtest_busy_wait(vtws, res->res_handle, 0);
+   mtx_unlock(&vtws->io_mutex);
 
    if (ret < 0)
       return FALSE;
@@ -222,18 +272,18 @@ static void virgl_vtest_resource_reference(struct virgl_winsys *vws,
 }
 
 static struct virgl_hw_res *
-virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
-                                   enum pipe_texture_target target,
-                                   const void *map_front_private,
-                                   uint32_t format,
-                                   uint32_t bind,
-                                   uint32_t width,
-                                   uint32_t height,
-                                   uint32_t depth,
-                                   uint32_t array_size,
-                                   uint32_t last_level,
-                                   uint32_t nr_samples,
-                                   uint32_t size)
+virgl_vtest_winsys_resource_create_locked(struct virgl_winsys *vws,
+                                          enum pipe_texture_target target,
+                                          const void *map_front_private,
+                                          uint32_t format,
+                                          uint32_t bind,
+                                          uint32_t width,
+                                          uint32_t height,
+                                          uint32_t depth,
+                                          uint32_t array_size,
+                                          uint32_t last_level,
+                                          uint32_t nr_samples,
+                                          uint32_t size)
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
    struct virgl_hw_res *res;
@@ -273,14 +323,15 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
    res->height = height;
    res->width = width;
    res->size = size;
-   virgl_vtest_send_resource_create(vtws, handle, target, pipe_to_virgl_format(format), bind,
+   res->res_handle = handle;
+   virgl_vtest_send_resource_create(vtws, target, pipe_to_virgl_format(format), bind,
                                     width, height, depth, array_size,
-                                    last_level, nr_samples, size, &fd);
+                                    last_level, nr_samples, size,
+                                    &res->res_handle, &fd);
 
    if (vtws->protocol_version >= 2) {
       if (res->size == 0) {
          res->ptr = NULL;
-         res->res_handle = handle;
          goto out;
       }
 
@@ -303,7 +354,6 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
       close(fd);
    }
 
-   res->res_handle = handle;
    if (map_front_private && res->ptr && res->dt) {
       void *dt_map = vtws->sws->displaytarget_map(vtws->sws, res->dt, PIPE_MAP_READ_WRITE);
       uint32_t shm_stride = util_format_get_stride(res->format, res->width);
@@ -312,7 +362,7 @@ virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
 
       struct pipe_box box;
       u_box_2d(0, 0, res->width, res->height, &box);
-      virgl_vtest_transfer_put(vws, res, &box, res->stride, 0, 0, 0);
+      virgl_vtest_transfer_put_locked(vws, res, &box, res->stride, 0, 0, 0);
    }
 
 out:
@@ -323,6 +373,33 @@ out:
    return res;
 }
 
+static struct virgl_hw_res *
+virgl_vtest_winsys_resource_create(struct virgl_winsys *vws,
+                                   enum pipe_texture_target target,
+                                   const void *map_front_private,
+                                   uint32_t format,
+                                   uint32_t bind,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   uint32_t depth,
+                                   uint32_t array_size,
+                                   uint32_t last_level,
+                                   uint32_t nr_samples,
+                                   uint32_t size)
+{
+   struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
+   struct virgl_hw_res *res;
+
+   mtx_lock(&vtws->io_mutex);
+   res = virgl_vtest_winsys_resource_create_locked(vws, target,
+                                                   map_front_private, format,
+                                                   bind, width, height, depth,
+                                                   array_size, last_level,
+                                                   nr_samples, size);
+   mtx_unlock(&vtws->io_mutex);
+   return res;
+}
+
 static void *virgl_vtest_resource_map(struct virgl_winsys *vws,
                                       struct virgl_hw_res *res)
 {
@@ -358,7 +435,9 @@ static void virgl_vtest_resource_wait(struct virgl_winsys *vws,
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
+   mtx_lock(&vtws->io_mutex);
    virgl_vtest_busy_wait(vtws, res->res_handle, VCMD_BUSY_WAIT_FLAG_WAIT);
+   mtx_unlock(&vtws->io_mutex);
 }
 
 static struct virgl_hw_res *
@@ -543,7 +622,9 @@ static int virgl_vtest_winsys_submit_cmd(struct virgl_winsys *vws,
    if (cbuf->base.cdw == 0)
       return 0;
 
+   mtx_lock(&vtws->io_mutex);
    ret = virgl_vtest_submit_cmd(vtws, cbuf);
+   mtx_unlock(&vtws->io_mutex);
    if (fence && ret == 0)
       *fence = virgl_vtest_fence_create(vws);
 
@@ -584,7 +665,9 @@ static int virgl_vtest_get_caps(struct virgl_winsys *vws,
    int ret;
 
    virgl_ws_fill_new_caps_defaults(caps);
+   mtx_lock(&vtws->io_mutex);
    ret = virgl_vtest_send_get_caps(vtws, caps);
+   mtx_unlock(&vtws->io_mutex);
    // vtest doesn't support that
    if (caps->caps.v2.capability_bits_v2 & VIRGL_CAP_V2_COPY_TRANSFER_BOTH_DIRECTIONS)
       caps->caps.v2.capability_bits_v2 &= ~VIRGL_CAP_V2_COPY_TRANSFER_BOTH_DIRECTIONS;
@@ -629,6 +712,31 @@ static void virgl_fence_reference(struct virgl_winsys *vws,
                                   virgl_hw_res(src));
 }
 
+/* Prints the transfer bytes per frame since the last report, at most once
+ * a second.
+ */
+static void
+virgl_vtest_report_transfer_stats(struct virgl_vtest_winsys *vtws)
+{
+   int64_t now = os_time_get();
+
+   if (now - vtws->stats_report_time < 1000000)
+      return;
+
+   unsigned frames = vtws->transfer_stats.frames - vtws->reported_stats.frames;
+   uint64_t data_bytes = vtws->transfer_stats.data_bytes -
+                         vtws->reported_stats.data_bytes;
+   uint64_t wire_bytes = vtws->transfer_stats.wire_bytes -
+                         vtws->reported_stats.wire_bytes;
+
+   fprintf(stderr, "vtest: %u frames, %" PRIu64 " bytes/frame transferred, "
+           "%" PRIu64 " bytes/frame on the wire\n",
+           frames, data_bytes / frames, wire_bytes / frames);
+
+   vtws->reported_stats = vtws->transfer_stats;
+   vtws->stats_report_time = now;
+}
+
 static void virgl_vtest_flush_frontbuffer(struct virgl_winsys *vws,
                                           struct virgl_hw_res *res,
                                           unsigned level, unsigned layer,
@@ -655,11 +763,17 @@ static void virgl_vtest_flush_frontbuffer(struct virgl_winsys *vws,
       box.depth = 1;
    }
 
+   mtx_lock(&vtws->io_mutex);
    virgl_vtest_transfer_get_internal(vws, res, &box, res->stride, 0, offset,
                                      level, true);
 
    vtws->sws->displaytarget_display(vtws->sws, res->dt, winsys_drawable_handle,
                                     sub_box);
+
+   vtws->transfer_stats.frames++;
+   if (vtws->transfer_stats_enabled)
+      virgl_vtest_report_transfer_stats(vtws);
+   mtx_unlock(&vtws->io_mutex);
 }
 
 static void
@@ -667,8 +781,22 @@ virgl_vtest_winsys_destroy(struct virgl_winsys *vws)
 {
    struct virgl_vtest_winsys *vtws = virgl_vtest_winsys(vws);
 
-   virgl_resource_cache_flush(&vtws->cache);
+   virgl_resource_cache_fini(&vtws->cache);
+   /* send the unrefs */
+   virgl_vtest_flush(vtws);
+   virgl_vtest_ring_fini(vtws);
+
+   if (vtws->transfer_stats_enabled) {
+      fprintf(stderr, "vtest: %u frames, %" PRIu64 " bytes transferred, "
+              "%" PRIu64 " bytes on the wire\n",
+              vtws->transfer_stats.frames,
+              vtws->transfer_stats.data_bytes,
+              vtws->transfer_stats.wire_bytes);
+   }
 
+   free(vtws->transfer_scratch[0]);
+   free(vtws->transfer_scratch[1]);
+   mtx_destroy(&vtws->io_mutex);
    mtx_destroy(&vtws->mutex);
    FREE(vtws);
 }
@@ -705,12 +833,19 @@ virgl_vtest_winsys_wrap(struct sw_winsys *sws)
 
    virgl_vtest_connect(vtws);
    vtws->sws = sws;
+   vtws->transfer_stats_enabled = vtws->encode_transfers &&
+                                  debug_get_bool_option("VTEST_TRANSFER_STATS", false);
+   vtws->stats_report_time = os_time_get();
 
    virgl_resource_cache_init(&vtws->cache, CACHE_TIMEOUT_USEC,
                              virgl_vtest_resource_cache_entry_is_busy,
                              virgl_vtest_resource_cache_entry_release,
                              vtws);
    (void) mtx_init(&vtws->mutex, mtx_plain);
+   (void) mtx_init(&vtws->io_mutex, mtx_plain);
+
+   /* releasing resources takes io_mutex, which nests inside mutex */
+   virgl_resource_cache_start_reaper(&vtws->cache, &vtws->mutex);
 
    vtws->base.destroy = virgl_vtest_winsys_destroy;
 
@@ -734,7 +869,10 @@ virgl_vtest_winsys_wrap(struct sw_winsys *sws)
    vtws->base.fence_wait = virgl_fence_wait;
    vtws->base.fence_reference = virgl_fence_reference;
    vtws->base.supports_fences =  0;
-   vtws->base.supports_encoded_transfers = (vtws->protocol_version >= 2);
+   vtws->base.supports_threads = 1;
+   /* Encoded transfers go through the shared backing store. */
+   vtws->base.supports_encoded_transfers = (vtws->protocol_version >= 2 &&
+                                            !vtws->encode_transfers);
 
    vtws->base.flush_frontbuffer = virgl_vtest_flush_frontbuffer;
 
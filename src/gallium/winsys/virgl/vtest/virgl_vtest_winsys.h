@@ -31,9 +31,19 @@
 #include "os/os_thread.h"
 
 #include "virgl/virgl_winsys.h"
+#define VIRGL_RENDERER_UNSTABLE_APIS
+#include "vtest/vtest_batch.h"
 #include "vtest/vtest_protocol.h"
 #include "virgl_resource_cache.h"
 
+/* Protocol version 3 changes how resources are created, so newer versions
+ * are only asked for when transfer encoding or the ring is enabled.
+ */
+#define VTEST_PROTOCOL_VERSION_DEFAULT 2
+
+/* large enough for a few full command buffers */
+#define VIRGL_VTEST_RING_SIZE (1 << 20)
+
 struct pipe_fence_handle;
 struct sw_winsys;
 struct sw_displaytarget;
@@ -45,11 +55,58 @@ struct virgl_vtest_winsys {
 
    /* fd to remote renderer */
    int sock_fd;
+   /* commands not sent yet */
+   struct vtest_batch batch;
+
+   /* Command buffers are copied into a ring shared with the server and
+    * submitted with VCMD_SUBMIT_CMD_RING rather than sent through the
+    * socket, see VCMD_RING_CREATE.
+    */
+   struct {
+      void *ptr;
+      uint32_t size;
+      uint32_t cur;
+   } ring;
 
    struct virgl_resource_cache cache;
    mtx_t mutex;
 
+   /* Held around every exchange with the server, so that requests from
+    * several threads don't interleave and each reads its own reply.  Also
+    * protects the batch, the ring and the transfer shadows.  Nests inside
+    * mutex.
+    */
+   mtx_t io_mutex;
+
    unsigned protocol_version;
+
+   /* Send transfers inline with VCMD_TRANSFER_{PUT,GET}3, compressed and
+    * delta encoded, instead of through the shared memory backing store.
+    * For remote renderers where the backing store isn't actually shared.
+    */
+   bool encode_transfers;
+   uint32_t transfer_encodings;
+   void *transfer_scratch[2];
+   size_t transfer_scratch_size[2];
+
+   bool transfer_stats_enabled;
+   struct {
+      uint64_t data_bytes;
+      uint64_t wire_bytes;
+      unsigned frames;
+   } transfer_stats, reported_stats;
+   int64_t stats_report_time;
+};
+
+/* Data of the last TRANSFER3 in one direction, the base for the next
+ * delta encoded one.
+ */
+struct virgl_vtest_transfer_shadow {
+   uint32_t level;
+   uint32_t offset;
+   uint32_t size;
+   struct pipe_box box;
+   uint8_t *data;
 };
 
 struct virgl_hw_res {
@@ -70,6 +127,9 @@ struct virgl_hw_res {
 
    uint32_t bind;
    struct virgl_resource_cache_entry cache_entry;
+
+   struct virgl_vtest_transfer_shadow put_shadow;
+   struct virgl_vtest_transfer_shadow get_shadow;
 };
 
 struct virgl_vtest_cmd_buf {
@@ -108,7 +168,6 @@ int virgl_vtest_send_get_caps(struct virgl_vtest_winsys *vws,
                               struct virgl_drm_caps *caps);
 
 int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
-                                     uint32_t handle,
                                      enum pipe_texture_target target,
                                      uint32_t format,
                                      uint32_t bind,
@@ -119,12 +178,15 @@ int virgl_vtest_send_resource_create(struct virgl_vtest_winsys *vws,
                                      uint32_t last_level,
                                      uint32_t nr_samples,
                                      uint32_t size,
+                                     uint32_t *handle,
                                      int *out_fd);
 
 int virgl_vtest_send_resource_unref(struct virgl_vtest_winsys *vws,
                                     uint32_t handle);
 int virgl_vtest_submit_cmd(struct virgl_vtest_winsys *vtws,
                            struct virgl_vtest_cmd_buf *cbuf);
+int virgl_vtest_flush(struct virgl_vtest_winsys *vws);
+void virgl_vtest_ring_fini(struct virgl_vtest_winsys *vws);
 
 int virgl_vtest_send_transfer_get(struct virgl_vtest_winsys *vws,
                                   uint32_t handle,
@@ -145,6 +207,22 @@ int virgl_vtest_send_transfer_put(struct virgl_vtest_winsys *vws,
 int virgl_vtest_send_transfer_put_data(struct virgl_vtest_winsys *vws,
                                        void *data,
                                        uint32_t data_size);
+
+int virgl_vtest_send_transfer_put3(struct virgl_vtest_winsys *vws,
+                                   struct virgl_hw_res *res,
+                                   uint32_t level,
+                                   const struct pipe_box *box,
+                                   const void *data,
+                                   uint32_t data_size,
+                                   uint32_t offset);
+int virgl_vtest_transfer_get3(struct virgl_vtest_winsys *vws,
+                              struct virgl_hw_res *res,
+                              uint32_t level,
+                              const struct pipe_box *box,
+                              void *data,
+                              uint32_t data_size,
+                              uint32_t offset);
+void virgl_vtest_transfer_shadow_fini(struct virgl_vtest_transfer_shadow *shadow);
 int virgl_vtest_recv_transfer_get_data(struct virgl_vtest_winsys *vws,
                                        void *data,
                                        uint32_t data_size,
@@ -1343,6 +1343,9 @@ check_init_viewport(struct gl_context *ctx, GLuint width, GLuint height)
          _mesa_set_viewport(ctx, i, 0, 0, width, height);
          _mesa_set_scissor(ctx, i, 0, 0, width, height);
       }
+
+      /* glthread is idle during MakeCurrent. */
+      _mesa_glthread_update_viewport_scissor(ctx);
    }
 }
 
@@ -13967,6 +13967,28 @@ _mesa_glthread_execute_list(struct gl_context *ctx, GLuint list)
          case OPCODE_ENABLE:
             _mesa_glthread_Enable(ctx, n[1].e);
             break;
+         case OPCODE_DISABLE_INDEXED:
+            _mesa_glthread_Enablei(ctx, n[1].ui, n[2].e, false);
+            break;
+         case OPCODE_ENABLE_INDEXED:
+            _mesa_glthread_Enablei(ctx, n[1].ui, n[2].e, true);
+            break;
+         case OPCODE_VIEWPORT:
+            _mesa_glthread_Viewport(ctx, n[1].i, n[2].i, n[3].i, n[4].i);
+            break;
+         case OPCODE_VIEWPORT_ARRAY_V:
+         case OPCODE_VIEWPORT_INDEXED_F:
+         case OPCODE_VIEWPORT_INDEXED_FV:
+            _mesa_glthread_ViewportIndexed(ctx, n[1].ui);
+            break;
+         case OPCODE_SCISSOR:
+            _mesa_glthread_Scissor(ctx, n[1].i, n[2].i, n[3].i, n[4].i);
+            break;
+         case OPCODE_SCISSOR_ARRAY_V:
+         case OPCODE_SCISSOR_INDEXED:
+         case OPCODE_SCISSOR_INDEXED_V:
+            _mesa_glthread_ScissorIndexed(ctx, n[1].ui);
+            break;
          case OPCODE_LIST_BASE:
             _mesa_glthread_ListBase(ctx, n[1].ui);
             break;
@@ -14025,6 +14047,16 @@ _mesa_glthread_should_execute_list(struct gl_context *ctx,
       case OPCODE_CALL_LISTS:
       case OPCODE_DISABLE:
       case OPCODE_ENABLE:
+      case OPCODE_DISABLE_INDEXED:
+      case OPCODE_ENABLE_INDEXED:
+      case OPCODE_VIEWPORT:
+      case OPCODE_VIEWPORT_ARRAY_V:
+      case OPCODE_VIEWPORT_INDEXED_F:
+      case OPCODE_VIEWPORT_INDEXED_FV:
+      case OPCODE_SCISSOR:
+      case OPCODE_SCISSOR_ARRAY_V:
+      case OPCODE_SCISSOR_INDEXED:
+      case OPCODE_SCISSOR_INDEXED_V:
       case OPCODE_LIST_BASE:
       case OPCODE_MATRIX_MODE:
       case OPCODE_POP_ATTRIB:
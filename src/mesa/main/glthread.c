@@ -36,6 +36,10 @@
 #include "main/glthread.h"
 #include "main/glthread_marshal.h"
 #include "main/hash.h"
+#include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
 #include "util/u_atomic.h"
 #include "util/u_thread.h"
 #include "util/u_cpu_detect.h"
@@ -90,6 +94,44 @@ glthread_thread_initialization(void *job, void *gdata, int thread_index)
    _glapi_set_context(ctx);
 }
 
+static void
+copy_pixelstore(struct glthread_pixelstore *dst,
+                const struct gl_pixelstore_attrib *src)
+{
+   dst->Alignment = src->Alignment;
+   dst->RowLength = src->RowLength;
+   dst->SkipPixels = src->SkipPixels;
+   dst->SkipRows = src->SkipRows;
+   dst->ImageHeight = src->ImageHeight;
+   dst->SkipImages = src->SkipImages;
+}
+
+/**
+ * Copy the viewport and scissor box of index 0 from the context, which must
+ * only be done while the worker thread is idle. This is used when the context
+ * sets them by itself on the first MakeCurrent.
+ */
+void
+_mesa_glthread_update_viewport_scissor(struct gl_context *ctx)
+{
+   struct glthread_state *glthread = &ctx->GLThread;
+
+   if (!glthread->enabled)
+      return;
+
+   glthread->Viewport[0] = lroundf(ctx->ViewportArray[0].X);
+   glthread->Viewport[1] = lroundf(ctx->ViewportArray[0].Y);
+   glthread->Viewport[2] = lroundf(ctx->ViewportArray[0].Width);
+   glthread->Viewport[3] = lroundf(ctx->ViewportArray[0].Height);
+   glthread->ViewportKnown = true;
+
+   glthread->Scissor[0] = ctx->Scissor.ScissorArray[0].X;
+   glthread->Scissor[1] = ctx->Scissor.ScissorArray[0].Y;
+   glthread->Scissor[2] = ctx->Scissor.ScissorArray[0].Width;
+   glthread->Scissor[3] = ctx->Scissor.ScissorArray[0].Height;
+   glthread->ScissorKnown = true;
+}
+
 static void
 _mesa_glthread_init_dispatch(struct gl_context *ctx,
                              struct _glapi_table *table)
@@ -140,9 +182,11 @@ _mesa_glthread_init(struct gl_context *ctx)
    }
    glthread->next_batch = &glthread->batches[glthread->next];
    glthread->used = 0;
+   glthread->batch_limit = MARSHAL_MAX_CMD_SIZE / 8;
 
    glthread->enabled = true;
    glthread->stats.queue = &glthread->queue;
+   glthread->stats.batch_size_limit = glthread->batch_limit;
 
    glthread->SupportsBufferUploads =
       ctx->Const.BufferCreateMapUnsynchronizedThreadSafe &&
@@ -152,6 +196,19 @@ _mesa_glthread_init(struct gl_context *ctx)
 
    glthread->LastDListChangeBatchIndex = -1;
 
+   /* Start the glGet state mirror from the current state. */
+   glthread->PolygonOffsetFill = ctx->Polygon.OffsetFill;
+   glthread->ScissorTest = ctx->Scissor.EnableFlags & 1;
+   glthread->StencilTest = ctx->Stencil.Enabled;
+   copy_pixelstore(&glthread->Pack, &ctx->Pack);
+   copy_pixelstore(&glthread->Unpack, &ctx->Unpack);
+   _mesa_glthread_update_viewport_scissor(ctx);
+
+   if (env_var_as_boolean("MESA_GLTHREAD_SYNC_STATS", false)) {
+      glthread->SyncCounts = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                                     _mesa_key_string_equal);
+   }
+
    /* Execute the thread initialization function in the thread. */
    struct util_queue_fence fence;
    util_queue_fence_init(&fence);
@@ -167,6 +224,40 @@ free_vao(void *data, UNUSED void *userData)
    free(data);
 }
 
+static int
+compare_sync_counts(const void *a, const void *b)
+{
+   const struct hash_entry *ea = *(const struct hash_entry **)a;
+   const struct hash_entry *eb = *(const struct hash_entry **)b;
+   uintptr_t ca = (uintptr_t)ea->data;
+   uintptr_t cb = (uintptr_t)eb->data;
+
+   return ca < cb ? 1 : ca > cb ? -1 : strcmp(ea->key, eb->key);
+}
+
+static void
+print_sync_counts(struct hash_table *counts)
+{
+   struct hash_entry **entries =
+      malloc(counts->entries * sizeof(struct hash_entry *));
+   unsigned num = 0;
+
+   if (!entries)
+      return;
+
+   hash_table_foreach(counts, entry)
+      entries[num++] = entry;
+
+   qsort(entries, num, sizeof(entries[0]), compare_sync_counts);
+
+   fprintf(stderr, "glthread syncs per function:\n");
+   for (unsigned i = 0; i < num; i++) {
+      fprintf(stderr, "  %10" PRIuPTR " %s\n",
+              (uintptr_t)entries[i]->data, (const char *)entries[i]->key);
+   }
+   free(entries);
+}
+
 void
 _mesa_glthread_destroy(struct gl_context *ctx, const char *reason)
 {
@@ -187,6 +278,12 @@ _mesa_glthread_destroy(struct gl_context *ctx, const char *reason)
    _mesa_HashDeleteAll(glthread->VAOs, free_vao, NULL);
    _mesa_DeleteHashTable(glthread->VAOs);
 
+   if (glthread->SyncCounts) {
+      print_sync_counts(glthread->SyncCounts);
+      _mesa_hash_table_destroy(glthread->SyncCounts, NULL);
+      glthread->SyncCounts = NULL;
+   }
+
    ctx->GLThread.enabled = false;
    ctx->CurrentClientDispatch = ctx->CurrentServerDispatch;
 
@@ -252,8 +349,43 @@ _mesa_glthread_flush_batch(struct gl_context *ctx)
    p_atomic_add(&glthread->stats.num_offloaded_items, glthread->used);
    next->used = glthread->used;
 
-   util_queue_add_job(&glthread->queue, next, &next->fence,
-                      glthread_unmarshal_batch, NULL, 0);
+   /* The worker is idle if it has executed the last batch. The queue is full
+    * if the worker hasn't executed the batch that we are going to fill next,
+    * in which case util_queue_add_job waits.
+    */
+   bool idle =
+      util_queue_fence_is_signalled(&glthread->batches[glthread->last].fence);
+   bool stalled =
+      !util_queue_fence_is_signalled(&glthread->batches[(glthread->next + 1) %
+                                                        MARSHAL_MAX_BATCHES].fence);
+
+   if (unlikely(stalled)) {
+      int64_t start = os_time_get_nano();
+
+      MESA_TRACE_BEGIN("glthread stall");
+      util_queue_add_job(&glthread->queue, next, &next->fence,
+                         glthread_unmarshal_batch, NULL, 0);
+      MESA_TRACE_END();
+
+      p_atomic_add(&glthread->stats.stall_time_ns, os_time_get_nano() - start);
+   } else {
+      util_queue_add_job(&glthread->queue, next, &next->fence,
+                         glthread_unmarshal_batch, NULL, 0);
+   }
+
+   /* Flush smaller batches while the worker waits for work, so that it gets
+    * new calls sooner, and bigger batches while we wait for the worker, so
+    * that the queue overhead is lower.
+    */
+   if (idle) {
+      glthread->batch_limit = MAX2(glthread->batch_limit / 2,
+                                   MARSHAL_MIN_BATCH_SIZE / 8);
+   } else if (stalled) {
+      glthread->batch_limit = MIN2(glthread->batch_limit * 2,
+                                   MARSHAL_MAX_CMD_SIZE / 8);
+   }
+   glthread->stats.batch_size_limit = glthread->batch_limit;
+
    glthread->last = glthread->next;
    glthread->next = (glthread->next + 1) % MARSHAL_MAX_BATCHES;
    glthread->next_batch = &glthread->batches[glthread->next];
@@ -321,10 +453,21 @@ _mesa_glthread_finish(struct gl_context *ctx)
 void
 _mesa_glthread_finish_before(struct gl_context *ctx, const char *func)
 {
+   MESA_TRACE_SCOPE(func);
    _mesa_glthread_finish(ctx);
 
-   /* Uncomment this if you want to know where glthread syncs. */
-   /*printf("fallback to sync: %s\n", func);*/
+   /* Set MESA_GLTHREAD_SYNC_STATS=1 to know where glthread syncs. */
+   struct hash_table *counts = ctx->GLThread.SyncCounts;
+   if (counts) {
+      uint32_t hash = _mesa_hash_string(func);
+      struct hash_entry *entry =
+         _mesa_hash_table_search_pre_hashed(counts, hash, func);
+
+      if (entry)
+         entry->data = (void *)((uintptr_t)entry->data + 1);
+      else
+         _mesa_hash_table_insert_pre_hashed(counts, hash, func, (void *)1);
+   }
 }
 
 void
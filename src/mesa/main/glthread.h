@@ -35,6 +35,15 @@
  */
 #define MARSHAL_MAX_CMD_SIZE (8 * 1024)
 
+/* The smallest size at which batches are flushed, in bytes.
+ *
+ * The flush size adapts between this and MARSHAL_MAX_CMD_SIZE. It shrinks
+ * when the glthread worker runs out of work, so that it gets new calls
+ * sooner, and grows when the application thread stalls on a full queue,
+ * so that fewer batches are queued.
+ */
+#define MARSHAL_MIN_BATCH_SIZE (MARSHAL_MAX_CMD_SIZE / 8)
+
 /* The number of batch slots in memory.
  *
  * One batch is being executed, one batch is being filled, the rest are
@@ -62,6 +71,7 @@ struct gl_context;
 struct gl_buffer_object;
 struct _mesa_HashTable;
 struct _glapi_table;
+struct hash_table;
 
 struct glthread_attrib_binding {
    struct gl_buffer_object *buffer; /**< where non-VBO data was uploaded */
@@ -114,6 +124,16 @@ struct glthread_batch
    uint64_t buffer[MARSHAL_MAX_CMD_SIZE / 8];
 };
 
+/* Pixel store state shadowed for glGet. */
+struct glthread_pixelstore {
+   GLint Alignment;
+   GLint RowLength;
+   GLint SkipPixels;
+   GLint SkipRows;
+   GLint ImageHeight;
+   GLint SkipImages;
+};
+
 struct glthread_client_attrib {
    struct glthread_vao VAO;
    GLuint CurrentArrayBufferName;
@@ -124,6 +144,11 @@ struct glthread_client_attrib {
 
    /** Whether this element of the client attrib stack contains saved state. */
    bool Valid;
+
+   /** GL_CLIENT_PIXEL_STORE_BIT */
+   struct glthread_pixelstore Pack;
+   struct glthread_pixelstore Unpack;
+   bool PixelStoreValid;
 };
 
 /* For glPushAttrib / glPopAttrib. */
@@ -136,6 +161,13 @@ struct glthread_attrib_node {
    bool DepthTest;
    bool Lighting;
    bool PolygonStipple;
+   bool PolygonOffsetFill;
+   bool ScissorTest;
+   bool StencilTest;
+   bool ViewportKnown;
+   bool ScissorKnown;
+   GLint Viewport[4];
+   GLint Scissor[4];
 };
 
 typedef enum {
@@ -184,6 +216,9 @@ struct glthread_state
    /** Number of uint64_t elements filled already. */
    unsigned used;
 
+   /** Number of uint64_t elements after which the batch is flushed. */
+   unsigned batch_limit;
+
    /** Upload buffer. */
    struct gl_buffer_object *upload_buffer;
    uint8_t *upload_ptr;
@@ -242,6 +277,29 @@ struct glthread_state
    bool CullFace;
    bool Lighting;
    bool PolygonStipple;
+   bool PolygonOffsetFill;
+   bool ScissorTest; /**< of viewport 0 */
+   bool StencilTest;
+
+   /**
+    * Viewport and scissor box of index 0, as returned by glGet. They are
+    * unknown after the indexed and array variants, which glthread doesn't
+    * track, until the next glViewport or glScissor.
+    */
+   bool ViewportKnown;
+   bool ScissorKnown;
+   GLint Viewport[4];
+   GLint Scissor[4];
+
+   /** Pixel store state. */
+   struct glthread_pixelstore Pack;
+   struct glthread_pixelstore Unpack;
+
+   /**
+    * The number of syncs per entrypoint name, for MESA_GLTHREAD_SYNC_STATS.
+    * NULL if disabled.
+    */
+   struct hash_table *SyncCounts;
 
    GLuint CurrentDrawFramebuffer;
    GLuint CurrentReadFramebuffer;
@@ -339,6 +397,7 @@ void _mesa_glthread_ClientAttribDefault(struct gl_context *ctx, GLbitfield mask)
 void _mesa_glthread_InterleavedArrays(struct gl_context *ctx, GLenum format,
                                       GLsizei stride, const GLvoid *pointer);
 void _mesa_glthread_ProgramChanged(struct gl_context *ctx);
+void _mesa_glthread_update_viewport_scissor(struct gl_context *ctx);
 
 #ifdef __cplusplus
 }
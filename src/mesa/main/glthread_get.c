@@ -32,14 +32,81 @@ _mesa_unmarshal_GetIntegerv(struct gl_context *ctx,
    return 0;
 }
 
-void GLAPIENTRY
-_mesa_marshal_GetIntegerv(GLenum pname, GLint *p)
+uint32_t
+_mesa_unmarshal_GetBooleanv(struct gl_context *ctx,
+                            const struct marshal_cmd_GetBooleanv *cmd)
 {
-   GET_CURRENT_CONTEXT(ctx);
+   unreachable("never executed");
+   return 0;
+}
 
+uint32_t
+_mesa_unmarshal_GetFloatv(struct gl_context *ctx,
+                          const struct marshal_cmd_GetFloatv *cmd)
+{
+   unreachable("never executed");
+   return 0;
+}
+
+static unsigned
+get_pixelstore(struct gl_context *ctx, const struct glthread_pixelstore *ps,
+               GLenum pname, GLint *p)
+{
+   /* The alignment is the only pixel store state of GLES 1 and 2. */
+   if (pname != GL_PACK_ALIGNMENT && pname != GL_UNPACK_ALIGNMENT &&
+       !_mesa_is_desktop_gl(ctx) && !_mesa_is_gles3(ctx))
+      return 0;
+
+   /* GLES doesn't have all the pack state, so let get.c decide whether
+    * these are valid there.
+    */
+   if ((pname == GL_PACK_SKIP_IMAGES || pname == GL_PACK_IMAGE_HEIGHT) &&
+       !_mesa_is_desktop_gl(ctx))
+      return 0;
+
+   switch (pname) {
+   case GL_PACK_ALIGNMENT:
+   case GL_UNPACK_ALIGNMENT:
+      *p = ps->Alignment;
+      return 1;
+   case GL_PACK_ROW_LENGTH:
+   case GL_UNPACK_ROW_LENGTH:
+      *p = ps->RowLength;
+      return 1;
+   case GL_PACK_SKIP_PIXELS:
+   case GL_UNPACK_SKIP_PIXELS:
+      *p = ps->SkipPixels;
+      return 1;
+   case GL_PACK_SKIP_ROWS:
+   case GL_UNPACK_SKIP_ROWS:
+      *p = ps->SkipRows;
+      return 1;
+   case GL_PACK_IMAGE_HEIGHT:
+   case GL_UNPACK_IMAGE_HEIGHT:
+      *p = ps->ImageHeight;
+      return 1;
+   case GL_PACK_SKIP_IMAGES:
+   case GL_UNPACK_SKIP_IMAGES:
+      *p = ps->SkipImages;
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Return the state glthread tracks without syncing.
+ *
+ * All values are integers, which is what get.c returns them as too, except
+ * for GL_VIEWPORT, whose floats are always integral here.
+ *
+ * \return the number of values written to p, or 0 if glthread must sync
+ */
+static unsigned
+get_integerv(struct gl_context *ctx, GLenum pname, GLint *p)
+{
    /* This will generate GL_INVALID_OPERATION, as it should. */
    if (ctx->GLThread.inside_begin_end)
-      goto sync;
+      return 0;
 
    /* TODO: Use get_hash_params.py to return values for items containing:
     * - CONST(
@@ -49,90 +116,180 @@ _mesa_marshal_GetIntegerv(GLenum pname, GLint *p)
    switch (pname) {
    case GL_ACTIVE_TEXTURE:
       *p = GL_TEXTURE0 + ctx->GLThread.ActiveTexture;
-      return;
+      return 1;
    case GL_ARRAY_BUFFER_BINDING:
       *p = ctx->GLThread.CurrentArrayBufferName;
-      return;
+      return 1;
    case GL_ATTRIB_STACK_DEPTH:
       *p = ctx->GLThread.AttribStackDepth;
-      return;
+      return 1;
    case GL_CLIENT_ACTIVE_TEXTURE:
       *p = GL_TEXTURE0 + ctx->GLThread.ClientActiveTexture;
-      return;
+      return 1;
    case GL_CLIENT_ATTRIB_STACK_DEPTH:
       *p = ctx->GLThread.ClientAttribStackTop;
-      return;
+      return 1;
    case GL_CURRENT_PROGRAM:
       *p = ctx->GLThread.CurrentProgram;
-      return;
+      return 1;
    case GL_DRAW_INDIRECT_BUFFER_BINDING:
       *p = ctx->GLThread.CurrentDrawIndirectBufferName;
-      return;
+      return 1;
    case GL_DRAW_FRAMEBUFFER_BINDING:
       *p = ctx->GLThread.CurrentDrawFramebuffer;
-      return;
+      return 1;
    case GL_READ_FRAMEBUFFER_BINDING:
       *p = ctx->GLThread.CurrentReadFramebuffer;
-      return;
+      return 1;
    case GL_PIXEL_PACK_BUFFER_BINDING:
       *p = ctx->GLThread.CurrentPixelPackBufferName;
-      return;
+      return 1;
    case GL_PIXEL_UNPACK_BUFFER_BINDING:
       *p = ctx->GLThread.CurrentPixelUnpackBufferName;
-      return;
+      return 1;
    case GL_QUERY_BUFFER_BINDING:
       *p = ctx->GLThread.CurrentQueryBufferName;
-      return;
+      return 1;
+
+   /* Vertex array objects are only tracked in compatibility contexts. */
+   case GL_ELEMENT_ARRAY_BUFFER_BINDING:
+      if (ctx->API == API_OPENGL_CORE)
+         return 0;
+      *p = ctx->GLThread.CurrentVAO->CurrentElementBufferName;
+      return 1;
+   case GL_VERTEX_ARRAY_BINDING:
+      if (ctx->API == API_OPENGL_CORE || ctx->API == API_OPENGLES ||
+          (ctx->API == API_OPENGLES2 && !_mesa_is_gles3(ctx) &&
+           !_mesa_has_OES_vertex_array_object(ctx)))
+         return 0;
+      *p = ctx->GLThread.CurrentVAO->Name;
+      return 1;
+
+   case GL_VIEWPORT:
+      if (!ctx->GLThread.ViewportKnown)
+         return 0;
+      memcpy(p, ctx->GLThread.Viewport, sizeof(ctx->GLThread.Viewport));
+      return 4;
+   case GL_SCISSOR_BOX:
+      if (!ctx->GLThread.ScissorKnown)
+         return 0;
+      memcpy(p, ctx->GLThread.Scissor, sizeof(ctx->GLThread.Scissor));
+      return 4;
+
+   case GL_PACK_ALIGNMENT:
+   case GL_PACK_ROW_LENGTH:
+   case GL_PACK_SKIP_PIXELS:
+   case GL_PACK_SKIP_ROWS:
+   case GL_PACK_IMAGE_HEIGHT:
+   case GL_PACK_SKIP_IMAGES:
+      return get_pixelstore(ctx, &ctx->GLThread.Pack, pname, p);
+   case GL_UNPACK_ALIGNMENT:
+   case GL_UNPACK_ROW_LENGTH:
+   case GL_UNPACK_SKIP_PIXELS:
+   case GL_UNPACK_SKIP_ROWS:
+   case GL_UNPACK_IMAGE_HEIGHT:
+   case GL_UNPACK_SKIP_IMAGES:
+      return get_pixelstore(ctx, &ctx->GLThread.Unpack, pname, p);
 
    case GL_MATRIX_MODE:
       *p = ctx->GLThread.MatrixMode;
-      return;
+      return 1;
    case GL_CURRENT_MATRIX_STACK_DEPTH_ARB:
       *p = ctx->GLThread.MatrixStackDepth[ctx->GLThread.MatrixIndex] + 1;
-      return;
+      return 1;
    case GL_MODELVIEW_STACK_DEPTH:
       *p = ctx->GLThread.MatrixStackDepth[M_MODELVIEW] + 1;
-      return;
+      return 1;
    case GL_PROJECTION_STACK_DEPTH:
       *p = ctx->GLThread.MatrixStackDepth[M_PROJECTION] + 1;
-      return;
+      return 1;
    case GL_TEXTURE_STACK_DEPTH:
       *p = ctx->GLThread.MatrixStackDepth[M_TEXTURE0 + ctx->GLThread.ActiveTexture] + 1;
-      return;
+      return 1;
 
    case GL_VERTEX_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_POS)) != 0;
-      return;
+      return 1;
    case GL_NORMAL_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_NORMAL)) != 0;
-      return;
+      return 1;
    case GL_COLOR_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_COLOR0)) != 0;
-      return;
+      return 1;
    case GL_SECONDARY_COLOR_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_COLOR1)) != 0;
-      return;
+      return 1;
    case GL_FOG_COORD_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_FOG)) != 0;
-      return;
+      return 1;
    case GL_INDEX_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_COLOR_INDEX)) != 0;
-      return;
+      return 1;
    case GL_EDGE_FLAG_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_EDGEFLAG)) != 0;
-      return;
+      return 1;
    case GL_TEXTURE_COORD_ARRAY:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled &
             (1 << (VERT_ATTRIB_TEX0 + ctx->GLThread.ClientActiveTexture))) != 0;
-      return;
+      return 1;
    case GL_POINT_SIZE_ARRAY_OES:
       *p = (ctx->GLThread.CurrentVAO->UserEnabled & (1 << VERT_ATTRIB_POINT_SIZE)) != 0;
-      return;
+      return 1;
+
+   default: {
+      /* Enable states. */
+      int enabled = _mesa_glthread_IsEnabled(ctx, pname);
+      if (enabled >= 0) {
+         *p = enabled;
+         return 1;
+      }
+      return 0;
+   }
    }
+}
+
+void GLAPIENTRY
+_mesa_marshal_GetIntegerv(GLenum pname, GLint *p)
+{
+   GET_CURRENT_CONTEXT(ctx);
+
+   if (get_integerv(ctx, pname, p))
+      return;
 
-sync:
    _mesa_glthread_finish_before(ctx, "GetIntegerv");
    CALL_GetIntegerv(ctx->CurrentServerDispatch, (pname, p));
 }
 
-/* TODO: Implement glGetBooleanv, glGetFloatv, etc. if needed */
+void GLAPIENTRY
+_mesa_marshal_GetBooleanv(GLenum pname, GLboolean *p)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   GLint v[4];
+   unsigned count = get_integerv(ctx, pname, v);
+
+   if (count) {
+      for (unsigned i = 0; i < count; i++)
+         p[i] = v[i] ? GL_TRUE : GL_FALSE;
+      return;
+   }
+
+   _mesa_glthread_finish_before(ctx, "GetBooleanv");
+   CALL_GetBooleanv(ctx->CurrentServerDispatch, (pname, p));
+}
+
+void GLAPIENTRY
+_mesa_marshal_GetFloatv(GLenum pname, GLfloat *p)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   GLint v[4];
+   unsigned count = get_integerv(ctx, pname, v);
+
+   if (count) {
+      for (unsigned i = 0; i < count; i++)
+         p[i] = v[i];
+      return;
+   }
+
+   _mesa_glthread_finish_before(ctx, "GetFloatv");
+   CALL_GetFloatv(ctx->CurrentServerDispatch, (pname, p));
+}
@@ -61,7 +61,7 @@ _mesa_glthread_allocate_command(struct gl_context *ctx,
 
    assert (num_elements <= MARSHAL_MAX_CMD_SIZE / 8);
 
-   if (unlikely(glthread->used + num_elements > MARSHAL_MAX_CMD_SIZE / 8))
+   if (unlikely(glthread->used + num_elements > glthread->batch_limit))
       _mesa_glthread_flush_batch(ctx);
 
    struct glthread_batch *next = glthread->next_batch;
@@ -488,6 +488,15 @@ _mesa_glthread_Enable(struct gl_context *ctx, GLenum cap)
    case GL_POLYGON_STIPPLE:
       ctx->GLThread.PolygonStipple = true;
       break;
+   case GL_POLYGON_OFFSET_FILL:
+      ctx->GLThread.PolygonOffsetFill = true;
+      break;
+   case GL_SCISSOR_TEST:
+      ctx->GLThread.ScissorTest = true;
+      break;
+   case GL_STENCIL_TEST:
+      ctx->GLThread.StencilTest = true;
+      break;
    }
 }
 
@@ -517,6 +526,33 @@ _mesa_glthread_Disable(struct gl_context *ctx, GLenum cap)
    case GL_POLYGON_STIPPLE:
       ctx->GLThread.PolygonStipple = false;
       break;
+   case GL_POLYGON_OFFSET_FILL:
+      ctx->GLThread.PolygonOffsetFill = false;
+      break;
+   case GL_SCISSOR_TEST:
+      ctx->GLThread.ScissorTest = false;
+      break;
+   case GL_STENCIL_TEST:
+      ctx->GLThread.StencilTest = false;
+      break;
+   }
+}
+
+/* Only index 0 is tracked, which is what glIsEnabled and glGet return. */
+static inline void
+_mesa_glthread_Enablei(struct gl_context *ctx, GLenum cap, GLuint index,
+                       bool value)
+{
+   if (ctx->GLThread.ListMode == GL_COMPILE || index != 0)
+      return;
+
+   switch (cap) {
+   case GL_BLEND:
+      ctx->GLThread.Blend = value;
+      break;
+   case GL_SCISSOR_TEST:
+      ctx->GLThread.ScissorTest = value;
+      break;
    }
 }
 
@@ -535,9 +571,20 @@ _mesa_glthread_IsEnabled(struct gl_context *ctx, GLenum cap)
    case GL_DEPTH_TEST:
       return ctx->GLThread.DepthTest;
    case GL_LIGHTING:
+      /* Core profiles generate GL_INVALID_ENUM for these. */
+      if (ctx->API != API_OPENGL_COMPAT)
+         return -1;
       return ctx->GLThread.Lighting;
    case GL_POLYGON_STIPPLE:
+      if (ctx->API != API_OPENGL_COMPAT)
+         return -1;
       return ctx->GLThread.PolygonStipple;
+   case GL_POLYGON_OFFSET_FILL:
+      return ctx->GLThread.PolygonOffsetFill;
+   case GL_SCISSOR_TEST:
+      return ctx->GLThread.ScissorTest;
+   case GL_STENCIL_TEST:
+      return ctx->GLThread.StencilTest;
    case GL_VERTEX_ARRAY:
       return !!(ctx->GLThread.CurrentVAO->UserEnabled & VERT_BIT_POS);
    case GL_NORMAL_ARRAY:
@@ -572,11 +619,28 @@ _mesa_glthread_PushAttrib(struct gl_context *ctx, GLbitfield mask)
    if (mask & (GL_POLYGON_BIT | GL_ENABLE_BIT)) {
       attr->CullFace = ctx->GLThread.CullFace;
       attr->PolygonStipple = ctx->GLThread.PolygonStipple;
+      attr->PolygonOffsetFill = ctx->GLThread.PolygonOffsetFill;
    }
 
    if (mask & (GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT))
       attr->DepthTest = ctx->GLThread.DepthTest;
 
+   if (mask & (GL_SCISSOR_BIT | GL_ENABLE_BIT))
+      attr->ScissorTest = ctx->GLThread.ScissorTest;
+
+   if (mask & (GL_STENCIL_BUFFER_BIT | GL_ENABLE_BIT))
+      attr->StencilTest = ctx->GLThread.StencilTest;
+
+   if (mask & GL_SCISSOR_BIT) {
+      attr->ScissorKnown = ctx->GLThread.ScissorKnown;
+      memcpy(attr->Scissor, ctx->GLThread.Scissor, sizeof(attr->Scissor));
+   }
+
+   if (mask & GL_VIEWPORT_BIT) {
+      attr->ViewportKnown = ctx->GLThread.ViewportKnown;
+      memcpy(attr->Viewport, ctx->GLThread.Viewport, sizeof(attr->Viewport));
+   }
+
    if (mask & (GL_LIGHTING_BIT | GL_ENABLE_BIT))
       attr->Lighting = ctx->GLThread.Lighting;
 
@@ -606,11 +670,28 @@ _mesa_glthread_PopAttrib(struct gl_context *ctx)
    if (mask & (GL_POLYGON_BIT | GL_ENABLE_BIT)) {
       ctx->GLThread.CullFace = attr->CullFace;
       ctx->GLThread.PolygonStipple = attr->PolygonStipple;
+      ctx->GLThread.PolygonOffsetFill = attr->PolygonOffsetFill;
    }
 
    if (mask & (GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT))
       ctx->GLThread.DepthTest = attr->DepthTest;
 
+   if (mask & (GL_SCISSOR_BIT | GL_ENABLE_BIT))
+      ctx->GLThread.ScissorTest = attr->ScissorTest;
+
+   if (mask & (GL_STENCIL_BUFFER_BIT | GL_ENABLE_BIT))
+      ctx->GLThread.StencilTest = attr->StencilTest;
+
+   if (mask & GL_SCISSOR_BIT) {
+      ctx->GLThread.ScissorKnown = attr->ScissorKnown;
+      memcpy(ctx->GLThread.Scissor, attr->Scissor, sizeof(attr->Scissor));
+   }
+
+   if (mask & GL_VIEWPORT_BIT) {
+      ctx->GLThread.ViewportKnown = attr->ViewportKnown;
+      memcpy(ctx->GLThread.Viewport, attr->Viewport, sizeof(attr->Viewport));
+   }
+
    if (mask & (GL_LIGHTING_BIT | GL_ENABLE_BIT))
       ctx->GLThread.Lighting = attr->Lighting;
 
@@ -713,6 +794,123 @@ _mesa_glthread_MatrixMode(struct gl_context *ctx, GLenum mode)
    ctx->GLThread.MatrixMode = MIN2(mode, 0xffff);
 }
 
+static inline void
+_mesa_glthread_Viewport(struct gl_context *ctx, GLint x, GLint y,
+                        GLsizei width, GLsizei height)
+{
+   if (ctx->GLThread.ListMode == GL_COMPILE)
+      return;
+
+   /* This will generate GL_INVALID_VALUE. */
+   if (width < 0 || height < 0)
+      return;
+
+   /* Clamp the same way as _mesa_set_viewport. */
+   if (_mesa_has_ARB_viewport_array(ctx) ||
+       _mesa_has_OES_viewport_array(ctx)) {
+      x = CLAMP(x, (GLint)ctx->Const.ViewportBounds.Min,
+                (GLint)ctx->Const.ViewportBounds.Max);
+      y = CLAMP(y, (GLint)ctx->Const.ViewportBounds.Min,
+                (GLint)ctx->Const.ViewportBounds.Max);
+   }
+
+   ctx->GLThread.Viewport[0] = x;
+   ctx->GLThread.Viewport[1] = y;
+   ctx->GLThread.Viewport[2] = MIN2(width, (GLint)ctx->Const.MaxViewportWidth);
+   ctx->GLThread.Viewport[3] = MIN2(height, (GLint)ctx->Const.MaxViewportHeight);
+   ctx->GLThread.ViewportKnown = true;
+}
+
+static inline void
+_mesa_glthread_Scissor(struct gl_context *ctx, GLint x, GLint y,
+                       GLsizei width, GLsizei height)
+{
+   if (ctx->GLThread.ListMode == GL_COMPILE)
+      return;
+
+   /* This will generate GL_INVALID_VALUE. */
+   if (width < 0 || height < 0)
+      return;
+
+   ctx->GLThread.Scissor[0] = x;
+   ctx->GLThread.Scissor[1] = y;
+   ctx->GLThread.Scissor[2] = width;
+   ctx->GLThread.Scissor[3] = height;
+   ctx->GLThread.ScissorKnown = true;
+}
+
+/* glViewportIndexed*, glViewportArrayv and the scissor equivalents. */
+static inline void
+_mesa_glthread_ViewportIndexed(struct gl_context *ctx, GLuint first)
+{
+   if (ctx->GLThread.ListMode == GL_COMPILE || first != 0)
+      return;
+
+   ctx->GLThread.ViewportKnown = false;
+}
+
+static inline void
+_mesa_glthread_ScissorIndexed(struct gl_context *ctx, GLuint first)
+{
+   if (ctx->GLThread.ListMode == GL_COMPILE || first != 0)
+      return;
+
+   ctx->GLThread.ScissorKnown = false;
+}
+
+/* This is never compiled into display lists. */
+static inline void
+_mesa_glthread_PixelStorei(struct gl_context *ctx, GLenum pname, GLint param)
+{
+   /* Negative values and invalid alignments will generate GL_INVALID_VALUE.
+    * Invalid pnames for the API are not answered from glthread either.
+    */
+   if (param < 0)
+      return;
+
+   switch (pname) {
+   case GL_PACK_ALIGNMENT:
+   case GL_UNPACK_ALIGNMENT:
+      if (param != 1 && param != 2 && param != 4 && param != 8)
+         return;
+      if (pname == GL_PACK_ALIGNMENT)
+         ctx->GLThread.Pack.Alignment = param;
+      else
+         ctx->GLThread.Unpack.Alignment = param;
+      break;
+   case GL_PACK_ROW_LENGTH:
+      ctx->GLThread.Pack.RowLength = param;
+      break;
+   case GL_PACK_SKIP_PIXELS:
+      ctx->GLThread.Pack.SkipPixels = param;
+      break;
+   case GL_PACK_SKIP_ROWS:
+      ctx->GLThread.Pack.SkipRows = param;
+      break;
+   case GL_PACK_IMAGE_HEIGHT:
+      ctx->GLThread.Pack.ImageHeight = param;
+      break;
+   case GL_PACK_SKIP_IMAGES:
+      ctx->GLThread.Pack.SkipImages = param;
+      break;
+   case GL_UNPACK_ROW_LENGTH:
+      ctx->GLThread.Unpack.RowLength = param;
+      break;
+   case GL_UNPACK_SKIP_PIXELS:
+      ctx->GLThread.Unpack.SkipPixels = param;
+      break;
+   case GL_UNPACK_SKIP_ROWS:
+      ctx->GLThread.Unpack.SkipRows = param;
+      break;
+   case GL_UNPACK_IMAGE_HEIGHT:
+      ctx->GLThread.Unpack.ImageHeight = param;
+      break;
+   case GL_UNPACK_SKIP_IMAGES:
+      ctx->GLThread.Unpack.SkipImages = param;
+      break;
+   }
+}
+
 static inline void
 _mesa_glthread_ListBase(struct gl_context *ctx, GLuint base)
 {
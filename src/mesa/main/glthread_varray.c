@@ -594,6 +594,14 @@ _mesa_glthread_PushClientAttrib(struct gl_context *ctx, GLbitfield mask,
       top->Valid = false;
    }
 
+   if (mask & GL_CLIENT_PIXEL_STORE_BIT) {
+      top->Pack = glthread->Pack;
+      top->Unpack = glthread->Unpack;
+      top->PixelStoreValid = true;
+   } else {
+      top->PixelStoreValid = false;
+   }
+
    glthread->ClientAttribStackTop++;
 
    if (set_default)
@@ -613,6 +621,11 @@ _mesa_glthread_PopClientAttrib(struct gl_context *ctx)
    struct glthread_client_attrib *top =
       &glthread->ClientAttribStack[glthread->ClientAttribStackTop];
 
+   if (top->PixelStoreValid) {
+      glthread->Pack = top->Pack;
+      glthread->Unpack = top->Unpack;
+   }
+
    if (!top->Valid)
       return;
 
@@ -644,6 +657,13 @@ _mesa_glthread_ClientAttribDefault(struct gl_context *ctx, GLbitfield mask)
 {
    struct glthread_state *glthread = &ctx->GLThread;
 
+   if (mask & GL_CLIENT_PIXEL_STORE_BIT) {
+      static const struct glthread_pixelstore defaults = { .Alignment = 4 };
+
+      glthread->Pack = defaults;
+      glthread->Unpack = defaults;
+   }
+
    if (!(mask & GL_CLIENT_VERTEX_ARRAY_BIT))
       return;
 
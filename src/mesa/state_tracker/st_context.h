@@ -36,6 +36,7 @@
 #include "util/u_helpers.h"
 #include "util/u_inlines.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "vbo/vbo.h"
 #include "util/list.h"
 #include "cso_cache/cso_context.h"
@@ -181,6 +182,13 @@ struct st_context
     */
    boolean allow_st_finalize_nir_twice;
 
+   /**
+    * Threads running the per-stage NIR lowering of glLinkProgram once the
+    * stages have been linked together.  Created on the first link of a
+    * program with more than one stage.
+    */
+   struct util_queue link_queue;
+
    /**
     * If a shader can be created when we get its source.
     * This means it has only 1 variant, not counting glBitmap and
@@ -53,6 +53,9 @@
 #include "compiler/glsl/linker_util.h"
 #include "compiler/glsl/string_to_uint_map.h"
 
+#include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
+
 static int
 type_size(const struct glsl_type *type)
 {
@@ -463,15 +466,15 @@ filter_64_bit_instr(const nir_instr *const_instr, UNUSED const void *data)
    return lower;
 }
 
-/* Second third of converting glsl_to_nir. This creates uniforms, gathers
- * info on varyings, etc after NIR link time opts have been applied.
+/* Second third of converting glsl_to_nir, part one.  This creates the
+ * uniforms and associates them with the uniform storage, which is shared by
+ * all stages of the program, so it's not thread-safe.
  */
-static char *
-st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
-                         struct gl_shader_program *shader_program)
+static void
+st_glsl_to_nir_add_uniforms(struct st_context *st, struct gl_program *prog,
+                            struct gl_shader_program *shader_program)
 {
    nir_shader *nir = prog->nir;
-   struct pipe_screen *screen = st->screen;
 
    /* Make a pass over the IR to add state references for any built-in
     * uniforms that are used.  This has to be done now (during linking).
@@ -509,6 +512,18 @@ st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
     * This should be enough for Bitmap and DrawPixels constants.
     */
    _mesa_ensure_and_associate_uniform_storage(st->ctx, shader_program, prog, 28);
+}
+
+/* Second third of converting glsl_to_nir, part two.  This gathers info on
+ * varyings, etc after NIR link time opts have been applied.  It only touches
+ * the given stage, so the stages of a program can go through it in parallel.
+ */
+static char *
+st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
+                         struct gl_shader_program *shader_program)
+{
+   nir_shader *nir = prog->nir;
+   struct pipe_screen *screen = st->screen;
 
    /* None of the builtins being lowered here can be produced by SPIR-V.  See
     * _mesa_builtin_uniform_desc. Also drivers that support packed uniform
@@ -576,18 +591,42 @@ st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
    if (st->allow_st_finalize_nir_twice)
       msg = st_finalize_nir(st, prog, shader_program, nir, true, true);
 
-   if (st->ctx->_Shader->Flags & GLSL_DUMP) {
-      _mesa_log("\n");
-      _mesa_log("NIR IR for linked %s program %d:\n",
-             _mesa_shader_stage_to_string(prog->info.stage),
-             shader_program->Name);
-      nir_print_shader(nir, _mesa_get_log_file());
-      _mesa_log("\n\n");
-   }
-
    return msg;
 }
 
+struct st_link_job {
+   struct st_context *st;
+   struct gl_program *prog;
+   struct gl_shader_program *shader_program;
+   char *msg;
+   struct util_queue_fence fence;
+};
+
+static void
+st_link_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct st_link_job *job = (struct st_link_job *)data;
+
+   job->msg = st_glsl_to_nir_post_opts(job->st, job->prog,
+                                       job->shader_program);
+}
+
+static bool
+st_init_link_queue(struct st_context *st)
+{
+   if (util_queue_is_initialized(&st->link_queue))
+      return true;
+
+   /* At most one thread per graphics stage. */
+   unsigned num_threads = MIN2(util_get_cpu_caps()->nr_cpus,
+                               MESA_SHADER_FRAGMENT + 1);
+   if (num_threads < 2)
+      return false;
+
+   return util_queue_init(&st->link_queue, "gllink", MESA_SHADER_STAGES,
+                          num_threads, 0, NULL);
+}
+
 static void
 st_nir_vectorize_io(nir_shader *producer, nir_shader *consumer)
 {
@@ -872,18 +911,68 @@ st_link_nir(struct gl_context *ctx,
       }
    }
 
+   for (unsigned i = 0; i < num_shaders; i++) {
+      st_glsl_to_nir_add_uniforms(st, linked_shader[i]->Program,
+                                  shader_program);
+   }
+
+   /* The stages are independent from here on, so lower them in parallel.
+    * Errors and dumps are reported in stage order once all of them are done,
+    * so that the result doesn't depend on the scheduling.
+    */
+   struct st_link_job jobs[MESA_SHADER_STAGES];
+   bool threaded = num_shaders > 1 && st_init_link_queue(st);
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      struct st_link_job *job = &jobs[i];
+
+      job->st = st;
+      job->prog = linked_shader[i]->Program;
+      job->shader_program = shader_program;
+      job->msg = NULL;
+
+      if (threaded) {
+         util_queue_fence_init(&job->fence);
+         util_queue_add_job(&st->link_queue, job, &job->fence,
+                            st_link_job_execute, NULL, 0);
+      } else {
+         st_link_job_execute(job, NULL, 0);
+      }
+   }
+
+   char *msg = NULL;
+   for (unsigned i = 0; i < num_shaders; i++) {
+      struct st_link_job *job = &jobs[i];
+
+      if (threaded) {
+         util_queue_fence_wait(&job->fence);
+         util_queue_fence_destroy(&job->fence);
+      }
+
+      if (ctx->_Shader->Flags & GLSL_DUMP) {
+         _mesa_log("\n");
+         _mesa_log("NIR IR for linked %s program %d:\n",
+                   _mesa_shader_stage_to_string(job->prog->info.stage),
+                   shader_program->Name);
+         nir_print_shader(job->prog->nir, _mesa_get_log_file());
+         _mesa_log("\n\n");
+      }
+
+      if (!msg)
+         msg = job->msg;
+   }
+
+   if (msg) {
+      linker_error(shader_program, msg);
+      return false;
+   }
+
    struct shader_info *prev_info = NULL;
 
    for (unsigned i = 0; i < num_shaders; i++) {
       struct gl_linked_shader *shader = linked_shader[i];
       struct shader_info *info = &shader->Program->nir->info;
 
-      char *msg = st_glsl_to_nir_post_opts(st, shader->Program, shader_program);
-      if (msg) {
-         linker_error(shader_program, msg);
-         return false;
-      }
-
       if (prev_info &&
           ctx->Const.ShaderCompilerOptions[shader->Stage].NirOptions->unify_interfaces) {
          prev_info->outputs_written |= info->inputs_read &
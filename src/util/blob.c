@@ -308,15 +308,22 @@ blob_skip_bytes(struct blob_reader *blob, size_t size)
       blob->current += size;
 }
 
-#define BLOB_READ_TYPE(name, type)         \
-type                                       \
-name(struct blob_reader *blob)             \
-{                                          \
-   type ret = 0;                           \
-   int size = sizeof(ret);                 \
-   blob_reader_align(blob, size);          \
-   blob_copy_bytes(blob, &ret, size);      \
-   return ret;                             \
+/* These are called a lot by nir_deserialize(), so avoid going through
+ * blob_reader_align() and blob_copy_bytes() and let the compiler turn the
+ * memcpy() into a plain load.
+ */
+#define BLOB_READ_TYPE(name, type)                                     \
+type                                                                   \
+name(struct blob_reader *blob)                                         \
+{                                                                      \
+   type ret = 0;                                                       \
+   int size = sizeof(ret);                                             \
+   blob->current = blob->data + align64(blob->current - blob->data, size); \
+   if (ensure_can_read(blob, size)) {                                  \
+      memcpy(&ret, blob->current, size);                               \
+      blob->current += size;                                           \
+   }                                                                   \
+   return ret;                                                         \
 }
 
 BLOB_READ_TYPE(blob_read_uint8, uint8_t)
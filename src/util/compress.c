@@ -36,9 +36,13 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "zdict.h"
 #endif
 
+#include <stdlib.h>
+
 #include "util/compress.h"
+#include "util/simple_mtx.h"
 #include "macros.h"
 
 /* 3 is the recomended level, with 22 as the absolute maximum */
@@ -163,4 +167,163 @@ util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
+struct util_compress_dict {
+#ifdef HAVE_ZSTD
+   ZSTD_CDict *cdict;
+   ZSTD_DDict *ddict;
+   uint32_t id;
+
+   /* One cached context of each kind, contexts are expensive to create and
+    * compression usually happens on a single thread at a time anyway.
+    */
+   simple_mtx_t cctx_mtx;
+   ZSTD_CCtx *cctx;
+   simple_mtx_t dctx_mtx;
+   ZSTD_DCtx *dctx;
+#else
+   int unused;
+#endif
+};
+
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size)
+{
+#ifdef HAVE_ZSTD
+   struct util_compress_dict *dict = calloc(1, sizeof(*dict));
+   if (!dict)
+      return NULL;
+
+   dict->id = ZDICT_getDictID(dict_data, dict_size);
+   if (!dict->id)
+      goto fail;
+
+   dict->cdict = ZSTD_createCDict(dict_data, dict_size, ZSTD_COMPRESSION_LEVEL);
+   dict->ddict = ZSTD_createDDict(dict_data, dict_size);
+   dict->cctx = ZSTD_createCCtx();
+   dict->dctx = ZSTD_createDCtx();
+   if (!dict->cdict || !dict->ddict || !dict->cctx || !dict->dctx)
+      goto fail;
+
+   simple_mtx_init(&dict->cctx_mtx, mtx_plain);
+   simple_mtx_init(&dict->dctx_mtx, mtx_plain);
+
+   return dict;
+
+fail:
+   ZSTD_freeDCtx(dict->dctx);
+   ZSTD_freeCCtx(dict->cctx);
+   ZSTD_freeDDict(dict->ddict);
+   ZSTD_freeCDict(dict->cdict);
+   free(dict);
+   return NULL;
+#else
+   return NULL;
+#endif
+}
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict)
+{
+   if (!dict)
+      return;
+
+#ifdef HAVE_ZSTD
+   simple_mtx_destroy(&dict->dctx_mtx);
+   simple_mtx_destroy(&dict->cctx_mtx);
+   ZSTD_freeDCtx(dict->dctx);
+   ZSTD_freeCCtx(dict->cctx);
+   ZSTD_freeDDict(dict->ddict);
+   ZSTD_freeCDict(dict->cdict);
+#endif
+   free(dict);
+}
+
+uint32_t
+util_compress_dict_id(const struct util_compress_dict *dict)
+{
+#ifdef HAVE_ZSTD
+   return dict ? dict->id : 0;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Trains a dictionary from \p num_samples samples which are stored back to
+ * back in \p samples.  Returns the size of the dictionary written to
+ * \p dict_buffer or 0 on failure.
+ */
+size_t
+util_compress_dict_train(void *dict_buffer, size_t dict_buffer_size,
+                         const void *samples, const size_t *sample_sizes,
+                         unsigned num_samples)
+{
+#ifdef HAVE_ZSTD
+   size_t ret = ZDICT_trainFromBuffer(dict_buffer, dict_buffer_size,
+                                      samples, sample_sizes, num_samples);
+   if (ZDICT_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Compresses data using a dictionary, returns the size of the compressed
+ * data or 0 on failure.
+ */
+size_t
+util_compress_deflate_with_dict(struct util_compress_dict *dict,
+                                const uint8_t *in_data, size_t in_data_size,
+                                uint8_t *out_data, size_t out_buff_size)
+{
+#ifdef HAVE_ZSTD
+   if (!dict)
+      return util_compress_deflate(in_data, in_data_size, out_data, out_buff_size);
+
+   simple_mtx_lock(&dict->cctx_mtx);
+   size_t ret = ZSTD_compress_usingCDict(dict->cctx, out_data, out_buff_size,
+                                         in_data, in_data_size, dict->cdict);
+   simple_mtx_unlock(&dict->cctx_mtx);
+
+   if (ZSTD_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return util_compress_deflate(in_data, in_data_size, out_data, out_buff_size);
+#endif
+}
+
+/**
+ * Decompresses data which may or may not have been compressed with \p dict,
+ * returns true if successful.  Data compressed with some other dictionary
+ * can't be decompressed.
+ */
+bool
+util_compress_inflate_with_dict(struct util_compress_dict *dict,
+                                const uint8_t *in_data, size_t in_data_size,
+                                uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   uint32_t frame_dict_id = ZSTD_getDictID_fromFrame(in_data, in_data_size);
+   if (frame_dict_id == 0)
+      return util_compress_inflate(in_data, in_data_size, out_data, out_data_size);
+
+   if (!dict || frame_dict_id != dict->id)
+      return false;
+
+   simple_mtx_lock(&dict->dctx_mtx);
+   size_t ret = ZSTD_decompress_usingDDict(dict->dctx, out_data, out_data_size,
+                                           in_data, in_data_size, dict->ddict);
+   simple_mtx_unlock(&dict->dctx_mtx);
+
+   return !ZSTD_isError(ret) && ret == out_data_size;
+#else
+   return util_compress_inflate(in_data, in_data_size, out_data, out_data_size);
+#endif
+}
+
 #endif
@@ -25,6 +25,7 @@
 
 #include <stdbool.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 size_t
 util_compress_max_compressed_len(size_t in_data_size);
@@ -37,4 +38,35 @@ size_t
 util_compress_deflate(const uint8_t *in_data, size_t in_data_size,
                       uint8_t *out_data, size_t out_buff_size);
 
+/* Pre-trained compression dictionary.  Only implemented for zstd, with zlib
+ * util_compress_dict_create() always returns NULL.  A NULL dictionary may be
+ * passed to the *_with_dict() functions, they then behave like the plain
+ * variants.
+ */
+struct util_compress_dict;
+
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size);
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict);
+
+uint32_t
+util_compress_dict_id(const struct util_compress_dict *dict);
+
+size_t
+util_compress_dict_train(void *dict_buffer, size_t dict_buffer_size,
+                         const void *samples, const size_t *sample_sizes,
+                         unsigned num_samples);
+
+bool
+util_compress_inflate_with_dict(struct util_compress_dict *dict,
+                                const uint8_t *in_data, size_t in_data_size,
+                                uint8_t *out_data, size_t out_data_size);
+
+size_t
+util_compress_deflate_with_dict(struct util_compress_dict *dict,
+                                const uint8_t *in_data, size_t in_data_size,
+                                uint8_t *out_data, size_t out_buff_size);
+
 #endif
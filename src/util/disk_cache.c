@@ -39,6 +39,7 @@
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/mesa-sha1.h"
@@ -60,7 +61,7 @@
  * - There is no strict requirement that cache versions be backwards
  *   compatible but effort should be taken to limit disruption where possible.
  */
-#define CACHE_VERSION 1
+#define CACHE_VERSION 2
 
 #define DRV_KEY_CPY(_dst, _src, _src_size) \
 do {                                       \
@@ -126,6 +127,16 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
          goto path_fail;
 
       cache->use_cache_db = true;
+      cache->uncompressed_hot_entries =
+         env_var_as_boolean("MESA_DISK_CACHE_UNCOMPRESSED_HOT", false);
+
+      if (cache->uncompressed_hot_entries) {
+         cache->hot_entry_loads = _mesa_hash_table_u64_create(cache);
+         if (!cache->hot_entry_loads)
+            goto path_fail;
+
+         simple_mtx_init(&cache->hot_entries_mtx, mtx_plain);
+      }
    }
 
    if (!disk_cache_mmap_cache_index(local, cache, path))
@@ -184,6 +195,13 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    if (cache->use_cache_db)
       mesa_cache_db_set_size_limit(&cache->cache_db, cache->max_size);
 
+   /* The mapped file may be impossible to create, e.g. when it doesn't fit
+    * on the file system.  Keep going with the multi-file cache then, its
+    * index has already been set up.
+    */
+   if (env_var_as_boolean("MESA_DISK_CACHE_MMAP", false))
+      cache->use_cache_mmap = disk_cache_mm_load_cache_index(local, cache);
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -235,6 +253,9 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    DRV_KEY_CPY(drv_key_blob, &ptr_size, ptr_size_size)
    DRV_KEY_CPY(drv_key_blob, &driver_flags, driver_flags_size)
 
+   if (!cache->path_init_failed)
+      disk_cache_load_compress_dict(cache);
+
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
@@ -263,7 +284,14 @@ disk_cache_destroy(struct disk_cache *cache)
       if (cache->use_cache_db)
          mesa_cache_db_close(&cache->cache_db);
 
+      if (cache->hot_entry_loads)
+         simple_mtx_destroy(&cache->hot_entries_mtx);
+
+      if (cache->use_cache_mmap)
+         mesa_cache_mmap_close(&cache->cache_mmap);
+
       disk_cache_destroy_mmap(cache);
+      disk_cache_destroy_compress_dict(cache);
    }
 
    ralloc_free(cache);
@@ -367,6 +395,8 @@ cache_put(void *job, void *gdata, int thread_index)
       disk_cache_write_item_to_disk_foz(dc_job);
    } else if (dc_job->cache->use_cache_db) {
       disk_cache_db_write_item_to_disk(dc_job);
+   } else if (dc_job->cache->use_cache_mmap) {
+      disk_cache_mm_write_item_to_disk(dc_job);
    } else {
       filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
       if (filename == NULL)
@@ -467,6 +497,8 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return disk_cache_load_item_foz(cache, key, size);
    } else if (cache->use_cache_db) {
       return disk_cache_db_load_item(cache, key, size);
+   } else if (cache->use_cache_mmap) {
+      return disk_cache_mm_load_item(cache, key, size);
    } else {
       char *filename = disk_cache_get_cache_filename(cache, key);
       if (filename == NULL)
@@ -98,8 +98,27 @@ disk_cache_get_function_identifier(void *ptr, struct mesa_sha1 *ctx)
 #include "util/blob.h"
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/mesa-sha1.h"
+#include "util/os_time.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
+#include "util/u_atomic.h"
+
+/* Entries larger than this aren't representative for the dictionary. */
+#define CACHE_DICT_MAX_SAMPLE_SIZE (128 * 1024)
+
+/* Train the dictionary once either limit is reached. */
+#define CACHE_DICT_TRAIN_SAMPLES 1024
+#define CACHE_DICT_TRAIN_BYTES (4 * 1024 * 1024)
+
+#define CACHE_DICT_SIZE (64 * 1024)
+
+/* Database entries which are loaded this many times, each load within
+ * CACHE_HOT_ENTRY_WINDOW_NS of the previous one, are considered hot.
+ */
+#define CACHE_HOT_ENTRY_LOADS 3
+#define CACHE_HOT_ENTRY_WINDOW_NS (5ull * 60 * 1000 * 1000 * 1000)
 
 /* Create a directory named 'path' if it does not already exist.
  *
@@ -492,7 +511,8 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
 
 static void *
 parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
-                              size_t cache_item_size, size_t *size)
+                              size_t cache_item_size, size_t *size,
+                              struct cache_entry_file_data **cf_data_out)
 {
    uint8_t *uncompressed_data = NULL;
 
@@ -550,20 +570,26 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
    if (!uncompressed_data)
       goto fail;
 
-   if (cache->compression_disabled) {
+   if (cache->compression_disabled ||
+       (cf_data->flags & CACHE_ENTRY_UNCOMPRESSED)) {
       if (cf_data->uncompressed_size != cache_data_size)
          goto fail;
 
       memcpy(uncompressed_data, data, cache_data_size);
    } else {
-      if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                                 cf_data->uncompressed_size))
+      if (!util_compress_inflate_with_dict(p_atomic_read(&cache->compress_dict),
+                                           data, cache_data_size,
+                                           uncompressed_data,
+                                           cf_data->uncompressed_size))
          goto fail;
    }
 
    if (size)
       *size = cf_data->uncompressed_size;
 
+   if (cf_data_out)
+      *cf_data_out = cf_data;
+
    return uncompressed_data;
 
  fail:
@@ -596,7 +622,7 @@ disk_cache_load_item(struct disk_cache *cache, char *filename, size_t *size)
       goto fail;
 
     uint8_t *uncompressed_data =
-       parse_and_validate_cache_item(cache, data, sb.st_size, size);
+       parse_and_validate_cache_item(cache, data, sb.st_size, size, NULL);
    if (!uncompressed_data)
       goto fail;
 
@@ -638,6 +664,147 @@ disk_cache_get_cache_filename(struct disk_cache *cache, const cache_key key)
    return filename;
 }
 
+static struct util_compress_dict *
+read_compress_dict(const char *path)
+{
+   struct util_compress_dict *dict = NULL;
+   void *dict_data = NULL;
+
+   int fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      return NULL;
+
+   struct stat sb;
+   if (fstat(fd, &sb) == -1 || sb.st_size == 0 || sb.st_size > CACHE_DICT_SIZE)
+      goto out;
+
+   dict_data = malloc(sb.st_size);
+   if (!dict_data)
+      goto out;
+
+   if (read_all(fd, dict_data, sb.st_size) == -1)
+      goto out;
+
+   dict = util_compress_dict_create(dict_data, sb.st_size);
+
+ out:
+   free(dict_data);
+   close(fd);
+
+   return dict;
+}
+
+static void
+train_compress_dict(struct disk_cache *cache, const void *samples,
+                    const size_t *sample_sizes, unsigned num_samples)
+{
+   struct util_compress_dict *dict = NULL;
+   char *filename_tmp = NULL;
+   int fd;
+
+   void *dict_data = malloc(CACHE_DICT_SIZE);
+   if (!dict_data)
+      return;
+
+   size_t dict_size = util_compress_dict_train(dict_data, CACHE_DICT_SIZE,
+                                               samples, sample_sizes,
+                                               num_samples);
+   if (dict_size == 0)
+      goto out;
+
+   if (asprintf(&filename_tmp, "%s.%d.tmp", cache->compress_dict_path,
+                (int) getpid()) == -1) {
+      filename_tmp = NULL;
+      goto out;
+   }
+
+   fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT | O_EXCL, 0644);
+   if (fd == -1)
+      goto out;
+
+   int ret = write_all(fd, dict_data, dict_size);
+   close(fd);
+   if (ret == -1)
+      goto out_unlink;
+
+   /* Entries compressed with a dictionary can only be read back with the
+    * very same dictionary.  link() doesn't replace an existing file, so if
+    * another process got there first, switch to its dictionary instead.
+    */
+   if (link(filename_tmp, cache->compress_dict_path) == 0)
+      dict = util_compress_dict_create(dict_data, dict_size);
+   else if (errno == EEXIST)
+      dict = read_compress_dict(cache->compress_dict_path);
+
+   if (dict)
+      p_atomic_set(&cache->compress_dict, dict);
+
+ out_unlink:
+   unlink(filename_tmp);
+ out:
+   free(filename_tmp);
+   free(dict_data);
+}
+
+static void
+add_compress_dict_sample(struct disk_cache *cache, const void *data,
+                         size_t size)
+{
+   if (size > CACHE_DICT_MAX_SAMPLE_SIZE ||
+       !p_atomic_read(&cache->collect_dict_samples))
+      return;
+
+   simple_mtx_lock(&cache->dict_samples_mtx);
+
+   if (!cache->collect_dict_samples) {
+      simple_mtx_unlock(&cache->dict_samples_mtx);
+      return;
+   }
+
+   if (cache->num_dict_samples % 64 == 0) {
+      size_t *sizes = realloc(cache->dict_sample_sizes,
+                              (cache->num_dict_samples + 64) * sizeof(size_t));
+      if (!sizes) {
+         cache->collect_dict_samples = false;
+         simple_mtx_unlock(&cache->dict_samples_mtx);
+         return;
+      }
+      cache->dict_sample_sizes = sizes;
+   }
+
+   if (!blob_write_bytes(&cache->dict_samples, data, size)) {
+      cache->collect_dict_samples = false;
+      simple_mtx_unlock(&cache->dict_samples_mtx);
+      return;
+   }
+   cache->dict_sample_sizes[cache->num_dict_samples++] = size;
+
+   if (cache->num_dict_samples < CACHE_DICT_TRAIN_SAMPLES &&
+       cache->dict_samples.size < CACHE_DICT_TRAIN_BYTES) {
+      simple_mtx_unlock(&cache->dict_samples_mtx);
+      return;
+   }
+
+   /* Only a single training attempt is made per cache instance, take the
+    * samples and train without holding the lock.
+    */
+   struct blob samples = cache->dict_samples;
+   size_t *sample_sizes = cache->dict_sample_sizes;
+   unsigned num_samples = cache->num_dict_samples;
+
+   blob_init(&cache->dict_samples);
+   cache->dict_sample_sizes = NULL;
+   cache->num_dict_samples = 0;
+   cache->collect_dict_samples = false;
+
+   simple_mtx_unlock(&cache->dict_samples_mtx);
+
+   train_compress_dict(cache, samples.data, sample_sizes, num_samples);
+
+   blob_finish(&samples);
+   free(sample_sizes);
+}
+
 static bool
 create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
                                   struct blob *cache_blob)
@@ -652,12 +819,21 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
       compressed_size = dc_job->size;
       compressed_data = dc_job->data;
    } else {
+      struct util_compress_dict *dict = NULL;
+
+      if (dc_job->cache->compress_with_dict) {
+         dict = p_atomic_read(&dc_job->cache->compress_dict);
+         if (!dict)
+            add_compress_dict_sample(dc_job->cache, dc_job->data,
+                                     dc_job->size);
+      }
+
       compressed_data = malloc(max_buf);
       if (compressed_data == NULL)
          return false;
       compressed_size =
-         util_compress_deflate(dc_job->data, dc_job->size,
-                              compressed_data, max_buf);
+         util_compress_deflate_with_dict(dict, dc_job->data, dc_job->size,
+                                         compressed_data, max_buf);
       if (compressed_size == 0)
          goto fail;
    }
@@ -694,6 +870,8 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
    struct cache_entry_file_data cf_data;
    cf_data.crc32 = util_hash_crc32(compressed_data, compressed_size);
    cf_data.uncompressed_size = dc_job->size;
+   cf_data.flags = dc_job->cache->compression_disabled ?
+                   CACHE_ENTRY_UNCOMPRESSED : 0;
 
    if (!blob_write_bytes(cache_blob, &cf_data, sizeof(cf_data)))
       goto fail;
@@ -836,6 +1014,8 @@ disk_cache_generate_cache_dir(void *mem_ctx, const char *gpu_name,
       cache_dir_name = CACHE_DIR_NAME_SF;
    else if (env_var_as_boolean("MESA_DISK_CACHE_DATABASE", false))
       cache_dir_name = CACHE_DIR_NAME_DB;
+   else if (env_var_as_boolean("MESA_DISK_CACHE_MMAP", false))
+      cache_dir_name = CACHE_DIR_NAME_MM;
 
    char *path = getenv("MESA_SHADER_CACHE_DIR");
 
@@ -955,7 +1135,8 @@ disk_cache_load_item_foz(struct disk_cache *cache, const cache_key key,
       return NULL;
 
    uint8_t *uncompressed_data =
-       parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size);
+       parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size,
+                                     NULL);
    free(cache_item);
 
    return uncompressed_data;
@@ -1048,20 +1229,146 @@ disk_cache_destroy_mmap(struct disk_cache *cache)
    munmap(cache->index_mmap, cache->index_mmap_size);
 }
 
+/* Returns whether the entry has now been loaded CACHE_HOT_ENTRY_LOADS times
+ * in quick succession.  The previous load may be from another process, it's
+ * known from the last access time stored in the database.
+ */
+static bool
+disk_cache_db_entry_is_hot(struct disk_cache *cache, const cache_key key,
+                           uint64_t prev_access_time)
+{
+   bool recent = os_time_get_nano() - prev_access_time <
+                 CACHE_HOT_ENTRY_WINDOW_NS;
+   bool hot = false;
+   uint64_t key64;
+
+   memcpy(&key64, key, sizeof(key64));
+
+   simple_mtx_lock(&cache->hot_entries_mtx);
+
+   if (recent) {
+      uintptr_t loads = (uintptr_t)
+         _mesa_hash_table_u64_search(cache->hot_entry_loads, key64);
+
+      /* Count the previous load, and this one. */
+      loads = MAX2(loads, 1) + 1;
+
+      if (loads >= CACHE_HOT_ENTRY_LOADS) {
+         _mesa_hash_table_u64_remove(cache->hot_entry_loads, key64);
+         hot = true;
+      } else {
+         _mesa_hash_table_u64_insert(cache->hot_entry_loads, key64,
+                                     (void *) loads);
+      }
+   } else {
+      _mesa_hash_table_u64_remove(cache->hot_entry_loads, key64);
+   }
+
+   simple_mtx_unlock(&cache->hot_entries_mtx);
+
+   return hot;
+}
+
+struct disk_cache_hot_entry_job {
+   struct util_queue_fence fence;
+   struct disk_cache *cache;
+   cache_key key;
+   struct blob blob;
+};
+
+static void
+store_hot_entry(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_hot_entry_job *hot_job =
+      (struct disk_cache_hot_entry_job *) job;
+
+   mesa_cache_db_entry_replace(&hot_job->cache->cache_db, hot_job->key,
+                               hot_job->blob.data, hot_job->blob.size);
+}
+
+static void
+destroy_hot_entry_job(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache_hot_entry_job *hot_job =
+      (struct disk_cache_hot_entry_job *) job;
+
+   blob_finish(&hot_job->blob);
+   free(hot_job);
+}
+
+/* Queues rewriting the entry without compression, so that loading it
+ * doesn't wait for the database lock and the write.
+ */
+static void
+disk_cache_db_store_uncompressed(struct disk_cache *cache, const cache_key key,
+                                 const uint8_t *cache_item,
+                                 const struct cache_entry_file_data *cf_data,
+                                 const void *data, size_t size)
+{
+   struct cache_entry_file_data new_cf_data;
+
+   struct disk_cache_hot_entry_job *hot_job =
+      malloc(sizeof(struct disk_cache_hot_entry_job));
+   if (!hot_job)
+      return;
+
+   hot_job->cache = cache;
+   memcpy(hot_job->key, key, sizeof(cache_key));
+
+   new_cf_data.crc32 = util_hash_crc32(data, size);
+   new_cf_data.uncompressed_size = size;
+   new_cf_data.flags = CACHE_ENTRY_UNCOMPRESSED;
+
+   blob_init(&hot_job->blob);
+
+   if (!blob_write_bytes(&hot_job->blob, cache_item,
+                         (const uint8_t *) cf_data - cache_item) ||
+       !blob_write_bytes(&hot_job->blob, &new_cf_data, sizeof(new_cf_data)) ||
+       !blob_write_bytes(&hot_job->blob, data, size)) {
+      destroy_hot_entry_job(hot_job, NULL, 0);
+      return;
+   }
+
+   util_queue_fence_init(&hot_job->fence);
+   util_queue_add_job(&cache->cache_queue, hot_job, &hot_job->fence,
+                      store_hot_entry, destroy_hot_entry_job,
+                      hot_job->blob.size);
+}
+
 void *
 disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
                         size_t *size)
 {
+   struct cache_entry_file_data *cf_data = NULL;
+   uint64_t prev_access_time = 0;
    size_t cache_tem_size = 0;
-   void *cache_item = mesa_cache_db_read_entry(&cache->cache_db, key,
-                                               &cache_tem_size);
+   size_t data_size = 0;
+
+   void *cache_item = mesa_cache_db_read_entry_lru(&cache->cache_db, key,
+                                                   &cache_tem_size,
+                                                   &prev_access_time);
    if (!cache_item)
       return NULL;
 
    uint8_t *uncompressed_data =
-       parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size);
+       parse_and_validate_cache_item(cache, cache_item, cache_tem_size,
+                                     &data_size, &cf_data);
+
+   /* Entries which keep being loaded aren't worth decompressing each time,
+    * trade some disk space for load time.
+    */
+   if (uncompressed_data && cache->uncompressed_hot_entries &&
+       !cache->compression_disabled &&
+       !(cf_data->flags & CACHE_ENTRY_UNCOMPRESSED) &&
+       disk_cache_db_entry_is_hot(cache, key, prev_access_time))
+      disk_cache_db_store_uncompressed(cache, key, cache_item, cf_data,
+                                       uncompressed_data, data_size);
+
    free(cache_item);
 
+   if (uncompressed_data && size)
+      *size = data_size;
+
    return uncompressed_data;
 }
 
@@ -1086,6 +1393,95 @@ disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache)
 {
    return mesa_cache_db_open(&cache->cache_db, cache->path);
 }
+
+void *
+disk_cache_mm_load_item(struct disk_cache *cache, const cache_key key,
+                        size_t *size)
+{
+   size_t cache_tem_size = 0;
+   void *cache_item = mesa_cache_mmap_read_entry(&cache->cache_mmap, key,
+                                                 &cache_tem_size);
+   if (!cache_item)
+      return NULL;
+
+   uint8_t *uncompressed_data =
+       parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size,
+                                     NULL);
+   free(cache_item);
+
+   return uncompressed_data;
+}
+
+bool
+disk_cache_mm_write_item_to_disk(struct disk_cache_put_job *dc_job)
+{
+   struct blob cache_blob;
+   blob_init(&cache_blob);
+
+   if (!create_cache_item_header_and_blob(dc_job, &cache_blob))
+      return false;
+
+   bool r = mesa_cache_mmap_entry_write(&dc_job->cache->cache_mmap,
+                                        dc_job->key, cache_blob.data,
+                                        cache_blob.size);
+
+   blob_finish(&cache_blob);
+   return r;
+}
+
+bool
+disk_cache_mm_load_cache_index(void *mem_ctx, struct disk_cache *cache)
+{
+   return mesa_cache_mmap_open(&cache->cache_mmap, cache->path,
+                               cache->max_size);
+}
+
+/* Loads the compression dictionary of this driver, or starts collecting
+ * samples for training one if there is none yet.  The dictionary file name
+ * is derived from the driver keys, so that every driver and Mesa version
+ * gets its own dictionary.
+ */
+void
+disk_cache_load_compress_dict(struct disk_cache *cache)
+{
+   simple_mtx_init(&cache->dict_samples_mtx, mtx_plain);
+   blob_init(&cache->dict_samples);
+
+#ifdef HAVE_ZSTD
+   if (cache->compression_disabled)
+      return;
+
+   unsigned char sha1[20];
+   char sha1_str[41];
+   _mesa_sha1_compute(cache->driver_keys_blob, cache->driver_keys_blob_size,
+                      sha1);
+   _mesa_sha1_format(sha1_str, sha1);
+
+   cache->compress_dict_path = ralloc_asprintf(cache, "%s/zstd_dict_%s",
+                                               cache->path, sha1_str);
+   if (!cache->compress_dict_path)
+      return;
+
+   /* Entries compressed with the dictionary must stay readable even when
+    * MESA_DISK_CACHE_ZSTD_DICT is unset, so only training and compressing
+    * with it depend on the environment variable.
+    */
+   cache->compress_dict = read_compress_dict(cache->compress_dict_path);
+   cache->compress_with_dict =
+      env_var_as_boolean("MESA_DISK_CACHE_ZSTD_DICT", false);
+   cache->collect_dict_samples =
+      cache->compress_with_dict && cache->compress_dict == NULL;
+#endif
+}
+
+void
+disk_cache_destroy_compress_dict(struct disk_cache *cache)
+{
+   util_compress_dict_destroy(cache->compress_dict);
+   free(cache->dict_sample_sizes);
+   blob_finish(&cache->dict_samples);
+   simple_mtx_destroy(&cache->dict_samples_mtx);
+}
 #endif
 
 #endif /* ENABLE_SHADER_CACHE */
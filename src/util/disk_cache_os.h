@@ -24,6 +24,8 @@
 #ifndef DISK_CACHE_OS_H
 #define DISK_CACHE_OS_H
 
+#include "util/blob.h"
+#include "util/simple_mtx.h"
 #include "util/u_queue.h"
 
 #if DETECT_OS_WINDOWS
@@ -34,6 +36,7 @@
 
 #include "util/fossilize_db.h"
 #include "util/mesa_cache_db.h"
+#include "util/mesa_cache_mmap.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,6 +51,9 @@ extern "C" {
 /* The number of keys that can be stored in the index. */
 #define CACHE_INDEX_MAX_KEYS (1 << CACHE_INDEX_KEY_BITS)
 
+struct util_compress_dict;
+struct hash_table_u64;
+
 struct disk_cache {
    /* The path to the cache directory. */
    char *path;
@@ -62,6 +68,10 @@ struct disk_cache {
 
    bool use_cache_db;
 
+   struct mesa_cache_mmap cache_mmap;
+
+   bool use_cache_mmap;
+
    /* Seed for rand, which is used to pick a random directory */
    uint64_t seed_xorshift128plus[2];
 
@@ -87,11 +97,47 @@ struct disk_cache {
 
    /* Don't compress cached data. This is for testing purposes only. */
    bool compression_disabled;
+
+   /* Trained compression dictionary for this driver, NULL until one has
+    * been loaded from or written to compress_dict_path.  Published with
+    * p_atomic_set() by whichever cache thread trained it.
+    */
+   struct util_compress_dict *compress_dict;
+   char *compress_dict_path;
+
+   /* Whether new entries are compressed with the dictionary, and one is
+    * trained if there is none yet.  An existing dictionary is always loaded
+    * for reading entries written by a process which had this enabled.
+    */
+   bool compress_with_dict;
+
+   /* Uncompressed entries collected for training the dictionary. */
+   simple_mtx_t dict_samples_mtx;
+   struct blob dict_samples;
+   size_t *dict_sample_sizes;
+   unsigned num_dict_samples;
+   bool collect_dict_samples;
+
+   /* Store entries of the database backend which are loaded repeatedly
+    * without compression.
+    */
+   bool uncompressed_hot_entries;
+
+   /* Number of quick successive loads of each database entry, keyed by the
+    * first 64 bits of the cache key.  Only entries whose last load was
+    * recent are tracked.
+    */
+   simple_mtx_t hot_entries_mtx;
+   struct hash_table_u64 *hot_entry_loads;
 };
 
+/* The entry data is stored as is rather than compressed. */
+#define CACHE_ENTRY_UNCOMPRESSED (1u << 0)
+
 struct cache_entry_file_data {
    uint32_t crc32;
    uint32_t uncompressed_size;
+   uint32_t flags;
 };
 
 struct disk_cache_put_job {
@@ -160,6 +206,22 @@ disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
 bool
 disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 
+void *
+disk_cache_mm_load_item(struct disk_cache *cache, const cache_key key,
+                        size_t *size);
+
+bool
+disk_cache_mm_write_item_to_disk(struct disk_cache_put_job *dc_job);
+
+bool
+disk_cache_mm_load_cache_index(void *mem_ctx, struct disk_cache *cache);
+
+void
+disk_cache_load_compress_dict(struct disk_cache *cache);
+
+void
+disk_cache_destroy_compress_dict(struct disk_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,10 +33,13 @@
 #ifdef FOZ_DB_UTIL
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -44,6 +47,7 @@
 #include "hash_table.h"
 #include "mesa-sha1.h"
 #include "ralloc.h"
+#include "u_thread.h"
 
 #define FOZ_REF_MAGIC_SIZE 16
 
@@ -54,6 +58,28 @@ static const uint8_t stream_reference_magic_and_version[FOZ_REF_MAGIC_SIZE] = {
    0, 0, 0, FOSSILIZE_FORMAT_VERSION, /* 4 bytes to use for versioning. */
 };
 
+/* The sorted index sidecar of a read only foz db is a header followed by
+ * num_entries entries sorted by key.  It is only valid for the index file it
+ * was built from, which is identified by its size and modification time.
+ */
+#define FOZ_SORTED_IDX_VERSION 1
+
+static const char foz_sorted_idx_magic[16] = "MESA_FOZ_SORTED";
+
+struct foz_sorted_index_header {
+   char magic[16];
+   uint32_t version;
+   uint32_t num_entries;
+   uint64_t idx_size;
+   int64_t idx_mtime;
+};
+
+struct foz_sorted_index_entry {
+   uint8_t key[20];
+   uint32_t pad;
+   uint64_t offset;
+};
+
 /* Mesa uses 160bit hashes to identify cache entries, a hash of this size
  * makes collisions virtually impossible for our use case. However the foz db
  * format uses a 64bit hash table to lookup file offsets for reading cache
@@ -104,6 +130,66 @@ create_foz_db_filenames(char *cache_path, char *name, char **filename,
    return true;
 }
 
+static bool
+check_foz_magic(FILE *file)
+{
+   uint8_t magic[FOZ_REF_MAGIC_SIZE];
+   if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, file) != FOZ_REF_MAGIC_SIZE)
+      return false;
+
+   if (memcmp(magic, stream_reference_magic_and_version,
+              FOZ_REF_MAGIC_SIZE - 1))
+      return false;
+
+   int version = magic[FOZ_REF_MAGIC_SIZE - 1];
+   if (version > FOSSILIZE_FORMAT_VERSION ||
+       version < FOSSILIZE_FORMAT_MIN_COMPAT_VERSION)
+      return false;
+
+   return true;
+}
+
+/* Reads the index entry at *offset, returns false if there is no complete
+ * entry left before len.
+ */
+static bool
+read_foz_index_entry(FILE *db_idx, uint64_t len, uint64_t *offset,
+                     char *hash_str, struct foz_payload_header *header,
+                     uint64_t *cache_offset)
+{
+   char bytes_to_read[FOSSILIZE_BLOB_HASH_LENGTH + sizeof(struct foz_payload_header)];
+
+   /* Corrupt entry. Our process might have been killed before we
+    * could write all data.
+    */
+   if (*offset + sizeof(bytes_to_read) > len)
+      return false;
+
+   /* NAME + HEADER in one read */
+   if (fread(bytes_to_read, 1, sizeof(bytes_to_read), db_idx) !=
+       sizeof(bytes_to_read))
+      return false;
+
+   memcpy(header, &bytes_to_read[FOSSILIZE_BLOB_HASH_LENGTH], sizeof(*header));
+
+   /* Corrupt entry. Our process might have been killed before we
+    * could write all data.
+    */
+   if (*offset + sizeof(bytes_to_read) + header->payload_size > len ||
+       header->payload_size != sizeof(uint64_t))
+      return false;
+
+   memcpy(hash_str, bytes_to_read, FOSSILIZE_BLOB_HASH_LENGTH);
+   hash_str[FOSSILIZE_BLOB_HASH_LENGTH] = '\0';
+
+   /* read cache item offset from index file */
+   if (fread(cache_offset, 1, sizeof(*cache_offset), db_idx) !=
+       sizeof(*cache_offset))
+      return false;
+
+   *offset += sizeof(bytes_to_read) + header->payload_size;
+   return true;
+}
 
 /* This looks at stuff that was added to the index since the last time we looked at it. This is safe
  * to do without locking the file as we assume the file is append only */
@@ -120,45 +206,19 @@ update_foz_index(struct foz_db *foz_db, FILE *db_idx, unsigned file_idx)
 
    fseek(db_idx, offset, SEEK_SET);
    while (offset < len) {
-      char bytes_to_read[FOSSILIZE_BLOB_HASH_LENGTH + sizeof(struct foz_payload_header)];
-      struct foz_payload_header *header;
-
-      /* Corrupt entry. Our process might have been killed before we
-       * could write all data.
-       */
-      if (offset + sizeof(bytes_to_read) > len)
-         break;
-
-      /* NAME + HEADER in one read */
-      if (fread(bytes_to_read, 1, sizeof(bytes_to_read), db_idx) !=
-          sizeof(bytes_to_read))
-         break;
-
-      offset += sizeof(bytes_to_read);
-      header = (struct foz_payload_header*)&bytes_to_read[FOSSILIZE_BLOB_HASH_LENGTH];
-
-      /* Corrupt entry. Our process might have been killed before we
-       * could write all data.
-       */
-      if (offset + header->payload_size > len ||
-          header->payload_size != sizeof(uint64_t))
-         break;
-
-      char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1] = {0};
-      memcpy(hash_str, bytes_to_read, FOSSILIZE_BLOB_HASH_LENGTH);
-
-      /* read cache item offset from index file */
+      char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1];
+      struct foz_payload_header header;
       uint64_t cache_offset;
-      if (fread(&cache_offset, 1, sizeof(cache_offset), db_idx) !=
-          sizeof(cache_offset))
+
+      if (!read_foz_index_entry(db_idx, len, &offset, hash_str, &header,
+                                &cache_offset))
          break;
 
-      offset += header->payload_size;
       parsed_offset = offset;
 
       struct foz_db_entry *entry = ralloc(foz_db->mem_ctx,
                                           struct foz_db_entry);
-      entry->header = *header;
+      entry->header = header;
       entry->file_idx = file_idx;
       _mesa_sha1_hex_to_sha1(entry->key, hash_str);
 
@@ -219,19 +279,8 @@ load_foz_dbs(struct foz_db *foz_db, FILE *db_idx, uint8_t file_idx,
    }
 
    if (len != 0) {
-      uint8_t magic[FOZ_REF_MAGIC_SIZE];
-      if (fread(magic, 1, FOZ_REF_MAGIC_SIZE, db_idx) != FOZ_REF_MAGIC_SIZE)
+      if (!check_foz_magic(db_idx))
          goto fail;
-
-      if (memcmp(magic, stream_reference_magic_and_version,
-                 FOZ_REF_MAGIC_SIZE - 1))
-         goto fail;
-
-      int version = magic[FOZ_REF_MAGIC_SIZE - 1];
-      if (version > FOSSILIZE_FORMAT_VERSION ||
-          version < FOSSILIZE_FORMAT_MIN_COMPAT_VERSION)
-         goto fail;
-
    } else {
       /* Appending to a fresh file. Make sure we have the magic. */
       if (fwrite(stream_reference_magic_and_version, 1,
@@ -261,9 +310,212 @@ fail:
    return false;
 }
 
+static int
+compare_sorted_index_entries(const void *a, const void *b)
+{
+   const struct foz_sorted_index_entry *ea = a;
+   const struct foz_sorted_index_entry *eb = b;
+
+   return memcmp(ea->key, eb->key, sizeof(ea->key));
+}
+
+static bool
+map_sorted_index(struct foz_ro_index *index, const char *filename,
+                 const struct stat *idx_st)
+{
+   int fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, &st) == -1 ||
+       st.st_size < sizeof(struct foz_sorted_index_header)) {
+      close(fd);
+      return false;
+   }
+
+   void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return false;
+
+   /* Rebuild the sidecar if the db was modified since it was written. */
+   const struct foz_sorted_index_header *header = map;
+   if (memcmp(header->magic, foz_sorted_idx_magic, sizeof(header->magic)) ||
+       header->version != FOZ_SORTED_IDX_VERSION ||
+       header->idx_size != idx_st->st_size ||
+       header->idx_mtime != idx_st->st_mtime ||
+       st.st_size != sizeof(*header) +
+                     (uint64_t)header->num_entries *
+                     sizeof(struct foz_sorted_index_entry)) {
+      munmap(map, st.st_size);
+      return false;
+   }
+
+   index->entries = (const struct foz_sorted_index_entry *)(header + 1);
+   index->num_entries = header->num_entries;
+   index->map = map;
+   index->map_size = st.st_size;
+   return true;
+}
+
+static bool
+build_sorted_index(struct foz_ro_index *index, FILE *db_idx, uint64_t len)
+{
+   if (!check_foz_magic(db_idx))
+      return false;
+
+   struct foz_sorted_index_entry *entries = NULL;
+   uint32_t num_entries = 0, max_entries = 0;
+   uint64_t offset = FOZ_REF_MAGIC_SIZE;
+
+   while (offset < len) {
+      char hash_str[FOSSILIZE_BLOB_HASH_LENGTH + 1];
+      struct foz_payload_header header;
+      uint64_t cache_offset;
+
+      if (!read_foz_index_entry(db_idx, len, &offset, hash_str, &header,
+                                &cache_offset))
+         break;
+
+      if (num_entries == max_entries) {
+         max_entries = MAX2(max_entries * 2, 1024);
+         void *new_entries = realloc(entries, max_entries * sizeof(*entries));
+         if (!new_entries) {
+            free(entries);
+            return false;
+         }
+         entries = new_entries;
+      }
+
+      struct foz_sorted_index_entry *entry = &entries[num_entries++];
+      _mesa_sha1_hex_to_sha1(entry->key, hash_str);
+      entry->pad = 0;
+      entry->offset = cache_offset;
+   }
+
+   qsort(entries, num_entries, sizeof(*entries), compare_sorted_index_entries);
+
+   index->entries = entries;
+   index->num_entries = num_entries;
+   index->map = NULL;
+   index->map_size = 0;
+   return true;
+}
+
+/* Best effort, the db may well live in a directory we can't write to. */
+static void
+write_sorted_index(const struct foz_ro_index *index, const char *filename,
+                   const struct stat *idx_st)
+{
+   char *tmp_filename;
+   if (asprintf(&tmp_filename, "%s.XXXXXX", filename) == -1)
+      return;
+
+   int fd = mkstemp(tmp_filename);
+   if (fd == -1) {
+      free(tmp_filename);
+      return;
+   }
+
+   FILE *file = fdopen(fd, "wb");
+   if (!file) {
+      close(fd);
+      goto fail;
+   }
+
+   struct foz_sorted_index_header header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, foz_sorted_idx_magic, sizeof(header.magic));
+   header.version = FOZ_SORTED_IDX_VERSION;
+   header.num_entries = index->num_entries;
+   header.idx_size = idx_st->st_size;
+   header.idx_mtime = idx_st->st_mtime;
+
+   bool ok =
+      fwrite(&header, 1, sizeof(header), file) == sizeof(header) &&
+      fwrite(index->entries, sizeof(*index->entries), index->num_entries,
+             file) == index->num_entries;
+   ok &= fclose(file) == 0;
+
+   /* Readers only ever see a complete sidecar. */
+   if (ok && rename(tmp_filename, filename) == 0) {
+      free(tmp_filename);
+      return;
+   }
+
+fail:
+   unlink(tmp_filename);
+   free(tmp_filename);
+}
+
+struct foz_ro_load_job {
+   struct foz_ro_index *index;
+   char *idx_filename;
+   char *sorted_filename;
+   bool result;
+   bool threaded;
+   thrd_t thread;
+};
+
+/* Loads the index of a read only foz db.  This reads nothing but the sorted
+ * sidecar if it's up to date, otherwise the index is parsed and sorted, and
+ * the sidecar is written for the next process.
+ */
+static int
+load_read_only_foz_index(void *data)
+{
+   struct foz_ro_load_job *job = data;
+
+   FILE *db_idx = fopen(job->idx_filename, "rb");
+   if (!db_idx)
+      return 0;
+
+   struct stat idx_st;
+   if (fstat(fileno(db_idx), &idx_st) == -1) {
+      fclose(db_idx);
+      return 0;
+   }
+
+   if (map_sorted_index(job->index, job->sorted_filename, &idx_st)) {
+      job->result = true;
+   } else if (build_sorted_index(job->index, db_idx, idx_st.st_size)) {
+      write_sorted_index(job->index, job->sorted_filename, &idx_st);
+      job->result = true;
+   }
+
+   fclose(db_idx);
+   return 0;
+}
+
+static const struct foz_sorted_index_entry *
+search_read_only_indices(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
+                         uint8_t *file_idx)
+{
+   struct foz_sorted_index_entry key;
+   memcpy(key.key, cache_key_160bit, sizeof(key.key));
+
+   for (unsigned i = 1; i < FOZ_MAX_DBS; i++) {
+      const struct foz_ro_index *index = &foz_db->ro_index[i];
+      if (!index->num_entries)
+         continue;
+
+      const struct foz_sorted_index_entry *entry =
+         bsearch(&key, index->entries, index->num_entries,
+                 sizeof(*index->entries), compare_sorted_index_entries);
+      if (entry) {
+         *file_idx = i;
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
 /* Here we open mesa cache foz dbs files. If the files exist we load the index
  * db into a hash table. The index db contains the offsets needed to later
  * read cache entries from the foz db containing the actual cache entries.
+ * The indices of the read only dbs are loaded in parallel.
  */
 bool
 foz_prepare(struct foz_db *foz_db, char *cache_path)
@@ -298,6 +550,8 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
    if (!foz_dbs)
       return true;
 
+   struct foz_ro_load_job jobs[FOZ_MAX_DBS];
+
    for (unsigned n; n = strcspn(foz_dbs, ","), *foz_dbs;
         foz_dbs += MAX2(1, n)) {
       char *foz_db_filename = strndup(foz_dbs, n);
@@ -309,34 +563,65 @@ foz_prepare(struct foz_db *foz_db, char *cache_path)
          free(foz_db_filename);
          continue; /* Ignore invalid user provided filename and continue */
       }
+
+      char *sorted_filename;
+      if (asprintf(&sorted_filename, "%s/%s_idx.sorted", cache_path,
+                   foz_db_filename) == -1) {
+         free(foz_db_filename);
+         free(filename);
+         free(idx_filename);
+         continue;
+      }
       free(foz_db_filename);
 
       /* Open files as read only */
       foz_db->file[file_idx] = fopen(filename, "rb");
-      FILE *db_idx = fopen(idx_filename, "rb");
-
       free(filename);
-      free(idx_filename);
 
-      if (!check_files_opened_successfully(foz_db->file[file_idx], db_idx)) {
+      if (!foz_db->file[file_idx] || access(idx_filename, R_OK) != 0) {
+         if (foz_db->file[file_idx])
+            fclose(foz_db->file[file_idx]);
+
          /* Prevent foz_destroy from destroying it a second time. */
          foz_db->file[file_idx] = NULL;
 
+         free(idx_filename);
+         free(sorted_filename);
          continue; /* Ignore invalid user provided filename and continue */
       }
 
-      if (!load_foz_dbs(foz_db, db_idx, file_idx, true)) {
-         fclose(db_idx);
-         return false;
-      }
+      struct foz_ro_load_job *job = &jobs[file_idx];
+      job->index = &foz_db->ro_index[file_idx];
+      job->idx_filename = idx_filename;
+      job->sorted_filename = sorted_filename;
+      job->result = false;
+      job->threaded =
+         u_thread_create(&job->thread, load_read_only_foz_index, job) ==
+         thrd_success;
+      if (!job->threaded)
+         load_read_only_foz_index(job);
 
-      fclose(db_idx);
       file_idx++;
 
       if (file_idx >= FOZ_MAX_DBS)
          break;
    }
 
+   bool result = true;
+   for (unsigned i = 1; i < file_idx; i++) {
+      if (jobs[i].threaded)
+         thrd_join(jobs[i].thread, NULL);
+
+      result &= jobs[i].result;
+      free(jobs[i].idx_filename);
+      free(jobs[i].sorted_filename);
+   }
+
+   if (!result) {
+      foz_destroy(foz_db);
+      return false;
+   }
+
    return true;
 }
 
@@ -348,6 +633,12 @@ foz_destroy(struct foz_db *foz_db)
    for (unsigned i = 0; i < FOZ_MAX_DBS; i++) {
       if (foz_db->file[i])
          fclose(foz_db->file[i]);
+
+      struct foz_ro_index *index = &foz_db->ro_index[i];
+      if (index->map)
+         munmap(index->map, index->map_size);
+      else
+         free((void *)index->entries);
    }
 
    if (foz_db->mem_ctx) {
@@ -374,42 +665,56 @@ foz_read_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
 
    simple_mtx_lock(&foz_db->mtx);
 
-   struct foz_db_entry *entry =
-      _mesa_hash_table_u64_search(foz_db->index_db, hash);
-   if (!entry) {
-      update_foz_index(foz_db, foz_db->db_idx, 0);
-      entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
-   }
-   if (!entry) {
-      simple_mtx_unlock(&foz_db->mtx);
-      return NULL;
+   uint8_t file_idx;
+   uint64_t offset;
+
+   /* The read only dbs are searched by their full 160bit key, so there is no
+    * collision to check for.
+    */
+   const struct foz_sorted_index_entry *ro_entry =
+      search_read_only_indices(foz_db, cache_key_160bit, &file_idx);
+   if (ro_entry) {
+      offset = ro_entry->offset;
+   } else {
+      struct foz_db_entry *entry =
+         _mesa_hash_table_u64_search(foz_db->index_db, hash);
+      if (!entry) {
+         update_foz_index(foz_db, foz_db->db_idx, 0);
+         entry = _mesa_hash_table_u64_search(foz_db->index_db, hash);
+      }
+      if (!entry) {
+         simple_mtx_unlock(&foz_db->mtx);
+         return NULL;
+      }
+
+      /* Check for collision using full 160bit hash for increased assurance
+       * against potential collisions.
+       */
+      for (int i = 0; i < 20; i++) {
+         if (cache_key_160bit[i] != entry->key[i])
+            goto fail;
+      }
+
+      file_idx = entry->file_idx;
+      offset = entry->offset;
    }
 
-   uint8_t file_idx = entry->file_idx;
-   if (fseek(foz_db->file[file_idx], entry->offset, SEEK_SET) < 0)
+   if (fseek(foz_db->file[file_idx], offset, SEEK_SET) < 0)
       goto fail;
 
+   struct foz_payload_header header;
    uint32_t header_size = sizeof(struct foz_payload_header);
-   if (fread(&entry->header, 1, header_size, foz_db->file[file_idx]) !=
-       header_size)
+   if (fread(&header, 1, header_size, foz_db->file[file_idx]) != header_size)
       goto fail;
 
-   /* Check for collision using full 160bit hash for increased assurance
-    * against potential collisions.
-    */
-   for (int i = 0; i < 20; i++) {
-      if (cache_key_160bit[i] != entry->key[i])
-         goto fail;
-   }
-
-   uint32_t data_sz = entry->header.payload_size;
+   uint32_t data_sz = header.payload_size;
    data = malloc(data_sz);
    if (fread(data, 1, data_sz, foz_db->file[file_idx]) != data_sz)
       goto fail;
 
    /* verify checksum */
-   if (entry->header.crc != 0) {
-      if (util_hash_crc32(data, data_sz) != entry->header.crc)
+   if (header.crc != 0) {
+      if (util_hash_crc32(data, data_sz) != header.crc)
          goto fail;
    }
 
@@ -440,6 +745,11 @@ foz_write_entry(struct foz_db *foz_db, const uint8_t *cache_key_160bit,
    if (!foz_db->alive)
       return false;
 
+   /* Nothing to do if one of the read only dbs already has it. */
+   uint8_t ro_file_idx;
+   if (search_read_only_indices(foz_db, cache_key_160bit, &ro_file_idx))
+      return false;
+
    /* The flock is per-fd, not per thread, we do it outside of the main mutex to avoid having to
     * wait in the mutex potentially blocking reads. We use the secondary flock_mtx to stop race
     * conditions between the write threads sharing the same file descriptor. */
@@ -72,13 +72,25 @@ struct foz_db_entry {
    struct foz_payload_header header;
 };
 
+/* Index of a read only foz db, sorted by key so that it can be binary
+ * searched.  It is either mapped from the sidecar file written next to the
+ * db the first time it was loaded, or built in memory if that failed.
+ */
+struct foz_ro_index {
+   const struct foz_sorted_index_entry *entries;
+   uint32_t num_entries;
+   void *map;                        /* Mapping of the sidecar file or NULL */
+   size_t map_size;
+};
+
 struct foz_db {
    FILE *file[FOZ_MAX_DBS];          /* An array of all foz dbs */
    FILE *db_idx;                     /* The default writable foz db idx */
    simple_mtx_t mtx;                 /* Mutex for file/hash table read/writes */
    simple_mtx_t flock_mtx;           /* Mutex for flocking the file for writes */
    void *mem_ctx;
-   struct hash_table_u64 *index_db;  /* Hash table of all foz db entries */
+   struct hash_table_u64 *index_db;  /* Hash table of the writable db entries */
+   struct foz_ro_index ro_index[FOZ_MAX_DBS]; /* Read only db indices */
    bool alive;
 };
 
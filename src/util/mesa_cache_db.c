@@ -504,33 +504,33 @@ mesa_db_compact(struct mesa_cache_db *db, int64_t blob_size)
        !mesa_db_seek(compacted_index, ftell(db->index.file)))
       goto cleanup;
 
-   /* Do the compaction */
+   /* Do the compaction. Replaced entries leave dead space behind in both
+    * files, hence the read cursors are positioned explicitly for every live
+    * entry and everything after the first hole is moved down. */
    for (i = 0; i < num_entries; i++) {
       blob_size = blob_file_size(entries[i]->size);
 
-      /* Sanity-check the cache-read offset */
-      if (ftell(db->cache.file) != entries[i]->cache_db_file_offset)
-         goto cleanup;
-
       if (entries[i]->evicted) {
-         /* Jump over the evicted entry */
-         if (!mesa_db_seek_cur(db->cache.file, blob_size) ||
-             !mesa_db_seek_cur(db->index.file, sizeof(index_entry)))
-            goto cleanup;
-
          compact = true;
          continue;
       }
 
+      if (!compact &&
+          (ftell(compacted_cache) != entries[i]->cache_db_file_offset ||
+           ftell(compacted_index) != entries[i]->index_db_file_offset))
+         compact = true;
+
       if (compact) {
          /* Compact the cache file */
-         if (!mesa_db_read_data(db->cache.file,   buffer, blob_size) ||
+         if (!mesa_db_seek(db->cache.file, entries[i]->cache_db_file_offset) ||
+             !mesa_db_read_data(db->cache.file,   buffer, blob_size) ||
              !mesa_db_cache_entry_valid(buffer) ||
              !mesa_db_write_data(compacted_cache, buffer, blob_size))
             goto cleanup;
 
          /* Compact the index file */
-         if (!mesa_db_read(db->index.file, &index_entry) ||
+         if (!mesa_db_seek(db->index.file, entries[i]->index_db_file_offset) ||
+             !mesa_db_read(db->index.file, &index_entry) ||
              !mesa_db_index_entry_valid(&index_entry) ||
              index_entry.cache_db_file_offset != entries[i]->cache_db_file_offset ||
              index_entry.size != entries[i]->size)
@@ -541,14 +541,8 @@ mesa_db_compact(struct mesa_cache_db *db, int64_t blob_size)
          if (!mesa_db_write(compacted_index, &index_entry))
             goto cleanup;
       } else {
-         /* Sanity-check the cache-write offset */
-         if (ftell(compacted_cache) != entries[i]->cache_db_file_offset)
-            goto cleanup;
-
          /* Jump over the unchanged entry */
-         if (!mesa_db_seek_cur(db->index.file,  sizeof(index_entry)) ||
-             !mesa_db_seek_cur(compacted_index, sizeof(index_entry)) ||
-             !mesa_db_seek_cur(db->cache.file,  blob_size) ||
+         if (!mesa_db_seek_cur(compacted_index, sizeof(index_entry)) ||
              !mesa_db_seek_cur(compacted_cache, blob_size))
             goto cleanup;
       }
@@ -649,9 +643,9 @@ mesa_cache_db_file_entry_size(void)
 }
 
 void *
-mesa_cache_db_read_entry(struct mesa_cache_db *db,
-                         const uint8_t *cache_key_160bit,
-                         size_t *size)
+mesa_cache_db_read_entry_lru(struct mesa_cache_db *db,
+                             const uint8_t *cache_key_160bit,
+                             size_t *size, uint64_t *prev_access_time)
 {
    uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
    struct mesa_cache_db_file_entry cache_entry;
@@ -698,6 +692,9 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
        index_entry.size != hash_entry->size)
       goto fail_fatal;
 
+   if (prev_access_time)
+      *prev_access_time = index_entry.last_access_time;
+
    index_entry.last_access_time = os_time_get_nano();
    hash_entry->last_access_time = index_entry.last_access_time;
 
@@ -723,10 +720,19 @@ fail:
    return NULL;
 }
 
-bool
-mesa_cache_db_entry_write(struct mesa_cache_db *db,
-                          const uint8_t *cache_key_160bit,
-                          const void *blob, size_t blob_size)
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db,
+                         const uint8_t *cache_key_160bit,
+                         size_t *size)
+{
+   return mesa_cache_db_read_entry_lru(db, cache_key_160bit, size, NULL);
+}
+
+static bool
+mesa_db_entry_write(struct mesa_cache_db *db,
+                    const uint8_t *cache_key_160bit,
+                    const void *blob, size_t blob_size,
+                    bool replace)
 {
    uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
    struct mesa_index_db_hash_entry *hash_entry = NULL;
@@ -753,8 +759,10 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
          goto fail_fatal;
    }
 
+   /* A replaced entry is appended like a new one, the old copy becomes dead
+    * space which is dropped by the next compaction. */
    hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
-   if (hash_entry) {
+   if (hash_entry && !replace) {
       hash_entry = NULL;
       goto fail;
    }
@@ -808,4 +816,20 @@ fail:
    return false;
 }
 
+bool
+mesa_cache_db_entry_write(struct mesa_cache_db *db,
+                          const uint8_t *cache_key_160bit,
+                          const void *blob, size_t blob_size)
+{
+   return mesa_db_entry_write(db, cache_key_160bit, blob, blob_size, false);
+}
+
+bool
+mesa_cache_db_entry_replace(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size)
+{
+   return mesa_db_entry_write(db, cache_key_160bit, blob, blob_size, true);
+}
+
 #endif /* DETECT_OS_WINDOWS */
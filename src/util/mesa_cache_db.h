@@ -58,10 +58,20 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
                          const uint8_t *cache_key_160bit,
                          size_t *size);
 
+void *
+mesa_cache_db_read_entry_lru(struct mesa_cache_db *db,
+                             const uint8_t *cache_key_160bit,
+                             size_t *size, uint64_t *prev_access_time);
+
 bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
                           const void *blob, size_t blob_size);
+
+bool
+mesa_cache_db_entry_replace(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size);
 #else
 static inline bool
 mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
@@ -94,6 +104,14 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    return NULL;
 }
 
+static inline void *
+mesa_cache_db_read_entry_lru(struct mesa_cache_db *db,
+                             const uint8_t *cache_key_160bit,
+                             size_t *size, uint64_t *prev_access_time)
+{
+   return NULL;
+}
+
 static inline bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
@@ -101,6 +119,14 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
 {
    return false;
 }
+
+static inline bool
+mesa_cache_db_entry_replace(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size)
+{
+   return false;
+}
 #endif /* DETECT_OS_WINDOWS */
 
 #ifdef __cplusplus
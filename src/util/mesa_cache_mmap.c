@@ -0,0 +1,473 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "detect_os.h"
+
+#if DETECT_OS_WINDOWS == 0
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "disk_cache.h"
+#include "macros.h"
+#include "mesa_cache_mmap.h"
+#include "u_atomic.h"
+#include "u_math.h"
+
+/* File layout:
+ *
+ *   struct mesa_mmap_file_header
+ *   struct mesa_mmap_index_slot[num_slots]
+ *   (padding up to data_offset)
+ *   data area: { struct mesa_mmap_data_entry, blob, padding } ...
+ *
+ * The header and the index are fully allocated when the file is created, so
+ * stores through the mapping can never fault on a full disk.  Blobs are only
+ * ever appended with pwrite() and become visible to readers once the index
+ * slot pointing at them is published.
+ *
+ * Slot publication order: the writer stores the data offset first and the
+ * hash last with release semantics.  A reader that observes a non-zero hash
+ * with an acquire load is therefore guaranteed to see the offset and the
+ * blob behind it.
+ *
+ * When the data area or the index fills up, the writer wipes the cache.  The
+ * header generation is odd while that happens and is bumped again once the
+ * file is consistent, so readers can detect (and drop) any lookup that
+ * raced with the wipe, seqlock style.  A writer that died in the middle of
+ * a wipe leaves the generation odd, so whoever takes the file lock next
+ * redoes the wipe.
+ */
+
+#define MESA_CACHE_MMAP_VERSION        1
+#define MESA_CACHE_MMAP_MAGIC          "MESA_MM"
+
+#define MESA_CACHE_MMAP_MIN_SIZE       (1024 * 1024)
+#define MESA_CACHE_MMAP_MIN_SLOTS      1024
+#define MESA_CACHE_MMAP_MAX_SLOTS      (1u << 22)
+#define MESA_CACHE_MMAP_ENTRY_ALIGN    8
+
+struct mesa_mmap_file_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t num_slots;
+   uint64_t file_size;
+   uint64_t data_offset;
+   uint64_t data_end;
+   uint32_t generation;
+   uint32_t num_entries;
+};
+
+struct mesa_mmap_index_slot {
+   uint64_t hash;
+   uint64_t offset;
+};
+
+struct mesa_mmap_data_entry {
+   cache_key key;
+   uint32_t crc;
+   uint32_t size;
+};
+
+static inline struct mesa_mmap_file_header *
+mesa_mmap_header(struct mesa_cache_mmap *db)
+{
+   return (struct mesa_mmap_file_header *)db->map;
+}
+
+static inline struct mesa_mmap_index_slot *
+mesa_mmap_slots(struct mesa_cache_mmap *db)
+{
+   return (struct mesa_mmap_index_slot *)
+      (db->map + sizeof(struct mesa_mmap_file_header));
+}
+
+static uint64_t to_mesa_cache_mmap_hash(const uint8_t *cache_key_160bit)
+{
+   uint64_t hash = 0;
+
+   for (unsigned i = 0; i < 8; i++)
+      hash |= ((uint64_t)cache_key_160bit[i]) << i * 8;
+
+   /* Zero marks an empty index slot. */
+   return hash ? hash : 1;
+}
+
+static inline uint64_t
+mesa_mmap_entry_file_size(size_t blob_size)
+{
+   return align64(sizeof(struct mesa_mmap_data_entry) + blob_size,
+                  MESA_CACHE_MMAP_ENTRY_ALIGN);
+}
+
+static bool
+mesa_mmap_header_valid(const struct mesa_mmap_file_header *header,
+                       uint64_t file_size)
+{
+   uint64_t index_end;
+
+   if (strncmp(header->magic, MESA_CACHE_MMAP_MAGIC, sizeof(header->magic)) ||
+       header->version != MESA_CACHE_MMAP_VERSION ||
+       header->file_size != file_size ||
+       !util_is_power_of_two_nonzero(header->num_slots))
+      return false;
+
+   index_end = sizeof(*header) +
+               (uint64_t)header->num_slots * sizeof(struct mesa_mmap_index_slot);
+
+   return header->data_offset >= index_end &&
+          header->data_offset <= header->data_end &&
+          header->data_end <= header->file_size;
+}
+
+static bool
+mesa_mmap_write_zeros(int fd, uint64_t offset, uint64_t size)
+{
+   static const uint8_t zeros[4096];
+
+   while (size) {
+      size_t chunk = MIN2(size, sizeof(zeros));
+      ssize_t ret = pwrite(fd, zeros, chunk, offset);
+
+      if (ret <= 0)
+         return false;
+
+      offset += ret;
+      size -= ret;
+   }
+
+   return true;
+}
+
+static bool
+mesa_mmap_write_data(int fd, const void *data, size_t size, uint64_t offset)
+{
+   const uint8_t *ptr = data;
+
+   while (size) {
+      ssize_t ret = pwrite(fd, ptr, size, offset);
+
+      if (ret <= 0)
+         return false;
+
+      ptr += ret;
+      offset += ret;
+      size -= ret;
+   }
+
+   return true;
+}
+
+/* Create a fresh, empty cache file.  Called with the file lock held. */
+static bool
+mesa_mmap_create_file(int fd, uint64_t max_cache_size, uint64_t cur_size,
+                      struct mesa_mmap_file_header *header)
+{
+   uint64_t file_size = MAX2(max_cache_size, MESA_CACHE_MMAP_MIN_SIZE);
+   uint64_t index_end;
+   uint32_t num_slots;
+
+   /* Keep the whole file mappable on 32-bit platforms. */
+   if (sizeof(void *) < 8)
+      file_size = MIN2(file_size, 256 * 1024 * 1024);
+
+   /* Assume entries of a few KiB on average, the index must be able to
+    * address them at a load factor of 3/4.
+    */
+   num_slots = util_next_power_of_two64(file_size / 2048);
+   num_slots = CLAMP(num_slots, MESA_CACHE_MMAP_MIN_SLOTS,
+                     MESA_CACHE_MMAP_MAX_SLOTS);
+
+   index_end = sizeof(*header) +
+               (uint64_t)num_slots * sizeof(struct mesa_mmap_index_slot);
+
+   memset(header, 0, sizeof(*header));
+   memcpy(header->magic, MESA_CACHE_MMAP_MAGIC, sizeof(header->magic));
+   header->version = MESA_CACHE_MMAP_VERSION;
+   header->num_slots = num_slots;
+   header->data_offset = align64(index_end, 4096);
+   header->data_end = header->data_offset;
+
+   /* Never shrink the file: other processes may still have it mapped, and
+    * touching pages past the new end would fault in them.
+    */
+   header->file_size = MAX3(file_size, header->data_offset + 4096, cur_size);
+
+   /* Clear the header together with the index, so that a crash while the
+    * file is being created can't leave a valid-looking header behind.
+    */
+   if (!mesa_mmap_write_zeros(fd, 0, header->data_offset) ||
+       ftruncate(fd, header->file_size) == -1)
+      return false;
+
+   return mesa_mmap_write_data(fd, header, sizeof(*header), 0);
+}
+
+/* Drop every entry.  Called with the file lock held. */
+static void
+mesa_mmap_wipe(struct mesa_cache_mmap *db)
+{
+   struct mesa_mmap_file_header *header = mesa_mmap_header(db);
+   struct mesa_mmap_index_slot *slots = mesa_mmap_slots(db);
+
+   /* The generation is already odd if a previous wipe was interrupted. */
+   p_atomic_set(&header->generation, header->generation | 1);
+
+   for (uint32_t i = 0; i < header->num_slots; i++)
+      p_atomic_set(&slots[i].hash, 0);
+
+   header->data_end = header->data_offset;
+   header->num_entries = 0;
+
+   p_atomic_inc(&header->generation);
+}
+
+bool
+mesa_cache_mmap_open(struct mesa_cache_mmap *db, const char *cache_path,
+                     uint64_t max_cache_size)
+{
+   struct mesa_mmap_file_header header;
+   struct stat st;
+   char *path;
+   void *map;
+
+   if (asprintf(&path, "%s/mesa_cache.mm", cache_path) == -1)
+      return false;
+
+   db->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   free(path);
+
+   if (db->fd == -1)
+      return false;
+
+   if (flock(db->fd, LOCK_EX) == -1)
+      goto close_fd;
+
+   if (fstat(db->fd, &st) == -1)
+      goto unlock;
+
+   if (pread(db->fd, &header, sizeof(header), 0) != sizeof(header) ||
+       !mesa_mmap_header_valid(&header, st.st_size)) {
+      if (!mesa_mmap_create_file(db->fd, max_cache_size, st.st_size,
+                                 &header))
+         goto unlock;
+   }
+
+   map = mmap(NULL, header.file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+              db->fd, 0);
+   if (map == MAP_FAILED)
+      goto unlock;
+
+   db->map = map;
+   db->map_size = header.file_size;
+
+   if (header.generation & 1)
+      mesa_mmap_wipe(db);
+
+   flock(db->fd, LOCK_UN);
+
+   simple_mtx_init(&db->write_mtx, mtx_plain);
+
+   return true;
+
+unlock:
+   flock(db->fd, LOCK_UN);
+close_fd:
+   close(db->fd);
+   db->fd = -1;
+
+   return false;
+}
+
+void
+mesa_cache_mmap_close(struct mesa_cache_mmap *db)
+{
+   munmap(db->map, db->map_size);
+   close(db->fd);
+   simple_mtx_destroy(&db->write_mtx);
+}
+
+/* Returns the slot holding the entry for the key, the first free slot of
+ * its probe sequence or NULL if the index is full.
+ */
+static struct mesa_mmap_index_slot *
+mesa_mmap_find_slot(struct mesa_cache_mmap *db, uint32_t num_slots,
+                    const uint8_t *cache_key_160bit, uint64_t hash)
+{
+   struct mesa_mmap_index_slot *slots = mesa_mmap_slots(db);
+   uint32_t mask = num_slots - 1;
+
+   for (uint32_t i = 0; i < num_slots; i++) {
+      struct mesa_mmap_index_slot *slot = &slots[(hash + i) & mask];
+      uint64_t slot_hash = p_atomic_read(&slot->hash);
+      uint64_t offset;
+
+      if (!slot_hash)
+         return slot;
+
+      if (slot_hash != hash)
+         continue;
+
+      offset = p_atomic_read(&slot->offset);
+      if (offset > db->map_size - sizeof(struct mesa_mmap_data_entry))
+         continue;
+
+      if (!memcmp(db->map + offset, cache_key_160bit, sizeof(cache_key)))
+         return slot;
+   }
+
+   return NULL;
+}
+
+void *
+mesa_cache_mmap_read_entry(struct mesa_cache_mmap *db,
+                           const uint8_t *cache_key_160bit,
+                           size_t *size)
+{
+   struct mesa_mmap_file_header *header = mesa_mmap_header(db);
+   uint64_t hash = to_mesa_cache_mmap_hash(cache_key_160bit);
+   struct mesa_mmap_data_entry entry;
+   struct mesa_mmap_index_slot *slot;
+   uint32_t generation, num_slots;
+   uint64_t offset;
+   void *data;
+
+   generation = p_atomic_read(&header->generation);
+   if (generation & 1)
+      return NULL;
+
+   /* num_slots is fixed for the lifetime of the file. */
+   num_slots = header->num_slots;
+
+   slot = mesa_mmap_find_slot(db, num_slots, cache_key_160bit, hash);
+   if (!slot || !p_atomic_read(&slot->hash))
+      return NULL;
+
+   offset = p_atomic_read(&slot->offset);
+   if (offset > db->map_size - sizeof(entry))
+      return NULL;
+
+   memcpy(&entry, db->map + offset, sizeof(entry));
+
+   if (entry.size > db->map_size - offset - sizeof(entry))
+      return NULL;
+
+   data = malloc(entry.size);
+   if (!data)
+      return NULL;
+
+   memcpy(data, db->map + offset + sizeof(entry), entry.size);
+
+   /* Make sure the copies above are complete before re-checking the
+    * generation, otherwise a concurrent wipe could go unnoticed.
+    */
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+   if (p_atomic_read(&header->generation) != generation ||
+       memcmp(entry.key, cache_key_160bit, sizeof(entry.key)) ||
+       util_hash_crc32(data, entry.size) != entry.crc) {
+      free(data);
+      return NULL;
+   }
+
+   *size = entry.size;
+
+   return data;
+}
+
+static bool
+mesa_mmap_lock(struct mesa_cache_mmap *db)
+{
+   simple_mtx_lock(&db->write_mtx);
+
+   if (flock(db->fd, LOCK_EX) == -1) {
+      simple_mtx_unlock(&db->write_mtx);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+mesa_mmap_unlock(struct mesa_cache_mmap *db)
+{
+   flock(db->fd, LOCK_UN);
+   simple_mtx_unlock(&db->write_mtx);
+}
+
+bool
+mesa_cache_mmap_entry_write(struct mesa_cache_mmap *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size)
+{
+   struct mesa_mmap_file_header *header = mesa_mmap_header(db);
+   uint64_t hash = to_mesa_cache_mmap_hash(cache_key_160bit);
+   uint64_t entry_size = mesa_mmap_entry_file_size(blob_size);
+   struct mesa_mmap_data_entry entry;
+   struct mesa_mmap_index_slot *slot;
+   uint64_t offset;
+
+   if (blob_size > UINT32_MAX ||
+       entry_size > db->map_size - header->data_offset)
+      return false;
+
+   if (!mesa_mmap_lock(db))
+      return false;
+
+   /* Another process may have recreated the file from scratch. */
+   if (!mesa_mmap_header_valid(header, db->map_size))
+      goto fail;
+
+   if (header->generation & 1)
+      mesa_mmap_wipe(db);
+
+   slot = mesa_mmap_find_slot(db, header->num_slots, cache_key_160bit, hash);
+   if (slot && p_atomic_read(&slot->hash))
+      goto fail;
+
+   if (!slot || header->num_entries >= header->num_slots / 4 * 3 ||
+       header->data_end + entry_size > header->file_size) {
+      mesa_mmap_wipe(db);
+      slot = mesa_mmap_find_slot(db, header->num_slots, cache_key_160bit,
+                                 hash);
+   }
+
+   offset = header->data_end;
+
+   memcpy(entry.key, cache_key_160bit, sizeof(entry.key));
+   entry.crc = util_hash_crc32(blob, blob_size);
+   entry.size = blob_size;
+
+   if (!mesa_mmap_write_data(db->fd, &entry, sizeof(entry), offset) ||
+       !mesa_mmap_write_data(db->fd, blob, blob_size, offset + sizeof(entry)))
+      goto fail;
+
+   /* Publish: offset first, hash last. */
+   p_atomic_set(&slot->offset, offset);
+   p_atomic_set(&slot->hash, hash);
+
+   header->data_end = offset + entry_size;
+   header->num_entries++;
+
+   mesa_mmap_unlock(db);
+
+   return true;
+
+fail:
+   mesa_mmap_unlock(db);
+
+   return false;
+}
+
+#endif /* DETECT_OS_WINDOWS */
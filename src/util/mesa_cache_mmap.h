@@ -0,0 +1,85 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MESA_CACHE_MMAP_H
+#define MESA_CACHE_MMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "detect_os.h"
+#include "simple_mtx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Single-file cache which is mapped in its entirety.  The file starts with
+ * an open-addressing index, followed by an append-only data area.  Readers
+ * look entries up in the mapping with atomic loads and never take a lock,
+ * writers append under a short file lock and publish new index slots with
+ * release stores.
+ */
+struct mesa_cache_mmap {
+   int fd;
+   uint8_t *map;
+   uint64_t map_size;
+   simple_mtx_t write_mtx;
+};
+
+#if DETECT_OS_WINDOWS == 0
+bool
+mesa_cache_mmap_open(struct mesa_cache_mmap *db, const char *cache_path,
+                     uint64_t max_cache_size);
+
+void
+mesa_cache_mmap_close(struct mesa_cache_mmap *db);
+
+void *
+mesa_cache_mmap_read_entry(struct mesa_cache_mmap *db,
+                           const uint8_t *cache_key_160bit,
+                           size_t *size);
+
+bool
+mesa_cache_mmap_entry_write(struct mesa_cache_mmap *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size);
+#else
+static inline bool
+mesa_cache_mmap_open(struct mesa_cache_mmap *db, const char *cache_path,
+                     uint64_t max_cache_size)
+{
+   return false;
+}
+
+static inline void
+mesa_cache_mmap_close(struct mesa_cache_mmap *db)
+{
+}
+
+static inline void *
+mesa_cache_mmap_read_entry(struct mesa_cache_mmap *db,
+                           const uint8_t *cache_key_160bit,
+                           size_t *size)
+{
+   return NULL;
+}
+
+static inline bool
+mesa_cache_mmap_entry_write(struct mesa_cache_mmap *db,
+                            const uint8_t *cache_key_160bit,
+                            const void *blob, size_t blob_size)
+{
+   return false;
+}
+#endif /* DETECT_OS_WINDOWS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESA_CACHE_MMAP_H */
@@ -522,6 +522,60 @@ test_put_and_get_between_instances(const char *driver_id)
    disk_cache_destroy(cache2);
 }
 
+/* Turn the single file cache into a read only foz db and read it back, once
+ * after parsing its index and once through the sorted index written by the
+ * first load.
+ */
+static void
+test_put_and_get_read_only_foz_db(const char *driver_id)
+{
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char *result;
+   size_t size;
+
+   struct disk_cache *cache = disk_cache_create("test_read_only_foz_db",
+                                                driver_id, 0);
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   void *mem_ctx = ralloc_context(NULL);
+   const char *dir = CACHE_TEST_TMP "/mesa-shader-cache-dir/"
+                     CACHE_DIR_NAME_SF;
+   char *src = ralloc_asprintf(mem_ctx, "%s/%s/test_read_only_foz_db/foz_cache",
+                               dir, driver_id);
+   char *dst = ralloc_asprintf(mem_ctx, "%s/%s/test_read_only_foz_db/ro_cache",
+                               dir, driver_id);
+   char *src_file = ralloc_asprintf(mem_ctx, "%s.foz", src);
+   char *dst_file = ralloc_asprintf(mem_ctx, "%s.foz", dst);
+   EXPECT_EQ(rename(src_file, dst_file), 0) << "Moving the foz db";
+   src_file = ralloc_asprintf(mem_ctx, "%s_idx.foz", src);
+   dst_file = ralloc_asprintf(mem_ctx, "%s_idx.foz", dst);
+   EXPECT_EQ(rename(src_file, dst_file), 0) << "Moving the foz db index";
+
+   setenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS", "ro_cache", 1);
+
+   for (unsigned i = 0; i < 2; i++) {
+      cache = disk_cache_create("test_read_only_foz_db", driver_id, 0);
+
+      result = (char *) disk_cache_get(cache, blob_key, &size);
+      EXPECT_STREQ(blob, result) << "disk_cache_get of read only item (pointer)";
+      EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get of read only item (size)";
+      free(result);
+
+      disk_cache_destroy(cache);
+   }
+
+   char *sorted_file = ralloc_asprintf(mem_ctx, "%s_idx.sorted", dst);
+   EXPECT_EQ(access(sorted_file, R_OK), 0) << "Sorted index written";
+
+   unsetenv("MESA_DISK_CACHE_READ_ONLY_FOZ_DBS");
+
+   ralloc_free(mem_ctx);
+}
+
 static void
 test_put_and_get_between_instances_with_eviction(const char *driver_id)
 {
@@ -651,6 +705,142 @@ test_put_and_get_between_instances_with_eviction(const char *driver_id)
    disk_cache_destroy(cache[0]);
    disk_cache_destroy(cache[1]);
 }
+
+static void
+test_put_and_get_hot_uncompressed(const char *driver_id)
+{
+   struct disk_cache *cache;
+   cache_key keys[64], big_key;
+   uint8_t blob[256];
+   char *result;
+   size_t size;
+   unsigned i, k, pass, found;
+
+   setenv("MESA_DISK_CACHE_UNCOMPRESSED_HOT", "true", 1);
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "32K", 1);
+
+   cache = disk_cache_create("test_hot_uncompressed", driver_id, 0);
+
+   for (i = 0; i < ARRAY_SIZE(keys); i++) {
+      for (k = 0; k < sizeof(blob); k++)
+         blob[k] = i + k % 7;
+
+      disk_cache_compute_key(cache, blob, sizeof(blob), keys[i]);
+      disk_cache_put(cache, keys[i], blob, sizeof(blob), NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   /* The entries were written just now, hence they are hot and the first
+    * pass replaces them with uncompressed copies, which the second pass
+    * loads.
+    */
+   for (pass = 0; pass < 2; pass++) {
+      for (i = 0; i < ARRAY_SIZE(keys); i++) {
+         for (k = 0; k < sizeof(blob); k++)
+            blob[k] = i + k % 7;
+
+         result = (char *) disk_cache_get(cache, keys[i], &size);
+         EXPECT_NE(result, nullptr) << "disk_cache_get of hot item (pointer)";
+         EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get of hot item (size)";
+         if (result)
+            EXPECT_EQ(memcmp(result, blob, sizeof(blob)), 0)
+               << "disk_cache_get of hot item (data)";
+         free(result);
+      }
+   }
+
+   /* Overflow the cache to compact the database, which now has holes left
+    * behind by the replaced entries.
+    */
+   uint8_t *big = (uint8_t *) malloc(8192);
+   for (k = 0; k < 8192; k++)
+      big[k] = rand();
+
+   disk_cache_compute_key(cache, big, 8192, big_key);
+   disk_cache_put(cache, big_key, big, 8192, NULL);
+   disk_cache_wait_for_idle(cache);
+   free(big);
+
+   EXPECT_TRUE(does_cache_contain(cache, big_key))
+      << "disk_cache_get after compaction (new item)";
+
+   for (i = 0, found = 0; i < ARRAY_SIZE(keys); i++) {
+      for (k = 0; k < sizeof(blob); k++)
+         blob[k] = i + k % 7;
+
+      result = (char *) disk_cache_get(cache, keys[i], &size);
+      if (result) {
+         EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get after compaction (size)";
+         EXPECT_EQ(memcmp(result, blob, sizeof(blob)), 0)
+            << "disk_cache_get after compaction (data)";
+         found++;
+      }
+      free(result);
+   }
+
+   EXPECT_GT(found, 0) << "disk_cache_get after compaction (evicted everything)";
+   EXPECT_LT(found, ARRAY_SIZE(keys)) << "disk_cache_get after compaction (evicted nothing)";
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
+   unsetenv("MESA_DISK_CACHE_UNCOMPRESSED_HOT");
+}
+
+static void
+test_put_and_get_with_compress_dict(const char *driver_id)
+{
+   struct disk_cache *cache;
+   static cache_key keys[1100];
+   char blob[256];
+   char *result;
+   size_t size;
+   unsigned i, n;
+
+   setenv("MESA_DISK_CACHE_ZSTD_DICT", "true", 1);
+
+   /* Enough entries to train the dictionary, followed by some which get
+    * compressed with it.
+    */
+   cache = disk_cache_create("test_compress_dict", driver_id, 0);
+
+   for (i = 0; i < ARRAY_SIZE(keys); i++) {
+      memset(blob, 0, sizeof(blob));
+      snprintf(blob, sizeof(blob),
+               "decl_var shader_in vec4 in_%u; decl_var uniform mat4 m_%u; "
+               "ssa_%u = load_deref(in_%u); ssa_%u = fmul(ssa_%u, %u.0);",
+               i % 13, i % 7, i, i % 13, i + 1, i, i * 31);
+
+      disk_cache_compute_key(cache, blob, sizeof(blob), keys[i]);
+      disk_cache_put(cache, keys[i], blob, sizeof(blob), NULL);
+
+      if (i == 1024)
+         disk_cache_wait_for_idle(cache);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   /* The second instance reads the dictionary back from disk. */
+   for (n = 0; n < 2; n++) {
+      if (n == 1) {
+         disk_cache_destroy(cache);
+         cache = disk_cache_create("test_compress_dict", driver_id, 0);
+      }
+
+      for (i = 0; i < ARRAY_SIZE(keys); i++) {
+         result = (char *) disk_cache_get(cache, keys[i], &size);
+         EXPECT_NE(result, nullptr) << "disk_cache_get with dictionary (pointer)";
+         EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get with dictionary (size)";
+         if (result)
+            EXPECT_EQ(strtoul(strstr(result, "ssa_") + 4, NULL, 10), i)
+               << "disk_cache_get with dictionary (data)";
+         free(result);
+      }
+   }
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_ZSTD_DICT");
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 class Cache : public ::testing::Test {
@@ -724,6 +914,8 @@ run_tests:
 
    test_put_and_get_between_instances(driver_id);
 
+   test_put_and_get_read_only_foz_db(driver_id);
+
    setenv("MESA_DISK_CACHE_SINGLE_FILE", "false", 1);
 
    int err = rmrf_local(CACHE_TEST_TMP);
@@ -767,9 +959,40 @@ TEST_F(Cache, Database)
 
    test_put_and_get_between_instances_with_eviction(driver_id);
 
+   test_put_and_get_hot_uncompressed("make_check");
+
+   test_put_and_get_with_compress_dict("make_check");
+
    setenv("MESA_DISK_CACHE_DATABASE", "false", 1);
 
    err = rmrf_local(CACHE_TEST_TMP);
    EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
 #endif
 }
+
+TEST_F(Cache, Mmap)
+{
+   const char *driver_id = "make_check_uncompressed";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_MMAP", "true", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_MM, driver_id);
+
+   /* We skip testing cache size limit as the mmap cache drops all of its
+    * entries at once when it fills up instead of evicting the LRU ones.
+    */
+   test_put_and_get(false, driver_id);
+
+   test_put_key_and_get_key(driver_id);
+
+   test_put_and_get_between_instances(driver_id);
+
+   setenv("MESA_DISK_CACHE_MMAP", "false", 1);
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
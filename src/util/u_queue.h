@@ -274,6 +274,12 @@ struct util_queue_monitoring
    unsigned num_direct_items;
    unsigned num_syncs;
    unsigned num_batches;
+
+   /* Time the producer spent waiting for a free batch. */
+   uint64_t stall_time_ns;
+
+   /* Number of items after which the producer currently flushes a batch. */
+   unsigned batch_size_limit;
 };
 
 #ifdef __cplusplus
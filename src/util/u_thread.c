@@ -6,6 +6,7 @@
  */
 
 #include "util/u_thread.h"
+#include "util/u_cpu_detect.h"
 
 #include "macros.h"
 
@@ -151,6 +152,54 @@ util_set_thread_affinity(thrd_t thread,
 #endif
 }
 
+/**
+ * Pin one thread of a thread pool to an L3 cache domain.
+ *
+ * Thread \p index out of \p count goes to L3 cache
+ * index * num_L3_caches / count, so consecutive threads share a cache (and
+ * thus a socket) while the whole pool is spread over all of them.  The
+ * thread stays within the CPUs it is already allowed to run on, e.g.
+ * because of taskset or a cpuset cgroup.
+ *
+ * \return  false if the L3 topology is unknown, the cache has none of the
+ *          allowed CPUs or the affinity can't be set
+ */
+bool
+util_thread_pin_to_L3(thrd_t thread, unsigned index, unsigned count)
+{
+#if defined(HAVE_PTHREAD_SETAFFINITY)
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   util_affinity_mask mask = {0};
+   bool empty = true;
+   cpu_set_t allowed;
+
+   if (caps->num_L3_caches <= 1 || !caps->L3_affinity_mask || !count)
+      return false;
+
+   if (pthread_getaffinity_np(thread, sizeof(allowed), &allowed) != 0)
+      return false;
+
+   unsigned cache = (uint64_t)index * caps->num_L3_caches / count;
+
+   for (unsigned i = 0; i < caps->num_cpu_mask_bits && i < CPU_SETSIZE; i++) {
+      if ((caps->L3_affinity_mask[cache][i / 32] & (1u << (i % 32))) &&
+          CPU_ISSET(i, &allowed)) {
+         mask[i / 32] |= 1u << (i % 32);
+         empty = false;
+      }
+   }
+
+   if (empty)
+      return false;
+
+   return util_set_thread_affinity(thread, mask, NULL,
+                                   caps->num_cpu_mask_bits);
+#else
+   /* The allowed CPUs can't be queried, leave the thread alone. */
+   return false;
+#endif
+}
+
 int64_t
 util_thread_get_time_nano(thrd_t thread)
 {
@@ -87,6 +87,9 @@ util_set_thread_affinity(thrd_t thread,
                          uint32_t *old_mask,
                          unsigned num_mask_bits);
 
+bool
+util_thread_pin_to_L3(thrd_t thread, unsigned index, unsigned count);
+
 static inline bool
 util_set_current_thread_affinity(const uint32_t *mask,
                                  uint32_t *old_mask,
@@ -47,6 +47,30 @@ u_worklist_fini(u_worklist *w)
    ralloc_free(w->entries);
 }
 
+/** Grows the worklist to accept indices in the range [0, num_entries),
+ * keeping the entries currently queued in order.
+ */
+void
+u_worklist_grow(u_worklist *w, unsigned num_entries)
+{
+   if (num_entries <= w->size)
+      return;
+
+   void *mem_ctx = ralloc_parent(w->entries);
+   unsigned **entries = rzalloc_array(mem_ctx, unsigned *, num_entries);
+
+   for (unsigned i = 0; i < w->count; i++)
+      entries[i] = w->entries[(w->start + i) % w->size];
+
+   ralloc_free(w->entries);
+   w->entries = entries;
+   w->start = 0;
+
+   w->present = rerzalloc(mem_ctx, w->present, BITSET_WORD,
+                          BITSET_WORDS(w->size), BITSET_WORDS(num_entries));
+   w->size = num_entries;
+}
+
 void
 u_worklist_push_head_index(u_worklist *w, unsigned *index)
 {
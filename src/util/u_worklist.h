@@ -68,6 +68,8 @@ void u_worklist_init(u_worklist *w, unsigned num_entries, void *mem_ctx);
 
 void u_worklist_fini(u_worklist *w);
 
+void u_worklist_grow(u_worklist *w, unsigned num_entries);
+
 static inline bool
 u_worklist_is_empty(const u_worklist *w)
 {
@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2026 The Mesa Authors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VTEST_BATCH_H
+#define VTEST_BATCH_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/*
+ * A vtest_batch coalesces the writes of one or more vtest commands into a
+ * single writev.  Small writes are copied into the batch.  Large writes are
+ * referenced in place and must stay valid until the batch is flushed.
+ *
+ * The server executes commands and sends replies in command order.  Commands
+ * without replies can thus be batched freely, as long as the batch is
+ * flushed before reading a reply or when the server is expected to act on
+ * the commands without further commands (e.g., after a submit).
+ */
+
+#define VTEST_BATCH_MAX_IOV_COUNT 64
+#define VTEST_BATCH_DATA_SIZE 4096
+#define VTEST_BATCH_COPY_MAX_SIZE 256
+
+struct vtest_batch {
+   struct iovec iovs[VTEST_BATCH_MAX_IOV_COUNT];
+   int iov_count;
+
+   uint8_t data[VTEST_BATCH_DATA_SIZE];
+   size_t data_size;
+};
+
+static inline bool
+vtest_batch_is_empty(const struct vtest_batch *batch)
+{
+   return !batch->iov_count;
+}
+
+static inline void
+vtest_batch_reset(struct vtest_batch *batch)
+{
+   batch->iov_count = 0;
+   batch->data_size = 0;
+}
+
+/* Returns 0 on success or a negative errno.  The batch is reset either way. */
+static inline int
+vtest_batch_flush(struct vtest_batch *batch, int fd)
+{
+   struct iovec *iov = batch->iovs;
+   int count = batch->iov_count;
+
+   while (count) {
+      const ssize_t ret = writev(fd, iov, count);
+      if (ret < 0) {
+         if (errno == EINTR)
+            continue;
+         const int err = -errno;
+         vtest_batch_reset(batch);
+         return err;
+      }
+
+      size_t written = ret;
+      while (count && written >= iov->iov_len) {
+         written -= iov->iov_len;
+         iov++;
+         count--;
+      }
+      if (count) {
+         iov->iov_base = (uint8_t *)iov->iov_base + written;
+         iov->iov_len -= written;
+      }
+   }
+
+   vtest_batch_reset(batch);
+   return 0;
+}
+
+/* Returns 0 on success or a negative errno from an implicit flush. */
+static inline int
+vtest_batch_write(struct vtest_batch *batch,
+                  int fd,
+                  const void *buf,
+                  size_t size)
+{
+   if (!size)
+      return 0;
+
+   const bool copy = size <= VTEST_BATCH_COPY_MAX_SIZE;
+   if (batch->iov_count == VTEST_BATCH_MAX_IOV_COUNT ||
+       (copy && batch->data_size + size > VTEST_BATCH_DATA_SIZE)) {
+      const int ret = vtest_batch_flush(batch, fd);
+      if (ret)
+         return ret;
+   }
+
+   if (!copy) {
+      batch->iovs[batch->iov_count++] = (struct iovec){
+         .iov_base = (void *)buf,
+         .iov_len = size,
+      };
+      return 0;
+   }
+
+   uint8_t *dst = batch->data + batch->data_size;
+   memcpy(dst, buf, size);
+   batch->data_size += size;
+
+   /* extend the last iov when it ends right where the copy starts */
+   struct iovec *last =
+      batch->iov_count ? &batch->iovs[batch->iov_count - 1] : NULL;
+   if (last && (uint8_t *)last->iov_base + last->iov_len == dst) {
+      last->iov_len += size;
+   } else {
+      batch->iovs[batch->iov_count++] = (struct iovec){
+         .iov_base = dst,
+         .iov_len = size,
+      };
+   }
+
+   return 0;
+}
+
+#endif /* VTEST_BATCH_H */
@@ -28,7 +28,7 @@
 #define VTEST_DEFAULT_SOCKET_NAME "/tmp/.virgl_test"
 
 #ifdef VIRGL_RENDERER_UNSTABLE_APIS
-#define VTEST_PROTOCOL_VERSION 3
+#define VTEST_PROTOCOL_VERSION 5
 #else
 #define VTEST_PROTOCOL_VERSION 2
 #endif
@@ -82,6 +82,14 @@
 #define VCMD_SYNC_WRITE 22
 #define VCMD_SYNC_WAIT 23
 #define VCMD_SUBMIT_CMD2 24
+
+/* since protocol version 4 */
+#define VCMD_TRANSFER_GET3 25
+#define VCMD_TRANSFER_PUT3 26
+
+/* since protocol version 5 */
+#define VCMD_RING_CREATE 27
+#define VCMD_SUBMIT_CMD_RING 28
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #define VCMD_RES_CREATE_SIZE 10
@@ -154,6 +162,10 @@
 
 enum vcmd_param  {
    VCMD_PARAM_MAX_SYNC_QUEUE_COUNT      = 1,
+   /* since protocol version 4, mask of (1 << vcmd_transfer3_encoding) */
+   VCMD_PARAM_TRANSFER3_ENCODINGS       = 2,
+   /* since protocol version 5, whether VCMD_RING_CREATE is supported */
+   VCMD_PARAM_RING                      = 3,
 };
 #define VCMD_GET_PARAM_SIZE 1
 #define VCMD_GET_PARAM_PARAM 0
@@ -244,6 +256,68 @@ struct vcmd_submit_cmd2_batch {
 #define VCMD_SUBMIT_CMD2_BATCH_SYNC_QUEUE_ID_LO(n) (1 + 8 * (n) + 6)
 #define VCMD_SUBMIT_CMD2_BATCH_SYNC_QUEUE_ID_HI(n) (1 + 8 * (n) + 7)
 
+enum vcmd_transfer3_encoding {
+   VCMD_TRANSFER3_ENCODING_RAW  = 0,
+   VCMD_TRANSFER3_ENCODING_ZLIB = 1,
+   VCMD_TRANSFER3_ENCODING_ZSTD = 2,
+};
+
+enum vcmd_transfer3_flag {
+   /* The decoded payload is a delta against the previous TRANSFER3 in the
+    * same direction on the same resource with identical level, box, offset
+    * and data size: a bitmask of DIV_ROUND_UP(blocks, 32) dwords followed by
+    * the VCMD_TRANSFER3_DELTA_BLOCK_SIZE blocks whose bit is set.  The last
+    * block may be short.
+    */
+   VCMD_TRANSFER3_FLAG_DELTA = 1 << 0,
+};
+#define VCMD_TRANSFER3_DELTA_BLOCK_SIZE 4096
+
+/* Like TRANSFER2, but the data is sent inline instead of going through the
+ * shared memory backing store.  data_size bytes starting at offset of the
+ * backing store are encoded into payload_size bytes, padded to dwords.
+ *
+ * PUT3 is followed by the payload.  For GET3 the client sets encoding to
+ * the mask of encodings and flags to the flags it accepts, and the server
+ * replies with a GET3 header describing the payload, followed by it.
+ */
+#define VCMD_TRANSFER3_HDR_SIZE 14
+#define VCMD_TRANSFER3_RES_HANDLE 0
+#define VCMD_TRANSFER3_LEVEL 1
+#define VCMD_TRANSFER3_X 2
+#define VCMD_TRANSFER3_Y 3
+#define VCMD_TRANSFER3_Z 4
+#define VCMD_TRANSFER3_WIDTH 5
+#define VCMD_TRANSFER3_HEIGHT 6
+#define VCMD_TRANSFER3_DEPTH 7
+#define VCMD_TRANSFER3_DATA_SIZE 8
+#define VCMD_TRANSFER3_OFFSET 9
+#define VCMD_TRANSFER3_ENCODING 10
+#define VCMD_TRANSFER3_FLAGS 11
+#define VCMD_TRANSFER3_DECODED_SIZE 12
+#define VCMD_TRANSFER3_PAYLOAD_SIZE 13
+
+/* VCMD_RING_CREATE is followed by a single byte that carries a shared memory
+ * fd in SCM_RIGHTS.  The shared memory holds the head, a 32-bit position the
+ * server stores after consuming commands, at VCMD_RING_HEAD_OFFSET and the
+ * buffer of buffer_size bytes, a power of two, at VCMD_RING_BUFFER_OFFSET.
+ * There is at most one ring per client.
+ *
+ * VCMD_SUBMIT_CMD_RING is like VCMD_SUBMIT_CMD, but the command stream is
+ * read from the ring at the given position, which the server stores into
+ * the head when done.  The command stream never wraps around the end of the
+ * buffer.  Positions are in bytes and are not masked by the buffer size.
+ */
+#define VCMD_RING_HEAD_OFFSET 0
+#define VCMD_RING_BUFFER_OFFSET 64
+
+#define VCMD_RING_CREATE_SIZE 1
+#define VCMD_RING_CREATE_BUFFER_SIZE 0
+
+#define VCMD_SUBMIT_CMD_RING_SIZE 2
+#define VCMD_SUBMIT_CMD_RING_POS 0
+#define VCMD_SUBMIT_CMD_RING_CMD_SIZE 1 /* in dwords */
+
 #endif /* VIRGL_RENDERER_UNSTABLE_APIS */
 
 #endif /* VTEST_PROTOCOL */
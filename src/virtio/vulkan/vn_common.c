@@ -28,6 +28,7 @@ static const struct debug_control vn_debug_options[] = {
    { "vtest", VN_DEBUG_VTEST },
    { "wsi", VN_DEBUG_WSI },
    { "no_abort", VN_DEBUG_NO_ABORT },
+   { "ring", VN_DEBUG_RING },
    { NULL, 0 },
    /* clang-format on */
 };
@@ -115,8 +116,8 @@ vn_extension_get_spec_version(const char *name)
    return index >= 0 ? vn_info_extension_get(index)->spec_version : 0;
 }
 
-void
-vn_relax(uint32_t *iter, const char *reason)
+uint32_t
+vn_relax_get_sleep_us(uint32_t *iter, const char *reason)
 {
    /* Yield for the first 2^busy_wait_order times and then sleep for
     * base_sleep_us microseconds for the same number of times.  After that,
@@ -128,10 +129,8 @@ vn_relax(uint32_t *iter, const char *reason)
    const uint32_t abort_order = 16;
 
    (*iter)++;
-   if (*iter < (1 << busy_wait_order)) {
-      thrd_yield();
-      return;
-   }
+   if (*iter < (1 << busy_wait_order))
+      return 0;
 
    /* warn occasionally if we have slept at least 1.28ms for 8192 times (plus
     * another 8191 shorter sleeps)
@@ -146,5 +145,15 @@ vn_relax(uint32_t *iter, const char *reason)
    }
 
    const uint32_t shift = util_last_bit(*iter) - busy_wait_order - 1;
-   os_time_sleep(base_sleep_us << shift);
+   return base_sleep_us << shift;
+}
+
+void
+vn_relax(uint32_t *iter, const char *reason)
+{
+   const uint32_t sleep_us = vn_relax_get_sleep_us(iter, reason);
+   if (!sleep_us)
+      thrd_yield();
+   else
+      os_time_sleep(sleep_us);
 }
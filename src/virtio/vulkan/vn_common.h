@@ -101,6 +101,7 @@ enum vn_debug {
    VN_DEBUG_VTEST = 1ull << 2,
    VN_DEBUG_WSI = 1ull << 3,
    VN_DEBUG_NO_ABORT = 1ull << 4,
+   VN_DEBUG_RING = 1ull << 5,
 };
 
 enum vn_perf {
@@ -220,6 +221,9 @@ vn_refcount_dec(struct vn_refcount *ref)
 uint32_t
 vn_extension_get_spec_version(const char *name);
 
+uint32_t
+vn_relax_get_sleep_us(uint32_t *iter, const char *reason);
+
 void
 vn_relax(uint32_t *iter, const char *reason);
 
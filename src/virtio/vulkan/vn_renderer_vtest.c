@@ -20,6 +20,7 @@
 #include "util/u_process.h"
 #define VIRGL_RENDERER_UNSTABLE_APIS
 #include "virtio-gpu/virglrenderer_hw.h"
+#include "vtest/vtest_batch.h"
 #include "vtest/vtest_protocol.h"
 
 #include "vn_renderer_internal.h"
@@ -52,6 +53,8 @@ struct vtest {
 
    mtx_t sock_mutex;
    int sock_fd;
+   /* vcmds not sent yet */
+   struct vtest_batch batch;
 
    uint32_t protocol_version;
    uint32_t max_sync_queue_count;
@@ -95,9 +98,23 @@ vtest_connect_socket(struct vn_instance *instance, const char *path)
    return sock;
 }
 
+static void
+vtest_flush(struct vtest *vtest)
+{
+   const int ret = vtest_batch_flush(&vtest->batch, vtest->sock_fd);
+   if (unlikely(ret)) {
+      vn_log(vtest->instance,
+             "lost connection to rendering server on flush %d", -ret);
+      abort();
+   }
+}
+
 static void
 vtest_read(struct vtest *vtest, void *buf, size_t size)
 {
+   /* replies are for flushed vcmds */
+   vtest_flush(vtest);
+
    do {
       const ssize_t ret = read(vtest->sock_fd, buf, size);
       if (unlikely(ret < 0)) {
@@ -128,6 +145,8 @@ vtest_receive_fd(struct vtest *vtest)
       .msg_controllen = sizeof(cmsg_buf),
    };
 
+   vtest_flush(vtest);
+
    if (recvmsg(vtest->sock_fd, &msg, 0) < 0) {
       vn_log(vtest->instance, "recvmsg failed: %s", strerror(errno));
       abort();
@@ -143,21 +162,21 @@ vtest_receive_fd(struct vtest *vtest)
    return *((int *)CMSG_DATA(cmsg));
 }
 
+/**
+ * Queue a write to the batch.  Large buffers are referenced rather than
+ * copied and must stay valid until vtest_flush.
+ */
 static void
 vtest_write(struct vtest *vtest, const void *buf, size_t size)
 {
-   do {
-      const ssize_t ret = write(vtest->sock_fd, buf, size);
-      if (unlikely(ret < 0)) {
-         vn_log(vtest->instance,
-                "lost connection to rendering server on %zu write %zi %d",
-                size, ret, errno);
-         abort();
-      }
-
-      buf += ret;
-      size -= ret;
-   } while (size);
+   const int ret =
+      vtest_batch_write(&vtest->batch, vtest->sock_fd, buf, size);
+   if (unlikely(ret)) {
+      vn_log(vtest->instance,
+             "lost connection to rendering server on %zu write %d", size,
+             -ret);
+      abort();
+   }
 }
 
 static void
@@ -442,6 +461,9 @@ vtest_vcmd_sync_write(struct vtest *vtest, uint32_t sync_id, uint64_t val)
 
    vtest_write(vtest, vtest_hdr, sizeof(vtest_hdr));
    vtest_write(vtest, vcmd_sync_write, sizeof(vcmd_sync_write));
+
+   /* the renderer might be waiting for the value */
+   vtest_flush(vtest);
 }
 
 static int
@@ -575,6 +597,11 @@ vtest_vcmd_submit_cmd2(struct vtest *vtest,
          vtest_write(vtest, sync, sizeof(sync));
       }
    }
+
+   /* this also sends any vcmd batched before, and cs_data is no longer
+    * referenced after this
+    */
+   vtest_flush(vtest);
 }
 
 static VkResult
@@ -971,6 +998,8 @@ vtest_destroy(struct vn_renderer *renderer,
    vn_renderer_shmem_cache_fini(&vtest->shmem_cache);
 
    if (vtest->sock_fd >= 0) {
+      /* best effort for the batched unrefs */
+      vtest_batch_flush(&vtest->batch, vtest->sock_fd);
       shutdown(vtest->sock_fd, SHUT_RDWR);
       close(vtest->sock_fd);
    }
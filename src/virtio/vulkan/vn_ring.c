@@ -5,11 +5,27 @@
 
 #include "vn_ring.h"
 
+#include "util/futex.h"
+#include "util/os_time.h"
+
 #include "vn_cs.h"
 #include "vn_renderer.h"
 
+/* the busy-wait phase of vn_relax */
+#define VN_RING_SPIN_MAX 1024
+#define VN_RING_SPIN_MIN 16
+
 enum vn_ring_status_flag {
    VN_RING_STATUS_IDLE = 1u << 0,
+   VN_RING_STATUS_HEAD_WAKE = 1u << 1,
+};
+
+struct vn_ring_waiter {
+   const char *reason;
+   uint32_t iter;
+   int64_t begin_ns;
+   /* zero while still spinning */
+   int64_t sleep_begin_ns;
 };
 
 static uint32_t
@@ -86,19 +102,130 @@ vn_ring_retire_submits(struct vn_ring *ring, uint32_t seqno)
    }
 }
 
+static void
+vn_ring_waiter_init(struct vn_ring_waiter *waiter, const char *reason)
+{
+   waiter->reason = reason;
+   waiter->iter = 0;
+   waiter->begin_ns = os_time_get_nano();
+   waiter->sleep_begin_ns = 0;
+}
+
+static void
+vn_ring_waiter_finish(struct vn_ring *ring,
+                      const struct vn_ring_waiter *waiter)
+{
+   const int64_t end_ns = os_time_get_nano();
+   const uint32_t spin_limit =
+      atomic_load_explicit(&ring->wait.spin_limit, memory_order_relaxed);
+
+   /* Spin less after a wait that had to sleep anyway, and more after a wait
+    * that spinning alone satisfied.  Racing waiters may lose updates, which
+    * is fine.
+    */
+   if (waiter->sleep_begin_ns) {
+      atomic_fetch_add_explicit(&ring->wait.spin_ns,
+                                waiter->sleep_begin_ns - waiter->begin_ns,
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&ring->wait.sleep_ns,
+                                end_ns - waiter->sleep_begin_ns,
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&ring->wait.sleep_count, 1,
+                                memory_order_relaxed);
+
+      if (spin_limit > VN_RING_SPIN_MIN) {
+         atomic_store_explicit(&ring->wait.spin_limit, spin_limit / 2,
+                               memory_order_relaxed);
+      }
+   } else {
+      atomic_fetch_add_explicit(&ring->wait.spin_ns,
+                                end_ns - waiter->begin_ns,
+                                memory_order_relaxed);
+
+      if (spin_limit < VN_RING_SPIN_MAX) {
+         atomic_store_explicit(&ring->wait.spin_limit, spin_limit * 2,
+                               memory_order_relaxed);
+      }
+   }
+
+   atomic_fetch_add_explicit(&ring->wait.count, 1, memory_order_relaxed);
+}
+
+static void
+vn_ring_sleep(struct vn_ring *ring, uint32_t head, uint32_t sleep_us)
+{
+#if UTIL_FUTEX_SUPPORTED
+   const uint32_t status =
+      atomic_load_explicit(ring->shared.status, memory_order_relaxed);
+   if (status & VN_RING_STATUS_HEAD_WAKE) {
+      const int64_t deadline_ns =
+         os_time_get_nano() + (int64_t)sleep_us * 1000;
+      const struct timespec deadline = {
+         .tv_sec = deadline_ns / 1000000000,
+         .tv_nsec = deadline_ns % 1000000000,
+      };
+
+      /* the renderer is expected to load the waiters with
+       * memory_order_seq_cst after storing the head, such that either it
+       * sees our waiter or futex_wait sees its head
+       */
+      atomic_fetch_add_explicit(ring->shared.waiters, 1,
+                                memory_order_seq_cst);
+      futex_wait((uint32_t *)ring->shared.head, head, &deadline);
+      atomic_fetch_sub_explicit(ring->shared.waiters, 1,
+                                memory_order_relaxed);
+      return;
+   }
+#endif
+
+   os_time_sleep(sleep_us);
+}
+
+static void
+vn_ring_relax(struct vn_ring *ring,
+              struct vn_ring_waiter *waiter,
+              uint32_t head)
+{
+   if (!waiter->sleep_begin_ns) {
+      const uint32_t spin_limit =
+         atomic_load_explicit(&ring->wait.spin_limit, memory_order_relaxed);
+      if (waiter->iter < spin_limit) {
+         waiter->iter++;
+         thrd_yield();
+         return;
+      }
+
+      /* skip what is left of the busy-wait phase of vn_relax */
+      waiter->iter = VN_RING_SPIN_MAX - 1;
+      waiter->sleep_begin_ns = os_time_get_nano();
+   }
+
+   const uint32_t sleep_us =
+      vn_relax_get_sleep_us(&waiter->iter, waiter->reason);
+   assert(sleep_us);
+   vn_ring_sleep(ring, head, sleep_us);
+}
+
 static uint32_t
-vn_ring_wait_seqno(const struct vn_ring *ring, uint32_t seqno)
+vn_ring_wait_seqno(struct vn_ring *ring, uint32_t seqno)
 {
    /* A renderer wait incurs several hops and the renderer might poll
-    * repeatedly anyway.  Let's just poll here.
+    * repeatedly anyway.  Let's poll here, and sleep only when polling does
+    * not pay off.
     */
-   uint32_t iter = 0;
+   uint32_t head = vn_ring_load_head(ring);
+   if (vn_ring_ge_seqno(ring, head, seqno))
+      return head;
+
+   struct vn_ring_waiter waiter;
+   vn_ring_waiter_init(&waiter, "ring seqno");
    do {
-      const uint32_t head = vn_ring_load_head(ring);
-      if (vn_ring_ge_seqno(ring, head, seqno))
-         return head;
-      vn_relax(&iter, "ring seqno");
-   } while (true);
+      vn_ring_relax(ring, &waiter, head);
+      head = vn_ring_load_head(ring);
+   } while (!vn_ring_ge_seqno(ring, head, seqno));
+   vn_ring_waiter_finish(ring, &waiter);
+
+   return head;
 }
 
 static bool
@@ -107,16 +234,12 @@ vn_ring_has_space(const struct vn_ring *ring,
                   uint32_t *out_head)
 {
    const uint32_t head = vn_ring_load_head(ring);
-   if (likely(ring->cur + size - head <= ring->buffer_size)) {
-      *out_head = head;
-      return true;
-   }
-
-   return false;
+   *out_head = head;
+   return likely(ring->cur + size - head <= ring->buffer_size);
 }
 
 static uint32_t
-vn_ring_wait_space(const struct vn_ring *ring, uint32_t size)
+vn_ring_wait_space(struct vn_ring *ring, uint32_t size)
 {
    assert(size <= ring->buffer_size);
 
@@ -128,12 +251,14 @@ vn_ring_wait_space(const struct vn_ring *ring, uint32_t size)
       VN_TRACE_FUNC();
 
       /* see the reasoning in vn_ring_wait_seqno */
-      uint32_t iter = 0;
+      struct vn_ring_waiter waiter;
+      vn_ring_waiter_init(&waiter, "ring space");
       do {
-         vn_relax(&iter, "ring space");
-         if (vn_ring_has_space(ring, size, &head))
-            return head;
-      } while (true);
+         vn_ring_relax(ring, &waiter, head);
+      } while (!vn_ring_has_space(ring, size, &head));
+      vn_ring_waiter_finish(ring, &waiter);
+
+      return head;
    }
 }
 
@@ -147,6 +272,7 @@ vn_ring_get_layout(size_t buf_size,
       uint32_t head __attribute__((aligned(64)));
       uint32_t tail __attribute__((aligned(64)));
       uint32_t status __attribute__((aligned(64)));
+      uint32_t waiters;
 
       uint8_t buffer[] __attribute__((aligned(64)));
    };
@@ -156,6 +282,7 @@ vn_ring_get_layout(size_t buf_size,
    layout->head_offset = offsetof(struct layout, head);
    layout->tail_offset = offsetof(struct layout, tail);
    layout->status_offset = offsetof(struct layout, status);
+   layout->waiters_offset = offsetof(struct layout, waiters);
 
    layout->buffer_offset = offsetof(struct layout, buffer);
    layout->buffer_size = buf_size;
@@ -185,11 +312,14 @@ vn_ring_init(struct vn_ring *ring,
    ring->shared.head = shared + layout->head_offset;
    ring->shared.tail = shared + layout->tail_offset;
    ring->shared.status = shared + layout->status_offset;
+   ring->shared.waiters = shared + layout->waiters_offset;
    ring->shared.buffer = shared + layout->buffer_offset;
    ring->shared.extra = shared + layout->extra_offset;
 
    list_inithead(&ring->submits);
    list_inithead(&ring->free_submits);
+
+   ring->wait.spin_limit = VN_RING_SPIN_MAX;
 }
 
 void
@@ -198,6 +328,15 @@ vn_ring_fini(struct vn_ring *ring)
    vn_ring_retire_submits(ring, ring->cur);
    assert(list_is_empty(&ring->submits));
 
+   if (VN_DEBUG(RING)) {
+      vn_log(NULL,
+             "ring %p: %u waits (%u slept), spin %" PRIu64
+             " us, sleep %" PRIu64 " us, spin limit %u",
+             ring, ring->wait.count, ring->wait.sleep_count,
+             (uint64_t)ring->wait.spin_ns / 1000,
+             (uint64_t)ring->wait.sleep_ns / 1000, ring->wait.spin_limit);
+   }
+
    list_for_each_entry_safe(struct vn_ring_submit, submit,
                             &ring->free_submits, head)
       free(submit);
@@ -255,7 +394,7 @@ vn_ring_submit(struct vn_ring *ring,
  * This is thread-safe.
  */
 void
-vn_ring_wait(const struct vn_ring *ring, uint32_t seqno)
+vn_ring_wait(struct vn_ring *ring, uint32_t seqno)
 {
    vn_ring_wait_seqno(ring, seqno);
 }
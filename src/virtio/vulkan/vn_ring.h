@@ -15,6 +15,13 @@
  * Notifications for new data from the producer are needed only when the
  * consumer is not actively polling, which is indicated by the ring status.
  *
+ * In the other direction, the producer spins for a while when it waits for
+ * the consumer and then goes to sleep.  When the consumer sets
+ * VN_RING_STATUS_HEAD_WAKE in the ring status, it promises to futex-wake the
+ * head after advancing it whenever the waiters word is non-zero, and the
+ * producer sleeps on the head instead of polling it.  The waiters word
+ * immediately follows the status word.
+ *
  * For venus, the data are plain venus commands.  When a venus command is
  * consumed from the ring's perspective, there can still be ongoing CPU and/or
  * GPU works.  This is not an issue when the works generated by following
@@ -27,6 +34,7 @@ struct vn_ring_layout {
    size_t head_offset;
    size_t tail_offset;
    size_t status_offset;
+   size_t waiters_offset;
 
    size_t buffer_offset;
    size_t buffer_size;
@@ -45,6 +53,7 @@ struct vn_ring_shared {
    const volatile atomic_uint *head;
    volatile atomic_uint *tail;
    const volatile atomic_uint *status;
+   volatile atomic_uint *waiters;
    void *buffer;
    void *extra;
 };
@@ -71,6 +80,17 @@ struct vn_ring {
 
    struct list_head submits;
    struct list_head free_submits;
+
+   /* updated by concurrent waiters */
+   struct {
+      /* number of yields before sleeping, adapted to past waits */
+      atomic_uint spin_limit;
+
+      atomic_uint count;
+      atomic_uint sleep_count;
+      atomic_uint_fast64_t spin_ns;
+      atomic_uint_fast64_t sleep_ns;
+   } wait;
 };
 
 void
@@ -97,6 +117,6 @@ vn_ring_submit(struct vn_ring *ring,
                uint32_t *seqno);
 
 void
-vn_ring_wait(const struct vn_ring *ring, uint32_t seqno);
+vn_ring_wait(struct vn_ring *ring, uint32_t seqno);
 
 #endif /* VN_RING_H */
@@ -64,7 +64,10 @@ TEMPLATE_H = Template(COPYRIGHT + """\
 
 #pragma once
 
+#include <string.h>
+
 #include "util/list.h"
+#include "util/macros.h"
 
 #define VK_PROTOTYPES
 #include <vulkan/vulkan.h>
@@ -75,9 +78,25 @@ extern "C" {
 
 struct vk_device_dispatch_table;
 
+struct vk_cmd_queue_block {
+   struct list_head link;
+   size_t size;
+   /* Followed by size bytes of 8-byte aligned data */
+};
+
 struct vk_cmd_queue {
    const VkAllocationCallbacks *alloc;
    struct list_head cmds;
+
+   /* Entries and all the data they point to are sub-allocated linearly from
+    * a list of blocks owned by the queue.  Resetting the queue rewinds the
+    * blocks so the next recording reuses them rather than going back to the
+    * allocator.
+    */
+   struct list_head blocks;
+   struct vk_cmd_queue_block *block;
+   uint8_t *next;
+   uint8_t *end;
 };
 
 enum vk_cmd_type {
@@ -128,6 +147,9 @@ struct vk_cmd_queue_entry {
 % endif
 % endfor
    } u;
+   /* Must be allocated with vk_cmd_queue_zalloc() or released by
+    * driver_free_cb.
+    */
    void *driver_data;
    void (*driver_free_cb)(struct vk_cmd_queue *queue,
                           struct vk_cmd_queue_entry *cmd);
@@ -153,27 +175,43 @@ struct vk_cmd_queue_entry {
 
 void vk_free_queue(struct vk_cmd_queue *queue);
 
-static inline void
-vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
-{
-   queue->alloc = alloc;
-   list_inithead(&queue->cmds);
-}
+void *vk_cmd_queue_zalloc_slow(struct vk_cmd_queue *queue, size_t size);
 
-static inline void
-vk_cmd_queue_reset(struct vk_cmd_queue *queue)
+/** Allocates zeroed memory which lives until the queue is reset
+ *
+ * There is no way to free individual allocations.  Anything which has to
+ * be released when the queue is reset must be handled by the entry's
+ * driver_free_cb.
+ */
+static inline void *
+vk_cmd_queue_zalloc(struct vk_cmd_queue *queue, size_t size)
 {
-   vk_free_queue(queue);
-   list_inithead(&queue->cmds);
+   size = ALIGN_POT(size, 8);
+   if (unlikely(size >= (size_t)(queue->end - queue->next)))
+      return vk_cmd_queue_zalloc_slow(queue, size);
+
+   void *ptr = queue->next;
+   queue->next += size;
+   memset(ptr, 0, size);
+   return ptr;
 }
 
 static inline void
-vk_cmd_queue_finish(struct vk_cmd_queue *queue)
+vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
 {
-   vk_free_queue(queue);
+   queue->alloc = alloc;
    list_inithead(&queue->cmds);
+   list_inithead(&queue->blocks);
+   queue->block = NULL;
+   queue->next = queue->end = NULL;
 }
 
+/* Drops all the entries but keeps the memory around for the next recording */
+void vk_cmd_queue_reset(struct vk_cmd_queue *queue);
+
+/* Frees the memory of a queue, which is left empty and can still be used */
+void vk_cmd_queue_finish(struct vk_cmd_queue *queue);
+
 void vk_cmd_queue_execute(struct vk_cmd_queue *queue,
                           VkCommandBuffer commandBuffer,
                           const struct vk_device_dispatch_table *disp);
@@ -213,25 +251,6 @@ const char *vk_cmd_queue_type_names[] = {
 % if c.guard is not None:
 #ifdef ${c.guard}
 % endif
-static void
-vk_free_${to_underscore(c.name)}(struct vk_cmd_queue *queue,
-${' ' * len('vk_free_' + to_underscore(c.name) + '(')}\\
-struct vk_cmd_queue_entry *cmd)
-{
-   if (cmd->driver_free_cb)
-      cmd->driver_free_cb(queue, cmd);
-   else
-      vk_free(queue->alloc, cmd->driver_data);
-% for p in c.params[1:]:
-% if p.len:
-   vk_free(queue->alloc, (${remove_suffix(p.decl.replace("const", ""), p.name)})cmd->u.${to_struct_field_name(c.name)}.${to_field_name(p.name)});
-% elif '*' in p.decl:
-   ${get_struct_free(c, p, types)}
-% endif
-% endfor
-   vk_free(queue->alloc, cmd);
-}
-
 % if c.name not in manual_commands and c.name not in no_enqueue_commands:
 VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % for p in c.params[1:]:
@@ -239,9 +258,7 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % endfor
 )
 {
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(queue->alloc,
-                                              sizeof(*cmd), 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   struct vk_cmd_queue_entry *cmd = vk_cmd_queue_zalloc(queue, sizeof(*cmd));
    if (!cmd) return VK_ERROR_OUT_OF_HOST_MEMORY;
 
    cmd->type = ${to_enum_name(c.name)};
@@ -271,8 +288,7 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 
 % if need_error_handling:
 err:
-   if (cmd)
-      vk_free_${to_underscore(c.name)}(queue, cmd);
+   /* Whatever was already copied stays in the queue's blocks until reset */
    return VK_ERROR_OUT_OF_HOST_MEMORY;
 % endif
 }
@@ -283,25 +299,98 @@ err:
 
 % endfor
 
-void
-vk_free_queue(struct vk_cmd_queue *queue)
+/* Blocks grow geometrically so that small secondaries stay small while long
+ * recordings only go back to the allocator a handful of times.
+ */
+#define VK_CMD_QUEUE_MIN_BLOCK_SIZE (4 * 1024)
+#define VK_CMD_QUEUE_MAX_BLOCK_SIZE (256 * 1024)
+
+static inline uint8_t *
+vk_cmd_queue_block_data(struct vk_cmd_queue_block *block)
 {
-   struct vk_cmd_queue_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &queue->cmds, cmd_link) {
-      switch(cmd->type) {
-% for c in commands:
-% if c.guard is not None:
-#ifdef ${c.guard}
-% endif
-      case ${to_enum_name(c.name)}:
-         vk_free_${to_underscore(c.name)}(queue, cmd);
+   return (uint8_t *)(block + 1);
+}
+
+void *
+vk_cmd_queue_zalloc_slow(struct vk_cmd_queue *queue, size_t size)
+{
+   /* The inline path punts on an exact fit */
+   if (queue->block && size <= (size_t)(queue->end - queue->next)) {
+      void *ptr = queue->next;
+      queue->next += size;
+      memset(ptr, 0, size);
+      return ptr;
+   }
+
+   struct list_head *prev = queue->block ? &queue->block->link : &queue->blocks;
+   struct vk_cmd_queue_block *block = NULL;
+
+   /* Look for a block left over from a previous recording.  Blocks which
+    * are too small are skipped but stay in the list for later allocations.
+    */
+   for (struct list_head *link = prev->next; link != &queue->blocks;
+        link = link->next) {
+      struct vk_cmd_queue_block *b =
+         list_entry(link, struct vk_cmd_queue_block, link);
+      if (b->size >= size) {
+         block = b;
+         list_del(&block->link);
          break;
-% if c.guard is not None:
-#endif // ${c.guard}
-% endif
-% endfor
       }
    }
+
+   if (block == NULL) {
+      size_t block_size = queue->block ?
+         MIN2(queue->block->size * 2, VK_CMD_QUEUE_MAX_BLOCK_SIZE) :
+         VK_CMD_QUEUE_MIN_BLOCK_SIZE;
+      block_size = MAX2(block_size, size);
+
+      block = vk_alloc(queue->alloc, sizeof(*block) + block_size, 8,
+                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (block == NULL)
+         return NULL;
+
+      block->size = block_size;
+   }
+
+   list_add(&block->link, prev);
+   queue->block = block;
+
+   uint8_t *ptr = vk_cmd_queue_block_data(block);
+   queue->next = ptr + size;
+   queue->end = ptr + block->size;
+   memset(ptr, 0, size);
+   return ptr;
+}
+
+void
+vk_free_queue(struct vk_cmd_queue *queue)
+{
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (cmd->driver_free_cb)
+         cmd->driver_free_cb(queue, cmd);
+   }
+}
+
+void
+vk_cmd_queue_reset(struct vk_cmd_queue *queue)
+{
+   vk_free_queue(queue);
+   list_inithead(&queue->cmds);
+
+   queue->block = NULL;
+   queue->next = queue->end = NULL;
+}
+
+void
+vk_cmd_queue_finish(struct vk_cmd_queue *queue)
+{
+   vk_cmd_queue_reset(queue);
+
+   list_for_each_entry_safe(struct vk_cmd_queue_block, block,
+                            &queue->blocks, link)
+      vk_free(queue->alloc, block);
+   list_inithead(&queue->blocks);
 }
 
 void
@@ -425,7 +514,7 @@ def get_array_copy(command, param):
         field_size = "1"
     else:
         field_size = "sizeof(*%s)" % field_name
-    allocation = "%s = vk_zalloc(queue->alloc, %s * (%s), 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s * (%s));\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
     const_cast = remove_suffix(param.decl.replace("const", ""), param.name)
     copy = "memcpy((%s)%s, %s, %s * (%s));" % (const_cast, field_name, param.name, field_size, param.len)
     return "%s\n   %s" % (allocation, copy)
@@ -436,7 +525,7 @@ def get_array_member_copy(struct, src_name, member):
         field_size = "sizeof(*%s)" % (field_name)
     else:
         field_size = "sizeof(*%s) * %s->%s" % (field_name, struct, member.len)
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
     const_cast = remove_suffix(member.decl.replace("const", ""), member.name)
     copy = "memcpy((%s)%s, %s->%s, %s);" % (const_cast, field_name, src_name, member.name, field_size)
     return "if (%s->%s) {\n   %s\n   %s\n}\n" % (src_name, member.name, allocation, copy)
@@ -466,7 +555,7 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     global tmp_dst_idx
     global tmp_src_idx
 
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
     copy = "memcpy((void*)%s, %s, %s);" % (dst, src_name, size)
 
     level += 1
@@ -485,19 +574,6 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     if_stmt = "if (%s) {" % src_name
     return "%s\n      %s\n      %s\n   %s\n   %s   \n   %s   } else {\n      %s\n   }" % (if_stmt, allocation, copy, tmp_dst, tmp_src, member_copies, null_assignment)
 
-def get_struct_free(command, param, types):
-    field_name = "cmd->u.%s.%s" % (to_struct_field_name(command.name), to_field_name(param.name))
-    const_cast = remove_suffix(param.decl.replace("const", ""), param.name)
-    struct_free = "vk_free(queue->alloc, (%s)%s);" % (const_cast, field_name)
-    member_frees = ""
-    if (param.type in types):
-        for member in types[param.type].members:
-            if member.len and member.len != 'null-terminated':
-                member_name = "cmd->u.%s.%s->%s" % (to_struct_field_name(command.name), to_field_name(param.name), member.name)
-                const_cast = remove_suffix(member.decl.replace("const", ""), member.name)
-                member_frees += "vk_free(queue->alloc, (%s)%s);\n" % (const_cast, member_name)
-    return "%s      %s\n" % (member_frees, struct_free)
-
 EntrypointType = namedtuple('EntrypointType', 'name enum members extended_by')
 
 def get_types(doc):
@@ -578,7 +654,6 @@ def main():
         'to_struct_name': to_struct_name,
         'get_array_copy': get_array_copy,
         'get_struct_copy': get_struct_copy,
-        'get_struct_free': get_struct_free,
         'types': types,
         'manual_commands': MANUAL_COMMANDS,
         'no_enqueue_commands': NO_ENQUEUE_COMMANDS,